@@ -28,6 +28,7 @@
 #include <iostream>
 #include <fstream>
 #include <assert.h>
+#include <algorithm>
 
 using namespace std;
 // This class implements a simple three-layer backpropagation network.
@@ -235,6 +236,40 @@ vector<float> nnwork::run(vector<float>& data)
     return result;
 }
 
+void nnwork::runBatch(const float* data,
+                      int count,
+                      float* hidden,
+                      float* result)
+{
+    // sums for each item are accumulated in the same order as in `run`, so
+    // that outputs are identical
+    for (int j = 0; j < hidden_size; j++) {
+        float* sums = hidden + j * count;
+        fill(sums, sums + count, 0.0f);
+        for (int i = 0; i < input_size; ++i) {
+            float weight = hidden_nodes->nodes[j].weights[i];
+            const float* inputs = data + i * count;
+            for (int n = 0; n < count; ++n)
+                sums[n] += weight * inputs[n];
+        }
+        for (int n = 0; n < count; ++n)
+            sums[n] = sigmoid(sums[n]);
+    }
+
+    for (int k = 0; k < output_size; ++k) {
+        float* sums = result + k * count;
+        fill(sums, sums + count, 0.0f);
+        for (int j = 0; j < hidden_size; ++j) {
+            float weight = output_nodes->nodes[k].weights[j];
+            const float* hiddenOutputs = hidden + j * count;
+            for (int n = 0; n < count; ++n)
+                sums[n] += weight * hiddenOutputs[n];
+        }
+        for (int n = 0; n < count; ++n)
+            sums[n] = sigmoid(sums[n]);
+    }
+}
+
 void nnwork::run(float data [], float result [])
 {
     int i, j, k;
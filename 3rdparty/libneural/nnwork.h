@@ -74,6 +74,20 @@ public:
      */
     void run(float [], float []);
 
+    /**
+     * @brief Run the network on a batch of inputs at once.
+     * @details Gives the same outputs as calling `run` for each input, but
+     * evaluates every node for the whole batch in one pass over contiguous
+     * memory and allocates nothing.
+     * @param data Inputs stored input-major, i.e., input `i` of the `n`th
+     * item of the batch is at `data[i * count + n]`.
+     * @param count Number of items in the batch.
+     * @param hidden Buffer for the `hidden_size * count` hidden node outputs.
+     * @param result Buffer for the `output_size * count` outputs, stored
+     * output-major like the inputs.
+     */
+    void runBatch(const float* data, int count, float* hidden, float* result);
+
 // Arg for load and save is just the filename.
 
 	int load (char*);
@@ -64,8 +64,16 @@ int main(int argc, char *argv[]) {
     //set Maven Parameters
     peakdetectorCLI->peakDetector->setMavenParameters(peakdetectorCLI->mavenParameters);
 
+    // a spectral library search on its own does not need a compound database
+    bool librarySearchOnly =
+        !peakdetectorCLI->spectralLibraryFilename.empty()
+        && peakdetectorCLI->mavenParameters->ligandDbFilename.empty();
+
     //load compounds file
-    if (peakdetectorCLI->mavenParameters->processAllSlices == false) peakdetectorCLI->loadCompoundsFile();
+    if (peakdetectorCLI->mavenParameters->processAllSlices == false
+        && !librarySearchOnly) {
+        peakdetectorCLI->loadCompoundsFile();
+    }
 
     //load files
     peakdetectorCLI->loadSamples(peakdetectorCLI->filenames);
@@ -76,6 +84,10 @@ int main(int argc, char *argv[]) {
     //ionization
     peakdetectorCLI->mavenParameters->setIonizationMode(MavenParameters::AutoDetect);
 
+    //search MS2 scans against a spectral library
+    if (!peakdetectorCLI->spectralLibraryFilename.empty())
+        peakdetectorCLI->searchSpectralLibrary();
+
     //align samples
     if (peakdetectorCLI->mavenParameters->samples.size() > 1 && peakdetectorCLI->mavenParameters->alignSamplesFlag) {
         peakdetectorCLI->peakDetector->alignSamples((int)peakdetectorCLI->alignMode);
@@ -103,6 +115,8 @@ int main(int argc, char *argv[]) {
 	//write report
 	if (peakdetectorCLI->mavenParameters->allgroups.size() > 0) {
 		peakdetectorCLI->writeReport("compounds",jsPath,nodePath);
+        if (peakdetectorCLI->clusterGroupsFlag)
+            peakdetectorCLI->clusterGroups();
         if (peakdetectorCLI->saveAnalysisAsProject())
             peakdetectorCLI->saveEmdb();
     } else if (!(peakdetectorCLI->pollyArgs.isEmpty())){
@@ -5,12 +5,16 @@
 #include "common/downloadmanager.h"
 #include "Compound.h"
 #include "csvparser.h"
+#include "groupClustering.h"
 #include "common/logger.h"
 #include "mavenparameters.h"
 #include "masscutofftype.h"
 #include "mzUtils.h"
 #include "peakdetectorcli.h"
 #include "projectDB/projectdatabase.h"
+#include "Scan.h"
+#include "scanstore.h"
+#include "spectrallibrarysearch.h"
 
 PeakDetectorCLI::PeakDetectorCLI(Logger* log, Analytics* analytics)
 {
@@ -21,8 +25,11 @@ PeakDetectorCLI::PeakDetectorCLI(Logger* log, Analytics* analytics)
     mavenParameters = new MavenParameters();
     peakDetector = new PeakDetector();
     saveJsonEIC = false;
+    clusterGroupsFlag = false;
     quantitationType = PeakGroup::AreaTop;
     clsfModelFilename = "default.model";
+    sampleLoadWorkers = 0;
+    sampleLoadMemoryBudget = 0;
     alignMode = AlignmentMode::None;
     _reduceGroupsFlag = true;
     _parseOptions = new ParseOptions();
@@ -82,6 +89,10 @@ void PeakDetectorCLI::processOptions(int argc, char* argv[])
             mavenParameters->minGoodGroupCount = atoi(optarg);
             break;
 
+        case 'B':
+            mzSample::setEicIndex_enabled(atoi(optarg) > 0);
+            break;
+
         case 'c':
             mavenParameters->compoundRTWindow = atof(optarg);
             mavenParameters->matchRtFlag = true;
@@ -156,14 +167,30 @@ void PeakDetectorCLI::processOptions(int argc, char* argv[])
                 saveJsonEIC = false;
             break;
 
+        case 'K':
+            clusterGroupsFlag = atoi(optarg) > 0;
+            break;
+
         case 'k':
             mavenParameters->charge = atoi(optarg);
             break;
 
+        case 'l':
+            spectralLibraryFilename = optarg;
+            break;
+
+        case 'L':
+            _setLazyScanMemory(atoi(optarg));
+            break;
+
         case 'm':
             clsfModelFilename = optarg;
             break;
 
+        case 'M':
+            sampleLoadMemoryBudget = max(0, atoi(optarg));
+            break;
+
         case 'n':
             mavenParameters->eicMaxGroups = atoi(optarg);
             break;
@@ -208,6 +235,15 @@ void PeakDetectorCLI::processOptions(int argc, char* argv[])
             _projectName = QString(optarg);
             break;
 
+        case 't':
+            sampleLoadWorkers = max(0, atoi(optarg));
+            break;
+
+        case 'u':
+            mzSample::setCache_enabled(true);
+            mzSample::setCache_dir(optarg ? optarg : "");
+            break;
+
         case 'v':
             mavenParameters->ionizationMode = atoi(optarg);
             break;
@@ -533,6 +569,30 @@ void PeakDetectorCLI::_processGeneralArgsXML(xml_node& generalArgs)
             mavenParameters->outputdir =
                 node.attribute("value").value() + string(DIR_SEPARATOR_STR);
 
+        } else if (strcmp(node.name(), "sampleLoadWorkers") == 0) {
+            sampleLoadWorkers = max(0, atoi(node.attribute("value").value()));
+
+        } else if (strcmp(node.name(), "sampleLoadMemory") == 0) {
+            sampleLoadMemoryBudget =
+                max(0, atoi(node.attribute("value").value()));
+
+        } else if (strcmp(node.name(), "sampleCache") == 0) {
+            string cacheDir = node.attribute("value").value();
+            if (!cacheDir.empty()) {
+                mzSample::setCache_enabled(true);
+                mzSample::setCache_dir(cacheDir);
+            }
+
+        } else if (strcmp(node.name(), "eicIndex") == 0) {
+            mzSample::setEicIndex_enabled(
+                atoi(node.attribute("value").value()) > 0);
+
+        } else if (strcmp(node.name(), "clusterGroups") == 0) {
+            clusterGroupsFlag = atoi(node.attribute("value").value()) > 0;
+
+        } else if (strcmp(node.name(), "lazyScanMemory") == 0) {
+            _setLazyScanMemory(atoi(node.attribute("value").value()));
+
         } else if (strcmp(node.name(), "pollyExtra") == 0) {
             _pollyExtraInfo = QString(node.attribute("value").value());
 
@@ -618,6 +678,167 @@ void PeakDetectorCLI::loadCompoundsFile()
     cout << endl;
 }
 
+string PeakDetectorCLI::_csvQuoted(string value)
+{
+    size_t pos = 0;
+    while ((pos = value.find('"', pos)) != string::npos) {
+        value.insert(pos, 1, '"');
+        pos += 2;
+    }
+    return "\"" + value + "\"";
+}
+
+void PeakDetectorCLI::searchSpectralLibrary()
+{
+#ifndef __APPLE__
+    double startSearchTime = getTime();
+#endif
+    _log->info() << "Loading spectral library…" << std::flush;
+    Databases libraryDb;
+    int loadCount = libraryDb.loadNISTLibrary(spectralLibraryFilename);
+    if (loadCount == 0) {
+        _log->error() << "Given spectral library is empty or could not be read."
+                      << std::flush;
+        return;
+    }
+    _log->info() << "Loaded " << loadCount << " library spectra" << std::flush;
+
+    MassCutoff* precursorCutoff = mavenParameters->compoundMassCutoffWindow;
+    SpectralLibrarySearch librarySearch(libraryDb.compoundsDB,
+                                        *precursorCutoff,
+                                        mavenParameters->fragmentTolerance);
+    librarySearch.setMinFragmentMatches(mavenParameters->minFragMatch);
+    librarySearch.setScoringAlgorithm(mavenParameters->scoringAlgo);
+    librarySearch.setMinScore(mavenParameters->minFragMatchScore);
+
+    string fileName = mavenParameters->outputdir + "spectral_library_hits.csv";
+    ofstream hitsFile(fileName.c_str());
+    if (!hitsFile.is_open()) {
+        _log->error() << "Unable to open " << fileName << " for writing."
+                      << std::flush;
+        libraryDb.closeAll();
+        return;
+    }
+
+    const char SEP = ',';
+
+    hitsFile << "sample" << SEP
+             << "scan" << SEP
+             << "rt" << SEP
+             << "precursorMz" << SEP
+             << "compound" << SEP
+             << "compoundId" << SEP
+             << "libraryPrecursorMz" << SEP
+             << "numMatches" << SEP
+             << "fractionMatched" << SEP
+             << "ppmError" << SEP
+             << "score" << SEP
+             << "ticMatched" << SEP
+             << "dotProduct" << SEP
+             << "weightedDotProduct" << SEP
+             << "hypergeomScore" << SEP
+             << "spearmanRankCorrelation" << SEP
+             << "mvhScore" << "\n";
+
+    _log->info() << "Searching MS2 scans against "
+                 << librarySearch.librarySize()
+                 << " library spectra…"
+                 << std::flush;
+    unsigned int hitCount = 0;
+    librarySearch.search(
+        mavenParameters->samples,
+        [&](const SpectralLibraryHit& hit) {
+            Compound* compound = hit.compound;
+            const FragmentationMatchScore& score = hit.score;
+            hitsFile << _csvQuoted(hit.scan->sample->sampleName)
+                     << SEP << hit.scan->scannum
+                     << SEP << hit.scan->rt
+                     << SEP << hit.scan->precursorMz
+                     << SEP << _csvQuoted(compound->name())
+                     << SEP << _csvQuoted(compound->id())
+                     << SEP << compound->precursorMz()
+                     << SEP << score.numMatches
+                     << SEP << score.fractionMatched
+                     << SEP << score.ppmError
+                     << SEP << score.mergedScore
+                     << SEP << score.ticMatched
+                     << SEP << score.dotProduct
+                     << SEP << score.weightedDotProduct
+                     << SEP << score.hypergeomScore
+                     << SEP << score.spearmanRankCorrelation
+                     << SEP << score.mvhScore << "\n";
+            ++hitCount;
+        });
+    hitsFile.close();
+
+    _log->info() << "Found " << hitCount << " spectral library hits"
+                 << std::flush;
+    _log->info() << "Library search output file: " << fileName << std::flush;
+    libraryDb.closeAll();
+#ifndef __APPLE__
+    cout << "Execution time (spectral library search): "
+         << getTime() - startSearchTime
+         << " seconds.\n";
+#endif
+}
+
+void PeakDetectorCLI::clusterGroups()
+{
+#ifndef __APPLE__
+    double startClusteringTime = getTime();
+#endif
+    _log->info() << "Clustering groups…" << std::flush;
+
+    vector<PeakGroup*> groups;
+    for (auto& group : mavenParameters->allgroups)
+        groups.push_back(&group);
+    GroupClustering clustering(mavenParameters->samples,
+                               mavenParameters->massCutoffMerge,
+                               mavenParameters->eicType,
+                               mavenParameters->filterline);
+    int clusterCount = clustering.cluster(groups);
+
+    mzUtils::createDir(mavenParameters->outputdir);
+    string fileName = mavenParameters->outputdir + "clusters.csv";
+    ofstream clustersFile(fileName.c_str());
+    if (!clustersFile.is_open()) {
+        _log->error() << "Unable to open " << fileName << " for writing."
+                      << std::flush;
+        return;
+    }
+
+    const char SEP = ',';
+    clustersFile << "cluster" << SEP
+                 << "medMz" << SEP
+                 << "medRt" << SEP
+                 << "minRt" << SEP
+                 << "maxRt" << SEP
+                 << "compound" << SEP
+                 << "compoundId" << "\n";
+    for (auto group : groups) {
+        Compound* compound = group->getCompound();
+        clustersFile << group->clusterId
+                     << SEP << group->meanMz
+                     << SEP << group->meanRt
+                     << SEP << group->minRt
+                     << SEP << group->maxRt
+                     << SEP << (compound ? _csvQuoted(compound->name()) : "")
+                     << SEP << (compound ? _csvQuoted(compound->id()) : "")
+                     << "\n";
+    }
+    clustersFile.close();
+
+    _log->info() << "Found " << clusterCount << " clusters of "
+                 << groups.size() << " groups"
+                 << std::flush;
+    _log->info() << "Clusters output file: " << fileName << std::flush;
+#ifndef __APPLE__
+    cout << "Execution time (clustering): "
+         << getTime() - startClusteringTime
+         << " seconds.\n";
+#endif
+}
+
 void PeakDetectorCLI::loadSamples(vector<string>& filenames)
 {
 #ifndef __APPLE__
@@ -625,30 +846,88 @@ void PeakDetectorCLI::loadSamples(vector<string>& filenames)
 #endif
     _log->info() << "Loading samples…" << std::flush;
 
-    for (unsigned int i = 0; i < filenames.size(); i++) {
+    int numFiles = filenames.size();
+    int numWorkers = sampleLoadWorkers > 0 ? sampleLoadWorkers
+                                           : mzUtils::numSystemCpus();
+    numWorkers = max(1, min(numWorkers, numFiles));
+
+    unsigned long long memoryBudget = sampleLoadMemoryBudget * 1024 * 1024;
+    if (memoryBudget == 0)
+        memoryBudget = mzUtils::availableSystemMemory();
+
+    // same estimates as used by the GUI when warning about large imports: a
+    // loaded sample takes about one and a half times its file size, and a
+    // sample being loaded needs about one file size more, transiently
+    vector<unsigned long long> fileSizes(numFiles, 0);
+    for (int i = 0; i < numFiles; i++) {
+        QFileInfo fileInfo(QString::fromStdString(filenames[i]));
+        fileSizes[i] = fileInfo.size();
+    }
+
+    std::mutex memoryMutex;
+    std::condition_variable memoryReleased;
+    unsigned long long reservedMemory = 0;
+    int loadsInProgress = 0;
+
+    vector<mzSample*> loadedSamples(numFiles, nullptr);
+#pragma omp parallel for schedule(dynamic, 1) num_threads(numWorkers)
+    for (int i = 0; i < numFiles; i++) {
+        unsigned long long loadingCost = fileSizes[i] * 5 / 2;
+        unsigned long long loadedCost = fileSizes[i] * 3 / 2;
+        {
+            // at least one sample is always allowed to load, so that a
+            // single file larger than the budget does not stall loading
+            std::unique_lock<std::mutex> lock(memoryMutex);
+            memoryReleased.wait(lock, [&] {
+                return loadsInProgress == 0
+                       || reservedMemory + loadingCost <= memoryBudget;
+            });
+            reservedMemory += loadingCost;
+            ++loadsInProgress;
+        }
+
         mzSample* sample = new mzSample();
+        bool outOfMemory = false;
         try {
             sample->loadSample(filenames[i].c_str());
         } catch (const std::bad_alloc&) {
-            cerr << "MemoryError: " << "ran out of memory" << endl;
+            outOfMemory = true;
             mzUtils::delete_all(sample->scans);
         }
-        if (!sample->scans.empty()) {
+
+        bool loaded = !sample->scans.empty();
+        if (loaded) {
             sample->sampleName = mzUtils::cleanFilename(filenames[i]);
             sample->isSelected = true;
-            mavenParameters->samples.push_back(sample);
-            _log->info() << "Loaded sample: "
-                         << sample->getSampleName()
-                         << std::flush;
+            loadedSamples[i] = sample;
         } else {
-            if (sample != NULL) {
-                delete sample;
-                sample = NULL;
+            delete sample;
+            sample = nullptr;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(memoryMutex);
+            reservedMemory -= loaded ? loadingCost - loadedCost : loadingCost;
+            --loadsInProgress;
+
+            if (outOfMemory)
+                cerr << "MemoryError: " << "ran out of memory" << endl;
+            if (loaded) {
+                _log->info() << "Loaded sample: "
+                             << sample->getSampleName()
+                             << std::flush;
+            } else {
+                _log->info() << "Failed to load file: "
+                             << filenames[i]
+                             << std::flush;
             }
-            _log->info() << "Failed to load file: "
-                         << filenames[i]
-                         << std::flush;
         }
+        memoryReleased.notify_all();
+    }
+
+    for (auto sample : loadedSamples) {
+        if (sample != nullptr)
+            mavenParameters->samples.push_back(sample);
     }
 
     if (mavenParameters->samples.size() == 0) {
@@ -1090,6 +1369,15 @@ QStringList PeakDetectorCLI::_getSampleList()
     return loadedSamples;
 }
 
+void PeakDetectorCLI::_setLazyScanMemory(int megabytes)
+{
+    mzSample::setLazyScans(megabytes > 0);
+    if (megabytes > 0) {
+        size_t budget = static_cast<size_t>(megabytes) * 1024 * 1024;
+        ScanStore::setMemoryBudget(budget);
+    }
+}
+
 void PeakDetectorCLI::_groupReduction()
 {
     if (_reduceGroupsFlag) {
@@ -1338,10 +1626,11 @@ void PeakDetectorCLI::saveCSV(string setName, bool pollyExport)
                                 ddaGroupExists, includeSetNamesLine,
                                 mavenParameters, pollyExport);
 
-    for (int i = 0; i < mavenParameters->allgroups.size(); i++) {
-        PeakGroup& group = mavenParameters->allgroups[i];
-        csvreports->addGroup(&group);
-    }
+    vector<PeakGroup*> groupsToWrite;
+    groupsToWrite.reserve(mavenParameters->allgroups.size());
+    for (auto& group : mavenParameters->allgroups)
+        groupsToWrite.push_back(&group);
+    csvreports->addGroups(groupsToWrite);
 
 
     // NOTE: The following validation is being done to prevent a workflow
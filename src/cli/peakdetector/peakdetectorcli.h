@@ -4,10 +4,12 @@
 #include <limits.h>
 #include <sys/time.h>
 #include <algorithm>
+#include <condition_variable>
 #include <ctime>
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <mutex>
 #include <string>
 #include <vector>
 #ifndef __APPLE__
@@ -66,8 +68,23 @@ public:
     MavenParameters* mavenParameters;
     PeakDetector* peakDetector;
     bool saveJsonEIC;
+    bool clusterGroupsFlag;
     PeakGroup::QType quantitationType;
     string clsfModelFilename;
+    string spectralLibraryFilename;
+
+    /**
+     * @brief Number of samples loaded concurrently. A value of zero uses as
+     * many workers as there are processors on the system.
+     */
+    int sampleLoadWorkers;
+
+    /**
+     * @brief Upper bound (in MB) on the estimated memory used by loaded
+     * samples and samples still being loaded. A value of zero uses the
+     * memory reported by `mzUtils::availableSystemMemory` as the budget.
+     */
+    unsigned long long sampleLoadMemoryBudget;
     QString pollyArgs;
     AlignmentMode alignMode;
 
@@ -108,8 +125,29 @@ public:
     void loadCompoundsFile();
 
     /**
-     * [loadSamples description]
-     * @param filenames [description]
+     * @brief Search all MS2 scans of loaded samples against a spectral library.
+     * @details The library (an MSP file) is loaded from the path set for the
+     * "spectralLibrary" option and hits are written, as they are found, to a
+     * CSV file in the output directory.
+     */
+    void searchSpectralLibrary();
+
+    /**
+     * @brief Cluster detected groups that are likely to have arisen from the
+     * same compound.
+     * @details Cluster IDs are assigned to the groups and also written, along
+     * with the m/z, RT and compound of each group, to a CSV file in the
+     * output directory.
+     */
+    void clusterGroups();
+
+    /**
+     * @brief Load sample files, several at a time.
+     * @details Each worker reserves an estimate of the memory a sample will
+     * occupy before it starts loading it, and waits while that reservation
+     * would exceed the memory budget, unless nothing else is being loaded.
+     * Samples are sorted by name once all of them have been loaded.
+     * @param filenames Paths of sample files to be loaded.
      */
     void loadSamples(vector<string>& filenames);
 
@@ -165,6 +203,9 @@ public:
             "a?alignSamples: Enter 1 for Obi-Warp alignment, 2 for Polyfit.",
             "b?minGoodGroupCount: Enter minimum number of good peaks per "
                 "group. <int>",
+            "B?eicIndex: Enter non-zero integer to index the peaks of each "
+                "sample by m/z after loading, for faster EIC extraction at the "
+                "cost of extra memory. <int>",
             "c?matchRtFlag: Enter non-zero integer to match retention time to "
                 "the database values. <int>",
             "C?compoundPPMWindow: Enter ppm window for m/z. <float>",
@@ -184,8 +225,21 @@ public:
                 "the intensity threshold. <float>",
             "j?saveEicJson: Enter non-zero integer to save EIC JSON in the "
                 "output folder. <int>",
+            "K?clusterGroups: Enter non-zero integer to cluster groups by RT, "
+                "intensity and peak shape similarity, and save cluster IDs in "
+                "the output folder. <int>",
             "k?charge: Enter the magnitude of charge on each compound. <int>",
+            "L?lazyScanMemory: Enter memory budget (in MB) for decoded scans. "
+                "If non-zero, samples are loaded lazily from binary caches "
+                "(see sampleCache) and peak arrays are decoded on demand. "
+                "<int>",
+            "l?spectralLibrary: Enter full path to a spectral library (MSP) "
+                "file to search MS2 scans against. <string>",
             "m?model: Enter full path to the model file. <string>",
+            "M?sampleLoadMemory: Enter memory budget (in MB) for loading "
+                "samples in parallel. Enter 0 to use available system "
+                "memory. "
+                "<int>",
             "n?eicMaxGroups: Enter maximum number of groups reported per "
                 "compound. <int>",
             "o?outputdir: Enter full path to output folder. <string>",
@@ -201,6 +255,11 @@ public:
                 "<name>.emDB project. If given <name> contains the string "
                 "\".raw\" in it, the emDB will be saved with raw peak data. "
                 "<string>",
+            "t?sampleLoadWorkers: Enter number of samples to be loaded in "
+                "parallel. Enter 0 to use all processors. <int>",
+            "u?sampleCache: Enter full path to a folder in which binary "
+                "copies of loaded samples will be cached, to speed up loading "
+                "them again. <string>",
             "v?ionizationMode: Enter 0, -1 or 1 ionization mode. <int>",
             "w?minPeakWidth: Enter min peak width threshold in a group. <int>",
             "x?xml: Enter full path to the config file or a settings file from "
@@ -262,6 +321,17 @@ private:
 
     void _groupReduction();
 
+    /**
+     * @brief Load samples lazily, keeping at most the given number of MB of
+     * decoded peak arrays in memory. Zero loads samples fully.
+     */
+    void _setLazyScanMemory(int megabytes);
+
+    /**
+     * @brief Quote a value for a CSV file, escaping any quotes within it.
+     */
+    static string _csvQuoted(string value);
+
     QStringList _getSampleList();
 
     void _makeSampleCohortFile(QString sampleCohortFilename,
@@ -301,6 +371,12 @@ struct Arguments
         generalArgs << "int" << "alignSamples" << "0";
         generalArgs << "int" << "saveEicJson" << "0";
         generalArgs << "string" << "outputdir" << "0";
+        generalArgs << "int" << "sampleLoadWorkers" << "0";
+        generalArgs << "int" << "sampleLoadMemory" << "0";
+        generalArgs << "string" << "sampleCache" << "";
+        generalArgs << "int" << "lazyScanMemory" << "0";
+        generalArgs << "int" << "eicIndex" << "0";
+        generalArgs << "int" << "clusterGroups" << "0";
         generalArgs << "string" << "pollyExtra" << "";
         generalArgs << "string" << "samples" << "path/to/sample1";
         generalArgs << "string" << "samples" << "path/to/sample2";
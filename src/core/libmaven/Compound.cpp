@@ -109,6 +109,7 @@ Compound* Compound::operator = (const Compound& rhs)
     _fragmentIntensities = rhs._fragmentIntensities;
     _fragmentIonTypes = rhs._fragmentIonTypes;
     _category = rhs._category;
+    _resetLibrarySpectra();
     return this;
 }
 
@@ -145,6 +146,56 @@ Compound::Type Compound::type() const {
     return Type::UNKNOWN;
 }
 
+shared_ptr<const Fragment>
+Compound::_buildLibrarySpectrum(bool searchProton) const
+{
+    auto libFrag = make_shared<Fragment>();
+    libFrag->precursorMz = _precursorMz;
+    libFrag->mzValues = _fragmentMzValues;
+    libFrag->intensityValues = _fragmentIntensities;
+    libFrag->annotations = _fragmentIonTypes;
+    if (searchProton)  { //special case, check for loss or gain of protons
+        int N = libFrag->mzValues.size();
+        libFrag->mzValues.reserve(3 * N);
+        libFrag->intensityValues.reserve(3 * N);
+        for(int i = 0; i < N; i++) {
+            libFrag->mzValues.push_back(libFrag->mzValues[i] + PROTON_MASS);
+            libFrag->intensityValues.push_back(libFrag->intensityValues[i]);
+            libFrag->mzValues.push_back( libFrag->mzValues[i] - PROTON_MASS);
+            libFrag->intensityValues.push_back(libFrag->intensityValues[i]);
+        }
+    }
+    libFrag->sortByIntensity();
+    return libFrag;
+}
+
+void Compound::_resetLibrarySpectra()
+{
+    atomic_store(&_librarySpectrum, shared_ptr<const Fragment>());
+    atomic_store(&_protonShiftedLibrarySpectrum, shared_ptr<const Fragment>());
+}
+
+const Fragment& Compound::librarySpectrum(bool searchProton) const
+{
+    shared_ptr<const Fragment>* cache = searchProton
+                                            ? &_protonShiftedLibrarySpectrum
+                                            : &_librarySpectrum;
+
+    // threads racing to build the spectrum create identical copies, only one
+    // of which ends up being cached
+    auto spectrum = atomic_load(cache);
+    if (!spectrum) {
+        shared_ptr<const Fragment> expected;
+        auto built = _buildLibrarySpectrum(searchProton);
+        if (atomic_compare_exchange_strong(cache, &expected, built)) {
+            spectrum = built;
+        } else {
+            spectrum = expected;
+        }
+    }
+    return *spectrum;
+}
+
 FragmentationMatchScore Compound::scoreCompoundHit(Fragment* expFrag,
                                                    float productPpmTolr,
                                                    bool searchProton)
@@ -153,23 +204,9 @@ FragmentationMatchScore Compound::scoreCompoundHit(Fragment* expFrag,
 
     if (_fragmentMzValues.size() == 0) return s;
 
-    Fragment libFrag;
-    libFrag.precursorMz = _precursorMz;
-    libFrag.mzValues = _fragmentMzValues;
-    libFrag.intensityValues = _fragmentIntensities;
-    libFrag.annotations = _fragmentIonTypes;
-    if (searchProton)  { //special case, check for loss or gain of protons
-        int N = libFrag.mzValues.size();
-        for(int i = 0; i < N; i++) {
-            libFrag.mzValues.push_back(libFrag.mzValues[i] + PROTON_MASS);
-            libFrag.intensityValues.push_back(libFrag.intensityValues[i]);
-            libFrag.mzValues.push_back( libFrag.mzValues[i] - PROTON_MASS);
-            libFrag.intensityValues.push_back(libFrag.intensityValues[i]);
-        }
-    }
     //theory fragmentation or library fragmentation = libFrag
     //experimental data = expFrag
-    libFrag.sortByIntensity();
+    const Fragment& libFrag = librarySpectrum(searchProton);
     s = libFrag.scoreMatch(expFrag, productPpmTolr);
     return s;
 }
@@ -281,6 +318,7 @@ float Compound::productMz()
 void Compound::setPrecursorMz(float precursorMz)
 {
     this->_precursorMz = precursorMz;
+    _resetLibrarySpectra();
 }
 
 float Compound::precursorMz()
@@ -339,6 +377,7 @@ vector<string> Compound::category(){
 
 void Compound::setFragmentMzValues(vector<float> mzValues){
     _fragmentMzValues = mzValues;
+    _resetLibrarySpectra();
 }
 
 vector<float> Compound::fragmentMzValues(){
@@ -347,6 +386,7 @@ vector<float> Compound::fragmentMzValues(){
 
 void Compound::setFragmentIntensities(vector<float> intensities){
     _fragmentIntensities = intensities;
+    _resetLibrarySpectra();
 }
 
 vector<float> Compound::fragmentIntensities(){
@@ -355,6 +395,7 @@ vector<float> Compound::fragmentIntensities(){
 
 void Compound::setFragmentIonTypes(map<int, string> types){
     _fragmentIonTypes = types;
+    _resetLibrarySpectra();
 }
 
 map<int, string> Compound::fragmentIonTypes(){
@@ -686,6 +727,37 @@ TEST_CASE_FIXTURE( Test_CompoundFixture ,"Testing Compound_Class"){
         REQUIRE(f.mzFragError == 1000);
     }
 
+    SUBCASE("Testing library spectrum"){
+        Compound a("C00166", "UTP" ,
+                   "C9H15N2O14P3", 1, 14.81);
+        a.setPrecursorMz(482.9614);
+        a.setFragmentMzValues({78.9591f, 158.9254f, 384.9846f});
+        a.setFragmentIntensities({50.0f, 100.0f, 10.0f});
+
+        const Fragment& spectrum = a.librarySpectrum();
+        REQUIRE(spectrum.precursorMz == doctest::Approx(482.9614));
+        REQUIRE(spectrum.mzValues.size() == 3);
+        REQUIRE(spectrum.intensityValues[0] == doctest::Approx(100.0f));
+        REQUIRE(spectrum.mzValues[0] == doctest::Approx(158.9254f));
+        REQUIRE(&a.librarySpectrum() == &spectrum);
+
+        const Fragment& shifted = a.librarySpectrum(true);
+        REQUIRE(shifted.mzValues.size() == 9);
+        REQUIRE(shifted.intensityValues[0] == doctest::Approx(100.0f));
+
+        Fragment expFrag;
+        expFrag.precursorMz = 482.9610;
+        expFrag.mzValues = {78.9592f, 158.9255f, 384.9845f};
+        expFrag.intensityValues = {40.0f, 100.0f, 5.0f};
+        FragmentationMatchScore f = a.scoreCompoundHit(&expFrag, 20, false);
+        REQUIRE(f.numMatches == 3);
+        REQUIRE(f.fractionMatched == doctest::Approx(1.0));
+
+        a.setFragmentMzValues({78.9591f, 158.9254f});
+        a.setFragmentIntensities({50.0f, 100.0f});
+        REQUIRE(a.librarySpectrum().mzValues.size() == 2);
+    }
+
     SUBCASE("Testing type"){
         Compound a("C00166", "UTP" , "C9H15N2O14P3",
                          1, 14.81);
@@ -151,6 +151,33 @@ class Compound{
          */
         string _hmdb_id;
 
+        /**
+         * @brief Library spectrum built from fragment m/z values, intensities
+         * and ion types, sorted by intensity, ready to be scored against.
+         * @details Built lazily on first use and reset whenever fragment
+         * data or precursor m/z changes. The spectrum is never modified once
+         * built, so copies of a compound can safely share it.
+         */
+        mutable shared_ptr<const Fragment> _librarySpectrum;
+
+        /**
+         * @brief Same as `_librarySpectrum`, but each fragment is also
+         * accompanied by its proton gain and loss variants.
+         */
+        mutable shared_ptr<const Fragment> _protonShiftedLibrarySpectrum;
+
+        /**
+         * @brief Create the library spectrum for this compound.
+         * @param searchProton Whether proton-shifted variants of each
+         * fragment m/z should be included.
+         */
+        shared_ptr<const Fragment> _buildLibrarySpectrum(bool searchProton) const;
+
+        /**
+         * @brief Discard any cached library spectra, so that they are rebuilt
+         * from current fragment data on next use.
+         */
+        void _resetLibrarySpectra();
 
     public:
         enum class Type {
@@ -320,6 +347,15 @@ class Compound{
          */
         Type type() const;
 
+        /**
+         * @brief Obtain an immutable, intensity-sorted library spectrum for
+         * this compound, built once and reused for subsequent calls.
+         * @param searchProton If true, the returned spectrum also contains
+         * proton gain and loss variants of each fragment.
+         * @return Const reference to the cached library spectrum.
+         */
+        const Fragment& librarySpectrum(bool searchProton = false) const;
+
         FragmentationMatchScore scoreCompoundHit(Fragment* expFrag,
                                                  float productPpmTolr = 20,
                                                  bool searchProton = false);
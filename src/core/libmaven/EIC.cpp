@@ -1,12 +1,15 @@
+#include "doctest.h"
 #include "datastructures/adduct.h"
 #include "datastructures/mzSlice.h"
 #include "EIC.h"
+#include "eicindex.h"
 #include "Peak.h"
 #include "mavenparameters.h"
 #include "mzPatterns.h"
 #include "mzSample.h"
 #include "SavGolSmoother.h"
 #include "Scan.h"
+#include "scanstore.h"
 
 /**
  * @file EIC.cpp
@@ -911,10 +914,7 @@ void EIC::checkGaussianFit(Peak &peak)
     if (moves < 3)
         return;
 
-    //copy intensities into separate vector
-    //dim
-    vector<float> pints(moves * 2 + 1);
-
+    // fit intensities in place
     int j = peak.pos + moves;
     if (j >= intensity.size())
         j = intensity.size() - 1;
@@ -923,14 +923,10 @@ void EIC::checkGaussianFit(Peak &peak)
     int i = peak.pos - moves;
     if (i < 1)
         i = 1;
+    if (j < i)
+        return;
 
-    int k = 0;
-    for (; i <= j; i++)
-    {
-        pints[k] = intensity[i];
-        k++;
-    }
-    pair<float, float> res = mzUtils::gaussFit(pints);
+    pair<float, float> res = mzUtils::gaussFit(&intensity[i], j - i + 1);
     if(res.first != numeric_limits<float>::max()
        && res.second != numeric_limits<float>::max()) {
         peak.gaussFitSigma = res.first;
@@ -985,14 +981,131 @@ void EIC::removeLowRankGroups(vector<PeakGroup> &groups, unsigned int rankLimit)
     if (groups.size() < rankLimit)
         return;
     std::sort(groups.begin(), groups.end(), PeakGroup::compIntensity);
-    for (unsigned int i = 0; i < groups.size(); i++)
+    if (groups.size() > rankLimit + 1)
+        groups.erase(groups.begin() + rankLimit + 1, groups.end());
+}
+
+namespace {
+
+/**
+ * @brief Finds the best matching merged peak for peaks of individual samples.
+ * @details Merged peaks are sorted by RT, so only a window of them can ever
+ * match a given sample peak: those within `grouping_maxRtWindow` of it when
+ * overlap is not used, or those lying between the first merged peak that
+ * reaches the sample peak and the first one that lies completely to its
+ * right, when overlap is used. Both bounds are found using binary search
+ * over running maxima of the merged peak boundaries (which, unlike the
+ * boundaries themselves, are sorted) and the candidates in between are
+ * scored exactly as they would be in a scan over all merged peaks.
+ */
+class MergedPeakMatcher
+{
+public:
+    MergedPeakMatcher(const vector<Peak>& mergedPeaks,
+                      const MavenParameters* mp)
+        : _peaks(mergedPeaks), _mp(mp)
     {
-        if (i > rankLimit)
-        {
-            groups.erase(groups.begin() + i);
-            i--;
+        _upperBounds.reserve(_peaks.size());
+        _lowerBounds.reserve(_peaks.size());
+        float maxUpper = numeric_limits<float>::lowest();
+        float maxLower = numeric_limits<float>::lowest();
+        for (const auto& peak : _peaks) {
+            maxUpper = max(maxUpper, max(peak.rtmin, peak.rtmax));
+            maxLower = max(maxLower, min(peak.rtmin, peak.rtmax));
+            _upperBounds.push_back(maxUpper);
+            _lowerBounds.push_back(maxLower);
         }
     }
+
+    /**
+     * @brief Set the group number of the given peak to the index of the
+     * best scoring merged peak (or -1, if none matched) and its group
+     * overlap to that score.
+     */
+    void match(Peak& b) const
+    {
+        b.groupNum = -1;
+        b.groupOverlap = FLT_MIN;
+
+        size_t first = 0;
+        size_t last = _peaks.size();
+        if (_mp->useOverlap) {
+            // merged peaks before `first` end before the sample peak starts
+            // and the merged peak at `last` starts after it ends
+            if (b.rtmin <= b.rtmax) {
+                first = lower_bound(_upperBounds.begin(),
+                                    _upperBounds.end(),
+                                    b.rtmin)
+                        - _upperBounds.begin();
+                last = upper_bound(_lowerBounds.begin(),
+                                   _lowerBounds.end(),
+                                   b.rtmax)
+                       - _lowerBounds.begin();
+            }
+        } else {
+            float maxRtWindow = _mp->grouping_maxRtWindow;
+            auto tooEarly = [&](const Peak& a) {
+                return b.rt - a.rt > maxRtWindow;
+            };
+            auto notTooLate = [&](const Peak& a) {
+                return !(a.rt - b.rt > maxRtWindow);
+            };
+            first = partition_point(_peaks.begin(), _peaks.end(), tooEarly)
+                    - _peaks.begin();
+            last = partition_point(_peaks.begin() + first,
+                                   _peaks.end(),
+                                   notTooLate)
+                   - _peaks.begin();
+        }
+
+        for (size_t k = first; k < last; k++) {
+            const Peak& a = _peaks[k];
+
+            float score;
+
+            // check for overlap
+            float overlap = checkOverlap(a.rtmin, a.rtmax, b.rtmin, b.rtmax);
+            float distx = abs(b.rt - a.rt);
+            float disty = abs(b.peakIntensity - a.peakIntensity);
+
+            if (_mp->useOverlap) {
+                if (overlap == 0 and a.rtmax < b.rtmin)
+                    continue;
+                if (overlap == 0 and a.rtmin > b.rtmax)
+                    break;
+
+                if (distx > _mp->grouping_maxRtWindow && overlap < 0.2)
+                    continue;
+
+                score = 1.0
+                        / (_mp->distXWeight * distx + 0.01)
+                        / (_mp->distYWeight * disty + 0.01)
+                        * (_mp->overlapWeight * overlap);
+            } else {
+                if (distx > _mp->grouping_maxRtWindow)
+                    continue;
+
+                score = 1.0
+                        / (_mp->distXWeight * distx + 0.01)
+                        / (_mp->distYWeight * disty + 0.01);
+            }
+
+            if (score > b.groupOverlap) {
+                b.groupNum = k;
+                b.groupOverlap = score;
+            }
+        }
+    }
+
+private:
+    const vector<Peak>& _peaks;
+    const MavenParameters* _mp;
+
+    // running maxima of the later and earlier boundaries of merged peaks
+    vector<float> _upperBounds;
+    vector<float> _lowerBounds;
+};
+
 }
 
 vector<PeakGroup> EIC::groupPeaks(vector<EIC *> &eics,
@@ -1017,81 +1130,27 @@ vector<PeakGroup> EIC::groupPeaks(vector<EIC *> &eics,
     m->getPeakPositions(mp->eic_smoothingWindow);
     sort(m->peaks.begin(), m->peaks.end(), Peak::compRt);
 
+    pgroups.reserve(m->peaks.size());
     for (unsigned int i = 0; i < m->peaks.size(); i++) {
-        PeakGroup grp(mp, integrationType);
+        pgroups.emplace_back(mp, integrationType);
+        PeakGroup& grp = pgroups.back();
         grp.groupId = i;
         if (slice) {
             grp.setSlice(*slice);
             grp.setAdduct(slice->adduct);
         }
         grp.setSelectedSamples(samples);
-        pgroups.push_back(grp);
     }
 
     // for every sample
+    MergedPeakMatcher matcher(m->peaks, mp.get());
     for (unsigned int i = 0; i < eics.size(); i++) {
         // for every peak in the sample
         for (unsigned int j = 0; j < eics[i]->peaks.size(); j++) {
             Peak &b = eics[i]->peaks[j];
-            b.groupNum = -1;
-            b.groupOverlap = FLT_MIN;
-
-            vector<Peak>::iterator itr = lower_bound(m->peaks.begin(),
-                                                     m->peaks.end(),
-                                                     b,
-                                                     Peak::compRtMin);
-            int lb = (itr - (m->peaks.begin())) - 1;
-            if (lb < 0)
-                lb = 0;
 
             // find best matching group
-            for (unsigned int k = 0; k < m->peaks.size(); k++)
-            {
-                Peak &a = m->peaks[k];
-
-                float score;
-
-                // check for overlap
-                float overlap = checkOverlap(a.rtmin,
-                                             a.rtmax,
-                                             b.rtmin,
-                                             b.rtmax);
-                float distx = abs(b.rt - a.rt);
-                float disty = abs(b.peakIntensity - a.peakIntensity);
-
-                if (mp->useOverlap)
-                {
-
-                    if (overlap == 0 and a.rtmax < b.rtmin)
-                        continue;
-                    if (overlap == 0 and a.rtmin > b.rtmax)
-                        break;
-
-                    if (distx > mp->grouping_maxRtWindow && overlap < 0.2)
-                        continue;
-
-                    score = 1.0
-                            / (mp->distXWeight * distx + 0.01)
-                            / (mp->distYWeight * disty + 0.01)
-                            * (mp->overlapWeight * overlap);
-                }
-                else
-                {
-
-                    if (distx > mp->grouping_maxRtWindow)
-                        continue;
-
-                    score = 1.0
-                            / (mp->distXWeight * distx + 0.01)
-                            / (mp->distYWeight * disty + 0.01);
-                }
-
-                if (score > b.groupOverlap)
-                {
-                    b.groupNum = k;
-                    b.groupOverlap = score;
-                }
-            }
+            matcher.match(b);
 
             if (b.groupNum != -1)
             {
@@ -1199,10 +1258,9 @@ bool EIC::makeEICSlice(mzSample *sample, float mzmin, float mzmax, float rtmin,
     float eicMz = 0, eicIntensity = 0;
     int lb, scanNum;
     vector<float>::iterator mzItr;
-    deque<Scan *>::iterator scanItr;
-    deque<Scan *> scans;
+    deque<Scan *>::const_iterator scanItr;
+    const deque<Scan *>& scans = sample->scans;
 
-    scans = sample->scans;
     //binary search rt domain iterator
     Scan tmpScan(sample, 0, 1, rtmin - 0.1, 0, -1);
     scanItr = lower_bound(scans.begin(), scans.end(), &tmpScan, Scan::compRt);
@@ -1227,6 +1285,12 @@ bool EIC::makeEICSlice(mzSample *sample, float mzmin, float mzmax, float rtmin,
 
     scanNum = scanItr - scans.begin() - 1;
 
+    // with an index of the sample's peaks, points are first added for all
+    // scans in range and filled in afterwards
+    const EicIndex* index = sample->eicIndex();
+    unsigned int firstScan = scanNum + 1;
+    vector<int> positions;
+
     for (; scanItr != scans.end(); scanItr++)
     {
         Scan *scan = *(scanItr);
@@ -1241,6 +1305,17 @@ bool EIC::makeEICSlice(mzSample *sample, float mzmin, float mzmax, float rtmin,
         if (scan->rt > rtmax)
             break;
 
+        if (index != nullptr) {
+            positions.resize(scanNum - firstScan + 1, -1);
+            positions.back() = this->rt.size();
+            this->scannum.push_back(scanNum);
+            this->rt.push_back(scan->rt);
+            this->intensity.push_back(0.0f);
+            this->mz.push_back(0.0f);
+            continue;
+        }
+
+        ScanPin pin(scan);
         eicMz = 0;
         eicIntensity = 0;
 
@@ -1325,9 +1400,73 @@ bool EIC::makeEICSlice(mzSample *sample, float mzmin, float mzmax, float rtmin,
         }
     }
 
+    if (index != nullptr && !positions.empty()) {
+        _addIndexedPeaks(*index,
+                         firstScan,
+                         positions,
+                         mzmin,
+                         mzmax,
+                         eicType);
+    }
     return true;
 }
 
+void EIC::_addIndexedPeaks(const EicIndex& index,
+                           unsigned int firstScan,
+                           const vector<int>& positions,
+                           float mzmin,
+                           float mzmax,
+                           int eicType)
+{
+    unsigned int lastScan = firstScan + positions.size() - 1;
+    if ((EIC::EicType)eicType == EIC::SUM) {
+        vector<double> sumMz(this->size(), 0.0);
+        vector<double> sumIntensity(this->size(), 0.0);
+        index.forEachPeak(mzmin,
+                          mzmax,
+                          firstScan,
+                          lastScan,
+                          [&](unsigned int scan, float mz, float intensity) {
+                              int pos = positions[scan - firstScan];
+                              if (pos < 0)
+                                  return;
+                              double y = static_cast<double>(intensity);
+                              sumIntensity[pos] += y;
+                              sumMz[pos] += static_cast<double>(mz) * y;
+                          });
+        for (int pos : positions) {
+            if (pos < 0 || sumIntensity[pos] == 0.0)
+                continue;
+            this->mz[pos] = static_cast<float>(sumMz[pos] / sumIntensity[pos]);
+            this->intensity[pos] = static_cast<float>(sumIntensity[pos]);
+        }
+    } else {
+        // highest intensity of each scan, and its m/z
+        index.forEachPeak(mzmin,
+                          mzmax,
+                          firstScan,
+                          lastScan,
+                          [&](unsigned int scan, float mz, float intensity) {
+                              int pos = positions[scan - firstScan];
+                              if (pos < 0 || intensity <= this->intensity[pos])
+                                  return;
+                              this->intensity[pos] = intensity;
+                              this->mz[pos] = mz;
+                          });
+    }
+
+    for (int pos : positions) {
+        if (pos < 0)
+            continue;
+        this->totalIntensity += this->intensity[pos];
+        if (this->intensity[pos] > this->maxIntensity) {
+            this->maxIntensity = this->intensity[pos];
+            this->rtAtMaxIntensity = this->rt[pos];
+            this->mzAtMaxIntensity = this->mz[pos];
+        }
+    }
+}
+
 void EIC::normalizeIntensityPerScan(float scale)
 {
     if (scale != 1.0)
@@ -1338,3 +1477,93 @@ void EIC::normalizeIntensityPerScan(float scale)
         }
     }
 }
+
+///////////////////////////Test Cases//////////////////////////////
+
+TEST_CASE("Testing peak to group assignment against exhaustive search")
+{
+    // assignment as done before the search was restricted to a window of
+    // merged peaks: every merged peak is considered, in RT order
+    auto exhaustiveMatch = [](const vector<Peak>& mergedPeaks,
+                              const MavenParameters* mp,
+                              Peak& b) {
+        b.groupNum = -1;
+        b.groupOverlap = FLT_MIN;
+        for (unsigned int k = 0; k < mergedPeaks.size(); k++) {
+            const Peak& a = mergedPeaks[k];
+            float score;
+            float overlap = checkOverlap(a.rtmin, a.rtmax, b.rtmin, b.rtmax);
+            float distx = abs(b.rt - a.rt);
+            float disty = abs(b.peakIntensity - a.peakIntensity);
+            if (mp->useOverlap) {
+                if (overlap == 0 and a.rtmax < b.rtmin)
+                    continue;
+                if (overlap == 0 and a.rtmin > b.rtmax)
+                    break;
+                if (distx > mp->grouping_maxRtWindow && overlap < 0.2)
+                    continue;
+                score = 1.0
+                        / (mp->distXWeight * distx + 0.01)
+                        / (mp->distYWeight * disty + 0.01)
+                        * (mp->overlapWeight * overlap);
+            } else {
+                if (distx > mp->grouping_maxRtWindow)
+                    continue;
+                score = 1.0
+                        / (mp->distXWeight * distx + 0.01)
+                        / (mp->distYWeight * disty + 0.01);
+            }
+            if (score > b.groupOverlap) {
+                b.groupNum = k;
+                b.groupOverlap = score;
+            }
+        }
+    };
+
+    mt19937 generator(42);
+    uniform_real_distribution<float> unit(0.0f, 1.0f);
+    auto randomPeak = [&](float maxWidth) {
+        Peak peak;
+        peak.rt = unit(generator) * 30.0f;
+        peak.rtmin = peak.rt - unit(generator) * maxWidth;
+        peak.rtmax = peak.rt + unit(generator) * maxWidth;
+
+        // a few peaks with grossly asymmetric or inverted bounds
+        float oddity = unit(generator);
+        if (oddity < 0.05f) {
+            swap(peak.rtmin, peak.rtmax);
+        } else if (oddity < 0.1f) {
+            peak.rtmax += unit(generator) * 10.0f;
+        }
+        peak.peakIntensity = unit(generator) * 1.0e6f;
+        return peak;
+    };
+
+    MavenParameters mp;
+    for (int trial = 0; trial < 40; ++trial) {
+        mp.useOverlap = trial % 2 == 0;
+        mp.grouping_maxRtWindow = unit(generator) * 2.0f;
+        mp.distXWeight = 1.0 + unit(generator) * 5.0;
+        mp.distYWeight = 1.0 + unit(generator) * 5.0;
+        mp.overlapWeight = 1.0 + unit(generator) * 5.0;
+
+        vector<Peak> mergedPeaks;
+        int numMergedPeaks = 1 + static_cast<int>(unit(generator) * 200);
+        float maxWidth = 0.05f + unit(generator) * 1.0f;
+        for (int i = 0; i < numMergedPeaks; ++i)
+            mergedPeaks.push_back(randomPeak(maxWidth));
+        sort(mergedPeaks.begin(), mergedPeaks.end(), Peak::compRt);
+
+        MergedPeakMatcher matcher(mergedPeaks, &mp);
+        for (int i = 0; i < 200; ++i) {
+            Peak expected = randomPeak(maxWidth);
+            if (i % 10 == 0)
+                expected.rt = mergedPeaks[i % numMergedPeaks].rt;
+            Peak actual = expected;
+            exhaustiveMatch(mergedPeaks, &mp, expected);
+            matcher.match(actual);
+            REQUIRE(actual.groupNum == expected.groupNum);
+            REQUIRE(actual.groupOverlap == expected.groupOverlap);
+        }
+    }
+}
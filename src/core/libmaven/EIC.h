@@ -12,6 +12,7 @@
 #include "standardincludes.h"
 #include "PeakGroup.h"
 
+class EicIndex;
 class Peak;
 class PeakGroup;
 class mzSample;
@@ -393,5 +394,21 @@ class EIC
     void _computeAsLSBaseline(const float lambda,
                               const float p,
                               const int numIterations=10);
+
+    /**
+     * @brief Fill in the m/z and intensity of EIC points, using an index of
+     * the sample's peaks instead of searching each scan.
+     * @param index Peak index of the sample.
+     * @param firstScan Position of the first scan (in the sample) that may
+     * contribute to this EIC.
+     * @param positions Position in this EIC of the point for each scan,
+     * starting with `firstScan`, or -1 for scans that are not part of it.
+     */
+    void _addIndexedPeaks(const EicIndex& index,
+                          unsigned int firstScan,
+                          const vector<int>& positions,
+                          float mzmin,
+                          float mzmax,
+                          int eicType);
 };
 #endif //MZEIC_H
@@ -2,6 +2,7 @@
 #include "mzSample.h"
 #include "mzUtils.h"
 #include "Scan.h"
+#include "scanstore.h"
 #include "statistics.h"
 
 using namespace std;
@@ -29,6 +30,7 @@ Fragment::Fragment(Scan* scan,
     this->sampleName = scan->sample->sampleName;
     this->scanNum = scan->scannum;
     this->precursorCharge = scan->precursorCharge;
+    ScanPin pin(scan);
     vector<pair<float, float>> mzarray = scan->getTopPeaks(minFractionalIntensity,
                                                            minSigNoiseRatio,
                                                            5);
@@ -136,7 +138,9 @@ int Fragment::findClosestHighestIntensityPos(float mz, float tolr)
     return bestPos;
 }
 
-vector<int> Fragment::compareRanks(Fragment* a, Fragment* b, float productPpmTolr)
+vector<int> Fragment::compareRanks(const Fragment* a,
+                                   const Fragment* b,
+                                   float productPpmTolr)
 { 
     bool verbose = false;
     vector<int> ranks (a->mzValues.size(), -1);	//missing value == -1
@@ -366,7 +370,7 @@ void Fragment::buildConsensusAvg()
     }
 }
 
-double Fragment::totalIntensity()
+double Fragment::totalIntensity() const
 {
     double TIC = 0;
     for(unsigned int i = 0; i < nobs(); i++)
@@ -375,7 +379,9 @@ double Fragment::totalIntensity()
     return TIC;
 }
 
-vector<float> Fragment::asDenseVector(float mzmin, float mzmax, int nbins)
+vector<float> Fragment::asDenseVector(float mzmin,
+                                      float mzmax,
+                                      int nbins) const
 {
     vector<float> v(nbins, 0);
     double mzrange = mzmax - mzmin;
@@ -390,7 +396,7 @@ vector<float> Fragment::asDenseVector(float mzmin, float mzmax, int nbins)
     return v;
 }
 
-double Fragment::logNchooseK(int N, int k)
+double Fragment::logNchooseK(int N, int k) const
 {
     if (N == k || k == 0) return 0;
     if (N == k) return -1;
@@ -399,7 +405,7 @@ double Fragment::logNchooseK(int N, int k)
     return (N * x * log(1 / x) + (1 - x) * log(1 / (1-x)));
 }
 
-double Fragment::spearmanRankCorrelation(const vector<int>& X)
+double Fragment::spearmanRankCorrelation(const vector<int>& X) const
 {
     double d2 = 0;
     int N = X.size();
@@ -413,7 +419,7 @@ double Fragment::spearmanRankCorrelation(const vector<int>& X)
     return 1.00 - (6.0 * d2) / (N * ((N * N) - 1));
 }
 
-double Fragment::ticMatched(const vector<int>& X)
+double Fragment::ticMatched(const vector<int>& X) const
 {
     if (X.size() == 0) return 0;
     double TIC = totalIntensity();
@@ -428,7 +434,7 @@ double Fragment::ticMatched(const vector<int>& X)
     else return 0;
 }
 
-double Fragment::mzErr(const vector<int>& X, Fragment* other)
+double Fragment::mzErr(const vector<int>& X, Fragment* other) const
 {
     if (X.size() == 0)
         return 1000.0;
@@ -447,7 +453,7 @@ double Fragment::mzErr(const vector<int>& X, Fragment* other)
     return sqrt(err);
 }
 
-double Fragment::dotProduct(Fragment* other)
+double Fragment::dotProduct(Fragment* other) const
 {
     double thisTIC = totalIntensity();
     double otherTIC = other->totalIntensity();
@@ -460,7 +466,7 @@ double Fragment::dotProduct(Fragment* other)
     return mzUtils::correlation(va, vb);
 }
 
-double Fragment::hyperGeometricScore(int k, int m, int n, int N)
+double Fragment::hyperGeometricScore(int k, int m, int n, int N) const
 {
     //k=matched, m=len1, n=len2
     if (k == 0) return 0;
@@ -474,7 +480,7 @@ double Fragment::hyperGeometricScore(int k, int m, int n, int N)
     return -(A + B - C);
 }
 
-double Fragment::MVH(const vector<int>& X, Fragment* other)
+double Fragment::MVH(const vector<int>& X, Fragment* other) const
 {
     //other is experimental spectra
     int N = 100000;
@@ -509,7 +515,8 @@ double Fragment::MVH(const vector<int>& X, Fragment* other)
     return -(A + B - C);
 }
 
-double Fragment::mzWeightedDotProduct(const vector<int>& X, Fragment* other)
+double Fragment::mzWeightedDotProduct(const vector<int>& X,
+                                      Fragment* other) const
 {
     if (X.size() == 0) return 0;
     double thisTIC = 0;
@@ -535,13 +542,14 @@ double Fragment::mzWeightedDotProduct(const vector<int>& X, Fragment* other)
     return (sqrt(dotP / (thisTIC * otherTIC))); //SIM
 }
 
-FragmentationMatchScore Fragment::scoreMatch(Fragment* other, float productPpmTolr)
+FragmentationMatchScore Fragment::scoreMatch(Fragment* other,
+                                             float productPpmTolr) const
 {
     FragmentationMatchScore s;
     if (mzValues.size() < 2 or other->mzValues.size() < 2) return s;
 
     //which one is smaller;
-    Fragment* a = this;
+    const Fragment* a = this;
     Fragment* b =  other;
 
     s.ppmError = abs((a->precursorMz - b->precursorMz) / a->precursorMz * 1e6);
@@ -551,8 +559,14 @@ FragmentationMatchScore Fragment::scoreMatch(Fragment* other, float productPpmTo
     }
 
     //annotate?
-    for(int i = 0; i < ranks.size(); i++)
-        other->annotations[ranks[i]] = annotations[i];
+    for(int i = 0; i < ranks.size(); i++) {
+        auto annotation = annotations.find(i);
+        if (annotation != annotations.end()) {
+            other->annotations[ranks[i]] = annotation->second;
+        } else {
+            other->annotations[ranks[i]] = "";
+        }
+    }
 
     s.fractionMatched = s.numMatches / a->nobs();
     s.spearmanRankCorrelation = spearmanRankCorrelation(ranks);
@@ -122,7 +122,9 @@ class Fragment {
 
         int findClosestHighestIntensityPos(float mz, float tolr);
 
-        static vector<int> compareRanks(Fragment* a, Fragment* b, float productAmuToll);
+        static vector<int> compareRanks(const Fragment* a,
+                                        const Fragment* b,
+                                        float productAmuToll);
 
         void addBrotherFragment(Fragment* b);
 
@@ -149,32 +151,44 @@ class Fragment {
 
         void buildConsensusAvg();
 
-        double totalIntensity();
+        double totalIntensity() const;
 
-        vector<float> asDenseVector(float mzmin, float mzmax, int nbins = 2000);
+        vector<float> asDenseVector(float mzmin,
+                                    float mzmax,
+                                    int nbins = 2000) const;
 
-        double logNchooseK(int N, int k);
+        double logNchooseK(int N, int k) const;
 
-        double spearmanRankCorrelation(const vector<int>& X);
+        double spearmanRankCorrelation(const vector<int>& X) const;
 
-        double ticMatched(const vector<int>& X);
+        double ticMatched(const vector<int>& X) const;
 
-        double mzErr(const vector<int>& X, Fragment* other);
+        double mzErr(const vector<int>& X, Fragment* other) const;
 
-        double dotProduct(Fragment* other);
+        double dotProduct(Fragment* other) const;
 
-        double hyperGeometricScore(int k, int m, int n, int N = 100000);
+        double hyperGeometricScore(int k, int m, int n, int N = 100000) const;
 
         /**
          * Multivariate hypergeometric distribution
          */
-        double MVH(const vector<int>& X, Fragment* other);
+        double MVH(const vector<int>& X, Fragment* other) const;
 
-        double mzWeightedDotProduct(const vector<int>& X, Fragment* other);
+        double mzWeightedDotProduct(const vector<int>& X,
+                                    Fragment* other) const;
 
-        FragmentationMatchScore scoreMatch(Fragment* other, float productPpmTolr);
+        /**
+         * @brief Score this fragment (treated as the reference spectrum)
+         * against another, experimental fragment.
+         * @details The reference spectrum is not modified, which allows a
+         * single, shared library spectrum to be scored against any number of
+         * experimental fragments. Annotations of matched m/z values are
+         * copied over to `other`.
+         */
+        FragmentationMatchScore scoreMatch(Fragment* other,
+                                           float productPpmTolr) const;
 
-        inline unsigned int nobs() { return mzValues.size(); }
+        inline unsigned int nobs() const { return mzValues.size(); }
 
         static bool compPrecursorMz(const Fragment* a, const Fragment* b);
         bool operator<(const Fragment* b) const;
@@ -1,6 +1,7 @@
 #include "Peak.h"
 #include "EIC.h"
 #include "Scan.h"
+#include "scanstore.h"
 #include "mzSample.h"
 #include "mzUtils.h"
 
@@ -99,57 +100,9 @@ Peak::Peak(EIC* e, int p) {
 
 
 void Peak::copyObj(const Peak& o ) {
-    pos= o.pos;
-    eic = o.eic;
-    sample = o.sample;
-    baseMz= o.baseMz;
-    fromBlankSample= o.fromBlankSample;
-    groupOverlap= o.groupOverlap;
-    groupOverlapFrac= o.groupOverlapFrac;
-    groupNum=o.groupNum;
-    label= o.label;
-    localMaxFlag= o.localMaxFlag;
-    maxscan= o.maxscan;
-    medianMz= o.medianMz;
-    minpos= o.minpos;
-    maxpos= o.maxpos;
-    splineminpos= o.splineminpos;
-    splinemaxpos= o.splinemaxpos;
-    minscan= o.minscan;
-    mzmax= o.mzmax;
-    mzmin= o.mzmin;
-    noNoiseObs= o.noNoiseObs;
-    noNoiseFraction= o.noNoiseFraction;
-    peakArea= o.peakArea;
-    peakSplineArea = o.peakSplineArea;
-    peakAreaCorrected=o.peakAreaCorrected;
-    peakAreaFractional=o.peakAreaFractional;
-    peakAreaTop=o.peakAreaTop;
-    peakAreaTopCorrected=o.peakAreaTopCorrected;
-    peakIntensity=o.peakIntensity;
-    peakMz= o.peakMz;
-    quality= o.quality;
-    peakBaseLineLevel=o.peakBaseLineLevel;
-    rt=o.rt;
-    rtmax= o.rtmax;
-    rtmin= o.rtmin;
-    scan= o.scan;
-    signalBaselineRatio= o.signalBaselineRatio;
-    signalBaselineDifference= o.signalBaselineDifference;
-    symmetry= o.symmetry;
-    width= o.width;
-    gaussFitSigma=o.gaussFitSigma;
-    gaussFitR2= o.gaussFitR2;
-    peakRank=o.peakRank;
+    *this = o;
 }
 
-Peak& Peak::operator=(const Peak& o)  {
-    copyObj(o);
-    return *this;
-}
-
-Peak::Peak(const Peak& o ) { copyObj(o); }
-
 vector<mzLink> Peak::findCovariants() {
 
     vector<mzLink>covariants;
@@ -174,6 +127,7 @@ vector<mzLink> Peak::findCovariants() {
     map<int, vector<float> >::iterator itr;
     for(unsigned int i=0; i<scans.size(); i++ ) {
         Scan* _scan = scans[i];
+        ScanPin pin(_scan);
         for(unsigned int j=0; j<_scan->nobs(); j++ ) {
             int rmz = int(_scan->mz[j]*1000);
             if (M[rmz].size()==0 )  M[rmz].resize(scanCount);
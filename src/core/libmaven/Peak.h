@@ -15,8 +15,14 @@ class Peak {
         Peak();
 
         Peak(EIC* e, int p);
-        Peak(const Peak& p);
-        Peak& operator=(const Peak& o);
+
+        /**
+         * @details A peak only holds plain values and non-owning pointers, so
+         * it is trivially copyable and can be relocated within containers
+         * without any allocations.
+         */
+        Peak(const Peak& p) = default;
+        Peak& operator=(const Peak& o) = default;
         void copyObj(const Peak& o);
 
         unsigned int pos;
@@ -135,7 +141,7 @@ class Peak {
          * @method getSample
          * @return []
          */
-        inline mzSample* getSample() { return sample; }
+        inline mzSample* getSample() const { return sample; }
 
         /**
          * [hasSample ]
@@ -12,6 +12,7 @@
 #include "constants.h"
 #include "classifier.h"
 #include "mzMassSlicer.h"
+#include "massindex.h"
 #include "peakFiltering.h"
 #include "groupFiltering.h"
 #include "mavenparameters.h"
@@ -307,7 +308,7 @@ void PeakDetector::processSlices(vector<mzSlice*> &slices, string setName)
         return;
 
     // shared `MavenParameters` object
-    auto mp = make_shared<MavenParameters>(*mavenParameters);
+    auto mp = MavenParameters::snapshot(*mavenParameters);
 
     // lambda that adds detected groups to mavenparameters
     auto detectGroupsForSlice = [&](vector<EIC*>& eics, mzSlice* slice) {
@@ -327,7 +328,7 @@ void PeakDetector::processSlices(vector<mzSlice*> &slices, string setName)
             // check for duplicates	and append group
             if (j >= mavenParameters->eicMaxGroups)
                 break;
-            mavenParameters->allgroups.push_back(peakgroups[j]);
+            mavenParameters->allgroups.push_back(std::move(peakgroups[j]));
         }
     };
 
@@ -418,61 +419,81 @@ void PeakDetector::identifyFeatures(const vector<Compound*>& identificationSet)
     if (identificationSet.empty())
         return;
 
-    GroupFiltering groupFiltering(mavenParameters);
-    vector<PeakGroup> toBeMerged;
-    auto iter = mavenParameters->allgroups.begin();
-    while(iter != mavenParameters->allgroups.end()) {
-        auto& group = *iter;
-        bool matchFound = false;
-        for (auto compound : identificationSet) {
-            float mz = 0.0f;
-            if (compound->formula().length() || compound->neutralMass() != 0.0f) {
-                int charge = mavenParameters->getCharge(compound);
-                mz = compound->adjustedMass(charge);
-            } else {
-                mz = compound->mz();
-            }
-            if (mzUtils::withinXMassCutoff(mz,
-                                           group.meanMz,
-                                           mavenParameters->massCutoffMerge)) {
-                PeakGroup groupWithTarget(group);
-                groupWithTarget.setCompound(compound);
-
-                // we should filter the annotated group based on its RT, if the
-                // user has restricted RT range
-                auto rtDiff = groupWithTarget.expectedRtDiff();
-                if (mavenParameters->identificationMatchRt
-                    && rtDiff > mavenParameters->identificationRtWindow) {
-                    continue;
-                }
+    MassIndex massIndex(identificationSet, [this](Compound* compound) {
+        if (compound->formula().length() || compound->neutralMass() != 0.0f) {
+            int charge = mavenParameters->getCharge(compound);
+            return compound->adjustedMass(charge);
+        }
+        return compound->mz();
+    });
+
+    vector<float> groupMzs;
+    groupMzs.reserve(mavenParameters->allgroups.size());
+    for (const auto& group : mavenParameters->allgroups)
+        groupMzs.push_back(group.meanMz);
+    auto matchesForGroups = massIndex.find(groupMzs,
+                                           *mavenParameters->massCutoffMerge);
+
+    // flatten all (group, compound) pairs, in group order and then compound
+    // order, so that filters can be applied to them independently
+    vector<pair<size_t, Compound*>> candidates;
+    for (size_t i = 0; i < matchesForGroups.size(); ++i) {
+        for (auto entry : matchesForGroups[i])
+            candidates.push_back(make_pair(i, entry->compound));
+    }
 
-                // since we are creating targeted groups, we should ensure they
-                // pass MS2 filtering criteria, if enabled
-                if (mavenParameters->matchFragmentationFlag
-                    && groupWithTarget.ms2EventCount > 0
-                    && groupFiltering.filterByMS2(groupWithTarget)) {
-                    continue;
-                }
+    sendBoostSignal("Identifying features using the given compound set…",
+                    0,
+                    candidates.size());
 
-                matchFound = true;
-                toBeMerged.push_back(groupWithTarget);
-            }
+    GroupFiltering groupFiltering(mavenParameters);
+    auto& allgroups = mavenParameters->allgroups;
+    vector<unique_ptr<PeakGroup>> annotatedGroups(candidates.size());
+    int numCandidates = candidates.size();
+#pragma omp parallel for schedule(dynamic, 16)
+    for (int i = 0; i < numCandidates; ++i) {
+        unique_ptr<PeakGroup> groupWithTarget(
+            new PeakGroup(allgroups[candidates[i].first]));
+        groupWithTarget->setCompound(candidates[i].second);
+
+        // we should filter the annotated group based on its RT, if the
+        // user has restricted RT range
+        auto rtDiff = groupWithTarget->expectedRtDiff();
+        if (mavenParameters->identificationMatchRt
+            && rtDiff > mavenParameters->identificationRtWindow) {
+            continue;
         }
 
-        if (matchFound) {
-            iter = mavenParameters->allgroups.erase(iter);
-        } else {
-            ++iter;
+        // since we are creating targeted groups, we should ensure they
+        // pass MS2 filtering criteria, if enabled
+        if (mavenParameters->matchFragmentationFlag
+            && groupWithTarget->ms2EventCount > 0
+            && groupFiltering.filterByMS2(*groupWithTarget)) {
+            continue;
         }
 
-       sendBoostSignal("Identifying features using the given compound set…",
-                       iter - mavenParameters->allgroups.begin(),
-                       mavenParameters->allgroups.size());
+        annotatedGroups[i] = move(groupWithTarget);
     }
 
-    if (!toBeMerged.empty()) {
-        mavenParameters->allgroups.insert(mavenParameters->allgroups.begin(),
-                                          make_move_iterator(toBeMerged.begin()),
-                                          make_move_iterator(toBeMerged.end()));
+    // annotated groups come first, followed by groups for which no target
+    // could be assigned, each in their original order
+    vector<bool> groupMatched(allgroups.size(), false);
+    vector<PeakGroup> identifiedGroups;
+    identifiedGroups.reserve(allgroups.size() + candidates.size());
+    for (size_t i = 0; i < annotatedGroups.size(); ++i) {
+        if (annotatedGroups[i] == nullptr)
+            continue;
+        groupMatched[candidates[i].first] = true;
+        identifiedGroups.push_back(move(*annotatedGroups[i]));
+        annotatedGroups[i].reset();
+    }
+    for (size_t i = 0; i < allgroups.size(); ++i) {
+        if (!groupMatched[i])
+            identifiedGroups.push_back(move(allgroups[i]));
     }
+    allgroups.swap(identifiedGroups);
+
+    sendBoostSignal("Identifying features using the given compound set…",
+                    candidates.size(),
+                    candidates.size());
 }
@@ -1,3 +1,4 @@
+#include "doctest.h"
 #include "PeakGroup.h"
 #include "Compound.h"
 #include "datastructures/adduct.h"
@@ -5,6 +6,7 @@
 #include "mzSample.h"
 #include "EIC.h"
 #include "Scan.h"
+#include "scanstore.h"
 #include "mavenparameters.h"
 #include "mzSample.h"
 #include "mzMassCalculator.h"
@@ -92,6 +94,19 @@ PeakGroup::PeakGroup(shared_ptr<MavenParameters> parameters,
 }
 
 void PeakGroup::copyObj(const PeakGroup& o)  {
+    _copyAttributes(o);
+    srmId = o.srmId;
+    tagString = o.tagString;
+    _tableName = o.tableName();
+    peaks = o.peaks;
+    samples = o.samples;
+
+    copyChildren(o);
+    _parameters = o._parameters;
+}
+
+void PeakGroup::_copyAttributes(const PeakGroup& o)
+{
     groupId= o.groupId;
     metaGroupId= o.metaGroupId;
     clusterId = o.clusterId;
@@ -152,27 +167,19 @@ void PeakGroup::copyObj(const PeakGroup& o)  {
     parentIon = o.parentIon;
     setSlice(o.getSlice());
 
-    srmId=o.srmId;
     isFocused=o.isFocused;
     label=o.label;
 
     goodPeakCount=o.goodPeakCount;
     _type = o._type;
     _sliceSet = o.hasSlice();
-    tagString = o.tagString;
 
     changeFoldRatio = o.changeFoldRatio;
     changePValue    = o.changePValue;
-    peaks = o.peaks;
-    samples=o.samples;
 
     markedBadByCloudModel = o.markedBadByCloudModel;
     markedGoodByCloudModel = o.markedGoodByCloudModel;
 
-    _tableName = o.tableName();
-
-    copyChildren(o);
-    _parameters = make_shared<MavenParameters>(*(o.parameters().get()));
     _integrationType = o.integrationType();
 }
 
@@ -181,6 +188,16 @@ PeakGroup::~PeakGroup() {
     clear();
 }
 
+void PeakGroup::_adoptChildren()
+{
+    for (auto& child : children)
+        child->parent = this;
+    for (auto& child : childrenBarPlot)
+        child->parent = this;
+    for (auto& child : childAdducts)
+        child->parent = this;
+}
+
 void PeakGroup::copyChildren(const PeakGroup& o) {
     children.clear();
     for (auto child : o.children) {
@@ -385,27 +402,34 @@ vector<float> PeakGroup::getOrderedIntensityVector(vector<mzSample*>& samples, Q
 
         if ( sampleOrder.count(sample) > 0 ) {
             int s  = sampleOrder[ sample ];
-            float y = 0;
-            switch (type)  {
-                case AreaTop: y = peak.peakAreaTopCorrected; break;
-                case Area: y = peak.peakAreaCorrected; break;
-                case Height: y = peak.peakIntensity; break;
-                case AreaNotCorrected: y = peak.peakArea; break;
-                case AreaTopNotCorrected: y = peak.peakAreaTop; break;
-                case RetentionTime: y = peak.rt; break;
-                case Quality: y = peak.quality; break;
-                case SNRatio: y = peak.signalBaselineRatio; break;
-                default: y = peak.peakIntensity; break;
-            }
-
-            //normalize
-            if(sample) y *= sample->getNormalizationConstant();
+            float y = peakQuantity(peak, type);
             if(maxIntensity[s] < y) { maxIntensity[s]=y;}
         }
     }
     return maxIntensity;
 }
 
+float PeakGroup::peakQuantity(const Peak& peak, QType type)
+{
+    float y = 0;
+    switch (type)  {
+        case AreaTop: y = peak.peakAreaTopCorrected; break;
+        case Area: y = peak.peakAreaCorrected; break;
+        case Height: y = peak.peakIntensity; break;
+        case AreaNotCorrected: y = peak.peakArea; break;
+        case AreaTopNotCorrected: y = peak.peakAreaTop; break;
+        case RetentionTime: y = peak.rt; break;
+        case Quality: y = peak.quality; break;
+        case SNRatio: y = peak.signalBaselineRatio; break;
+        default: y = peak.peakIntensity; break;
+    }
+
+    //normalize
+    mzSample* sample = peak.getSample();
+    if(sample) y *= sample->getNormalizationConstant();
+    return y;
+}
+
 void PeakGroup::computeAvgBlankArea(const vector<EIC*>& eics) {
 
     if (peaks.size() == 0 ) return;
@@ -498,46 +522,27 @@ void PeakGroup::fillInPeaks(const vector<EIC*>& eics) {
 }
 
 void PeakGroup::reduce() { // make sure there is only one peak per sample
-
-    map <mzSample*, Peak> maxPeaks;
-    map <mzSample*, Peak> :: iterator itr;
     if (peaks.size() < 2 ) return;
 
-    float groupMeanRt=0;
-    float totalWeight=1;
-
-
-    for( unsigned int i=0; i < peaks.size(); i++)  { totalWeight +=  peaks[i].peakIntensity; }
-    for( unsigned int i=0; i < peaks.size(); i++)  { groupMeanRt += peaks[i].rt * peaks[i].peakIntensity/totalWeight;  }
-
-
-    //In each group, take peak that closest to the mean retention time of a group
-
-
-
-    for( unsigned int i=0; i < peaks.size(); i++) {
-        mzSample* c = peaks[i].getSample();
-        //float rtdiff = abs(groupMeanRt-peaks[i].rt);
-
-        /*
-        //In each group, take peak that closest to the mean retention time of a group
-        if ( maxPeaks.count(c) == 0 ||  rtdiff < abs( groupMeanRt - maxPeaks[c].rt) ) {
-        maxPeaks[c].copyObj(peaks[i]);
-        }
-        */
-
-        //In each group, take the hghest peak
-        if ( maxPeaks.count(c) == 0 || maxPeaks[c].peakIntensity < peaks[i].peakIntensity) {
-            maxPeaks[c].copyObj(peaks[i]);
-        }
-    }
-
-    peaks.clear();
-    for( itr = maxPeaks.begin(); itr != maxPeaks.end(); ++itr ) {
-        const Peak& peak = (*itr).second;
-        addPeak(peak);
-    }
-    //	cerr << "\t\t\treduce() from " << startSize << " to " << peaks.size() << endl;
+    // In each group, take the highest peak of every sample. Peaks are
+    // ordered by sample, with the most intense peak of a sample placed
+    // before its other peaks, which are then dropped.
+    sort(peaks.begin(), peaks.end(), [](const Peak& a, const Peak& b) {
+        if (a.getSample() != b.getSample())
+            return less<mzSample*>()(a.getSample(), b.getSample());
+        if (a.peakIntensity != b.peakIntensity)
+            return a.peakIntensity > b.peakIntensity;
+        return a.rt < b.rt;
+    });
+    auto last = unique(peaks.begin(),
+                       peaks.end(),
+                       [](const Peak& a, const Peak& b) {
+                           return a.getSample() == b.getSample();
+                       });
+    peaks.erase(last, peaks.end());
+
+    for (auto& peak : peaks)
+        peak.groupNum = groupId;
 }
 
 void PeakGroup::setLabel(char label)
@@ -593,7 +598,7 @@ void PeakGroup::updateQuality() {
 }
 
 // TODO: Remove this function as expected mz should be calculated while creating the group - Sahil
-double PeakGroup::getExpectedMz(int charge) {
+double PeakGroup::getExpectedMz(int charge) const {
 
     float mz = 0;
 
@@ -799,6 +804,32 @@ PeakGroup& PeakGroup::operator=(const PeakGroup& o)  {
     return *this;
 }
 
+PeakGroup::PeakGroup(PeakGroup&& o) noexcept
+{
+    *this = std::move(o);
+}
+
+PeakGroup& PeakGroup::operator=(PeakGroup&& o) noexcept
+{
+    if (this == &o)
+        return *this;
+
+    _copyAttributes(o);
+    srmId = std::move(o.srmId);
+    tagString = std::move(o.tagString);
+    _tableName = std::move(o._tableName);
+    peaks = std::move(o.peaks);
+    samples = std::move(o.samples);
+    children = std::move(o.children);
+    childrenBarPlot = std::move(o.childrenBarPlot);
+    childAdducts = std::move(o.childAdducts);
+    _parameters = std::move(o._parameters);
+    _adoptChildren();
+
+    o.clear();
+    return *this;
+}
+
 
 bool PeakGroup::operator==(const PeakGroup* o)  {
     if ( this == o ) {
@@ -818,6 +849,16 @@ Peak* PeakGroup::getPeak(mzSample* s ) {
     return NULL;
 }
 
+const Peak* PeakGroup::getPeak(mzSample* s) const {
+    if ( s == NULL ) return NULL;
+    for(unsigned int i=0; i < peaks.size(); i++ ) {
+        if ( peaks[i].getSample() == s ) {
+            return &peaks[i];
+        }
+    }
+    return NULL;
+}
+
 
 void PeakGroup::reorderSamples() {
     std::sort(peaks.begin(), peaks.end(), Peak::compIntensity);
@@ -893,6 +934,11 @@ void PeakGroup::computeFragPattern(float productPpmTolr)
 {
     vector<Scan*> ms2Events = getFragmentationEvents();
     if (ms2Events.size() == 0) return;
+
+    // peak arrays of all events are needed while they are compared
+    deque<ScanPin> pins;
+    for (Scan* scan : ms2Events)
+        pins.emplace_back(scan);
     sort(ms2Events.begin(), ms2Events.end(), Scan::compIntensity);
 
     float minFractionalIntensity = 0.01;
@@ -1009,3 +1055,65 @@ void PeakGroup::setTableName(string tableName)
     for (auto child : children)
         child->setTableName(tableName);
 }
+
+///////////////////////////Test Cases//////////////////////////////
+
+TEST_CASE("Testing PeakGroup move and reduce")
+{
+    auto parameters = make_shared<MavenParameters>();
+    mzSample* sampleA = new mzSample();
+    mzSample* sampleB = new mzSample();
+
+    PeakGroup group(parameters, PeakGroup::IntegrationType::Programmatic);
+    group.groupId = 7;
+    vector<pair<mzSample*, float>> peakData = {{sampleA, 10.0f},
+                                               {sampleB, 30.0f},
+                                               {sampleA, 50.0f},
+                                               {sampleB, 20.0f},
+                                               {sampleA, 40.0f}};
+    for (const auto& data : peakData) {
+        Peak peak;
+        peak.setSample(data.first);
+        peak.peakIntensity = data.second;
+        group.addPeak(peak);
+    }
+
+    SUBCASE("Testing reduce")
+    {
+        group.reduce();
+        REQUIRE(group.peaks.size() == 2);
+        map<mzSample*, float> intensities;
+        for (const auto& peak : group.peaks) {
+            REQUIRE(peak.groupNum == 7);
+            intensities[peak.getSample()] = peak.peakIntensity;
+        }
+        REQUIRE(intensities[sampleA] == doctest::Approx(50.0f));
+        REQUIRE(intensities[sampleB] == doctest::Approx(30.0f));
+    }
+
+    SUBCASE("Testing move")
+    {
+        PeakGroup child(parameters, PeakGroup::IntegrationType::Programmatic);
+        child.tagString = "C13-label-1";
+        group.addChild(child);
+        PeakGroup* childPointer = group.children.front().get();
+
+        PeakGroup moved(std::move(group));
+        REQUIRE(moved.groupId == 7);
+        REQUIRE(moved.peaks.size() == peakData.size());
+        REQUIRE(moved.parameters() == parameters);
+        REQUIRE(moved.children.size() == 1);
+        REQUIRE(moved.children.front().get() == childPointer);
+        REQUIRE(childPointer->parent == &moved);
+        REQUIRE(group.peaks.empty());
+        REQUIRE(group.children.empty());
+
+        vector<PeakGroup> groups;
+        groups.push_back(std::move(moved));
+        groups.emplace_back(parameters, PeakGroup::IntegrationType::Manual);
+        REQUIRE(groups.front().children.front()->parent == &groups.front());
+    }
+
+    delete sampleA;
+    delete sampleB;
+}
@@ -42,6 +42,14 @@ class PeakGroup{
                   IntegrationType integrationType = IntegrationType::Inherit);
         PeakGroup& operator=(const PeakGroup& o);
 
+        /**
+         * @brief Move constructor and assignment, which take over the peaks,
+         * children and other containers of the given group without copying
+         * them. Children taken over are re-parented to this group.
+         */
+        PeakGroup(PeakGroup&& o) noexcept;
+        PeakGroup& operator=(PeakGroup&& o) noexcept;
+
         bool operator==(const PeakGroup* o);
         /**
          * [copyObj ]
@@ -236,7 +244,7 @@ class PeakGroup{
          * @method getParent
          * @return []
          */
-        inline PeakGroup* getParent() { return parent; }
+        inline PeakGroup* getParent() const { return parent; }
 
 
         inline vector<Peak>& getPeaks() { return peaks; }
@@ -262,7 +270,7 @@ class PeakGroup{
 
         void matchFragmentation(float ppmTolerance, string scoringAlgo);
         
-        double getExpectedMz(int charge);
+        double getExpectedMz(int charge) const;
 
         float getExpectedAbundance() const;
 
@@ -354,6 +362,8 @@ class PeakGroup{
 
         Peak* getPeak(mzSample* sample);
 
+        const Peak* getPeak(mzSample* sample) const;
+
         GroupType _type;
 
         /**
@@ -513,6 +523,13 @@ class PeakGroup{
 
         vector<float> getOrderedIntensityVector(vector<mzSample*>& samples, QType type);
 
+        /**
+         * @brief Quantity of a peak of the given type, scaled by the
+         * normalization constant of the peak's sample.
+         * @see QuantMatrix
+         */
+        static float peakQuantity(const Peak& peak, QType type);
+
         /**
          * [reorderSamples ]
          * @method reorderSamples
@@ -644,6 +661,20 @@ class PeakGroup{
             return _parameters;
         }
 
+        /**
+         * @brief Replace the parameters of this peak-group.
+         * @details Parameters are shared between copies of a group (and
+         * between groups created with the same settings), so they should
+         * never be modified in place. Instead, a snapshot of the modified
+         * parameters should be set using this method.
+         * @param parameters A shared pointer to a `MavenParameters` object,
+         * usually obtained from `MavenParameters::snapshot`.
+         */
+        void setParameters(shared_ptr<MavenParameters> parameters)
+        {
+            _parameters = parameters;
+        }
+
         IntegrationType integrationType() const {
             if (_type == GroupType::Isotope && parent != nullptr)
                 return parent->integrationType();
@@ -651,6 +682,18 @@ class PeakGroup{
         }
 
     private:
+        /**
+         * @brief Copy all attributes of another group, except for peaks,
+         * samples, children and parameters, which are copied (or moved) by
+         * the caller.
+         */
+        void _copyAttributes(const PeakGroup& o);
+
+        /**
+         * @brief Set the parent of all children of this group to itself.
+         */
+        void _adoptChildren();
+
         Adduct* _adduct;
         mzSlice _slice;
         bool _sliceSet;
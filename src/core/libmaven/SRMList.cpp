@@ -4,6 +4,8 @@
 #include "databases.h"
 #include "mzSample.h"
 #include "Scan.h"
+#include "scanstore.h"
+#include "transitionindex.h"
 
 SRMList::SRMList(vector<mzSample*>samples, deque<Compound*> compoundsDB){
     this->samples = samples;
@@ -17,23 +19,22 @@ vector<mzSlice*> SRMList::getSrmSlices(double amuQ1, double amuQ3, int userPolar
     vector<mzSlice*>slices;
     for(int i=0; i < samples.size(); i++ ) {
         mzSample* sample = samples[i];
-        for( int j=0; j < sample->scans.size(); j++ ) {
-            Scan* scan = sample->getScan(j);
-            if (!scan) continue;
 
-            // skipping empty scans
-            if (scan->totalIntensity() == 0) continue;
-
-            QString filterLine(scan->filterLine.c_str());
-
-            if (filterLine.isEmpty()) continue;
+        // the representative scan of every SRM ID of the sample is the
+        // non-empty scan with the highest intensity at its first peak
+        const TransitionIndex* index = sample->transitionIndex();
+        index->forEachSrm([&](const string& srmId, int scanPosition) {
+            Scan* scan = sample->scans[scanPosition];
+            QString filterLine(srmId.c_str());
 
             if (seenMRMS.contains(filterLine)){
-                if(scan->intensity[0] <= seenMRMS.value(filterLine)->intensity[0]) continue;
+                ScanPin pin(scan);
+                ScanPin seenPin(seenMRMS.value(filterLine));
+                if(scan->intensity[0] <= seenMRMS.value(filterLine)->intensity[0]) return;
             }
 
             seenMRMS.insert(filterLine, scan);
-        }
+        });
     }
 
     for (auto filterLine: seenMRMS.keys()){
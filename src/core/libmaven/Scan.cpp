@@ -3,6 +3,7 @@
 #include "mzSample.h"
 #include "constants.h"
 #include "SavGolSmoother.h"
+#include "scanstore.h"
 
 Scan::Scan(mzSample* sample, int scannum, int mslevel, float rt, float precursorMz, int polarity) {
     this->sample = sample;
@@ -17,10 +18,32 @@ Scan::Scan(mzSample* sample, int scannum, int mslevel, float rt, float precursor
     this->centroided = 0;
 	this->precursorCharge = 0;
 	this->precursorIntensity = 0;
+	this->precursorScanNum = 0;
     this->isolationWindow = 1;
+    this->_lazyData = nullptr;
+    this->_lazyMzCount = 0;
+    this->_lazyIntensityCount = 0;
+    this->_pinCount = 0;
+    this->_resident = false;
+}
+
+Scan::~Scan()
+{
+    if (isLazy())
+        ScanStore::forget(this);
+}
+
+void Scan::setLazyData(const char* data,
+                       unsigned int mzCount,
+                       unsigned int intensityCount)
+{
+    _lazyData = data;
+    _lazyMzCount = mzCount;
+    _lazyIntensityCount = intensityCount;
 }
 
 void Scan::deepcopy(Scan* b) {
+    ScanPin pin(b);
     this->sample = b->sample;
     this->rt = b->rt;
     this->scannum = b->scannum;
@@ -563,6 +586,7 @@ void Scan::recalculatePrecursorMz(float ppm)
     Scan* fullScan = getLastFullScan(50);
     if (!fullScan)
         return;
+    ScanPin fullScanPin(fullScan);
     
     MassCutoff* massCutoff = new MassCutoff();
     massCutoff->setMassCutoffAndType(ppm, "ppm");
@@ -587,6 +611,7 @@ vector<mzPoint> Scan::getIsolatedRegion(float isolationWindowAmu)
 	//find last ms1 scan or get out
 	Scan* lastFullScan = this->getLastFullScan();
 	if (!lastFullScan) return isolatedSegment;
+	ScanPin lastFullScanPin(lastFullScan);
 
 	//no precursor information
 	if (this->precursorMz <= 0) return isolatedSegment;
@@ -617,6 +642,7 @@ double Scan::getPrecursorPurity(float ppm)
     //get last full scan
     Scan* lastFullScan = this->getLastFullScan();
     if (!lastFullScan) return 0;
+    ScanPin lastFullScanPin(lastFullScan);
 
     //locate intensity of isolated mass
     MassCutoff* massCutoff = new MassCutoff();
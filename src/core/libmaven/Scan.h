@@ -5,6 +5,8 @@
 #include <QString>
 #include <QStringList>
 
+#include <list>
+
 #include "standardincludes.h"
 
 class mzSample;
@@ -27,8 +29,28 @@ class Scan
   public:
     Scan(mzSample *sample, int scannum, int mslevel, float rt, float precursorMz, int polarity);
 
+    ~Scan();
+
     void deepcopy(Scan *b);
 
+    /**
+     * @brief Turn this into a lazy scan, whose peak arrays are copied from
+     * the given location only while it is pinned.
+     * @see ScanStore
+     * @param data Location of `mzCount` m/z values, immediately followed by
+     * `intensityCount` intensity values. Must remain valid for the lifetime
+     * of the scan.
+     */
+    void setLazyData(const char* data,
+                     unsigned int mzCount,
+                     unsigned int intensityCount);
+
+    /**
+     * @brief Whether the peak arrays of this scan are only in memory while
+     * it is pinned (see ScanPin).
+     */
+    inline bool isLazy() const { return _lazyData != nullptr; }
+
     /**
     * @brief return number of m/z's(number of observatiosn) recorded in a scan.
     */
@@ -240,6 +262,17 @@ class Scan
     bool operator<(const Scan &b) const { return rt < b.rt; }
 
   private:
+    friend class ScanStore;
+
+    // location and size of the peak arrays of a lazy scan, and its state in
+    // the scan store
+    const char* _lazyData;
+    unsigned int _lazyMzCount;
+    unsigned int _lazyIntensityCount;
+    int _pinCount;
+    bool _resident;
+    list<Scan*>::iterator _lruPosition;
+
     float parentPeakIntensity;
 
     struct BrotherData
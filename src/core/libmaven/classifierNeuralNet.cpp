@@ -1,3 +1,6 @@
+#include <random>
+
+#include "doctest.h"
 #include "classifierNeuralNet.h"
 #include "EIC.h"
 #include "mzSample.h"
@@ -54,45 +57,78 @@ void ClassifierNeuralNet::loadModel(string filename) {
 
 vector<float> ClassifierNeuralNet::getFeatures(Peak& p) {
 	vector<float> set(num_features, 0);
-	if (p.width > 0) {
-		set[0] = p.peakAreaFractional;
-		set[1] = p.noNoiseFraction;
-		set[2] = p.symmetry / (p.width + 1) * log2(p.width + 1);
-		set[3] = p.groupOverlapFrac;
-		set[4] = p.gaussFitR2 * 100.0;
-		
-        set[5] = p.signalBaselineRatio > 0 ? log2(p.signalBaselineRatio) / 10.0 : 0;
-		set[6] = p.peakRank / 10.0;
-		set[7] = p.peakIntensity > 0 ? log10(p.peakIntensity) : 0;
-		set[8] = p.width <= 3 && p.signalBaselineRatio >= 3.0 ? 1 : 0;
-		//set[9] =  ((float) (p.width >= 3) + (int) (p.symmetry >= 5) + (int) (p.signalBaselineRatio > 3.0))/3;
-		if (p.peakRank / 10.0 > 1)
-			set[6] = 1;
-		//cerr << "tiny=" << set[8] << " " << set[7] << " " << p.symmetry << endl;
-		//set[7] =  ((float) (p.baseLineRightCleanCount >= 5) +  (int) (p.baseLineLeftCleanCount >= 5))/2;
-	}
+	_writeFeatures(p, set.data(), 1);
 	return set;
 }
 
+void ClassifierNeuralNet::_writeFeatures(const Peak& p,
+                                         float* set,
+                                         size_t stride)
+{
+    for (int i = 0; i < num_features; ++i)
+        set[i * stride] = 0;
+    if (p.width > 0) {
+        set[0 * stride] = p.peakAreaFractional;
+        set[1 * stride] = p.noNoiseFraction;
+        set[2 * stride] = p.symmetry / (p.width + 1) * log2(p.width + 1);
+        set[3 * stride] = p.groupOverlapFrac;
+        set[4 * stride] = p.gaussFitR2 * 100.0;
+        set[5 * stride] = p.signalBaselineRatio > 0
+                              ? log2(p.signalBaselineRatio) / 10.0
+                              : 0;
+        set[6 * stride] = p.peakRank / 10.0;
+        set[7 * stride] = p.peakIntensity > 0 ? log10(p.peakIntensity) : 0;
+        set[8 * stride] = p.width <= 3 && p.signalBaselineRatio >= 3.0 ? 1 : 0;
+        if (p.peakRank / 10.0 > 1)
+            set[6 * stride] = 1;
+    }
+}
+
 void ClassifierNeuralNet::classify(PeakGroup* grp) {
 
 	if (brain == NULL)
 		return;
 
-    for (unsigned int j=0; j < grp->peaks.size(); j++ ) {
-        grp->peaks[j].quality=scorePeak(grp->peaks[j]);
-	}
+    vector<Peak*> peaks;
+    peaks.reserve(grp->peaks.size());
+    for (auto& peak : grp->peaks)
+        peaks.push_back(&peak);
+    scorePeaks(peaks);
 }
 
 void ClassifierNeuralNet::scoreEICs(vector<EIC*> &eics)
 {
+    vector<Peak*> peaks;
+    for (auto eic : eics) {
+        for (auto& peak : eic->peaks)
+            peaks.push_back(&peak);
+    }
+    scorePeaks(peaks);
+}
 
-	for (unsigned int i = 0; i < eics.size(); i++)
-	{
-		for (unsigned int j = 0; j < eics[i]->peaks.size(); j++ ) {
-			eics[i]->peaks[j].quality = scorePeak(eics[i]->peaks[j]);
-		}
-	}
+void ClassifierNeuralNet::scorePeaks(const vector<Peak*>& peaks)
+{
+    if (!brain) {
+        for (auto peak : peaks)
+            peak->quality = 0.1;
+        return;
+    }
+    if (peaks.empty())
+        return;
+
+    // features, hidden node outputs and results are stored feature-major,
+    // so that each is contiguous across the batch
+    size_t count = peaks.size();
+    int numInputs = max(num_features, brain->get_layersize(NEUN_INPUT));
+    vector<float> features(numInputs * count, 0.0f);
+    vector<float> hidden(brain->get_layersize(HIDDEN) * count);
+    vector<float> result(brain->get_layersize(OUTPUT) * count);
+    for (size_t n = 0; n < count; ++n)
+        _writeFeatures(*peaks[n], features.data() + n, count);
+
+    brain->runBatch(features.data(), count, hidden.data(), result.data());
+    for (size_t n = 0; n < count; ++n)
+        peaks[n]->quality = result[n];
 }
 
 float ClassifierNeuralNet::scorePeak(Peak& p) {
@@ -200,3 +236,39 @@ void ClassifierNeuralNet::train(vector<PeakGroup*>& groups) {
  cerr << "Done training. " << endl;
 
  */
+
+///////////////////////////Test Cases//////////////////////////////
+
+TEST_CASE("Testing batched peak scoring")
+{
+    ClassifierNeuralNet classifier;
+    classifier.loadModel("bin/default.model");
+    REQUIRE(classifier.hasModel());
+
+    mt19937 generator(3);
+    uniform_real_distribution<float> fraction(0.0f, 1.0f);
+    vector<Peak> peaks(500);
+    for (size_t i = 0; i < peaks.size(); ++i) {
+        Peak& peak = peaks[i];
+        peak.width = i % 10;
+        peak.peakAreaFractional = fraction(generator);
+        peak.noNoiseFraction = fraction(generator);
+        peak.symmetry = 20.0f * fraction(generator);
+        peak.groupOverlapFrac = fraction(generator);
+        peak.gaussFitR2 = fraction(generator);
+        peak.signalBaselineRatio = 10.0f * fraction(generator);
+        peak.peakRank = i % 15;
+        peak.peakIntensity = 1e6f * fraction(generator);
+    }
+
+    vector<Peak*> batch;
+    for (auto& peak : peaks)
+        batch.push_back(&peak);
+    classifier.scorePeaks(batch);
+    for (auto& peak : peaks)
+        REQUIRE(peak.quality == classifier.scorePeak(peak));
+
+    ClassifierNeuralNet untrained;
+    untrained.scorePeaks(batch);
+    REQUIRE(peaks[0].quality == doctest::Approx(0.1f));
+}
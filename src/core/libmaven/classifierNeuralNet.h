@@ -20,9 +20,22 @@ public:
 	bool hasModel();
     vector<float> getFeatures(Peak& p);
 	float scorePeak(Peak& p);
+
+    /**
+     * @brief Score the quality of a batch of peaks, setting their `quality`.
+     * @details Scores are the same as those of `scorePeak`, but the features
+     * of all peaks are laid out in one buffer and the network is evaluated
+     * for all of them at once.
+     */
+    void scorePeaks(const vector<Peak*>& peaks);
+
 	void scoreEICs(vector<EIC*> &eics);
 private:
-	
+    /**
+     * @brief Write the features of a peak, `stride` values apart.
+     */
+    void _writeFeatures(const Peak& p, float* set, size_t stride);
+
 
 	//neural net specific features
 	nnwork* brain;
@@ -1,74 +1,142 @@
+#include "doctest.h"
 #include "comparesampleslogic.h"
+#include "mavenparameters.h"
 #include "mzSample.h"
 #include "mzUtils.h"
 #include "PeakGroup.h"
+#include "quantmatrix.h"
 
-CompareSamplesLogic::CompareSamplesLogic() {
-}
+namespace {
 
-int CompareSamplesLogic::countBelow(vector<float>& y, float ymax)
+/**
+ * @brief A small and fast xorshift128+ generator, seeded using splitmix64.
+ */
+class FastRandom
 {
-    vector<float> temp = y;
-    sort(temp.begin(), temp.end());
-    auto itr = lower_bound(temp.begin(), temp.end(), ymax);
-    int lb = itr-temp.begin();
-    return lb;
+public:
+    explicit FastRandom(uint64_t seed)
+    {
+        _state[0] = _splitMix(seed);
+        _state[1] = _splitMix(seed);
+    }
+
+    uint64_t next()
+    {
+        uint64_t s1 = _state[0];
+        const uint64_t s0 = _state[1];
+        _state[0] = s0;
+        s1 ^= s1 << 23;
+        _state[1] = s1 ^ s0 ^ (s1 >> 17) ^ (s0 >> 26);
+        return _state[1] + s0;
+    }
+
+    /**
+     * @brief Uniformly distributed integer in [0, n).
+     */
+    uint32_t below(uint32_t n)
+    {
+        return static_cast<uint32_t>(((next() >> 32) * n) >> 32);
+    }
 
+private:
+    uint64_t _state[2];
+
+    static uint64_t _splitMix(uint64_t& x)
+    {
+        uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+};
+
+/**
+ * @brief Compute absolute t-statistics (same as `mzUtils::ttest`) of a range
+ * of groups, for a given assignment of samples to the two sets.
+ * @param values Sample-major matrix of centred intensities, having
+ * `numGroups` values for each sample.
+ * @param numGroups Total number of groups in `values`.
+ * @param firstGroup Index of the first group of the range.
+ * @param lastGroup Index past the last group of the range.
+ * @param totalSum Per-group sum of values over all samples.
+ * @param totalSumSq Per-group sum of squared values over all samples.
+ * @param setA Indices of samples assigned to the first set. All other
+ * samples belong to the second set.
+ * @param n1 Number of samples in the first set.
+ * @param n2 Number of samples in the second set.
+ * @param sumA Buffer (of size `numGroups`) for per-group sums.
+ * @param sumSqA Buffer (of size `numGroups`) for per-group sums of squares.
+ * @param out Output array receiving one t-statistic per group, indexed the
+ * same way as groups in `values`.
+ */
+void tStatistics(const vector<float>& values,
+                 size_t numGroups,
+                 size_t firstGroup,
+                 size_t lastGroup,
+                 const vector<double>& totalSum,
+                 const vector<double>& totalSumSq,
+                 const int* setA,
+                 int n1,
+                 int n2,
+                 vector<double>& sumA,
+                 vector<double>& sumSqA,
+                 float* out)
+{
+    std::fill(sumA.begin() + firstGroup, sumA.begin() + lastGroup, 0.0);
+    std::fill(sumSqA.begin() + firstGroup, sumSqA.begin() + lastGroup, 0.0);
+    double* sA = sumA.data();
+    double* qA = sumSqA.data();
+    for (int k = 0; k < n1; ++k) {
+        const float* row = values.data() + setA[k] * numGroups;
+        for (size_t g = firstGroup; g < lastGroup; ++g) {
+            double x = row[g];
+            sA[g] += x;
+            qA[g] += x * x;
+        }
+    }
+
+    // variances are treated as zero when they are within round-off of the
+    // mean square, which is what a two-pass computation would give for sets
+    // of identical values
+    const double tolerance = 1e-12;
+    for (size_t g = firstGroup; g < lastGroup; ++g) {
+        double sB = totalSum[g] - sA[g];
+        double qB = totalSumSq[g] - qA[g];
+        double meanA = sA[g] / n1;
+        double meanB = sB / n2;
+        double varA = n1 > 1 ? (qA[g] - sA[g] * meanA) / (n1 - 1) : 0.0;
+        double varB = n2 > 1 ? (qB - sB * meanB) / (n2 - 1) : 0.0;
+        if (varA <= tolerance * qA[g] / n1)
+            varA = 1.0;
+        if (varB <= tolerance * qB / n2)
+            varB = 1.0;
+        out[g] = static_cast<float>(
+            abs(meanA - meanB) / sqrt(varA / n1 + varB / n2));
+    }
 }
 
-void CompareSamplesLogic::shuffle(StatisticsVector<float>& groupA,
-		StatisticsVector<float>& groupB) {
-	int n1 = groupA.size();
-	int n2 = groupB.size();
-	int n3 = n1 + n2;
-	if (n1 == 0 || n2 == 0)
-		return;
-
-	//combine two sets
-	//cerr << "N3=" << n3 << endl;
-	StatisticsVector<float> groupC(n1 + n2);
-	for (int i = 0; i < n1; i++)
-		groupC[i] = groupA[i];
-	for (int i = 0; i < n2; i++)
-		groupC[n1 + i] = groupB[i];
-	//for(int i=0; i < n3; i++ ) cerr << groupC[i] << " "; cerr << endl;
-
-	//float realT = ttest(groupA,ratio>100groupB);
-
-	for (int s = 0; s < 10; s++) {
-		//shuffle combined set
-		for (int i = 0; i < n3; i++) {
-			int r = randInt(0,n3 - 1);
-			assert(r <= n3 - 1);
-			if (i == r)
-				continue;
-			float tmp = groupC[i];
-			groupC[i] = groupC[r];
-			groupC[r] = tmp; //swap
-		}
+}
 
-		//split random vector
-		StatisticsVector<float> tmpA(n1);
-		StatisticsVector<float> tmpB(n2);
-		for (int i = 0; i < n1; i++)
-			tmpA[i] = groupC[i];
-		for (int i = 0; i < n2; i++)
-			tmpB[i] = groupC[n1 + i];
-
-		//for(int i=0; i < n1; i++ ) cerr << tmpA[i] << " "; cerr << endl;
-		//for(int i=0; i < n2; i++ ) cerr << tmpB[i] << " "; cerr << endl;
-
-		//ttest
-		float randT = abs(mzUtils::ttest(tmpA, tmpB));
-		//cerr << "RealT=" << realT << "  RandT=" << randT << endl;
-		rand_scores.push_back(randT);
-	}
-	/*
-	 std::sort(rand_scores.begin(), rand_scores.end());
-	 int rank = countBelow(rand_scores,  ttest(groupA,groupB));
-	 cerr << "Q=" << rank << " p-value=" << 1.0-(float) rank / rand_scores.size() << endl;
-	 */
+CompareSamplesLogic::CompareSamplesLogic():
+    _numPermutations(100),
+    _randomSeed(5489)
+{
+}
+
+void CompareSamplesLogic::setNumPermutations(int numPermutations)
+{
+    _numPermutations = max(0, numPermutations);
+}
 
+void CompareSamplesLogic::setRandomSeed(unsigned int seed)
+{
+    _randomSeed = seed;
+}
+
+int CompareSamplesLogic::countBelow(const vector<float>& y, float ymax)
+{
+    auto itr = lower_bound(y.begin(), y.end(), ymax);
+    return itr - y.begin();
 }
 
 void CompareSamplesLogic::FDRCorrection(QList<shared_ptr<PeakGroup>> allgroups,
@@ -101,57 +169,240 @@ void CompareSamplesLogic::FDRCorrection(QList<shared_ptr<PeakGroup>> allgroups,
 }
 
 void CompareSamplesLogic::computeMinPValue(QList<shared_ptr<PeakGroup>> allgroups) {
+    if (rand_scores.empty())
+        return;
+
+    // null distribution is normally sorted as soon as it is computed
+    if (!is_sorted(rand_scores.begin(), rand_scores.end()))
+        std::sort(rand_scores.begin(), rand_scores.end());
 
-	std::sort(rand_scores.begin(), rand_scores.end()); //sort random scores,
     for (auto group : allgroups) {
 		if (group->changeFoldRatio == 0)
 			continue;
 		int rank = countBelow(rand_scores, group->changePValue); //calculate p-value
-		//cerr << group->changePValue << " " <<  ((float) rank)/rand_scores.size() << endl;
 		group->changePValue = 1 - ((float) rank) / rand_scores.size();
 
 	}
 }
 
-void CompareSamplesLogic::computeStats(PeakGroup* group,
-		vector<mzSample*> sampleSet, vector<mzSample*> sset1,
-		vector<mzSample*> sset2, float _missingValue) {
-	group->changeFoldRatio = 0;		//TODO why?
-	group->changePValue = 1;		//TODO why?
-
-    //group->groupStatistics();
-	vector<float> yvalues = group->getOrderedIntensityVector(sampleSet,
-			PeakGroup::AreaTop);
-
-	StatisticsVector<float> groupA(sset1.size());
-	StatisticsVector<float> groupB(sset2.size());
-
-	// Was missing - Kiran
-	// TODO: misingSet1 and 2 is not used anywhere - Kiran
-    int missingSet1=0;
-	int missingSet2=0;
-	for(unsigned int i=0; i < sset1.size(); i++ ) { groupA[i]=yvalues[i]; if (groupA[i] == 0) missingSet1++; }
-	for(unsigned int i=0; i < sset2.size(); i++ ) { groupB[i]=yvalues[ sset1.size()+i ]; if (groupB[i] ==0 ) missingSet2++; }
-	
-	for (unsigned int i = 0; i < groupA.size(); i++)
-		if (groupA[i] < _missingValue)
-			groupA[i] = _missingValue;
-	for (unsigned int i = 0; i < groupB.size(); i++)
-		if (groupB[i] < _missingValue)
-			groupB[i] = _missingValue;
-
-    //skip empty
-	float meanA = abs(groupA.mean());
-	float meanB = abs(groupB.mean());
-
-    //Equation Updated -Kiran
-    if (meanA <= 0)
-		meanA = 1;
-	if (meanB <= 0)
-		meanB = 1;
-
-    //Equation Updated -Kiran
-    group->changeFoldRatio = log2(meanA/meanB);
-	group->changePValue = abs(mzUtils::ttest(groupA, groupB));
-	shuffle(groupA, groupB);
+void CompareSamplesLogic::computeStats(
+    const QList<shared_ptr<PeakGroup>>& allgroups,
+    const vector<mzSample*>& sset1,
+    const vector<mzSample*>& sset2,
+    float _missingValue)
+{
+    int numGroups = allgroups.size();
+    int n1 = sset1.size();
+    int n2 = sset2.size();
+    int n3 = n1 + n2;
+
+    real_scores.assign(numGroups, 0.0f);
+    for (auto group : allgroups) {
+        group->changeFoldRatio = 0;
+        group->changePValue = 1;
+    }
+    if (numGroups == 0 || n1 == 0 || n2 == 0)
+        return;
+
+    vector<mzSample*> sampleSet(sset1);
+    sampleSet.insert(sampleSet.end(), sset2.begin(), sset2.end());
+
+    vector<PeakGroup*> groups;
+    groups.reserve(numGroups);
+    for (auto group : allgroups)
+        groups.push_back(group.get());
+    QuantMatrix quantMatrix(groups, sampleSet, PeakGroup::AreaTop);
+
+    // sample-major intensity matrix, with values of each group centred
+    // around their mean (t-statistics do not change on shifting values)
+    vector<float> values(static_cast<size_t>(n3) * numGroups);
+#pragma omp parallel for schedule(dynamic, 64)
+    for (int g = 0; g < numGroups; ++g) {
+        PeakGroup* group = groups[g];
+        vector<float> yvalues = quantMatrix.rowVector(g);
+
+        double sumA = 0.0;
+        double sumB = 0.0;
+        for (int i = 0; i < n3; ++i) {
+            if (yvalues[i] < _missingValue)
+                yvalues[i] = _missingValue;
+            if (i < n1) {
+                sumA += yvalues[i];
+            } else {
+                sumB += yvalues[i];
+            }
+        }
+
+        float meanA = abs(sumA / n1);
+        float meanB = abs(sumB / n2);
+        if (meanA <= 0)
+            meanA = 1;
+        if (meanB <= 0)
+            meanB = 1;
+        group->changeFoldRatio = log2(meanA / meanB);
+
+        float mean = (sumA + sumB) / n3;
+        for (int i = 0; i < n3; ++i)
+            values[static_cast<size_t>(i) * numGroups + g] = yvalues[i] - mean;
+    }
+
+    vector<double> totalSum(numGroups, 0.0);
+    vector<double> totalSumSq(numGroups, 0.0);
+    for (int i = 0; i < n3; ++i) {
+        const float* row = values.data() + static_cast<size_t>(i) * numGroups;
+        for (int g = 0; g < numGroups; ++g) {
+            double x = row[g];
+            totalSum[g] += x;
+            totalSumSq[g] += x * x;
+        }
+    }
+
+    vector<int> identity(n3);
+    for (int i = 0; i < n3; ++i)
+        identity[i] = i;
+
+    vector<double> sumA(numGroups);
+    vector<double> sumSqA(numGroups);
+    tStatistics(values,
+                numGroups,
+                0,
+                numGroups,
+                totalSum,
+                totalSumSq,
+                identity.data(),
+                n1,
+                n2,
+                sumA,
+                sumSqA,
+                real_scores.data());
+    for (int g = 0; g < numGroups; ++g)
+        allgroups[g]->changePValue = real_scores[g];
+
+    // permutations are evaluated for one chunk of groups at a time, so that
+    // progress can be reported from the calling thread
+    rand_scores.resize(static_cast<size_t>(_numPermutations) * numGroups);
+    const int chunkSize = 1024;
+    for (int firstGroup = 0; firstGroup < numGroups; firstGroup += chunkSize) {
+        int lastGroup = min(firstGroup + chunkSize, numGroups);
+#pragma omp parallel
+        {
+            vector<int> permutation(n3);
+            vector<double> permSumA(numGroups);
+            vector<double> permSumSqA(numGroups);
+
+#pragma omp for schedule(dynamic, 1)
+            for (int p = 0; p < _numPermutations; ++p) {
+                // each permutation has its own generator, so that results do
+                // not depend on how permutations are distributed among
+                // threads, or on the chunk of groups being evaluated
+                FastRandom random(static_cast<uint64_t>(_randomSeed) << 32 | p);
+                permutation = identity;
+                for (int i = 0; i < n1; ++i) {
+                    int r = i + random.below(n3 - i);
+                    swap(permutation[i], permutation[r]);
+                }
+                tStatistics(values,
+                            numGroups,
+                            firstGroup,
+                            lastGroup,
+                            totalSum,
+                            totalSumSq,
+                            permutation.data(),
+                            n1,
+                            n2,
+                            permSumA,
+                            permSumSqA,
+                            rand_scores.data()
+                                + static_cast<size_t>(p) * numGroups);
+            }
+        }
+        boostSignal("Comparing samples…", lastGroup, numGroups);
+    }
+    std::sort(rand_scores.begin(), rand_scores.end());
+}
+
+///////////////////////////Test Cases//////////////////////////////
+
+TEST_CASE("Testing permutation statistics")
+{
+    auto parameters = make_shared<MavenParameters>();
+    mzSample samples[8];
+    vector<mzSample*> sset1;
+    vector<mzSample*> sset2;
+    for (int i = 0; i < 8; ++i) {
+        auto sample = &samples[i];
+        sample->setSampleName("sample" + to_string(i));
+        if (i < 3) {
+            sset1.push_back(sample);
+        } else {
+            sset2.push_back(sample);
+        }
+    }
+    vector<mzSample*> sampleSet(sset1);
+    sampleSet.insert(sampleSet.end(), sset2.begin(), sset2.end());
+
+    // first group differs between sets, second does not, third is constant
+    vector<vector<float>> intensities = {
+        {900.0f, 1100.0f, 1000.0f, 210.0f, 190.0f, 205.0f, 195.0f, 200.0f},
+        {530.0f, 450.0f, 550.0f, 480.0f, 520.0f, 470.0f, 530.0f, 500.0f},
+        {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f}};
+    QList<shared_ptr<PeakGroup>> groups;
+    for (const auto& groupIntensities : intensities) {
+        auto group = make_shared<PeakGroup>(
+            parameters, PeakGroup::IntegrationType::Programmatic);
+        for (size_t i = 0; i < sampleSet.size(); ++i) {
+            Peak peak;
+            peak.setSample(sampleSet[i]);
+            peak.peakAreaTopCorrected = groupIntensities[i];
+            group->addPeak(peak);
+        }
+        groups.push_back(group);
+    }
+
+    CompareSamplesLogic compareLogic;
+    compareLogic.setNumPermutations(50);
+    unsigned int lastProgress = 0;
+    int lastTotal = 0;
+    compareLogic.boostSignal.connect(
+        [&](const string&, unsigned int progress, int total) {
+            lastProgress = progress;
+            lastTotal = total;
+        });
+    compareLogic.computeStats(groups, sset1, sset2, 100.0f);
+    REQUIRE(lastProgress == 3);
+    REQUIRE(lastTotal == 3);
+
+    for (int g = 0; g < groups.size(); ++g) {
+        StatisticsVector<float> groupA;
+        StatisticsVector<float> groupB;
+        for (size_t i = 0; i < sampleSet.size(); ++i) {
+            float value = max(intensities[g][i], 100.0f);
+            if (i < sset1.size()) {
+                groupA.push_back(value);
+            } else {
+                groupB.push_back(value);
+            }
+        }
+        float expected = abs(mzUtils::ttest(groupA, groupB));
+        REQUIRE(compareLogic.real_scores[g] == doctest::Approx(expected));
+    }
+    REQUIRE(groups[0]->changeFoldRatio == doctest::Approx(log2(1000.0f / 200.0f)));
+    REQUIRE(groups[2]->changeFoldRatio == doctest::Approx(0.0f));
+
+    REQUIRE(compareLogic.rand_scores.size() == 50 * groups.size());
+    REQUIRE(is_sorted(compareLogic.rand_scores.begin(),
+                      compareLogic.rand_scores.end()));
+
+    auto nullScores = compareLogic.rand_scores;
+    CompareSamplesLogic repeatLogic;
+    repeatLogic.setNumPermutations(50);
+    repeatLogic.computeStats(groups, sset1, sset2, 100.0f);
+    REQUIRE(repeatLogic.rand_scores == nullScores);
+
+    compareLogic.computeMinPValue(groups);
+    REQUIRE(groups[0]->changePValue < groups[1]->changePValue);
+    for (auto group : groups) {
+        REQUIRE(group->changePValue >= 0.0f);
+        REQUIRE(group->changePValue <= 1.0f);
+    }
 }
@@ -2,6 +2,7 @@
 #define COMPARESAMPLESLOGIC_H
 
 #include <QList>
+#include <boost/signals2.hpp>
 
 #include "assert.h"
 #include "standardincludes.h"
@@ -12,18 +13,59 @@ class PeakGroup;
 
 class CompareSamplesLogic {
 public:
+    boost::signals2::signal<void (const std::string&, unsigned int, int)>
+        boostSignal;
+
 	CompareSamplesLogic();
 
-	void shuffle(StatisticsVector<float>& groupA,
-			StatisticsVector<float>& groupB);
+    /**
+     * @brief Number of random permutations of sample labels used to build
+     * the null distribution of t-statistics.
+     */
+    void setNumPermutations(int numPermutations);
+
+    /**
+     * @brief Seed for the generator used to permute sample labels. Results
+     * are reproducible for a given seed, irrespective of thread count.
+     */
+    void setRandomSeed(unsigned int seed);
+
     void FDRCorrection(QList<std::shared_ptr<PeakGroup> > allgroups, int correction);
     void computeMinPValue(QList<std::shared_ptr<PeakGroup> > allgroups);
-        void computeStats(PeakGroup* group, std::vector<mzSample*> sampleSet,
-                        std::vector<mzSample*> sset1, std::vector<mzSample*> sset2,
-			float _missingValue);
-        int countBelow(std::vector<float>& y, float ymax);
+
+    /**
+     * @brief Compute fold change and t-statistic of every group between two
+     * sets of samples, along with a permutation based null distribution.
+     * @details Intensities of all groups are laid out in a sample-major
+     * matrix, so that the t-statistics of all groups for a given assignment
+     * of samples to sets can be computed in contiguous passes over its rows.
+     * Every permutation reassigns samples to the two sets (keeping the set
+     * sizes), and the t-statistics of all groups under that permutation are
+     * added to `rand_scores`, which is sorted once all permutations are done.
+     * Permutations are evaluated in parallel, for one chunk of groups at a
+     * time, and progress is signalled (through `boostSignal`) once each chunk
+     * is done.
+     * @param allgroups Groups to be compared.
+     * @param sset1 Samples of the first set.
+     * @param sset2 Samples of the second set.
+     * @param _missingValue Intensities lower than this value are replaced by
+     * it.
+     */
+    void computeStats(const QList<std::shared_ptr<PeakGroup> >& allgroups,
+                      const std::vector<mzSample*>& sset1,
+                      const std::vector<mzSample*>& sset2,
+                      float _missingValue);
+
+    /**
+     * @brief Count the number of values lower than `ymax`.
+     * @param y A vector sorted in ascending order.
+     */
+    int countBelow(const std::vector<float>& y, float ymax);
 	StatisticsVector<float> rand_scores;
 	StatisticsVector<float> real_scores;
 
+private:
+    int _numPermutations;
+    unsigned int _randomSeed;
 };
 #endif // COMPARESAMPLESLOGIC_H
@@ -1,6 +1,7 @@
 #include "doctest.h"
 #include "testUtils.h"
 #include "csvreports.h"
+#include <boost/filesystem.hpp>
 #include <boost/lexical_cast.hpp>
 #include "Compound.h"
 #include "datastructures/adduct.h"
@@ -13,6 +14,8 @@
 #include "mavenparameters.h"
 #include "mzSample.h"
 #include "mzUtils.h"
+#include "quantmatrix.h"
+#include "spdlog/fmt/fmt.h"
 
 CSVReports::CSVReports(string filename,
                        ReportType reportType,
@@ -69,11 +72,18 @@ CSVReports::~CSVReports()
         _reportStream.close();
 }
 
-QString CSVReports::_sanitizeString(const char* s)
+string CSVReports::_sanitizeString(const string& s)
 {
-    QString out = s;
-    out.replace(QString("\""), QString("\"\""));
-    if (out.contains(SEP.c_str())) {
+    string out;
+    out.reserve(s.size() + 2);
+    for (char c : s) {
+        if (c == '"') {
+            out += "\"\"";
+        } else {
+            out += c;
+        }
+    }
+    if (out.find(SEP) != string::npos) {
         out = "\"" + out + "\"";
     }
     return out;
@@ -122,7 +132,7 @@ void CSVReports::_insertGroupReportColumnNamesintoCSVFile(
         _reportStream << header.toStdString();
         for (unsigned int i = 0; i < samples.size(); i++) {
             string name = samples[i]->getSampleName();
-            _reportStream << SEP << _sanitizeString(name.c_str()).toStdString();
+            _reportStream << SEP << _sanitizeString(name);
         }
         _reportStream << endl;
 
@@ -132,8 +142,7 @@ void CSVReports::_insertGroupReportColumnNamesintoCSVFile(
 
             for (size_t i = 0; i < samples.size(); i++) {
                 string name = samples[i]->getSetName();
-                _reportStream << SEP
-                              << _sanitizeString(name.c_str()).toStdString();
+                _reportStream << SEP << _sanitizeString(name);
             }
             _reportStream << endl;
         }
@@ -178,34 +187,104 @@ void CSVReports::_insertPeakReportColumnNamesintoCSVFile()
     }
 }
 
+namespace {
+
+/**
+ * @brief Append a separator followed by a floating point value, formatted the
+ * same way as `fixed << setprecision(precision)` on an output stream.
+ */
+void writeFixed(fmt::MemoryWriter& row,
+                const string& sep,
+                double value,
+                int precision)
+{
+    row.write("{}{:.{}f}", sep, value, precision);
+}
+
+}
+
 void CSVReports::addGroup(PeakGroup* group)
 {
-    if (_reportType == ReportType::PeakReport)
-        _writePeakInfo(group);
+    addGroups(vector<PeakGroup*>{group});
+}
 
-    if (_reportType == ReportType::GroupReport) {
-        if (group->getCompound() == NULL || group->childCount() == 0) {
-            _writeGroupInfo(group);
-        } else {
-            _insertIsotopes(group);
+void CSVReports::addGroups(const vector<PeakGroup*>& groups)
+{
+    if (!_reportStream.is_open())
+        return;
+
+    // IDs are assigned serially, before formatting, so that every row can be
+    // formatted independently of the others
+    vector<_ReportRow> rows;
+    rows.reserve(groups.size());
+    for (auto group : groups) {
+        if (_reportType == ReportType::PeakReport)
+            rows.push_back({group, group->groupId});
+
+        if (_reportType == ReportType::GroupReport) {
+            if (group->getCompound() == NULL || group->childCount() == 0) {
+                rows.push_back({group, ++_groupId});
+            } else {
+                _insertIsotopes(group, rows);
+            }
         }
     }
+
+    int numRows = static_cast<int>(rows.size());
+    vector<PeakGroup*> rowGroups;
+    rowGroups.reserve(numRows);
+    for (const auto& row : rows)
+        rowGroups.push_back(row.group);
+    QuantMatrix quantMatrix(rowGroups, samples, _qtype);
+
+    int numChunks = (numRows + _chunkSize - 1) / _chunkSize;
+    for (int first = 0; first < numChunks; first += _chunksPerWrite) {
+        int last = first + _chunksPerWrite;
+        if (last > numChunks)
+            last = numChunks;
+
+        vector<string> buffers(last - first);
+
+#pragma omp parallel for schedule(dynamic, 1)
+        for (int chunk = first; chunk < last; ++chunk) {
+            string& buffer = buffers[chunk - first];
+            int end = (chunk + 1) * _chunkSize;
+            if (end > numRows)
+                end = numRows;
+            for (int i = chunk * _chunkSize; i < end; ++i) {
+                if (_reportType == ReportType::PeakReport) {
+                    _writePeakInfo(rows[i].group, buffer);
+                } else {
+                    _writeGroupInfo(rows[i].group,
+                                    rows[i].groupId,
+                                    quantMatrix.row(i),
+                                    buffer);
+                }
+            }
+        }
+
+        for (const auto& buffer : buffers)
+            _reportStream.write(buffer.data(), buffer.size());
+    }
+    _reportStream.flush();
 }
 
 void CSVReports::_insertIsotopes(PeakGroup* group,
+                                 vector<_ReportRow>& rows,
                                  bool userSelectedIsotopesOnly)
 {
     if (userSelectedIsotopesOnly) {
-        _insertUserSelectedIsotopes(group);
+        _insertUserSelectedIsotopes(group, rows);
     } else {
         for (auto subGroup : group->children) {
             subGroup->metaGroupId = group->metaGroupId;
-            _writeGroupInfo(subGroup.get());
+            rows.push_back({subGroup.get(), ++_groupId});
         }
     }
 }
 
-void CSVReports::_insertUserSelectedIsotopes(PeakGroup* group)
+void CSVReports::_insertUserSelectedIsotopes(PeakGroup* group,
+                                             vector<_ReportRow>& rows)
 {
     bool C13Flag = getMavenParameters()->C13Labeled_BPE;
     bool N15Flag = getMavenParameters()->N15Labeled_BPE;
@@ -227,16 +306,15 @@ void CSVReports::_insertUserSelectedIsotopes(PeakGroup* group)
             continue;
 
         subGroup->metaGroupId = group->metaGroupId;
-        _writeGroupInfo(subGroup.get());
+        rows.push_back({subGroup.get(), ++_groupId});
     }
 }
 
-void CSVReports::_writeGroupInfo(PeakGroup* group)
+void CSVReports::_writeGroupInfo(PeakGroup* group,
+                                 int groupId,
+                                 const float* yvalues,
+                                 string& out)
 {
-    if (!_reportStream.is_open())
-        return;
-    _groupId++;
-
     char lab;
     lab = group->label;
 
@@ -260,24 +338,24 @@ void CSVReports::_writeGroupInfo(PeakGroup* group)
             return;
     }
 
-    vector<float> yvalues = group->getOrderedIntensityVector(samples, _qtype);
-
     string tagString = group->srmId + group->tagString;
     // using the new funtionality added - Kiran
-    tagString = _sanitizeString(tagString.c_str()).toStdString();
-
-    char label[2];
-    sprintf(label, "%c", group->label);
+    tagString = _sanitizeString(tagString);
 
     string adductName = "";
     if (group->getAdduct() != nullptr)
         adductName = group->getAdduct()->getName();
 
-    _reportStream << label << SEP << parentGroup->groupId << SEP << _groupId
-                  << SEP << group->goodPeakCount << fixed << SEP
-                  << setprecision(6) << group->meanMz << SEP << setprecision(3)
-                  << group->meanRt << SEP << setprecision(6)
-                  << group->maxQuality << SEP << adductName << SEP << tagString;
+    fmt::MemoryWriter row;
+    if (group->label != '\0')
+        row << group->label;
+    row << SEP << parentGroup->groupId << SEP << groupId << SEP
+        << group->goodPeakCount;
+    writeFixed(row, SEP, group->meanMz, 6);
+    writeFixed(row, SEP, group->meanRt, 3);
+    writeFixed(row, SEP, group->maxQuality, 6);
+    row << SEP << adductName << SEP << tagString;
+
     string compoundName = "";
     string compoundID = "";
     string formula = "";
@@ -286,9 +364,9 @@ void CSVReports::_writeGroupInfo(PeakGroup* group)
     float ppmDist = 0;
 
     if (group->getCompound() != NULL) {
-        compoundName = _sanitizeString(group->getCompound()->name().c_str()).toStdString();
-        compoundID   = _sanitizeString(group->getCompound()->id().c_str()).toStdString();
-        formula = _sanitizeString(group->getCompound()->formula().c_str()).toStdString();
+        compoundName = _sanitizeString(group->getCompound()->name());
+        compoundID   = _sanitizeString(group->getCompound()->id());
+        formula = _sanitizeString(group->getCompound()->formula());
         if (!group->getCompound()->formula().empty()) {
             int charge = getMavenParameters()->getCharge(group->getCompound());
             if (group->parent != NULL) {
@@ -316,14 +394,14 @@ void CSVReports::_writeGroupInfo(PeakGroup* group)
         compoundID = compoundName;
     }
 
-    _reportStream << SEP << compoundName << SEP << compoundID << SEP << formula
-                  << SEP << setprecision(3) << expectedRtDiff << SEP
-                  << setprecision(6) << ppmDist;
+    row << SEP << compoundName << SEP << compoundID << SEP << formula;
+    writeFixed(row, SEP, expectedRtDiff, 3);
+    writeFixed(row, SEP, ppmDist, 6);
 
     if (group->parent != NULL) {
-        _reportStream << SEP << group->parent->meanMz;
+        writeFixed(row, SEP, group->parent->meanMz, 6);
     } else {
-        _reportStream << SEP << group->meanMz;
+        writeFixed(row, SEP, group->meanMz, 6);
     }
 
     if (group->getCompound()
@@ -336,44 +414,45 @@ void CSVReports::_writeGroupInfo(PeakGroup* group)
         if (group->tagString.find("C12 PARENT") != std::string::npos)
             groupToWrite = group->parent;
 
-        _reportStream << SEP << groupToWrite->ms2EventCount << SEP
-                      << groupToWrite->fragMatchScore.numMatches << SEP
-                      << groupToWrite->fragMatchScore.fractionMatched << SEP
-                      << groupToWrite->fragMatchScore.ticMatched << SEP
-                      << groupToWrite->fragMatchScore.dotProduct << SEP
-                      << groupToWrite->fragMatchScore.weightedDotProduct << SEP
-                      << groupToWrite->fragMatchScore.hypergeomScore << SEP
-                      << groupToWrite->fragMatchScore.spearmanRankCorrelation
-                      << SEP << groupToWrite->fragMatchScore.mzFragError << SEP
-                      << groupToWrite->fragmentationPattern.purity;
+        const auto& score = groupToWrite->fragMatchScore;
+        row << SEP << groupToWrite->ms2EventCount;
+        writeFixed(row, SEP, score.numMatches, 6);
+        writeFixed(row, SEP, score.fractionMatched, 6);
+        writeFixed(row, SEP, score.ticMatched, 6);
+        writeFixed(row, SEP, score.dotProduct, 6);
+        writeFixed(row, SEP, score.weightedDotProduct, 6);
+        writeFixed(row, SEP, score.hypergeomScore, 6);
+        writeFixed(row, SEP, score.spearmanRankCorrelation, 6);
+        writeFixed(row, SEP, score.mzFragError, 6);
+        writeFixed(row, SEP, groupToWrite->fragmentationPattern.purity, 6);
     }
 
     // for intensity values, we only write two digits of floating point
     // precision since these values are supposed to be large (in the order of >
     // 10^3).
-    _reportStream << setprecision(2);
     for (unsigned int j = 0; j < samples.size(); j++) {
         for (int i = 0; i < static_cast<int>(group->samples.size()); ++i) {
             if (samples[j]->sampleName == group->samples[i]->sampleName) {
-                _reportStream << SEP << yvalues[j];
+                writeFixed(row, SEP, yvalues[j], 2);
                 break;
             } else if (i == static_cast<int>(group->samples.size()) - 1) {
-                _reportStream << SEP << "NA";
+                row << SEP << "NA";
             }
         }
     }
-    _reportStream << endl;
+    row << '\n';
+    out.append(row.data(), row.size());
 }
 
-void CSVReports::_writePeakInfo(PeakGroup* group)
+void CSVReports::_writePeakInfo(PeakGroup* group, string& out)
 {
     string compoundName = "";
     string compoundID = "";
     string formula = "";
     if (group->getCompound() != NULL) {
-        compoundName = _sanitizeString(group->getCompound()->name().c_str()).toStdString();
-        compoundID   = _sanitizeString(group->getCompound()->id().c_str()).toStdString();
-        formula = _sanitizeString(group->getCompound()->formula().c_str()).toStdString();
+        compoundName = _sanitizeString(group->getCompound()->name());
+        compoundID   = _sanitizeString(group->getCompound()->id());
+        formula = _sanitizeString(group->getCompound()->formula());
     } else {
         // absence of a group compound means this group was created using
         // untargeted detection,
@@ -404,6 +483,7 @@ void CSVReports::_writePeakInfo(PeakGroup* group)
     // different systems.
     std::sort(group->peaks.begin(), group->peaks.end(), Peak::compSampleName);
 
+    fmt::MemoryWriter rows;
     vector<mzSample*> samplesWithNoPeak = samples;
     for (unsigned int j = 0; j < group->peaks.size(); j++) {
         Peak& peak = group->peaks[j];
@@ -416,43 +496,48 @@ void CSVReports::_writePeakInfo(PeakGroup* group)
                           [sample](mzSample* s) { return s == sample; }),
                 end(samplesWithNoPeak));
 
-            sampleName =
-                _sanitizeString(sample->sampleName.c_str()).toStdString();
+            sampleName = _sanitizeString(sample->sampleName);
         }
 
-        _reportStream << fixed << setprecision(6) << group->groupId << SEP
-                      << compoundName << SEP << compoundID << SEP << formula
-                      << SEP << sampleName << SEP << adductName << SEP << peak.peakMz
-                      << SEP << peak.mzmin << SEP << peak.mzmax << setprecision(3)
-                      << SEP << peak.rt << SEP << peak.rtmin << SEP
-                      << peak.rtmax << SEP
-                      << peak.quality
-                      // for intensity values, we only write two digits of
-                      // floating point precision
-                      // since these values are supposed to be large
-                      // (in the order of > 10^3).
-                      << setprecision(2) << SEP << peak.peakIntensity << SEP
-                      << peak.peakArea << SEP << peak.peakSplineArea << SEP
-                      << peak.peakAreaTop << SEP << peak.peakAreaCorrected
-                      << SEP << peak.peakAreaTopCorrected << SEP
-                      << peak.noNoiseObs << SEP << peak.signalBaselineRatio
-                      << SEP << peak.fromBlankSample << endl;
+        rows << group->groupId << SEP << compoundName << SEP << compoundID
+             << SEP << formula << SEP << sampleName << SEP << adductName;
+        writeFixed(rows, SEP, peak.peakMz, 6);
+        writeFixed(rows, SEP, peak.mzmin, 6);
+        writeFixed(rows, SEP, peak.mzmax, 6);
+        writeFixed(rows, SEP, peak.rt, 3);
+        writeFixed(rows, SEP, peak.rtmin, 3);
+        writeFixed(rows, SEP, peak.rtmax, 3);
+        writeFixed(rows, SEP, peak.quality, 3);
+
+        // for intensity values, we only write two digits of floating point
+        // precision since these values are supposed to be large (in the order
+        // of > 10^3).
+        writeFixed(rows, SEP, peak.peakIntensity, 2);
+        writeFixed(rows, SEP, peak.peakArea, 2);
+        writeFixed(rows, SEP, peak.peakSplineArea, 2);
+        writeFixed(rows, SEP, peak.peakAreaTop, 2);
+        writeFixed(rows, SEP, peak.peakAreaCorrected, 2);
+        writeFixed(rows, SEP, peak.peakAreaTopCorrected, 2);
+        rows << SEP << peak.noNoiseObs;
+        writeFixed(rows, SEP, peak.signalBaselineRatio, 2);
+        rows << SEP << static_cast<int>(peak.fromBlankSample) << '\n';
     }
     for (auto sample : samplesWithNoPeak) {
         string sampleName = "";
         if (sample != nullptr) {
-            sampleName =
-                _sanitizeString(sample->sampleName.c_str()).toStdString();
+            sampleName = _sanitizeString(sample->sampleName);
         }
-        _reportStream << fixed << setprecision(6) << group->groupId << SEP
-                      << compoundName << SEP << compoundID << SEP << formula
-                      << SEP << sampleName << SEP << adductName<< SEP << 0.0f
-                      << SEP << 0.0f << SEP << 0.0f << setprecision(3) << SEP
-                      << 0.0f << SEP << 0.0f << SEP << 0.0f << SEP << 0.0f
-                      << setprecision(2) << SEP << 0.0f << SEP << 0.0f << SEP
-                      << 0.0f << SEP << 0.0f << SEP << 0.0f << SEP << 0.0f
-                      << SEP << 0.0f << SEP << 0.0f << SEP << 0 << endl;
+        rows << group->groupId << SEP << compoundName << SEP << compoundID
+             << SEP << formula << SEP << sampleName << SEP << adductName;
+        for (int i = 0; i < 3; ++i)
+            writeFixed(rows, SEP, 0.0, 6);
+        for (int i = 0; i < 4; ++i)
+            writeFixed(rows, SEP, 0.0, 3);
+        for (int i = 0; i < 8; ++i)
+            writeFixed(rows, SEP, 0.0, 2);
+        rows << SEP << 0 << '\n';
     }
+    out.append(rows.data(), rows.size());
 }
 
 void CSVReports::writeDataForPolly(const std::string& file,
@@ -476,15 +561,14 @@ void CSVReports::writeDataForPolly(const std::string& file,
                 _reportStream << ",";
 
                 string tagString = child->srmId + child->tagString;
-                tagString = _sanitizeString(tagString.c_str()).toStdString();
+                tagString = _sanitizeString(tagString);
                 _reportStream << tagString;
                 _reportStream << ",";
 
                 string compoundName = "";
                 if(child->hasCompoundLink()) {
-                    compoundName = _sanitizeString(
-                                       child->getCompound()->name().c_str())
-                                       .toStdString();
+                    compoundName =
+                        _sanitizeString(child->getCompound()->name());
                 } else {
                     compoundName = std::to_string(child->meanMz) + "@"
                                    + std::to_string(child->meanRt);
@@ -928,3 +1012,65 @@ TEST_CASE_FIXTURE(SampleLoadingFixture, "Testing CSV reports")
         remove("peakReport.csv");
     }
 }
+
+TEST_CASE_FIXTURE(SampleLoadingFixture, "Testing CSV reports against saved reports")
+{
+    // reports for the fixture set are written with a single call for all
+    // groups, and have to match the saved reports byte for byte
+    auto readLines = [](const string& filename) {
+        ifstream file(filename);
+        vector<string> lines;
+        string line;
+        while (getline(file, line))
+            lines.push_back(line);
+        return lines;
+    };
+    auto compareWithSaved = [&](CSVReports::ReportType reportType,
+                                const string& savedFilename) {
+        auto reportPath = boost::filesystem::temp_directory_path()
+                          / boost::filesystem::unique_path(
+                              "%%%%-%%%%-%%%%.csv");
+        string reportFilename = reportPath.string();
+        auto sample = samples();
+        vector<PeakGroup> groups = allgroups();
+        vector<PeakGroup*> groupsToWrite;
+        for (auto& group : groups)
+            groupsToWrite.push_back(&group);
+
+        auto csvReports = new CSVReports(reportFilename,
+                                         reportType,
+                                         sample,
+                                         PeakGroup::AreaTop,
+                                         false,
+                                         true,
+                                         mavenparameters());
+        csvReports->addGroups(groupsToWrite);
+        delete csvReports;
+
+        vector<string> written = readLines(reportFilename);
+        vector<string> saved = readLines(savedFilename);
+        boost::filesystem::remove(reportPath);
+
+        REQUIRE(written.size() == saved.size());
+        for (size_t i = 0; i < saved.size(); ++i)
+            REQUIRE(written[i] == saved[i]);
+    };
+
+    SUBCASE("Testing targeted reports")
+    {
+        targetedGroup();
+        compareWithSaved(CSVReports::ReportType::GroupReport,
+                         "tests/test-libmaven/test_TargetedGroupReport.csv");
+        compareWithSaved(CSVReports::ReportType::PeakReport,
+                         "tests/test-libmaven/test_TargetedPeakReport.csv");
+    }
+
+    SUBCASE("Testing untargeted reports")
+    {
+        untargetedGroup();
+        compareWithSaved(CSVReports::ReportType::GroupReport,
+                         "tests/test-libmaven/test_untargetedGroupReport.csv");
+        compareWithSaved(CSVReports::ReportType::PeakReport,
+                         "tests/test-libmaven/test_untargetedPeakReport.csv");
+    }
+}
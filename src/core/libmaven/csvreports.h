@@ -77,6 +77,16 @@ class CSVReports
          */
         void addGroup(PeakGroup* group);
 
+        /**
+         * @brief Add a collection of groups to the report.
+         * @details Rows are formatted in parallel, in chunks of consecutive
+         * rows, each chunk into its own buffer. The buffers are then written
+         * to the report in group order, so the output is the same as adding
+         * the groups one at a time using `addGroup`.
+         * @param groups Groups to be written, in order.
+         */
+        void addGroups(const vector<PeakGroup*>& groups);
+
         QString getErrorReport(void)
         {
             /**
@@ -123,14 +133,44 @@ class CSVReports
         }
 
     private:
+        /**
+         * @brief A group that will be written to the report along with the
+         * ID assigned to it (for group reports).
+         */
+        struct _ReportRow
+        {
+            PeakGroup* group;
+            int groupId;
+        };
+
+        /**
+         * @brief Number of consecutive rows formatted into a single buffer.
+         */
+        static const int _chunkSize = 64;
+
+        /**
+         * @brief Number of chunks formatted before their buffers are written
+         * to the output file.
+         */
+        static const int _chunksPerWrite = 64;
+
         /**
          *@brief-  helper function to write group info
+         *@param group Group to be written.
+         *@param groupId ID of the group in the report.
+         *@param yvalues Quantities of the group in the order of `samples`.
+         *@param out Buffer to which the row is appended.
          */
-        void _writeGroupInfo(PeakGroup* group);
+        void _writeGroupInfo(PeakGroup* group,
+                             int groupId,
+                             const float* yvalues,
+                             string& out);
         /**
          *@brief-  helper function to write peak info
+         *@param group Group whose peaks will be written.
+         *@param out Buffer to which the rows are appended.
          */
-        void _writePeakInfo(PeakGroup* group);
+        void _writePeakInfo(PeakGroup* group, string& out);
 
         /**
          *@param -  incremental group numbering.
@@ -143,7 +183,7 @@ class CSVReports
          *@brief -   update string with escape sequence for
          *  writing special character
          */
-        QString _sanitizeString(const char* s);
+        string _sanitizeString(const string& s);
 
         /**
          * @brief   Type of the report to be produced
@@ -203,14 +243,16 @@ class CSVReports
          * with `true` value.
          */
         void _insertIsotopes(PeakGroup* group,
+                             vector<_ReportRow>& rows,
                              bool userSelectedIsotopesOnly = false);
 
         /**
          * @brief - Create a masslist with isotopes only currently selected by user
-         * (accessible through a global settings object) and then write the
+         * (accessible through a global settings object) and then queue the
          * subgroups having these isotopes as tagrstrings, if they were found.
          */
-        void _insertUserSelectedIsotopes(PeakGroup* group);
+        void _insertUserSelectedIsotopes(PeakGroup* group,
+                                         vector<_ReportRow>& rows);
 
         void setTabDelimited()
         {
@@ -1,5 +1,8 @@
+#include <boost/filesystem.hpp>
+
 #include "databases.h"
 #include "Compound.h"
+#include "doctest.h"
 #include "mzMassCalculator.h"
 #include "mzUtils.h"
 
@@ -62,6 +65,239 @@ int Databases::loadCompoundCSVFile(string filename) {
     return loadCount;
 }
 
+int Databases::loadNISTLibrary(string filename)
+{
+    int loadCount = 0;
+    readNISTLibrary(filename, [&](Compound* compound) {
+        if (addCompound(compound))
+            loadCount++;
+    });
+    sort(compoundsDB.begin(), compoundsDB.end(), Compound::compMass);
+    return loadCount;
+}
+
+int Databases::readNISTLibrary(const string& filename,
+                               function<void(Compound*)> onCompound,
+                               function<void(int)> onLine)
+{
+    ifstream myfile(filename.c_str());
+    if (!myfile.is_open())
+        return 0;
+
+    string dbname = mzUtils::cleanFilename(filename);
+    Compound* compound = nullptr;
+    vector<float> mzValues;
+    vector<float> intensities;
+    map<int, string> ionTypes;
+    bool capturePeaks = false;
+    int readCount = 0;
+
+    // fragments are collected separately and set once per record, so that
+    // the compound's library spectrum is not rebuilt for every peak line
+    auto saveCompound = [&]() {
+        if (compound == nullptr)
+            return;
+
+        compound->setFragmentMzValues(mzValues);
+        compound->setFragmentIntensities(intensities);
+        compound->setFragmentIonTypes(ionTypes);
+        if (!compound->formula().empty()) {
+            auto formula = compound->formula();
+            compound->setMz(MassCalculator::computeMass(formula, 0));
+        }
+        if (compound->name().empty()) {
+            delete compound;
+        } else {
+            readCount++;
+            onCompound(compound);
+        }
+        compound = nullptr;
+    };
+
+    // returns the value following a (case-insensitive) key, with runs of
+    // whitespace collapsed, or false if the line does not start with any of
+    // the given keys
+    auto valueFor = [](const string& line,
+                       const string& upperLine,
+                       const vector<string>& keys,
+                       string& value) {
+        for (const auto& key : keys) {
+            if (upperLine.compare(0, key.size(), key) == 0) {
+                istringstream words(line.substr(key.size()));
+                string word;
+                value.clear();
+                while (words >> word)
+                    value += (value.empty() ? "" : " ") + word;
+                return true;
+            }
+        }
+        return false;
+    };
+
+    // patterns found in comments of MoNA libraries, available at:
+    // https://mona.fiehnlab.ucdavis.edu/downloads
+    regex formulaMatch("Formula\\=(C\\d+H\\d+\\S*)");
+    regex retentionTimeMatch("AvgRt\\=(\\S+)");
+    regex keyValuePattern("\"([^=\"]*)=([^\"]*)\"");
+
+    string line;
+    int lineCount = 0;
+    while (getline(myfile, line)) {
+        if (onLine)
+            onLine(++lineCount);
+
+        size_t found = line.find_last_not_of(" \n\r\t");
+        if (found == string::npos)
+            continue;
+        line.erase(found + 1);
+
+        string upperLine = line;
+        transform(upperLine.begin(),
+                  upperLine.end(),
+                  upperLine.begin(),
+                  ::toupper);
+
+        string value;
+        if (valueFor(line, upperLine, {"NAME:"}, value)) {
+            saveCompound();
+            compound = new Compound(value, value, "", 0);
+            compound->setDb(dbname);
+            mzValues.clear();
+            intensities.clear();
+            ionTypes.clear();
+            capturePeaks = false;
+            continue;
+        }
+
+        if (compound == nullptr)
+            continue;
+
+        if (valueFor(line, upperLine, {"MW:", "EXACTMASS:"}, value)) {
+            compound->setMz(string2float(value));
+        } else if (valueFor(line,
+                            upperLine,
+                            {"CE:", "COLLISION ENERGY:", "COLLISION_ENERGY:"},
+                            value)) {
+            compound->setCollisionEnergy(string2float(value));
+        } else if (valueFor(line, upperLine, {"ID:"}, value)) {
+            if (!value.empty())
+                compound->setId(value);
+        } else if (valueFor(line, upperLine, {"LOGP:"}, value)) {
+            compound->setLogP(string2float(value));
+        } else if (valueFor(line, upperLine, {"RT:"}, value)) {
+            compound->setExpectedRt(string2float(value));
+        } else if (valueFor(line, upperLine, {"SMILE:", "SMILES:"}, value)) {
+            if (!value.empty())
+                compound->setSmileString(value);
+        } else if (valueFor(line, upperLine, {"PRECURSORMZ:"}, value)) {
+            compound->setPrecursorMz(string2float(value));
+        } else if (valueFor(line,
+                            upperLine,
+                            {"FORMULA:", "MOLECULE FORMULA:"},
+                            value)) {
+            value.erase(remove(value.begin(), value.end(), '"'), value.end());
+            if (!value.empty())
+                compound->setFormula(value);
+        } else if (valueFor(line, upperLine, {"CATEGORY:"}, value)) {
+            auto category = compound->category();
+            category.push_back(value);
+            compound->setCategory(category);
+        } else if (valueFor(line, upperLine, {"TAG:"}, value)) {
+            if (upperLine.find("VIRTUAL") != string::npos)
+                compound->setVirtualFragmentation(true);
+        } else if (valueFor(line,
+                            upperLine,
+                            {"ION MODE:",
+                             "ION_MODE:",
+                             "IONMODE:",
+                             "IONIZATION:"},
+                            value)) {
+            if (makeLowerCase(value).find('p') != string::npos) {
+                compound->ionizationMode = Compound::IonizationMode::Positive;
+            } else {
+                compound->ionizationMode = Compound::IonizationMode::Negative;
+            }
+        } else if (valueFor(line,
+                            upperLine,
+                            {"COMMENT:", "COMMENTS:"},
+                            value)) {
+            smatch match;
+            if (regex_search(value, match, formulaMatch))
+                compound->setFormula(match[1]);
+            if (regex_search(value, match, retentionTimeMatch))
+                compound->setExpectedRt(string2float(match[1]));
+
+            // identifiers are taken in order of precedence: KEGG, HMDB,
+            // PubChem and then ChEBI
+            vector<string> idKeys = {"kegg", "hmdb", "pubchem", "chebi"};
+            vector<string> ids(idKeys.size());
+            string note;
+            for (sregex_iterator itr(value.begin(),
+                                     value.end(),
+                                     keyValuePattern);
+                 itr != sregex_iterator();
+                 ++itr) {
+                string key = (*itr)[1];
+                string keyValue = (*itr)[2];
+
+                // replace SMILE and category if available and not already set
+                if (key.find("SMILE") != string::npos
+                    && compound->smileString().empty()) {
+                    compound->setSmileString(keyValue);
+                }
+                if (key.find("compound class") != string::npos
+                    && compound->category().empty()) {
+                    compound->setCategory(mzUtils::split(keyValue, "; "));
+                }
+
+                string lowerKey = makeLowerCase(key);
+                for (size_t i = 0; i < idKeys.size(); ++i) {
+                    if (lowerKey.find(idKeys[i]) != string::npos)
+                        ids[i] = keyValue;
+                }
+                note += "\"" + key + ": " + keyValue + "\" ";
+            }
+            for (const auto& id : ids) {
+                if (!id.empty()) {
+                    compound->setId(id);
+                    break;
+                }
+            }
+
+            // comments are added as a note for the compound
+            if (note.empty()) {
+                compound->setNote(value);
+            } else {
+                note.pop_back();
+                compound->setNote(note);
+            }
+        } else if (valueFor(line,
+                            upperLine,
+                            {"NUM PEAKS:", "NUMPEAKS:"},
+                            value)) {
+            capturePeaks = true;
+        } else if (capturePeaks) {
+            istringstream peakLine(line);
+            float mz = -1.0f;
+            float intensity = -1.0f;
+            if (peakLine >> mz >> intensity
+                && mz >= 0.0f
+                && intensity >= 0.0f) {
+                mzValues.push_back(mz);
+                intensities.push_back(intensity);
+
+                string annotation;
+                if (peakLine >> annotation)
+                    ionTypes[mzValues.size() - 1] = annotation;
+            }
+        }
+    }
+    saveCompound();
+
+    myfile.close();
+    return readCount;
+}
+
 Compound* Databases::extractCompoundfromEachLine(vector<string>& fields, map<string, int> & header, int loadCount, string filename) {
     string id, name, formula, polarityString;
     string note;
@@ -242,3 +478,52 @@ void Databases::closeAll() {
     //mzUtils::delete_all(fragmentsDB);
     //mzUtils::delete_all(reactionsDB);
 }
+
+///////////////////////////Test Cases//////////////////////////////
+
+TEST_CASE("Testing NIST library loading")
+{
+    auto path = boost::filesystem::temp_directory_path()
+                / boost::filesystem::unique_path("%%%%-%%%%-%%%%.msp");
+    string filename = path.string();
+    ofstream library(filename);
+    library << "NAME: Citrate\n"
+            << "FORMULA: C6H8O7\n"
+            << "ION MODE: Negative\n"
+            << "TAG: virtual\n"
+            << "Num Peaks: 2\n"
+            << "87.0088 100 frag1\n"
+            << "111.0088 45.5\n"
+            << "\n"
+            << "Name: Alanine\n"
+            << "PrecursorMZ: 90.055\n"
+            << "Ion_mode: P\n"
+            << "Comments: \"SMILES=CC(N)C(O)=O\" \"kegg=C00041\" "
+            << "\"hmdb=HMDB0000161\"\n"
+            << "Num Peaks: 1\n"
+            << "44.0495 999\n";
+    library.close();
+
+    Databases db;
+    int loadCount = db.loadNISTLibrary(filename);
+    boost::filesystem::remove(path);
+    REQUIRE(loadCount == 2);
+
+    Compound* citrate = db.compoundsDB[1];
+    REQUIRE(citrate->name() == "Citrate");
+    REQUIRE(citrate->virtualFragmentation());
+    REQUIRE(citrate->ionizationMode == Compound::IonizationMode::Negative);
+    REQUIRE(citrate->fragmentMzValues().size() == 2);
+    REQUIRE(citrate->fragmentIonTypes().at(0) == "frag1");
+
+    Compound* alanine = db.compoundsDB[0];
+    REQUIRE(alanine->name() == "Alanine");
+    REQUIRE(!alanine->virtualFragmentation());
+    REQUIRE(alanine->ionizationMode == Compound::IonizationMode::Positive);
+    REQUIRE(alanine->id() == "C00041");
+    REQUIRE(alanine->smileString() == "CC(N)C(O)=O");
+    REQUIRE(alanine->precursorMz() == doctest::Approx(90.055));
+    REQUIRE(alanine->fragmentMzValues().size() == 1);
+
+    delete_all(db.compoundsDB);
+}
@@ -1,6 +1,8 @@
 #ifndef DATABASES_H
 #define DATABASES_H
 
+#include <functional>
+
 #include "standardincludes.h"
 
 class Compound;
@@ -12,6 +14,29 @@ class Databases {
     public:
         bool addCompound(Compound* c);
         int loadCompoundCSVFile(string filename);
+
+        /**
+         * @brief Load compounds (along with their fragment spectra) from a
+         * spectral library in NIST MSP format.
+         * @param filename Path to the MSP file.
+         * @return Number of compounds loaded.
+         */
+        int loadNISTLibrary(string filename);
+
+        /**
+         * @brief Read the records of a spectral library in NIST MSP format.
+         * @details Shared by all loaders of MSP files, so that libraries are
+         * read the same way everywhere.
+         * @param filename Path to the MSP file.
+         * @param onCompound Called with each compound read, which is then
+         * owned by the callee.
+         * @param onLine Called with the number of lines read so far, for
+         * reporting progress.
+         * @return Number of compounds read.
+         */
+        static int readNISTLibrary(const string& filename,
+                                   function<void(Compound*)> onCompound,
+                                   function<void(int)> onLine = nullptr);
         vector<Compound*> getCompoundsSubset(string dbname);
         Compound* extractCompoundfromEachLine(vector<string>& fields, map<string, int> & header, int loadCount, string filename);
         float getChargeFromDB(vector<string>& fields, map<string, int> & header);
@@ -0,0 +1,135 @@
+#include <random>
+
+#include "doctest.h"
+#include "EIC.h"
+#include "eicindex.h"
+#include "mzSample.h"
+#include "Scan.h"
+#include "scanstore.h"
+
+EicIndex::EicIndex(const deque<Scan*>& scans, float binWidth)
+    : _minMz(FLT_MAX), _maxMz(-FLT_MAX), _binWidth(binWidth)
+{
+    for (Scan* scan : scans) {
+        ScanPin pin(scan);
+        for (float mz : scan->mz) {
+            _minMz = min(_minMz, mz);
+            _maxMz = max(_maxMz, mz);
+        }
+    }
+    if (_minMz > _maxMz || !(_binWidth > 0.0f))
+        return;
+
+    // limit the size of the bin directory for samples with outlying m/z
+    const float maxBins = 1 << 24;
+    if ((_maxMz - _minMz) / _binWidth >= maxBins)
+        _binWidth = (_maxMz - _minMz) / (maxBins - 1);
+
+    // counting sort of all peaks by bin, which keeps the peaks of a bin
+    // ordered by scan and position in the scan
+    _binStarts.assign(_bin(_maxMz) + 2, 0);
+    for (Scan* scan : scans) {
+        ScanPin pin(scan);
+        for (float mz : scan->mz)
+            ++_binStarts[_bin(mz) + 1];
+    }
+    for (size_t bin = 1; bin < _binStarts.size(); ++bin)
+        _binStarts[bin] += _binStarts[bin - 1];
+
+    _peaks.resize(_binStarts.back());
+    vector<size_t> next(_binStarts.begin(), _binStarts.end() - 1);
+    for (unsigned int i = 0; i < scans.size(); ++i) {
+        Scan* scan = scans[i];
+        ScanPin pin(scan);
+        size_t numPeaks = min(scan->mz.size(), scan->intensity.size());
+        for (size_t j = 0; j < scan->mz.size(); ++j) {
+            float intensity = j < numPeaks ? scan->intensity[j] : 0.0f;
+            _peaks[next[_bin(scan->mz[j])]++] = {i, scan->mz[j], intensity};
+        }
+    }
+}
+
+size_t EicIndex::memoryUsage() const
+{
+    return _peaks.capacity() * sizeof(_Peak)
+           + _binStarts.capacity() * sizeof(size_t);
+}
+
+///////////////////////////Test Cases//////////////////////////////
+
+TEST_CASE("Testing EIC extraction from an m/z index")
+{
+    mt19937 generator(11);
+    uniform_real_distribution<float> mzDistribution(100.0f, 120.0f);
+    uniform_real_distribution<float> intensityDistribution(0.0f, 1e5f);
+
+    mzSample sample;
+    for (int i = 0; i < 300; ++i) {
+        int mslevel = i % 5 == 0 ? 2 : 1;
+        Scan* scan = new Scan(&sample, i, mslevel, i * 0.05f, 0.0f, 1);
+        scan->filterLine = i % 2 == 0 ? "even" : "odd";
+        for (int j = 0; j < 200; ++j) {
+            float mz = mzDistribution(generator);
+
+            // repeated m/z values test that ties are broken as in scans
+            if (j % 50 == 0)
+                mz = 110.0f;
+            scan->mz.push_back(mz);
+            scan->intensity.push_back(
+                j % 7 == 0 ? 5e4f : intensityDistribution(generator));
+        }
+        sort(scan->mz.begin(), scan->mz.end());
+        sample.addScan(scan);
+    }
+    sample.calculateMzRtRange();
+
+    auto extractEics = [&sample](vector<EIC*>& eics) {
+        for (float mzmin : {99.0f, 100.0f, 104.37f, 110.0f, 119.995f}) {
+            for (float width : {0.001f, 0.01f, 0.5f, 30.0f}) {
+                for (int eicType : {EIC::MAX, EIC::SUM}) {
+                    for (string filterLine : {"", "odd"}) {
+                        eics.push_back(sample.getEIC(mzmin,
+                                                     mzmin + width,
+                                                     2.0f,
+                                                     11.0f,
+                                                     1,
+                                                     eicType,
+                                                     filterLine));
+                        eics.push_back(sample.getEIC(mzmin,
+                                                     mzmin + width,
+                                                     0.0f,
+                                                     100.0f,
+                                                     2,
+                                                     eicType,
+                                                     filterLine));
+                    }
+                }
+            }
+        }
+    };
+
+    vector<EIC*> scannedEics;
+    extractEics(scannedEics);
+
+    sample.buildEicIndex(0.05f);
+    REQUIRE(sample.eicIndex() != nullptr);
+    REQUIRE(sample.eicIndex()->size() == 300 * 200);
+    vector<EIC*> indexedEics;
+    extractEics(indexedEics);
+
+    REQUIRE(scannedEics.size() == indexedEics.size());
+    for (size_t i = 0; i < scannedEics.size(); ++i) {
+        EIC* scanned = scannedEics[i];
+        EIC* indexed = indexedEics[i];
+        REQUIRE(scanned->scannum == indexed->scannum);
+        REQUIRE(scanned->rt == indexed->rt);
+        REQUIRE(scanned->mz == indexed->mz);
+        REQUIRE(scanned->intensity == indexed->intensity);
+        REQUIRE(scanned->totalIntensity == indexed->totalIntensity);
+        REQUIRE(scanned->maxIntensity == indexed->maxIntensity);
+        REQUIRE(scanned->rtAtMaxIntensity == indexed->rtAtMaxIntensity);
+        REQUIRE(scanned->mzAtMaxIntensity == indexed->mzAtMaxIntensity);
+    }
+    delete_all(scannedEics);
+    delete_all(indexedEics);
+}
@@ -0,0 +1,113 @@
+#ifndef EICINDEX_H
+#define EICINDEX_H
+
+#include "standardincludes.h"
+
+class Scan;
+
+using namespace std;
+
+/**
+ * @class EicIndex
+ * @ingroup libmaven
+ * @brief An inverted index of the peaks of a sample, binned by m/z, for
+ * extracting EICs without searching every scan.
+ * @details Every peak of every scan is copied into one array, ordered by its
+ * m/z bin and, within a bin, by scan and position in the scan. An EIC over a
+ * narrow m/z window only has to visit the few bins that overlap the window,
+ * and within each bin can jump directly to the first scan of interest.
+ * Since bins are visited in increasing m/z order, the peaks of any one scan
+ * are visited in the same order as they appear in that scan.
+ *
+ * The index costs 12 bytes per peak and reflects the peak arrays of the
+ * scans as they were when it was built.
+ */
+class EicIndex
+{
+public:
+    /**
+     * @brief Index the peaks of the given scans.
+     * @param scans Scans of a sample. Scans are identified by their position
+     * in this container.
+     * @param binWidth Width of m/z bins in Da. Narrower bins make lookups
+     * more precise at the cost of a larger bin directory.
+     */
+    EicIndex(const deque<Scan*>& scans, float binWidth = 0.01f);
+
+    /**
+     * @brief Visit all indexed peaks with m/z in [mzmin, mzmax] that belong
+     * to scans at positions [firstScan, lastScan].
+     * @param visit Callable as `visit(scanIndex, mz, intensity)`. Peaks of a
+     * scan are visited in increasing order of m/z.
+     */
+    template<typename Visitor>
+    void forEachPeak(float mzmin,
+                     float mzmax,
+                     unsigned int firstScan,
+                     unsigned int lastScan,
+                     Visitor visit) const
+    {
+        if (_binStarts.size() < 2
+            || mzmax < mzmin
+            || mzmax < _minMz
+            || mzmin > _maxMz) {
+            return;
+        }
+
+        size_t numBins = _binStarts.size() - 1;
+        size_t firstBin = mzmin <= _minMz ? 0 : _bin(mzmin);
+        size_t lastBin = mzmax >= _maxMz ? numBins - 1 : _bin(mzmax);
+
+        for (size_t bin = firstBin; bin <= lastBin; ++bin) {
+            auto first = _peaks.begin() + _binStarts[bin];
+            auto last = _peaks.begin() + _binStarts[bin + 1];
+            auto peak = lower_bound(first,
+                                    last,
+                                    firstScan,
+                                    [](const _Peak& p, unsigned int scan) {
+                                        return p.scan < scan;
+                                    });
+            for (; peak != last && peak->scan <= lastScan; ++peak) {
+                if (peak->mz < mzmin || peak->mz > mzmax)
+                    continue;
+                visit(peak->scan, peak->mz, peak->intensity);
+            }
+        }
+    }
+
+    /**
+     * @brief Number of indexed peaks.
+     */
+    size_t size() const { return _peaks.size(); }
+
+    /**
+     * @brief Approximate memory used by the index, in bytes.
+     */
+    size_t memoryUsage() const;
+
+private:
+    struct _Peak
+    {
+        unsigned int scan;
+        float mz;
+        float intensity;
+    };
+
+    float _minMz;
+    float _maxMz;
+    float _binWidth;
+    vector<_Peak> _peaks;
+
+    /**
+     * @brief Position in `_peaks` of the first peak of every bin, followed by
+     * the total number of peaks.
+     */
+    vector<size_t> _binStarts;
+
+    inline size_t _bin(float mz) const
+    {
+        return static_cast<size_t>((mz - _minMz) / _binWidth);
+    }
+};
+
+#endif // EICINDEX_H
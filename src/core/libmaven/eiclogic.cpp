@@ -1,10 +1,77 @@
+#include <omp.h>
+
+#include "classifierNeuralNet.h"
 #include "Compound.h"
+#include "doctest.h"
 #include "EIC.h"
 #include "eiclogic.h"
 #include "masscutofftype.h"
 #include "mavenparameters.h"
 #include "mzSample.h"
+#include "mzUtils.h"
 #include "PeakDetector.h"
+#include "peakFiltering.h"
+
+EICSet::~EICSet()
+{
+    mzUtils::delete_all(eics);
+}
+
+bool EICCache::Key::operator==(const Key& other) const
+{
+    return mzmin == other.mzmin
+           && mzmax == other.mzmax
+           && srmId == other.srmId
+           && compound == other.compound
+           && adduct == other.adduct
+           && samples == other.samples
+           && parameters == other.parameters
+           && groupPeaks == other.groupPeaks;
+}
+
+EICCache::EICCache(size_t maxEICs) : _maxEICs(maxEICs), _eicCount(0)
+{
+}
+
+shared_ptr<EICSet> EICCache::find(const Key& key)
+{
+    auto entry = find_if(_sets.begin(),
+                         _sets.end(),
+                         [&key](const pair<Key, shared_ptr<EICSet>>& entry) {
+                             return entry.first == key;
+                         });
+    if (entry == _sets.end())
+        return nullptr;
+
+    _sets.splice(_sets.begin(), _sets, entry);
+    return _sets.front().second;
+}
+
+void EICCache::insert(const Key& key, shared_ptr<EICSet> set)
+{
+    auto entry = find_if(_sets.begin(),
+                         _sets.end(),
+                         [&key](const pair<Key, shared_ptr<EICSet>>& entry) {
+                             return entry.first == key;
+                         });
+    if (entry != _sets.end()) {
+        _eicCount -= entry->second->eics.size();
+        _sets.erase(entry);
+    }
+
+    _sets.emplace_front(key, set);
+    _eicCount += set->eics.size();
+    while (_sets.size() > 1 && _eicCount > _maxEICs) {
+        _eicCount -= _sets.back().second->eics.size();
+        _sets.pop_back();
+    }
+}
+
+void EICCache::clear()
+{
+    _sets.clear();
+    _eicCount = 0;
+}
 
 EICLogic::EICLogic() {
 	_slice = mzSlice(0, 0.01, 0, 0.01);
@@ -69,7 +136,7 @@ void EICLogic::groupPeaks(mzSlice* slice, MavenParameters *mp)
 {
     peakgroups = EIC::groupPeaks(eics,
                                  slice,
-                                 make_shared<MavenParameters>(*mp));
+                                 MavenParameters::snapshot(*mp));
 
     // keep only top X groups ( ranked by intensity )
     EIC::removeLowRankGroups(peakgroups, 50);
@@ -99,13 +166,70 @@ void EICLogic::getEIC(mzSlice bounds,
     slice.rtmax = bounds.rtmax;
 
     // get eics
-    eics = PeakDetector::pullEICs(&slice, samples, mp);
+    auto set = make_shared<EICSet>();
+    set->eics = PeakDetector::pullEICs(&slice, samples, mp);
+    setEICSet(set);
+}
 
-        //find peaks
-	//for(int i=0; i < eics.size(); i++ )  eics[i]->getPeakPositions(eic_smoothingWindow);
-	//for(int i=0; i < eics.size(); i++ ) mzUtils::printF(eics[i]->intensity);
-	////qDebug << tr("computeEICs() Done. ElepsTime=%1 msec").arg(timer.elapsed());
+shared_ptr<EICSet>
+EICLogic::pullEICSet(const mzSlice& slice,
+                     const vector<mzSample*>& samples,
+                     MavenParameters* mp,
+                     ClassifierNeuralNet* clsf,
+                     bool groupPeaks,
+                     function<bool(shared_ptr<EICSet>, size_t)> pulled)
+{
+    auto set = make_shared<EICSet>();
+    set->eics.reserve(samples.size());
+
+    // every thread pulls one sample of each chunk
+    size_t chunkSize = static_cast<size_t>(max(omp_get_max_threads(), 1));
+    PeakFiltering peakFiltering(mp, false);
+    for (size_t first = 0; first < samples.size(); first += chunkSize) {
+        size_t last = min(first + chunkSize, samples.size());
+        vector<mzSample*> chunk(samples.begin() + first,
+                                samples.begin() + last);
+        vector<EIC*> eics = PeakDetector::pullEICs(&slice, chunk, mp);
+        if (clsf != nullptr)
+            clsf->scoreEICs(eics);
+        peakFiltering.filter(eics);
+
+        // at most one EIC is pulled per sample, so this never reallocates
+        set->eics.insert(set->eics.end(), eics.begin(), eics.end());
+        if (pulled && !pulled(set, set->eics.size()))
+            return nullptr;
+    }
+
+    if (groupPeaks) {
+        mzSlice groupSlice = slice;
+        set->peakgroups = EIC::groupPeaks(set->eics,
+                                          &groupSlice,
+                                          MavenParameters::snapshot(*mp));
+
+        // keep only top X groups ( ranked by intensity )
+        EIC::removeLowRankGroups(set->peakgroups, 50);
+    }
+    return set;
+}
 
+void EICLogic::setEICSet(shared_ptr<EICSet> set, size_t count)
+{
+    eicSet = set;
+    eics.assign(set->eics.begin(), set->eics.begin() + count);
+    peakgroups.clear();
+    if (count < set->eics.size())
+        return;
+
+    peakgroups = set->peakgroups;
+    for (auto& group : peakgroups)
+        group.setSlice(_slice);
+}
+
+void EICLogic::clearEICs()
+{
+    eics.clear();
+    peakgroups.clear();
+    eicSet = nullptr;
 }
 
 mzSlice EICLogic::visibleEICBounds() {
@@ -145,3 +269,60 @@ mzSlice EICLogic::visibleSamplesBounds(vector<mzSample*> samples) {
 	}
 	return bounds;
 }
+
+///////////////////////////Test Cases//////////////////////////////
+
+TEST_CASE("Testing EIC cache")
+{
+    auto makeSet = [](size_t size) {
+        auto set = make_shared<EICSet>();
+        for (size_t i = 0; i < size; ++i)
+            set->eics.push_back(new EIC());
+        return set;
+    };
+    auto makeKey = [](float mz) {
+        EICCache::Key key;
+        key.mzmin = mz - 0.01f;
+        key.mzmax = mz + 0.01f;
+        return key;
+    };
+
+    EICCache cache(10);
+    auto first = makeSet(4);
+    auto second = makeSet(4);
+    cache.insert(makeKey(100.0f), first);
+    cache.insert(makeKey(200.0f), second);
+    REQUIRE(cache.size() == 2);
+    REQUIRE(cache.eicCount() == 8);
+    REQUIRE(cache.find(makeKey(100.0f)) == first);
+    REQUIRE(cache.find(makeKey(300.0f)) == nullptr);
+
+    // keys differing in anything but m/z are different too
+    auto grouped = makeKey(100.0f);
+    grouped.groupPeaks = true;
+    REQUIRE(cache.find(grouped) == nullptr);
+
+    // the set for 200 is now the least recently used, and makes room
+    cache.insert(makeKey(300.0f), makeSet(4));
+    REQUIRE(cache.size() == 2);
+    REQUIRE(cache.eicCount() == 8);
+    REQUIRE(cache.find(makeKey(200.0f)) == nullptr);
+    REQUIRE(cache.find(makeKey(100.0f)) == first);
+
+    // replacing a set does not count it twice
+    cache.insert(makeKey(100.0f), makeSet(2));
+    REQUIRE(cache.size() == 2);
+    REQUIRE(cache.eicCount() == 6);
+
+    // a set larger than the cache is kept until the next one
+    cache.insert(makeKey(400.0f), makeSet(12));
+    REQUIRE(cache.size() == 1);
+    REQUIRE(cache.eicCount() == 12);
+
+    cache.clear();
+    REQUIRE(cache.size() == 0);
+    REQUIRE(cache.eicCount() == 0);
+
+    // sets outlive the cache while they are being shown
+    REQUIRE(second->eics.size() == 4);
+}
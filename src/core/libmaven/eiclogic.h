@@ -1,10 +1,15 @@
 #ifndef EICLOGIC_H
 #define EICLOGIC_H
 
+#include <functional>
+#include <list>
+
 #include "datastructures/mzSlice.h"
 #include "PeakGroup.h"
 #include "standardincludes.h"
 
+class Adduct;
+class ClassifierNeuralNet;
 class Compound;
 class EIC;
 class mzSlice;
@@ -12,6 +17,74 @@ class MassCutoff;
 class mzSample;
 class MavenParameters;
 
+/**
+ * @brief EICs pulled for a slice, along with the groups of their peaks.
+ * @details A set owns its EICs, which are deleted along with it. Sets are
+ * shared (e.g., by a widget showing them and a cache of recent slices), and
+ * must not be modified once pulled, other than to display them.
+ */
+struct EICSet
+{
+    ~EICSet();
+
+    vector<EIC*> eics;
+    vector<PeakGroup> peakgroups;
+};
+
+/**
+ * @brief Cache of recently pulled EIC sets.
+ * @details Sets are dropped, least recently used first, once the cache holds
+ * more than a given number of EICs in all. The most recently inserted set is
+ * always kept, however large.
+ */
+class EICCache
+{
+public:
+    /**
+     * @brief What a set was pulled for. EICs are always pulled over the full
+     * RT range of their samples, so the RT range of slices is not part of it.
+     */
+    struct Key
+    {
+        float mzmin = 0.0f;
+        float mzmax = 0.0f;
+        string srmId;
+        Compound* compound = nullptr;
+        Adduct* adduct = nullptr;
+        vector<mzSample*> samples;
+        shared_ptr<MavenParameters> parameters;
+        bool groupPeaks = false;
+
+        bool operator==(const Key& other) const;
+    };
+
+    EICCache(size_t maxEICs);
+
+    /**
+     * @brief Find the set pulled for a key, marking it as recently used.
+     * @return The set, or nullptr if not cached.
+     */
+    shared_ptr<EICSet> find(const Key& key);
+
+    /**
+     * @brief Add the set pulled for a key, replacing any set cached for it.
+     */
+    void insert(const Key& key, shared_ptr<EICSet> set);
+
+    void clear();
+
+    size_t size() const { return _sets.size(); }
+
+    size_t eicCount() const { return _eicCount; }
+
+private:
+    size_t _maxEICs;
+    size_t _eicCount;
+
+    // most recently used first
+    list<pair<Key, shared_ptr<EICSet>>> _sets;
+};
+
 class EICLogic {
 public:
 	EICLogic();
@@ -85,11 +158,56 @@ public:
 
     void getEIC(mzSlice bounds, vector<mzSample*> samples, MavenParameters* mp);
 
+    /**
+     * @brief Pull the EICs of a slice from the given samples, then score and
+     * filter their peaks, and group them if asked to.
+     * @details Samples are pulled a few at a time. After each of these
+     * chunks, `pulled` (if given) is called with the set and the number of
+     * its EICs that are complete, and the pull is abandoned if it returns
+     * false. Room for all EICs is reserved beforehand, so the complete ones
+     * may be read by another thread while later ones are being pulled.
+     * @param slice Slice to pull, over its RT range.
+     * @param samples Samples to pull from.
+     * @param mp Parameters for pulling, filtering and grouping.
+     * @param clsf Classifier scoring peaks, if any.
+     * @param groupPeaks Whether peaks should be grouped.
+     * @param pulled Function called as EICs are pulled.
+     * @return The set, or nullptr if abandoned.
+     */
+    static shared_ptr<EICSet> pullEICSet(
+        const mzSlice& slice,
+        const vector<mzSample*>& samples,
+        MavenParameters* mp,
+        ClassifierNeuralNet* clsf,
+        bool groupPeaks,
+        function<bool(shared_ptr<EICSet>, size_t)> pulled = nullptr);
+
+    /**
+     * @brief Show the first `count` EICs of a set, and the groups of the set
+     * once all of its EICs are shown. Groups are given the current slice.
+     */
+    void setEICSet(shared_ptr<EICSet> set, size_t count);
+
+    /**
+     * @brief Show all EICs and groups of a set.
+     */
+    void setEICSet(shared_ptr<EICSet> set)
+    {
+        setEICSet(set, set->eics.size());
+    }
+
+    /**
+     * @brief Stop showing any EICs and groups, releasing the set they belong
+     * to.
+     */
+    void clearEICs();
+
         //associate compound names with peak groups
 	void associateNameWithPeakGroups();
 
 	mzSlice _slice;						// current slice
 	vector<EIC*> eics;				// vectors mass slices one from each sample
+	shared_ptr<EICSet> eicSet;		// set owning the shown eics
 	deque<EIC*> tics;				// vectors total chromatogram intensities
 	vector<PeakGroup> peakgroups;	    //peaks grouped across samples
 
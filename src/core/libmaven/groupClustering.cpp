@@ -0,0 +1,273 @@
+#include "doctest.h"
+#include "EIC.h"
+#include "groupClustering.h"
+#include "masscutofftype.h"
+#include "mavenparameters.h"
+#include "mzSample.h"
+#include "mzUtils.h"
+#include "PeakGroup.h"
+#include "quantmatrix.h"
+#include "Scan.h"
+
+GroupClustering::GroupClustering(const vector<mzSample*>& samples,
+                                 MassCutoff* massCutoff,
+                                 int eicType,
+                                 string filterline)
+    : _samples(samples)
+    , _massCutoff(massCutoff)
+    , _eicType(eicType)
+    , _filterline(filterline)
+    , _maxRtDiff(0.5)
+    , _minSampleCorrelation(0.6)
+    , _minRtCorrelation(0.8)
+{
+}
+
+mzSample* GroupClustering::_apexSample(PeakGroup* group)
+{
+    mzSample* apexSample = nullptr;
+    float maxIntensity = 0.0f;
+    for (auto& peak : group->peaks) {
+        if (apexSample == nullptr || peak.peakIntensity > maxIntensity) {
+            apexSample = peak.getSample();
+            maxIntensity = peak.peakIntensity;
+        }
+    }
+    return apexSample;
+}
+
+vector<float> GroupClustering::_eicIntensities(mzSample* sample,
+                                               float mz,
+                                               PeakGroup* group) const
+{
+    float cutoff = _massCutoff->massCutoffValue(mz);
+    EIC* eic = sample->getEIC(mz - cutoff,
+                              mz + cutoff,
+                              group->minRt,
+                              group->maxRt,
+                              1,
+                              _eicType,
+                              _filterline);
+    vector<float> intensities;
+    swap(intensities, eic->intensity);
+    delete eic;
+    return intensities;
+}
+
+int GroupClustering::cluster(const vector<PeakGroup*>& groups)
+{
+    vector<int> ids = clusterIds(groups);
+    for (size_t i = 0; i < groups.size(); ++i)
+        groups[i]->clusterId = ids[i];
+    return ids.empty() ? 0 : *max_element(begin(ids), end(ids));
+}
+
+vector<int> GroupClustering::clusterIds(const vector<PeakGroup*>& groups)
+{
+    // indexes of the given groups, in order of their RT
+    vector<int> order(groups.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    stable_sort(begin(order), end(order), [&groups](int a, int b) {
+        return groups[a]->meanRt < groups[b]->meanRt;
+    });
+    vector<PeakGroup*> sortedGroups;
+    for (auto index : order)
+        sortedGroups.push_back(groups[index]);
+
+    int numGroups = sortedGroups.size();
+    QuantMatrix quantMatrix(sortedGroups, _samples, PeakGroup::AreaTop);
+    vector<vector<float>> intensityVectors(numGroups);
+    vector<mzSample*> apexSamples(numGroups, nullptr);
+#pragma omp parallel for schedule(dynamic, 64)
+    for (int i = 0; i < numGroups; ++i) {
+        PeakGroup* group = sortedGroups[i];
+        intensityVectors[i] = quantMatrix.rowVector(i);
+        apexSamples[i] = _apexSample(group);
+    }
+
+    vector<float> rts(numGroups);
+    for (int i = 0; i < numGroups; ++i)
+        rts[i] = sortedGroups[i]->meanRt;
+
+    // cluster IDs of the sorted groups, zero while unclustered
+    vector<int> sortedIds(numGroups, 0);
+    int clusterCount = 0;
+    map<int, int> parentIndexes;
+    for (int i = 0; i < numGroups; ++i) {
+        PeakGroup* group = sortedGroups[i];
+        if (sortedIds[i] == 0) {
+            sortedIds[i] = ++clusterCount;
+            parentIndexes[clusterCount] = i;
+        }
+
+        if (i % 10 == 0)
+            boostSignal("Clustering…", i + 1, numGroups);
+
+        mzSample* apexSample = apexSamples[i];
+        if (apexSample == nullptr)
+            continue;
+
+        // only unclustered groups that lie within the RT window of this
+        // group's cluster parent are candidates; a small margin is kept on
+        // the bounds so that the exact check below has the final say
+        PeakGroup* parent = sortedGroups[parentIndexes[sortedIds[i]]];
+        float rtWindow = _maxRtDiff * 2;
+        auto first = lower_bound(begin(rts),
+                                 end(rts),
+                                 parent->meanRt - rtWindow - 0.001f);
+        vector<int> candidates;
+        for (auto rt = first; rt != end(rts); ++rt) {
+            if (*rt > parent->meanRt + rtWindow + 0.001f)
+                break;
+            int j = rt - begin(rts);
+            PeakGroup* other = sortedGroups[j];
+            float rtDist = abs(parent->meanRt - other->meanRt);
+            if (sortedIds[j] == 0 && !(rtDist > _maxRtDiff * 2))
+                candidates.push_back(j);
+        }
+        if (candidates.empty())
+            continue;
+
+        // EIC of this group in its apex sample, shared by all candidates
+        vector<float> groupEic;
+        bool groupEicReady = false;
+
+        int numCandidates = candidates.size();
+        vector<char> clustered(numCandidates, 0);
+#pragma omp parallel for schedule(dynamic, 4)
+        for (int k = 0; k < numCandidates; ++k) {
+            PeakGroup* other = sortedGroups[candidates[k]];
+
+            float rtOverlap = mzUtils::checkOverlap(group->minRt,
+                                                    group->maxRt,
+                                                    other->minRt,
+                                                    other->maxRt);
+            if (rtOverlap < 0.1)
+                continue;
+
+            float sampleCorrelation =
+                mzUtils::correlation(intensityVectors[i],
+                                     intensityVectors[candidates[k]]);
+            if (sampleCorrelation < _minSampleCorrelation)
+                continue;
+
+#pragma omp critical(clusterGroupEic)
+            {
+                if (!groupEicReady) {
+                    groupEic = _eicIntensities(apexSample, group->meanMz, group);
+                    groupEicReady = true;
+                }
+            }
+            vector<float> otherEic = _eicIntensities(apexSample,
+                                                     other->meanMz,
+                                                     group);
+            float shapeCorrelation = mzUtils::correlation(groupEic, otherEic);
+            if (shapeCorrelation < _minRtCorrelation)
+                continue;
+
+            clustered[k] = 1;
+        }
+
+        for (int k = 0; k < numCandidates; ++k) {
+            if (clustered[k])
+                sortedIds[candidates[k]] = sortedIds[i];
+        }
+    }
+
+    boostSignal("Clustering done!", numGroups, numGroups);
+
+    vector<int> ids(numGroups);
+    for (int i = 0; i < numGroups; ++i)
+        ids[order[i]] = sortedIds[i];
+    return ids;
+}
+
+///////////////////////////Test Cases//////////////////////////////
+
+TEST_CASE("Testing group clustering")
+{
+    // features of the synthetic samples: m/z, apex RT and the scale of the
+    // peak in each sample; the first two co-elute and correlate across
+    // samples, the third co-elutes but does not correlate, the fourth
+    // correlates but elutes 0.3 min after the first and the last one elutes
+    // much later
+    vector<float> mzs = {100.0f, 150.0f, 200.0f, 250.0f, 300.0f};
+    vector<float> apexRts = {2.0f, 2.02f, 2.05f, 2.3f, 6.0f};
+    vector<vector<float>> scales = {{1.0f, 2.0f, 3.0f},
+                                    {2.0f, 4.0f, 6.0f},
+                                    {3.0f, 1.0f, 2.0f},
+                                    {1.0f, 2.0f, 3.0f},
+                                    {1.0f, 2.0f, 3.0f}};
+    float sigma = 0.5f;
+
+    vector<mzSample*> samples;
+    for (int s = 0; s < 3; ++s) {
+        auto sample = new mzSample();
+        for (int i = 0; i <= 400; ++i) {
+            float rt = i * 0.02f;
+            Scan* scan = new Scan(sample, i, 1, rt, 0, 1);
+            for (size_t f = 0; f < mzs.size(); ++f) {
+                float delta = (rt - apexRts[f]) / sigma;
+                scan->mz.push_back(mzs[f]);
+                scan->intensity.push_back(
+                    1e5f * scales[f][s] * exp(-0.5f * delta * delta) + 10.0f);
+            }
+            sample->addScan(scan);
+        }
+        sample->calculateMzRtRange();
+        samples.push_back(sample);
+    }
+
+    // groups are given in an order different from their RTs
+    auto parameters = make_shared<MavenParameters>();
+    vector<int> featureOrder = {3, 0, 4, 2, 1};
+    vector<PeakGroup*> groups;
+    for (auto f : featureOrder) {
+        auto group = new PeakGroup(parameters,
+                                   PeakGroup::IntegrationType::Automated);
+        group->meanMz = mzs[f];
+        group->meanRt = apexRts[f];
+        group->minRt = apexRts[f] - 1.5f;
+        group->maxRt = apexRts[f] + 1.5f;
+        for (int s = 0; s < 3; ++s) {
+            Peak peak;
+            peak.setSample(samples[s]);
+            peak.peakAreaTopCorrected = 1e5f * scales[f][s];
+            peak.peakIntensity = 1e5f * scales[f][s];
+            group->addPeak(peak);
+        }
+        groups.push_back(group);
+    }
+
+    MassCutoff massCutoff;
+    massCutoff.setMassCutoffAndType(10.0, "ppm");
+    GroupClustering clustering(samples, &massCutoff, EIC::MAX, "");
+
+    SUBCASE("Testing clusters within a wide RT window")
+    {
+        clustering.setMaxRtDifference(0.5);
+        vector<int> ids = clustering.clusterIds(groups);
+        REQUIRE(ids == vector<int>({1, 1, 3, 2, 1}));
+
+        // computing IDs leaves the groups untouched
+        for (auto group : groups)
+            REQUIRE(group->clusterId == 0);
+
+        REQUIRE(clustering.cluster(groups) == 3);
+        for (size_t i = 0; i < groups.size(); ++i)
+            REQUIRE(groups[i]->clusterId == ids[i]);
+    }
+
+    SUBCASE("Testing RT window cutoff")
+    {
+        // the fourth feature is now too far from the parent of the first
+        // cluster, and of every other cluster, to be compared with them
+        clustering.setMaxRtDifference(0.1);
+        vector<int> ids = clustering.clusterIds(groups);
+        REQUIRE(ids == vector<int>({3, 1, 4, 2, 1}));
+    }
+
+    mzUtils::delete_all(groups);
+    mzUtils::delete_all(samples);
+}
@@ -0,0 +1,111 @@
+#ifndef GROUPCLUSTERING_H
+#define GROUPCLUSTERING_H
+
+#include <boost/signals2.hpp>
+
+#include "standardincludes.h"
+
+class MassCutoff;
+class mzSample;
+class PeakGroup;
+
+using namespace std;
+
+/**
+ * @class GroupClustering
+ * @ingroup libmaven
+ * @brief Cluster peak-groups that are likely to have arisen from the same
+ * compound, i.e., groups that co-elute, have correlated intensities across
+ * samples and correlated peak shapes.
+ * @details Groups are swept in order of retention time and each group is only
+ * compared against unclustered groups that lie within an RT window around
+ * its cluster's parent. Intensity vectors and the apex-sample EIC of every
+ * group are computed only once, and candidate pairs for a group are
+ * evaluated in parallel.
+ */
+class GroupClustering
+{
+public:
+    boost::signals2::signal<void (const string&, unsigned int, int)>
+        boostSignal;
+
+    /**
+     * @brief Constructor of class GroupClustering.
+     * @param samples Samples whose intensities will be correlated.
+     * @param massCutoff Mass tolerance used to extract EICs for groups.
+     * @param eicType Type of EIC to be extracted (see `EIC::EicType`).
+     * @param filterline Filterline for which EICs will be extracted.
+     */
+    GroupClustering(const vector<mzSample*>& samples,
+                    MassCutoff* massCutoff,
+                    int eicType,
+                    string filterline);
+
+    /**
+     * @brief Set the maximum RT difference of a group from its cluster's
+     * parent group. Groups are compared within twice this difference.
+     */
+    void setMaxRtDifference(double maxRtDiff) { _maxRtDiff = maxRtDiff; }
+
+    /**
+     * @brief Set the minimum correlation between intensities (across
+     * samples) of two groups, for them to be clustered together.
+     */
+    void setMinSampleCorrelation(double minCorrelation)
+    {
+        _minSampleCorrelation = minCorrelation;
+    }
+
+    /**
+     * @brief Set the minimum correlation between peak shapes (EICs in the
+     * apex sample) of two groups, for them to be clustered together.
+     */
+    void setMinRtCorrelation(double minCorrelation)
+    {
+        _minRtCorrelation = minCorrelation;
+    }
+
+    /**
+     * @brief Assign cluster IDs to the given groups. Any previous cluster
+     * information of these groups is discarded.
+     * @param groups Groups to be clustered. The order of the vector is left
+     * untouched.
+     * @return The number of clusters created.
+     */
+    int cluster(const vector<PeakGroup*>& groups);
+
+    /**
+     * @brief Compute cluster IDs for the given groups, without modifying
+     * them. This allows clustering groups that are shared with another
+     * thread, and assigning the result once it is safe to do so.
+     * @param groups Groups to be clustered.
+     * @return Cluster IDs (starting from 1) of the groups, in the same order
+     * as the given vector.
+     */
+    vector<int> clusterIds(const vector<PeakGroup*>& groups);
+
+private:
+    vector<mzSample*> _samples;
+    MassCutoff* _massCutoff;
+    int _eicType;
+    string _filterline;
+    double _maxRtDiff;
+    double _minSampleCorrelation;
+    double _minRtCorrelation;
+
+    /**
+     * @brief Find the sample in which a group has its most intense peak.
+     * @return Pointer to the sample, or `nullptr` if the group has no peaks.
+     */
+    static mzSample* _apexSample(PeakGroup* group);
+
+    /**
+     * @brief Intensities for an m/z within the RT bounds of a group, in the
+     * given sample.
+     */
+    vector<float> _eicIntensities(mzSample* sample,
+                                  float mz,
+                                  PeakGroup* group) const;
+};
+
+#endif // GROUPCLUSTERING_H
@@ -20,15 +20,12 @@ GroupFiltering::GroupFiltering(MavenParameters *mavenParameters, mzSlice* slice)
 
 void GroupFiltering::filter(vector<PeakGroup> &peakgroups)
 {
-
-    unsigned int i = 0;
-    while (i < peakgroups.size())
-    {
+    // groups that pass all filters are moved towards the front, preserving
+    // their order, and the rest are erased at once
+    size_t numRetained = 0;
+    for (size_t i = 0; i < peakgroups.size(); ++i) {
         if (filterByMS1(peakgroups[i]))
-        {
-            peakgroups.erase(peakgroups.begin() + i);
             continue;
-        }
 
         // only filter for MS2 for groups having targets
         if (_mavenParameters->matchFragmentationFlag
@@ -36,20 +33,20 @@ void GroupFiltering::filter(vector<PeakGroup> &peakgroups)
             && !(peakgroups[i].isAdduct())
             && peakgroups[i].ms2EventCount > 0
             && filterByMS2(peakgroups[i])) {
-            peakgroups.erase(peakgroups.begin() + i);
             continue;
         }
         if (_mavenParameters->matchFragmentationFlag
             && !(peakgroups[i].isAdduct())
             && _mavenParameters->mustHaveFragmentation
             && peakgroups[i].ms2EventCount == 0) {
-            peakgroups.erase(peakgroups.begin() + i);
             continue;
         }
 
-        i++;
+        if (i != numRetained)
+            peakgroups[numRetained] = std::move(peakgroups[i]);
+        ++numRetained;
     }
-
+    peakgroups.erase(peakgroups.begin() + numRetained, peakgroups.end());
 }
 
 bool GroupFiltering::filterByMS1(PeakGroup &peakgroup)
@@ -11,6 +11,7 @@
 #include "peakFiltering.h"
 #include "PeakGroup.h"
 #include "Scan.h"
+#include "scanstore.h"
 
 IsotopeDetection::IsotopeDetection(
     MavenParameters *mavenParameters,
@@ -66,7 +67,7 @@ void IsotopeDetection::pullIsotopes(PeakGroup* parentgroup)
 map<string, PeakGroup> IsotopeDetection::getIsotopes(PeakGroup* parentGroup,
                                                      vector<Isotope> masslist)
 {
-    auto parameters = make_shared<MavenParameters>(*_mavenParameters);
+    auto parameters = MavenParameters::snapshot(*_mavenParameters);
     map<string, PeakGroup> isotopeGroups;
     for (auto sample : _mavenParameters->samples) {
         for (Isotope& isotope : masslist) {
@@ -245,6 +246,7 @@ std::pair<float, float> IsotopeDetection::getIntensity(Scan* scan, float mzmin,
     float highestIntensity = 0.0f;
     float rt = 0.0f;
     for (Scan* s : scansToCheck) {
+        ScanPin pin(s);
         vector<int> matches = s->findMatchingMzs(mzmin, mzmax);
         for (auto match : matches) {
             if (s->intensity[match] > highestIntensity) {
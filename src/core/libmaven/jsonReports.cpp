@@ -15,11 +15,49 @@
 
 using json = nlohmann::json;
 
+namespace {
+
+void appendValue(string& out, double value)
+{
+    // same representation as an ostream with `setprecision(10)`
+    char buffer[32];
+    int length = snprintf(buffer, sizeof(buffer), "%.10g", value);
+    out.append(buffer, length);
+}
+
+void appendValue(string& out, int value)
+{
+    out += to_string(value);
+}
+
+void appendValue(string& out, unsigned int value)
+{
+    out += to_string(value);
+}
+
+void appendValue(string& out, const string& value)
+{
+    out += value;
+}
+
+template<typename T>
+void appendField(string& out, const char* key, const T& value)
+{
+    out += ",\n\"";
+    out += key;
+    out += "\": ";
+    appendValue(out, value);
+}
+
+}
 
 JSONReports::JSONReports(MavenParameters* mp, bool pollyUpload):
     _uploadToPolly(pollyUpload), _mavenParameters(mp){}
 
-void JSONReports::_writeGroup(PeakGroup& grp, ofstream& filename)
+void JSONReports::_writeGroup(const PeakGroup& grp,
+                              int groupId,
+                              int metaGroupId,
+                              string& out)
 {
     //add labels to json file
     char label = grp.label;
@@ -30,31 +68,29 @@ void JSONReports::_writeGroup(PeakGroup& grp, ofstream& filename)
         }
     }
 
-    filename << setprecision(10);
-    filename << "{\n";
-    filename << "\"groupId\": " << grp.groupId ;
+    out += "{\n";
+    out += "\"groupId\": ";
+    appendValue(out, groupId);
 
-    filename << ",\n" << "\"label\": ";
-    filename << "\"";
-    if (label == 'g' || label == 'b') filename << label;
-    filename << "\"";
+    out += ",\n\"label\": \"";
+    if (label == 'g' || label == 'b') out += label;
+    out += "\"";
 
     if(_uploadToPolly) {
         int mlLabel =  (grp.markedGoodByCloudModel) ? 1 : (grp.markedBadByCloudModel) ? -1 : 0;
-        filename  << ",\n" << "\"ml-label\": " << mlLabel;
+        appendField(out, "ml-label", mlLabel);
     }
 
-    filename << ",\n" << "\"metaGroupId\": " << grp.metaGroupId ;
-    filename << ",\n" << "\"meanMz\": " << grp.meanMz  ;
-    filename << ",\n" << "\"meanRt\": " << grp.meanRt ;
-    filename << ",\n" << "\"rtmin\": " << grp.minRt ;
-    filename << ",\n" << "\"rtmax\": " << grp.maxRt ;
-    filename << ",\n" << "\"maxQuality\": " << grp.maxQuality ;
+    appendField(out, "metaGroupId", metaGroupId);
+    appendField(out, "meanMz", grp.meanMz);
+    appendField(out, "meanRt", grp.meanRt);
+    appendField(out, "rtmin", grp.minRt);
+    appendField(out, "rtmax", grp.maxRt);
+    appendField(out, "maxQuality", grp.maxQuality);
 }
 
-void JSONReports::_writeCompoundLink(PeakGroup& grp, ofstream& filename)
+void JSONReports::_writeCompoundLink(const PeakGroup& grp, string& out)
 {
-    filename << setprecision(10);
     double mz = 0.0f;
     int charge = _mavenParameters->getCharge(grp.getCompound());
     mz = grp.getExpectedMz(charge);
@@ -62,18 +98,18 @@ void JSONReports::_writeCompoundLink(PeakGroup& grp, ofstream& filename)
     if (mz == -1)
         mz = grp.meanMz;
 
-    filename << ",\n" << "\"compound\": { " ;
+    out += ",\n\"compound\": { ";
 
     string compoundID = grp.getCompound()->id();
-    filename << "\"compoundId\": "<< _sanitizeJSONstring(compoundID) ;
+    out += "\"compoundId\": " + _sanitizeJSONstring(compoundID);
     string compoundName = grp.getCompound()->name();
-    filename << ",\n" << "\"compoundName\": "<< _sanitizeJSONstring(compoundName);
+    appendField(out, "compoundName", _sanitizeJSONstring(compoundName));
     string formula = grp.getCompound()->formula();
-    filename << ",\n" << "\"formula\": "<< _sanitizeJSONstring(formula);
-    filename << ",\n" << "\"expectedRt\": " << grp.getCompound()->expectedRt();
-    filename << ",\n" << "\"expectedMz\": " << mz ;
-    filename << ",\n" << "\"srmID\": " << _sanitizeJSONstring(grp.srmId) ;
-    filename << ",\n" << "\"tagString\": " << _sanitizeJSONstring(grp.tagString) ;
+    appendField(out, "formula", _sanitizeJSONstring(formula));
+    appendField(out, "expectedRt", grp.getCompound()->expectedRt());
+    appendField(out, "expectedMz", mz);
+    appendField(out, "srmID", _sanitizeJSONstring(grp.srmId));
+    appendField(out, "tagString", _sanitizeJSONstring(grp.tagString));
 
     string fullTag = grp.srmId + grp.tagString;
     string fullName = compoundName;
@@ -82,220 +118,217 @@ void JSONReports::_writeCompoundLink(PeakGroup& grp, ofstream& filename)
         fullName = compoundName + " [" + fullTag + "]";
         fullID = compoundID + " [" + fullTag + "]";
     }
-    filename << ",\n" << "\"fullCompoundName\": "<< _sanitizeJSONstring(fullName);
-    filename << ",\n" << "\"fullCompoundID\": "<< _sanitizeJSONstring(fullID) ;
-    filename << "}" ; // compound
+    appendField(out, "fullCompoundName", _sanitizeJSONstring(fullName));
+    appendField(out, "fullCompoundID", _sanitizeJSONstring(fullID));
+    out += "}"; // compound
 }
 
-void JSONReports::_writePeak(PeakGroup& grp, ofstream& filename, vector<mzSample*> vsamples)
+void JSONReports::_writePeak(const PeakGroup& grp,
+                             const vector<mzSample*>& samples,
+                             string& out)
 {
-
-    filename << setprecision(10);
-
-    filename << ",\n"<< "\"peaks\": [ " ;
-
-    for(auto it = vsamples.begin(); it != vsamples.end(); ++it) {
-        if (it != vsamples.begin()) {
-            filename << ",\n";
+    static const char* peakFields[] = {
+        "peakMz", "medianMz", "baseMz", "mzmin", "mzmax", "rt", "rtmin",
+        "rtmax", "quality", "peakIntensity", "peakBaseLineLevel", "peakArea",
+        "peakSplineArea", "peakAreaTop", "peakAreaNotCorrected",
+        "peakAreaTopNotCorrected", "noNoiseObs", "signalBaselineRatio",
+        "fromBlankSample", "peakAreaFractional", "symmetry",
+        "noNoiseFraction", "groupOverlap", "groupOverlapFrac", "gaussFitR2",
+        "peakRank", "peakWidth"
+    };
+
+    out += ",\n\"peaks\": [ ";
+
+    for(auto it = samples.begin(); it != samples.end(); ++it) {
+        if (it != samples.begin()) {
+            out += ",\n";
         }
 
         mzSample* sample = *it;
-        Peak* peak = grp.getPeak(sample);
+        const Peak* peak = grp.getPeak(sample);
+        out += "{\n";
+        out += "\"sampleName\": " + _sanitizeJSONstring(sample->sampleName);
         if(peak) {
             //TODO: add slice information here: e.g. what ppm was used
-            filename << "{\n";
-            filename << "\"sampleName\": " << _sanitizeJSONstring((*it)->sampleName) ;
-            filename << ",\n" << "\"peakMz\": " << peak->peakMz ;
-            filename << ",\n" << "\"medianMz\": " << peak->medianMz ;
-            filename << ",\n" << "\"baseMz\": " << peak->baseMz ;
-            filename << ",\n" << "\"mzmin\": " << peak->mzmin ;
-            filename << ",\n" << "\"mzmax\": " << peak->mzmax ;
-            filename << ",\n" << "\"rt\": " << peak->rt ;
-            filename << ",\n" << "\"rtmin\": " << peak->rtmin ;
-            filename << ",\n" << "\"rtmax\": " << peak->rtmax ;
-            filename << ",\n" << "\"quality\": " << peak->quality ;
-            filename << ",\n" << "\"peakIntensity\": " << peak->peakIntensity ;
-            filename << ",\n" << "\"peakBaseLineLevel\": " << peak->peakBaseLineLevel ;
-            filename << ",\n" << "\"peakArea\": " << peak->peakAreaCorrected ;
-            filename << ",\n" << "\"peakSplineArea\": " << peak->peakSplineArea ;
-            filename << ",\n" << "\"peakAreaTop\": " << peak->peakAreaTopCorrected;
-            filename << ",\n" << "\"peakAreaNotCorrected\": " << peak->peakArea;
-            filename << ",\n" << "\"peakAreaTopNotCorrected\": " << peak->peakAreaTop;
-            filename << ",\n" << "\"noNoiseObs\": " << peak->noNoiseObs ;
-            filename << ",\n" << "\"signalBaselineRatio\": " << peak->signalBaselineRatio ;
-            filename << ",\n" << "\"fromBlankSample\": " << peak->fromBlankSample ;
-            filename << ",\n" << "\"peakAreaFractional\": " << peak->peakAreaFractional ;
-            filename << ",\n" << "\"symmetry\": " << peak->symmetry ;
-            filename << ",\n" << "\"noNoiseFraction\": " << peak->noNoiseFraction ;
-            filename << ",\n" << "\"groupOverlap\": " << peak->groupOverlap ;
-            filename << ",\n" << "\"groupOverlapFrac\": " << peak->groupOverlapFrac ;
-            filename << ",\n" << "\"gaussFitR2\": " << peak->gaussFitR2 ;
-            filename << ",\n" << "\"peakRank\": " << peak->peakRank ;
-            filename << ",\n" << "\"peakWidth\": " << peak->width ;
+            appendField(out, "peakMz", peak->peakMz);
+            appendField(out, "medianMz", peak->medianMz);
+            appendField(out, "baseMz", peak->baseMz);
+            appendField(out, "mzmin", peak->mzmin);
+            appendField(out, "mzmax", peak->mzmax);
+            appendField(out, "rt", peak->rt);
+            appendField(out, "rtmin", peak->rtmin);
+            appendField(out, "rtmax", peak->rtmax);
+            appendField(out, "quality", peak->quality);
+            appendField(out, "peakIntensity", peak->peakIntensity);
+            appendField(out, "peakBaseLineLevel", peak->peakBaseLineLevel);
+            appendField(out, "peakArea", peak->peakAreaCorrected);
+            appendField(out, "peakSplineArea", peak->peakSplineArea);
+            appendField(out, "peakAreaTop", peak->peakAreaTopCorrected);
+            appendField(out, "peakAreaNotCorrected", peak->peakArea);
+            appendField(out, "peakAreaTopNotCorrected", peak->peakAreaTop);
+            appendField(out, "noNoiseObs", peak->noNoiseObs);
+            appendField(out, "signalBaselineRatio", peak->signalBaselineRatio);
+            appendField(out, "fromBlankSample", int(peak->fromBlankSample));
+            appendField(out, "peakAreaFractional", peak->peakAreaFractional);
+            appendField(out, "symmetry", peak->symmetry);
+            appendField(out, "noNoiseFraction", peak->noNoiseFraction);
+            appendField(out, "groupOverlap", peak->groupOverlap);
+            appendField(out, "groupOverlapFrac", peak->groupOverlapFrac);
+            appendField(out, "gaussFitR2", peak->gaussFitR2);
+            appendField(out, "peakRank", peak->peakRank);
+            appendField(out, "peakWidth", peak->width);
         } else {
-            filename << "{\n";
-            filename << "\"sampleName\": " << _sanitizeJSONstring((*it)->sampleName) ;
-            filename << ",\n" << "\"peakMz\": " << "\"NA\"" ;
-            filename << ",\n" << "\"medianMz\": " << "\"NA\"" ;
-            filename << ",\n" << "\"baseMz\": " << "\"NA\"" ;
-            filename << ",\n" << "\"mzmin\": " << "\"NA\"" ;
-            filename << ",\n" << "\"mzmax\": " << "\"NA\"" ;
-            filename << ",\n" << "\"rt\": " << "\"NA\"" ;
-            filename << ",\n" << "\"rtmin\": " << "\"NA\"" ;
-            filename << ",\n" << "\"rtmax\": " << "\"NA\"" ;
-            filename << ",\n" << "\"quality\": " << "\"NA\"" ;
-            filename << ",\n" << "\"peakIntensity\": " << "\"NA\"" ;
-            filename << ",\n" << "\"peakBaseLineLevel\": " << "\"NA\"" ;
-            filename << ",\n" << "\"peakArea\": " << "\"NA\"" ;
-            filename << ",\n" << "\"peakSplineArea\": " << "\"NA\"" ;
-            filename << ",\n" << "\"peakAreaTop\": " << "\"NA\"";
-            filename << ",\n" << "\"peakAreaNotCorrected\": " << "\"NA\"";
-            filename << ",\n" << "\"peakAreaTopNotCorrected\": " << "\"NA\"";
-            filename << ",\n" << "\"noNoiseObs\": " << "\"NA\"" ;
-            filename << ",\n" << "\"signalBaselineRatio\": " << "\"NA\"" ;
-            filename << ",\n" << "\"fromBlankSample\": " << "\"NA\"" ;
-            filename << ",\n" << "\"peakAreaFractional\": " << "\"NA\"" ;
-            filename << ",\n" << "\"symmetry\": " << "\"NA\"" ;
-            filename << ",\n" << "\"noNoiseFraction\": " << "\"NA\"" ;
-            filename << ",\n" << "\"groupOverlap\": " << "\"NA\"";
-            filename << ",\n" << "\"groupOverlapFrac\": " << "\"NA\"" ;
-            filename << ",\n" << "\"gaussFitR2\": " << "\"NA\"" ;
-            filename << ",\n" << "\"peakRank\": " << "\"NA\"" ;
-            filename << ",\n" << "\"peakWidth\": " << "\"NA\"" ;
+            static const string notAvailable = "\"NA\"";
+            for (const char* field : peakFields)
+                appendField(out, field, notAvailable);
+        }
+
+        EIC* eic = _extractEIC(grp, sample);
+        if (eic) {
+            _writeEIC(eic, out);
+            delete eic;
         }
-        _writeEIC(grp, filename, sample);
+        out += "\n}"; //peak
     }
 
-    filename << "\n]" ; //peaks
+    out += "\n]"; //peaks
 
-    filename << "}" ; //group
+    out += "}"; //group
 }
 
-
-void JSONReports::_writeEIC(PeakGroup& grp, ofstream& filename, mzSample* sample)
+EIC* JSONReports::_extractEIC(const PeakGroup& grp, mzSample* sample)
 {
-
-    filename << setprecision(10);
-
-    mzSlice* slice= new mzSlice();
-
     int charge = _mavenParameters->getCharge(grp.getCompound());
-    slice->mz = grp.getExpectedMz(charge);
-
-    if (slice->mz == -1)
-        slice->mz = grp.meanMz;
+    float mz = grp.getExpectedMz(charge);
 
-    EIC* eic = nullptr;
+    if (mz == -1)
+        mz = grp.meanMz;
 
     //TODO: Refactor the code :Sahil
     if (grp.hasCompoundLink()) {
+        Compound* compound = grp.getCompound();
         if ( !grp.srmId.empty() ) { //MS-MS case 1
-            eic = (sample)->getEIC(grp.srmId, _mavenParameters->eicType);
+            return sample->getEIC(grp.srmId, _mavenParameters->eicType);
         }
-        else if((grp.getCompound()->precursorMz() > 0) & (grp.getCompound()->productMz() > 0)) { //MS-MS case 2
+        else if((compound->precursorMz() > 0) & (compound->productMz() > 0)) { //MS-MS case 2
             //TODO: this is a problem -- amuQ1 and amuQ3 that were used to generate the peakgroup are not stored anywhere
             //will use mainWindow->MavenParameters for now but those values may have changed between generation and export
-            eic =(sample)->getEIC(grp.getCompound()->precursorMz(), grp.getCompound()->collisionEnergy(), grp.getCompound()->productMz(),_mavenParameters->eicType,
-                               _mavenParameters->filterline, _mavenParameters->amuQ1, _mavenParameters->amuQ3);
+            return sample->getEIC(compound->precursorMz(),
+                                  compound->collisionEnergy(),
+                                  compound->productMz(),
+                                  _mavenParameters->eicType,
+                                  _mavenParameters->filterline,
+                                  _mavenParameters->amuQ1,
+                                  _mavenParameters->amuQ3);
         }
-       else {//MS1 case
-            //TODO: same problem here: need the ppm that was used, or the slice object
-            //for mz could rely on same computation being done way above
-            //redoing it only for code clarity
-            MassCutoff *massCutoff=_mavenParameters->compoundMassCutoffWindow;
-            slice->mzmin = slice->mz - massCutoff->massCutoffValue(slice->mz);
-            slice->mzmax = slice->mz + massCutoff->massCutoffValue(slice->mz);
-            slice->rtmin = grp.minRt - _outputRtWindow;
-            slice->rtmax = grp.maxRt + _outputRtWindow;
-            eic = (sample)->getEIC(slice->mzmin,slice->mzmax,slice->rtmin,slice->rtmax,1,
-                                   _mavenParameters->eicType,
-                                   _mavenParameters->filterline);
-            }
-    }else {
+    } else {
         //no compound information
-        //TODO: same problem here: need the ppm that was used, or the slice object
-        slice->mz=grp.meanMz;
-        MassCutoff *massCutoff=_mavenParameters->compoundMassCutoffWindow;
-        slice->mzmin = slice->mz - massCutoff->massCutoffValue(slice->mz);
-        slice->mzmax = slice->mz + massCutoff->massCutoffValue(slice->mz);
-        slice->rtmin = grp.minRt - _outputRtWindow;
-        slice->rtmax = grp.maxRt + _outputRtWindow;
-        eic = (sample)->getEIC(slice->mzmin, slice->mzmax, slice->rtmin, slice->rtmax,1,
-                               _mavenParameters->eicType,
-                               _mavenParameters->filterline);
+        mz = grp.meanMz;
     }
 
+    //MS1 case
+    //TODO: same problem here: need the ppm that was used, or the slice object
+    MassCutoff *massCutoff=_mavenParameters->compoundMassCutoffWindow;
+    float mzmin = mz - massCutoff->massCutoffValue(mz);
+    float mzmax = mz + massCutoff->massCutoffValue(mz);
+    float rtmin = grp.minRt - _outputRtWindow;
+    float rtmax = grp.maxRt + _outputRtWindow;
+    return sample->getEIC(mzmin,
+                          mzmax,
+                          rtmin,
+                          rtmax,
+                          1,
+                          _mavenParameters->eicType,
+                          _mavenParameters->filterline);
+}
+
+void JSONReports::_writeEIC(const EIC* eic, string& out)
+{
     //TODO: for MS1 we've already limited RT range, but for MS/MS the entire RT range of the SRM will be output
     //either check here or edit getEIC functionality
-    if(eic) {
-        int N = eic->rt.size();
-        filename << ",\n" << "\"eic\": {" ;
-        filename << "\"rt\": [";
-
-        for(int i = 0; i < N; i++){
-            if ( eic->rt[i] > 0) {
-                filename << eic->rt[i];
-                if (i < N - 1) filename << ",";
-            }
+    size_t N = eic->rt.size();
+    out += ",\n\"eic\": {";
+    out += "\"rt\": [";
+
+    bool first = true;
+    for(size_t i = 0; i < N; i++) {
+        if (eic->rt[i] > 0) {
+            if (!first) out += ",";
+            appendValue(out, eic->rt[i]);
+            first = false;
         }
+    }
 
-        filename << "],\n" ; //rt
-        filename << "\"intensity\": [";
-        for(int i= 0; i < N; i++){
-            if ( eic->rt[i] > 0) {
-                filename << eic->intensity[i];
-                if (i < N - 1) filename << ",";
-            }
+    out += "],\n"; //rt
+    out += "\"intensity\": [";
+    first = true;
+    for(size_t i = 0; i < N; i++) {
+        if (eic->rt[i] > 0) {
+            if (!first) out += ",";
+            appendValue(out, eic->intensity[i]);
+            first = false;
         }
-
-        filename << "]" ; //intensity
-        filename << "\n}" ;//eic
-        filename << "\n}" ; //peak
-        delete(eic);
     }
 
+    out += "]"; //intensity
+    out += "\n}"; //eic
 }
 
-
-
-void JSONReports::save(string filename, vector<PeakGroup> allgroups, vector<mzSample*> samples)
+void JSONReports::_writeRecord(const _GroupRecord& record,
+                               const vector<mzSample*>& samples,
+                               string& out)
 {
-    ofstream file(filename.c_str());
-    file << setprecision(10);
+    if (record.groupId > 1) out += "\n,";
+    _writeGroup(*record.group, record.groupId, record.metaGroupId, out);
+    if (record.group->hasCompoundLink())
+        _writeCompoundLink(*record.linkGroup, out);
+    _writePeak(*record.group, samples, out);
+}
 
-    file << "{\"groups\": [" <<endl;
+void JSONReports::save(const string& filename,
+                       const vector<PeakGroup>& allgroups,
+                       const vector<mzSample*>& samples)
+{
+    vector<_GroupRecord> records;
+    records.reserve(allgroups.size());
 
     int groupId = 0;
     int metaGroupId = 0;
-
-    for(size_t i=0; i < allgroups.size() ; i++ ) {
-        PeakGroup& grp = allgroups[i];
-
+    for (const auto& grp : allgroups) {
         //if compound is unknown, output only the unlabeled form information
-        if(grp.getCompound() == NULL || grp.childCount() == 0) {
-            grp.groupId = ++groupId;
-            grp.metaGroupId = ++metaGroupId;
-            if(groupId > 1) file<< "\n,";
-            _writeGroup(grp,file);
-            if(grp.hasCompoundLink())
-                _writeCompoundLink(grp, file);
-            _writePeak(grp, file, samples);
-
+        if (grp.getCompound() == NULL || grp.childCount() == 0) {
+            ++groupId;
+            ++metaGroupId;
+            records.push_back({&grp, &grp, groupId, metaGroupId});
         } else {
             //output all relevant isotope info otherwise
-            //does this work? is children[0] always the same as grp (parent)?
-            grp.metaGroupId = ++metaGroupId;
-            for (auto child : grp.children) {
-                child->metaGroupId = grp.metaGroupId;
-                child->groupId = ++groupId;
-                if(groupId > 1) file << "\n,";
-                _writeGroup(*(child.get()), file);
-                if (child->hasCompoundLink())
-                    _writeCompoundLink(grp, file);
-                _writePeak(*(child.get()), file, samples);
+            ++metaGroupId;
+            for (const auto& child : grp.children) {
+                ++groupId;
+                records.push_back({child.get(), &grp, groupId, metaGroupId});
             }
         }
     }
+
+    ofstream file(filename.c_str());
+    file << "{\"groups\": [" << endl;
+
+    vector<string> buffers;
+    for (size_t start = 0; start < records.size(); start += _batchSize) {
+        size_t batchSize = records.size() - start;
+        if (batchSize > _batchSize)
+            batchSize = _batchSize;
+        buffers.assign(batchSize, string());
+
+        int numRecords = static_cast<int>(batchSize);
+#pragma omp parallel for schedule(dynamic, 1)
+        for (int i = 0; i < numRecords; ++i)
+            _writeRecord(records[start + i], samples, buffers[i]);
+
+        for (const auto& buffer : buffers)
+            file.write(buffer.data(), buffer.size());
+    }
+
     file << "]}"; //groups
     file.close();
 }
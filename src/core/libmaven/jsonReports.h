@@ -20,41 +20,96 @@ public:
 
     /**
      * @brief save Stores the compounds information in a json file.
+     * @details Groups are written in batches. Within a batch, every group
+     * (along with the EICs of each of its peaks) is rendered to an in-memory
+     * buffer in parallel, after which the buffers are streamed to the file in
+     * order. Input groups are not modified, group and meta-group IDs are only
+     * assigned in the exported file.
      * @param filename Output filename.
      * @param allgroups Formed after processing the samples.
      * @param vsampleNames  vector of samples uploaded.
      */
-    void save(string filename, vector<PeakGroup> allgroups, vector<mzSample*> vsampleNames);
+    void save(const string& filename,
+              const vector<PeakGroup>& allgroups,
+              const vector<mzSample*>& vsampleNames);
 
-private:  
+private:
     /**
-     * @brief _writeGroup write specific group information to the file.
+     * @brief A single group entry of the exported file.
+     */
+    struct _GroupRecord
+    {
+        // group whose information and peaks will be written
+        const PeakGroup* group;
+
+        // group whose compound link will be written (the parent group, for
+        // isotopic children)
+        const PeakGroup* linkGroup;
+
+        int groupId;
+        int metaGroupId;
+    };
+
+    /**
+     * @brief Number of groups rendered in parallel, before being written to
+     * the output file.
+     */
+    static const size_t _batchSize = 256;
+
+    /**
+     * @brief _writeRecord write a complete group object (including its
+     * compound link, peaks and EICs) to a buffer.
+     * @param record Group record to be written.
+     * @param samples uploaded.
+     * @param out Buffer to which JSON text is appended.
+     */
+    void _writeRecord(const _GroupRecord& record,
+                      const vector<mzSample*>& samples,
+                      string& out);
+
+    /**
+     * @brief _writeGroup write specific group information to a buffer.
      * @param grp Group to be written.
-     * @param myfile filename.
+     * @param groupId ID of the group in the exported file.
+     * @param metaGroupId Meta-group ID of the group in the exported file.
+     * @param out Buffer to which JSON text is appended.
      */
-    void _writeGroup(PeakGroup& grp, ofstream& filename);
+    void _writeGroup(const PeakGroup& grp,
+                     int groupId,
+                     int metaGroupId,
+                     string& out);
 
     /**
-     * @brief _writeGroup write peak information to the file.
+     * @brief _writePeak write peak information to a buffer.
      * @param grp PeakGroup to be written.
-     * @param myfile filename.
      * @param samples uploaded.
+     * @param out Buffer to which JSON text is appended.
      */
-    void _writePeak(PeakGroup& grp, ofstream& filename, vector<mzSample*> vsampleNames);
+    void _writePeak(const PeakGroup& grp,
+                    const vector<mzSample*>& samples,
+                    string& out);
 
     /**
-     * @brief _writeEIC EIC infomation exported to csv file.
-     * @param grp
-     * @param myfile
+     * @brief _extractEIC obtain the EIC of a group for a given sample.
+     * @param grp Group whose EIC is needed.
+     * @param sample Sample from which the EIC will be extracted.
+     * @return A newly allocated EIC (to be deleted by the caller), or null.
+     */
+    EIC* _extractEIC(const PeakGroup& grp, mzSample* sample);
+
+    /**
+     * @brief _writeEIC write EIC infomation to a buffer.
+     * @param eic EIC to be written.
+     * @param out Buffer to which JSON text is appended.
      */
-    void _writeEIC(PeakGroup& grp, ofstream& filename, mzSample*);
+    void _writeEIC(const EIC* eic, string& out);
 
     /**
      * @brief _writeCompoundLink writes Compound Link of group
      * @param grp
-     * @param myfile
+     * @param out Buffer to which JSON text is appended.
      */
-    void _writeCompoundLink(PeakGroup& grp, ofstream& filename);
+    void _writeCompoundLink(const PeakGroup& grp, string& out);
     string _sanitizeJSONstring(string s);
     
     float _outputRtWindow = 2.0;
@@ -55,6 +55,7 @@ INCLUDEPATH +=  $$top_srcdir/3rdparty/pugixml/src/ \
                 $$top_srcdir/3rdparty/NimbleDSP/src \
                 $$top_srcdir/3rdparty/doctest       \
                 $$top_srcdir/3rdparty/json      \
+                $$top_srcdir/3rdparty/Logger \
                 $$top_srcdir/tests/test-libmaven
 
 QMAKE_LFLAGS += -L$$top_builddir/libs
@@ -112,7 +113,15 @@ SOURCES = base64.cpp \
           svmPredictor.cpp \
           zlib.cpp \
           adductdetection.cpp \
-          spectrallibexport.cpp
+          spectrallibexport.cpp \
+          spectrallibrarysearch.cpp \
+          massindex.cpp \
+          samplecache.cpp \
+          scanstore.cpp \
+          eicindex.cpp \
+          quantmatrix.cpp \
+          transitionindex.cpp \
+          groupClustering.cpp
 
 HEADERS += constants.h \
            base64.h \
@@ -159,4 +168,12 @@ HEADERS += constants.h \
            groupFeatures.h \
            svmPredictor.h \
            adductdetection.h \
-           spectrallibexport.h
+           spectrallibexport.h \
+           spectrallibrarysearch.h \
+           massindex.h \
+           samplecache.h \
+           scanstore.h \
+           eicindex.h \
+           quantmatrix.h \
+           transitionindex.h \
+           groupClustering.h
@@ -0,0 +1,219 @@
+#include "doctest.h"
+#include "Compound.h"
+#include "datastructures/adduct.h"
+#include "masscutofftype.h"
+#include "massindex.h"
+#include "mzMassCalculator.h"
+#include "mzUtils.h"
+
+MassIndex::MassIndex(const vector<Compound*>& compounds,
+                     MzFunction mzForCompound)
+{
+    _entries.reserve(compounds.size());
+    for (size_t i = 0; i < compounds.size(); ++i) {
+        Compound* compound = compounds[i];
+        float mz = mzForCompound(compound);
+        if (mz <= 0.0f)
+            continue;
+
+        _entries.push_back({mz, i, compound, nullptr});
+    }
+    _sortEntries();
+}
+
+MassIndex::MassIndex(const vector<Compound*>& compounds,
+                     const vector<Adduct*>& adducts)
+{
+    MassCalculator massCalc;
+    _entries.reserve(compounds.size() * adducts.size());
+    for (size_t i = 0; i < compounds.size(); ++i) {
+        Compound* compound = compounds[i];
+        float neutralMass = compound->neutralMass();
+        if (!compound->formula().empty())
+            neutralMass = massCalc.computeNeutralMass(compound->formula());
+
+        for (auto adduct : adducts) {
+            float mz = 0.0f;
+            if (neutralMass > 0.0f) {
+                mz = adduct->computeAdductMz(neutralMass);
+            } else if (adduct->isParent()) {
+                mz = compound->mz();
+            }
+            if (mz <= 0.0f)
+                continue;
+
+            _entries.push_back({mz, i, compound, adduct});
+        }
+    }
+    _sortEntries();
+}
+
+void MassIndex::_sortEntries()
+{
+    // stable, so that entries with equal m/z keep their input order
+    stable_sort(begin(_entries),
+                end(_entries),
+                [](const Entry& a, const Entry& b) { return a.mz < b.mz; });
+}
+
+float MassIndex::_searchWindow(float mz, const MassCutoff& massCutoff)
+{
+    return 2.0f * massCutoff.massCutoffValue(mz);
+}
+
+bool MassIndex::_matches(const Entry& entry,
+                         float mz,
+                         const MassCutoff& massCutoff)
+{
+    float window = massCutoff.massCutoffValue(entry.mz);
+    return mz > entry.mz - window && mz < entry.mz + window;
+}
+
+vector<const MassIndex::Entry*>
+MassIndex::find(float mz, const MassCutoff& massCutoff) const
+{
+    return find(vector<float>({mz}), massCutoff).front();
+}
+
+vector<vector<const MassIndex::Entry*>>
+MassIndex::find(const vector<float>& mzValues,
+                const MassCutoff& massCutoff) const
+{
+    vector<vector<const Entry*>> matches(mzValues.size());
+
+    vector<size_t> order(mzValues.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    sort(begin(order), end(order), [&mzValues](size_t a, size_t b) {
+        return mzValues[a] < mzValues[b];
+    });
+
+    // lower bounds of successive (sorted) queries never decrease, so the
+    // start of the candidate range only ever moves forward
+    auto first = begin(_entries);
+    for (auto queryIndex : order) {
+        float mz = mzValues[queryIndex];
+        float window = _searchWindow(mz, massCutoff);
+        while (first != end(_entries) && first->mz < mz - window)
+            ++first;
+
+        auto& queryMatches = matches[queryIndex];
+        for (auto entry = first; entry != end(_entries); ++entry) {
+            if (entry->mz > mz + window)
+                break;
+            if (_matches(*entry, mz, massCutoff))
+                queryMatches.push_back(&(*entry));
+        }
+        stable_sort(begin(queryMatches),
+                    end(queryMatches),
+                    [](const Entry* a, const Entry* b) {
+                        return a->compoundIndex < b->compoundIndex;
+                    });
+    }
+    return matches;
+}
+
+TEST_CASE("Testing mass index")
+{
+    vector<Compound*> compounds;
+    vector<float> masses = {200.0f, 100.0f, 100.0005f, 0.0f};
+    for (size_t i = 0; i < masses.size(); ++i) {
+        string id = "C" + to_string(i);
+        Compound* compound = new Compound(id, id, "", 1);
+        compound->setMz(masses[i]);
+        compounds.push_back(compound);
+    }
+
+    MassCutoff massCutoff;
+    massCutoff.setMassCutoffAndType(10.0, "ppm");
+    MassIndex index(compounds, [](Compound* c) { return c->mz(); });
+    REQUIRE(index.size() == 3);
+    REQUIRE(index.entries().front().compound == compounds[1]);
+
+    SUBCASE("Testing single query")
+    {
+        auto matches = index.find(100.0002f, massCutoff);
+        REQUIRE(matches.size() == 2);
+        REQUIRE(matches[0]->compound == compounds[1]);
+        REQUIRE(matches[1]->compound == compounds[2]);
+        REQUIRE(index.find(150.0f, massCutoff).empty());
+    }
+
+    SUBCASE("Testing batch query against brute force")
+    {
+        vector<float> queries = {200.0015f, 100.0f, 50.0f, 200.0f, 100.001f};
+        auto batchMatches = index.find(queries, massCutoff);
+        REQUIRE(batchMatches.size() == queries.size());
+        for (size_t i = 0; i < queries.size(); ++i) {
+            vector<Compound*> expected;
+            for (auto compound : compounds) {
+                if (compound->mz() <= 0.0f)
+                    continue;
+                if (mzUtils::withinXMassCutoff(compound->mz(),
+                                               queries[i],
+                                               &massCutoff)) {
+                    expected.push_back(compound);
+                }
+            }
+            REQUIRE(batchMatches[i].size() == expected.size());
+            for (size_t j = 0; j < expected.size(); ++j)
+                REQUIRE(batchMatches[i][j]->compound == expected[j]);
+        }
+    }
+
+    mzUtils::delete_all(compounds);
+}
+
+TEST_CASE("Testing adduct-expanded mass index")
+{
+    vector<Compound*> compounds;
+    compounds.push_back(new Compound("glucose", "glucose", "C6H12O6", 0));
+    compounds.push_back(new Compound("unknown", "unknown", "", 1));
+    compounds.back()->setMz(150.0f);
+
+    vector<Adduct*> adducts;
+    adducts.push_back(new Adduct("[M+H]+", 1, 1, PROTON_MASS));
+    adducts.push_back(new Adduct("[2M+H]+", 2, 1, PROTON_MASS));
+    adducts.push_back(new Adduct("[M+2H]++", 1, 2, 2.0f * PROTON_MASS));
+
+    MassIndex index(compounds, adducts);
+
+    // all three adducts of glucose, but only the parent adduct for the
+    // compound without a neutral mass
+    REQUIRE(index.size() == 4);
+    for (size_t i = 1; i < index.size(); ++i)
+        REQUIRE(index.entries()[i - 1].mz <= index.entries()[i].mz);
+
+    MassCutoff massCutoff;
+    massCutoff.setMassCutoffAndType(10.0, "ppm");
+    float neutralMass = MassCalculator::computeNeutralMass("C6H12O6");
+    vector<float> queries = {
+        (2.0f * neutralMass + static_cast<float>(PROTON_MASS)),
+        150.0f,
+        (neutralMass + 2.0f * static_cast<float>(PROTON_MASS)) / 2.0f,
+        neutralMass + static_cast<float>(PROTON_MASS),
+        300.0f};
+    auto matches = index.find(queries, massCutoff);
+    REQUIRE(matches.size() == queries.size());
+
+    REQUIRE(matches[0].size() == 1);
+    REQUIRE(matches[0][0]->compound == compounds[0]);
+    REQUIRE(matches[0][0]->adduct == adducts[1]);
+
+    REQUIRE(matches[1].size() == 1);
+    REQUIRE(matches[1][0]->compound == compounds[1]);
+    REQUIRE(matches[1][0]->adduct == adducts[0]);
+
+    REQUIRE(matches[2].size() == 1);
+    REQUIRE(matches[2][0]->compound == compounds[0]);
+    REQUIRE(matches[2][0]->adduct == adducts[2]);
+
+    REQUIRE(matches[3].size() == 1);
+    REQUIRE(matches[3][0]->compound == compounds[0]);
+    REQUIRE(matches[3][0]->adduct == adducts[0]);
+
+    REQUIRE(matches[4].empty());
+
+    mzUtils::delete_all(compounds);
+    mzUtils::delete_all(adducts);
+}
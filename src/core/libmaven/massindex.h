@@ -0,0 +1,126 @@
+#ifndef MASSINDEX_H
+#define MASSINDEX_H
+
+#include <functional>
+
+#include "standardincludes.h"
+
+class Adduct;
+class Compound;
+class MassCutoff;
+
+using namespace std;
+
+/**
+ * @class MassIndex
+ * @ingroup libmaven
+ * @brief A sorted, flat index of m/z values computed for a set of compounds
+ * (and optionally their adducts), that can be queried for one or many m/z
+ * values at a time.
+ * @details Two m/z values are considered a match under the same criteria as
+ * `mzUtils::withinXMassCutoff`, with the indexed m/z as reference. Batched
+ * queries are answered in a single merge pass over the sorted queries and the
+ * sorted index, which makes annotating thousands of features against a large
+ * compound database roughly linear in the size of both.
+ */
+class MassIndex
+{
+public:
+    /**
+     * @brief A single indexed m/z value.
+     */
+    struct Entry
+    {
+        float mz;
+
+        /**
+         * @brief Position of the compound in the list the index was built
+         * from. Matches for a query are ordered by this value.
+         */
+        size_t compoundIndex;
+
+        Compound* compound;
+
+        /**
+         * @brief The adduct form of the compound that this entry represents,
+         * or `nullptr` if the index was not expanded with adducts.
+         */
+        Adduct* adduct;
+    };
+
+    typedef std::function<float (Compound*)> MzFunction;
+
+    /**
+     * @brief Build an index with a single m/z value for each compound.
+     * @param compounds Compounds to be indexed.
+     * @param mzForCompound A function that returns the m/z value at which a
+     * compound should be indexed. Compounds for which this function returns a
+     * non-positive value are not indexed.
+     */
+    MassIndex(const vector<Compound*>& compounds, MzFunction mzForCompound);
+
+    /**
+     * @brief Build an index with an m/z value for every adduct of every
+     * compound.
+     * @details The adduct m/z is computed from the neutral mass of the
+     * compound (from its formula, if available). For compounds without a
+     * neutral mass, only parent adducts are indexed, at the compound's m/z.
+     * @param compounds Compounds to be indexed.
+     * @param adducts Adducts to be expanded for each compound.
+     */
+    MassIndex(const vector<Compound*>& compounds,
+              const vector<Adduct*>& adducts);
+
+    /**
+     * @brief Number of entries in the index.
+     */
+    size_t size() const { return _entries.size(); }
+
+    /**
+     * @brief All entries of the index, sorted by m/z.
+     */
+    const vector<Entry>& entries() const { return _entries; }
+
+    /**
+     * @brief Find all entries that match a single m/z value.
+     * @param mz The m/z value to be searched.
+     * @param massCutoff Tolerance used for matching.
+     * @return Matching entries, ordered by compound index.
+     */
+    vector<const Entry*> find(float mz, const MassCutoff& massCutoff) const;
+
+    /**
+     * @brief Find matching entries for a batch of m/z values.
+     * @param mzValues The m/z values to be searched, in any order.
+     * @param massCutoff Tolerance used for matching.
+     * @return A vector holding the matches (ordered by compound index) for
+     * each query, in the same order as the given m/z values.
+     */
+    vector<vector<const Entry*>> find(const vector<float>& mzValues,
+                                      const MassCutoff& massCutoff) const;
+
+private:
+    vector<Entry> _entries;
+
+    /**
+     * @brief Sort entries by their m/z values.
+     */
+    void _sortEntries();
+
+    /**
+     * @brief Half-width of the m/z range that is scanned for a query.
+     * @details The tolerance is defined with respect to indexed m/z values,
+     * so the range scanned around a query is widened to twice the tolerance
+     * at the query, after which every candidate is matched exactly.
+     */
+    static float _searchWindow(float mz, const MassCutoff& massCutoff);
+
+    /**
+     * @brief Whether an entry matches a query m/z.
+     */
+    static bool _matches(const Entry& entry,
+                         float mz,
+                         const MassCutoff& massCutoff);
+};
+
+#endif // MASSINDEX_H
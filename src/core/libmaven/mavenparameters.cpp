@@ -1,3 +1,6 @@
+#include <mutex>
+#include <unordered_map>
+
 #include <pugixml.hpp>
 
 #include "mavenparameters.h"
@@ -256,7 +259,6 @@ void MavenParameters::copyFrom(const MavenParameters& mp)
         mp.compoundMassCutoffWindow->getMassCutoff(),
         mp.compoundMassCutoffWindow->getMassCutoffType());
 
-    compoundMassCutoffWindow = mp.compoundMassCutoffWindow;
     compoundRTWindow = mp.compoundRTWindow;
     eicMaxGroups = mp.eicMaxGroups;
 
@@ -303,6 +305,173 @@ void MavenParameters::copyFrom(const MavenParameters& mp)
     samples = mp.samples;
 }
 
+namespace {
+
+template<typename T>
+void appendToKey(string& key, const T& value)
+{
+    key.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void appendToKey(string& key, const string& value)
+{
+    appendToKey(key, value.size());
+    key += value;
+}
+
+template<typename T>
+void appendToKey(string& key, const vector<T*>& values)
+{
+    appendToKey(key, values.size());
+    for (auto value : values)
+        appendToKey(key, value);
+}
+
+}
+
+string MavenParameters::_snapshotKey() const
+{
+    string key;
+    key.reserve(1024);
+
+    appendToKey(key, clsf);
+    appendToKey(key, alignSamplesFlag);
+    appendToKey(key, processAllSlices);
+    appendToKey(key, pullIsotopesFlag);
+    appendToKey(key, matchRtFlag);
+    appendToKey(key, stop);
+    appendToKey(key, outputdir);
+    appendToKey(key, writeCSVFlag);
+    appendToKey(key, ionizationMode);
+    appendToKey(key, charge);
+    appendToKey(key, keepFoundGroups);
+    appendToKey(key, showProgressFlag);
+    appendToKey(key, alignButton);
+
+    appendToKey(key, fragmentTolerance);
+    appendToKey(key, minFragMatchScore);
+    appendToKey(key, minFragMatch);
+    appendToKey(key, scoringAlgo);
+    appendToKey(key, matchFragmentationFlag);
+    appendToKey(key, mustHaveFragmentation);
+
+    appendToKey(key, mzBinStep);
+    appendToKey(key, rtStepSize);
+    appendToKey(key, avgScanTime);
+    appendToKey(key, limitGroupCount);
+
+    appendToKey(key, searchAdducts);
+    appendToKey(key, adductSearchWindow);
+    appendToKey(key, adductPercentCorrelation);
+    appendToKey(key, _chosenAdducts);
+
+    appendToKey(key, eic_smoothingWindow);
+    appendToKey(key, eic_smoothingAlgorithm);
+    appendToKey(key, aslsBaselineMode);
+    appendToKey(key, baseline_smoothingWindow);
+    appendToKey(key, baseline_dropTopX);
+    appendToKey(key, aslsSmoothness);
+    appendToKey(key, aslsAsymmetry);
+
+    appendToKey(key, isIsotopeEqualPeakFilter);
+    appendToKey(key, minSignalBaselineDifference);
+    appendToKey(key, isotopicMinSignalBaselineDifference);
+    appendToKey(key, minPeakQuality);
+    appendToKey(key, minIsotopicPeakQuality);
+    appendToKey(key, eicType);
+    appendToKey(key, grouping_maxRtWindow);
+
+    appendToKey(key, minGoodGroupCount);
+    appendToKey(key, minSignalBlankRatio);
+    appendToKey(key, minNoNoiseObs);
+    appendToKey(key, minSignalBaseLineRatio);
+    appendToKey(key, minGroupIntensity);
+    appendToKey(key, peakQuantitation);
+    appendToKey(key, minQuality);
+
+    appendToKey(key, qualityWeight);
+    appendToKey(key, intensityWeight);
+    appendToKey(key, deltaRTWeight);
+    appendToKey(key, deltaRtCheckFlag);
+
+    appendToKey(key, massCutoffMerge->getMassCutoff());
+    appendToKey(key, massCutoffMerge->getMassCutoffType());
+    appendToKey(key, compoundMassCutoffWindow->getMassCutoff());
+    appendToKey(key, compoundMassCutoffWindow->getMassCutoffType());
+    appendToKey(key, compoundRTWindow);
+    appendToKey(key, eicMaxGroups);
+
+    appendToKey(key, amuQ1);
+    appendToKey(key, amuQ3);
+    appendToKey(key, filterline);
+
+    appendToKey(key, maxIsotopeScanDiff);
+    appendToKey(key, minIsotopicCorrelation);
+    appendToKey(key, linkIsotopeRtRange);
+    appendToKey(key, C13Labeled_BPE);
+    appendToKey(key, N15Labeled_BPE);
+    appendToKey(key, S34Labeled_BPE);
+    appendToKey(key, D2Labeled_BPE);
+    appendToKey(key, C13Labeled_Barplot);
+    appendToKey(key, N15Labeled_Barplot);
+    appendToKey(key, S34Labeled_Barplot);
+    appendToKey(key, D2Labeled_Barplot);
+
+    appendToKey(key, alignMaxIterations);
+    appendToKey(key, alignPolynomialDegree);
+
+    appendToKey(key, quantileQuality);
+    appendToKey(key, quantileIntensity);
+    appendToKey(key, quantileSignalBaselineRatio);
+    appendToKey(key, quantileSignalBlankRatio);
+
+    appendToKey(key, distXWeight);
+    appendToKey(key, distYWeight);
+    appendToKey(key, overlapWeight);
+    appendToKey(key, useOverlap);
+
+    appendToKey(key, defaultSettingsData);
+    appendToKey(key, mavenSettings.size());
+    for (const auto& setting : mavenSettings) {
+        appendToKey(key, setting.first);
+        appendToKey(key, setting.second);
+    }
+
+    appendToKey(key, samples);
+    return key;
+}
+
+shared_ptr<MavenParameters> MavenParameters::snapshot(const MavenParameters& mp)
+{
+    static mutex registryMutex;
+    static unordered_map<string, weak_ptr<MavenParameters>> registry;
+    static size_t purgeThreshold = 64;
+
+    string key = mp._snapshotKey();
+    lock_guard<mutex> lock(registryMutex);
+
+    auto& entry = registry[key];
+    if (auto existing = entry.lock())
+        return existing;
+
+    auto created = make_shared<MavenParameters>(mp);
+    entry = created;
+
+    // forget snapshots that are no longer referenced by anyone, every time
+    // the registry doubles in size
+    if (registry.size() > purgeThreshold) {
+        for (auto it = registry.begin(); it != registry.end();) {
+            if (it->second.expired()) {
+                it = registry.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        purgeThreshold = max(static_cast<size_t>(64), 2 * registry.size());
+    }
+    return created;
+}
+
 void MavenParameters::setOutputDir(QString outdir) {
     outputdir = outdir.toStdString() + string(DIR_SEPARATOR_STR);
 }
@@ -29,6 +29,20 @@ class MavenParameters
         void copyFrom(const MavenParameters& mp);
         MavenParameters& operator=(const MavenParameters& mp);
 
+        /**
+         * @brief Obtain a shared copy of the given parameters, meant to be
+         * referenced by peak-groups (or other long lived objects).
+         * @details Snapshots are interned by content: if a live snapshot
+         * having the same settings (as copied by `copyFrom`) already exists,
+         * it is returned instead of making a new copy. Since a snapshot may
+         * be shared by many objects, it must not be modified. To change the
+         * settings of a group, modify a copy of its parameters and replace
+         * them with a snapshot of that copy.
+         * @param mp Parameters to be copied.
+         * @return A shared pointer to a snapshot of the parameters.
+         */
+        static shared_ptr<MavenParameters> snapshot(const MavenParameters& mp);
+
         enum Polarity{AutoDetect,Neutral, Positive, Negative};
         boost::signals2::signal< void (const string&,unsigned int , int ) > sig;
 
@@ -310,6 +324,12 @@ class MavenParameters
             { _chosenAdducts = chosenAdducts; }
 
     private:
+        /**
+         * @brief Serialize all settings copied by `copyFrom` into a string,
+         * such that two objects with equal keys are equivalent copies.
+         */
+        string _snapshotKey() const;
+
         vector<Adduct*> _chosenAdducts;
         char* defaultSettingsData;
         string lastUsedSettingsPath;
@@ -11,6 +11,7 @@
 #include "mavenparameters.h"
 #include "Peak.h"
 #include "Scan.h"
+#include "scanstore.h"
 
 mzSample* Aligner::refSample = nullptr;
 
@@ -353,6 +354,7 @@ bool Aligner::alignSampleRts(mzSample* sample,
     for(auto scan: sample->scans) {
         if (scan->mslevel == 1 && (intervalCounter % rtBinSize == 0 || scan == sample->scans.back())) {
             mxnCount++;
+            ScanPin pin(scan);
             for(int i = 0; i <  scan->mz.size(); i++) {
                 if (mp->stop) return (true);
                 if (scan->mz.at(i) < mzPoints.front() || scan->mz.at(i) > mzPoints.back())
@@ -437,6 +439,7 @@ bool Aligner::alignWithObiWarp(vector<mzSample*> samples,
     for(const auto scan: refSample->scans) {
         // PRM/DDA data have both mslevel 1 and mslevel 2 scans. We only want to align mslevel 1 scans
         if(scan->mslevel == 1) {
+            ScanPin pin(scan);
             for(const auto mz: scan->mz) {
                 minMzRange = min(minMzRange, mz);
                 maxMzRange = max(maxMzRange, mz);
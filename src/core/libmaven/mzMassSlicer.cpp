@@ -8,6 +8,7 @@
 #include "Matrix.h"
 #include "PeakDetector.h"
 #include "Scan.h"
+#include "scanstore.h"
 
 using namespace mzUtils;
 
@@ -144,6 +145,7 @@ void MassSlices::algorithmB(MassCutoff* massCutoff, int rtStep )
 
             float rt = scan->rt;
 
+            ScanPin pin(scan);
             for (unsigned int k = 0; k < scan->nobs(); k++) {
                 float mz = scan->mz[k];
                 float intensity = scan->intensity[k];
@@ -222,6 +224,7 @@ void MassSlices::algorithmC(float ppm, float minIntensity, float rtWindow) {
         for(unsigned int j=0; j < s->scans.size(); j++) {
             Scan* scan = samples[i]->scans[j];
             if (scan->mslevel != 1 ) continue;
+            ScanPin pin(scan);
             vector<int> positions = scan->intensityOrderDesc();
             for(unsigned int k=0; k< positions.size() && k<10; k++ ) {
                 int pos = positions[k];
@@ -10,15 +10,29 @@
 #include "Matrix.h"
 #include "EIC.h"
 #include "Scan.h"
+#include "eicindex.h"
+#include "transitionindex.h"
+#include "samplecache.h"
+#include "scanstore.h"
+
+#include <numeric>
+#include <queue>
+#include <random>
 
 #include <MavenException.h>
 
+#include "doctest.h"
+
 // global options
 int mzSample::filter_minIntensity = -1;
 bool mzSample::filter_centroidScans = false;
 int mzSample::filter_intensityQuantile = 0;
 int mzSample::filter_polarity = 0;
 int mzSample::filter_mslevel = 0;
+bool mzSample::cache_enabled = false;
+bool mzSample::lazy_scans = false;
+bool mzSample::eicIndex_enabled = false;
+string mzSample::cache_dir = "";
 
 mzSample::mzSample() : _setName(""), injectionOrder(0)
 {
@@ -157,12 +171,29 @@ void mzSample::checkSampleBlank(const char* filename)
 
 void mzSample::loadSample(string filename)
 {
-    // Loading and Decoding the file
+    // Loading and Decoding the file, unless a valid cache of its scans exists
     // catch any error while parsing
-    try {
-        loadAnySample(filename);
-    } catch (MavenException& excp) {
-        cerr << endl << "Error: " << excp.what() << endl;
+    SampleCache cache(cache_dir);
+    bool useCache = cache_enabled || lazy_scans;
+    if (!useCache || !cache.load(this, filename, lazy_scans)) {
+        try {
+            loadAnySample(filename);
+        } catch (MavenException& excp) {
+            cerr << endl << "Error: " << excp.what() << endl;
+        }
+
+        if (useCache && !scans.empty()) {
+            if (!cache.save(this, filename)) {
+                cerr << "Could not write sample cache: "
+                     << cache.cachePath(filename) << endl;
+            } else if (lazy_scans) {
+                // switch to lazy scans backed by the new cache, releasing
+                // the decoded peak arrays
+                deque<Scan*> decodedScans = scans;
+                if (cache.load(this, filename, true))
+                    delete_all(decodedScans);
+            }
+        }
     }
 
     // getting the SRM scan type
@@ -171,6 +202,9 @@ void mzSample::loadSample(string filename)
     // set min and max values for rt and mz
     calculateMzRtRange();
 
+    if (eicIndex_enabled)
+        buildEicIndex();
+
     // Setting Sample name
     sampleNaming(filename.c_str());
 
@@ -178,6 +212,11 @@ void mzSample::loadSample(string filename)
     checkSampleBlank(filename.c_str());
 }
 
+void mzSample::buildEicIndex(float binWidth)
+{
+    _eicIndex = make_shared<const EicIndex>(scans, binWidth);
+}
+
 void mzSample::parseMzCSV(const char* filename)
 {
     // file structure:
@@ -265,6 +304,7 @@ void mzSample::writeMzCSV(const char* filename)
           << endl;
     for (unsigned int i = 0; i < scans.size(); i++) {
         Scan* scan = scans[i];
+        ScanPin pin(scan);
         for (unsigned int j = 0; j < scan->nobs(); j++) {
             mzCSV << scan->scannum + 1 << "," << scan->rt * 60 << ","
                   << scan->mz[j] << "," << scan->intensity[j] << ","
@@ -1034,6 +1074,7 @@ void mzSample::calculateMzRtRange()
     unsigned int numOfScans = scans.size();
     for (unsigned int j = 0; j < numOfScans; j++) {
         Scan* currentScan = scans[j];
+        ScanPin pin(currentScan);
         unsigned int mzSize = currentScan->mz.size();
         for (unsigned int i = 0; i < mzSize; i++) {
             float intensity = currentScan->intensity[i];
@@ -1095,12 +1136,14 @@ float mzSample::getAverageFullScanTime()
 
 void mzSample::enumerateSRMScans()
 {
-    srmScans.clear();
-    for (unsigned int i = 0; i < scans.size(); i++) {
-        if (scans[i]->filterLine.length() > 0) {
-            srmScans[scans[i]->filterLine].push_back(i);
-        }
-    }
+    _transitionIndex = make_shared<const TransitionIndex>(scans);
+}
+
+const TransitionIndex* mzSample::transitionIndex()
+{
+    if (!_transitionIndex)
+        enumerateSRMScans();
+    return _transitionIndex.get();
 }
 
 Scan* mzSample::getScan(unsigned int scanNum)
@@ -1131,22 +1174,14 @@ EIC* mzSample::getEIC(float precursorMz,
     e->mzmin = 0;
     e->mzmax = 0;
 
-    for (unsigned int i = 0; i < scans.size(); i++) {
+    vector<int> matchingScans = transitionIndex()->findScans(
+        precursorMz, collisionEnergy, productMz, amuQ1, amuQ3, filterline);
+    for (int i : matchingScans) {
         Scan* scan = scans[i];
         if (filterline != "" && scan->filterLine != filterline)
             continue;
-        if (scan->mslevel != 2)
-            continue;
-        if (precursorMz != 0.0f && abs(scan->precursorMz - precursorMz) > amuQ1)
-            continue;
-        if (productMz != 0.0f && abs(scan->productMz - productMz) > amuQ3)
-            continue;
-        if (collisionEnergy != 0.0f
-            && scan->collisionEnergy != 0.0f
-            && abs(scan->collisionEnergy - collisionEnergy) > 0.5) {
-            continue;
-        }
 
+        ScanPin pin(scan);
         float eicMz = 0;
         float eicIntensity = 0;
 
@@ -1256,20 +1291,11 @@ EIC* mzSample::getEIC(string srm, int eicType)
     e->mzmin = 0;
     e->mzmax = 0;
 
-    // if (srmScans.size() == 0 )
-
-    // naman Checking for ‘List’ emptiness might be inefficient. Using
-    // List.empty() instead of List.size() can be faster. List.size() can take
-    // linear time but List.empty() is guaranteed to take constant time. src:
-    // https://kmdarshan.wordpress.com/2011/08/15/static-analysis-of-cc-code-using-cppcheck/
-    if (srmScans.empty()) {
-        enumerateSRMScans();
-    }
-
-    if (srmScans.count(srm) > 0) {
-        vector<int> srmscans = srmScans[srm];
-        for (unsigned int i = 0; i < srmscans.size(); i++) {
-            Scan* scan = scans[srmscans[i]];
+    const vector<int>* srmscans = transitionIndex()->scansOfSrm(srm);
+    if (srmscans) {
+        for (unsigned int i = 0; i < srmscans->size(); i++) {
+            Scan* scan = scans[(*srmscans)[i]];
+            ScanPin pin(scan);
             float eicMz = 0;
             float eicIntensity = 0;
 
@@ -1437,6 +1463,7 @@ EIC* mzSample::getTIC(float rtmin, float rtmax, int mslevel)
     for (int i = 0; i < scanCount; i++) {
         if (scans[i]->mslevel == mslevel) {
             Scan* scan = scans[i];
+            ScanPin pin(scan);
             float y = scan->totalIntensity();
             e->mz.push_back(0);
             e->scannum.push_back(i);
@@ -1484,6 +1511,7 @@ EIC* mzSample::getBIC(float rtmin, float rtmax, int mslevel)
     for (int i = 0; i < scanCount; i++) {
         if (scans[i]->mslevel == mslevel) {
             Scan* scan = scans[i];
+            ScanPin pin(scan);
             float maxMz = 0;
             float maxIntensity = 0;
             for (unsigned int i = 0; i < scan->intensity.size(); i++) {
@@ -1791,44 +1819,95 @@ Scan* mzSample::getAverageScan(float rtmin,
                                int polarity,
                                float sd)
 {
-    // TODO naman unused function
-
     float rt = rtmin + (rtmax - rtmin) / 2;
-    int scanCount = 0;
     int scannum = 0;
 
-    map<float, double> mz_intensity_map;
-    map<float, double> mz_bin_map;
-    map<float, int> mz_count;
-
-    for (unsigned int s = 0; s < scans.size(); s++) {
-        if (scans[s]->getPolarity() != polarity || scans[s]->mslevel != mslevel
-            || scans[s]->rt < rtmin || scans[s]->rt > rtmax)
+    vector<Scan*> selected;
+    for (auto scan : scans) {
+        if (scan->getPolarity() != polarity || scan->mslevel != mslevel
+            || scan->rt < rtmin || scan->rt > rtmax)
             continue;
+        selected.push_back(scan);
+    }
+    int scanCount = selected.size();
 
-        Scan* scan = scans[s];
-        scanCount++;
-        for (unsigned int i = 0; i < scan->mz.size(); i++) {
-            float bin = FLOATROUND(scan->mz[i], sd);
-            mz_intensity_map[bin] += ((double)scan->intensity[i]);
-            mz_bin_map[bin] += ((double)(scan->intensity[i]) * (scan->mz[i]));
-            mz_count[bin]++;
+    // points of each scan summed per m/z bin, in increasing order of bins
+    struct Bin
+    {
+        int index;
+        double intensity;
+        double weightedMz;
+        int count;
+    };
+    auto binOf = [sd](float mz) { return int(mz * sd + 0.5); };
+    vector<vector<Bin>> scanBins(scanCount);
+#pragma omp parallel for schedule(dynamic, 16)
+    for (int s = 0; s < scanCount; ++s) {
+        Scan* scan = selected[s];
+        ScanPin pin(scan);
+        vector<Bin>& bins = scanBins[s];
+        auto add = [&](size_t i) {
+            int index = binOf(scan->mz[i]);
+            if (bins.empty() || bins.back().index != index)
+                bins.push_back({index, 0.0, 0.0, 0});
+            Bin& bin = bins.back();
+            bin.intensity += (double)scan->intensity[i];
+            bin.weightedMz += (double)(scan->intensity[i]) * (scan->mz[i]);
+            ++bin.count;
+        };
+
+        if (is_sorted(scan->mz.begin(), scan->mz.end())) {
+            for (size_t i = 0; i < scan->mz.size(); ++i)
+                add(i);
+        } else {
+            vector<size_t> order(scan->mz.size());
+            iota(order.begin(), order.end(), 0);
+            stable_sort(order.begin(),
+                        order.end(),
+                        [&](size_t a, size_t b) {
+                            return binOf(scan->mz[a]) < binOf(scan->mz[b]);
+                        });
+            for (size_t i : order)
+                add(i);
         }
     }
 
     Scan* avgScan =
         new Scan(this, scannum, mslevel, rt / scanCount, 0, polarity);
-
-    map<float, double>::iterator itr;
-    for (itr = mz_intensity_map.begin(); itr != mz_intensity_map.end(); ++itr) {
-        float bin = (*itr).first;
-        double totalIntensity = (*itr).second;
-        double avgMz = mz_bin_map[bin] / totalIntensity;
+    size_t maxBins = 0;
+    for (const auto& bins : scanBins)
+        maxBins = max(maxBins, bins.size());
+    avgScan->mz.reserve(maxBins);
+    avgScan->intensity.reserve(maxBins);
+
+    // k-way merge of the bins of all scans; bins of equal index are summed
+    // in the order of their scans
+    typedef pair<int, int> Head;
+    priority_queue<Head, vector<Head>, greater<Head>> heads;
+    vector<size_t> positions(scanCount, 0);
+    for (int s = 0; s < scanCount; ++s) {
+        if (!scanBins[s].empty())
+            heads.push(make_pair(scanBins[s][0].index, s));
+    }
+    while (!heads.empty()) {
+        int index = heads.top().first;
+        double totalIntensity = 0.0;
+        double weightedMz = 0.0;
+        int count = 0;
+        while (!heads.empty() && heads.top().first == index) {
+            int s = heads.top().second;
+            heads.pop();
+            const Bin& bin = scanBins[s][positions[s]++];
+            totalIntensity += bin.intensity;
+            weightedMz += bin.weightedMz;
+            count += bin.count;
+            if (positions[s] < scanBins[s].size())
+                heads.push(make_pair(scanBins[s][positions[s]].index, s));
+        }
+        double avgMz = weightedMz / totalIntensity;
         avgScan->mz.push_back((float)avgMz);
-        avgScan->intensity.push_back((float)totalIntensity / mz_count[bin]);
+        avgScan->intensity.push_back((float)totalIntensity / count);
     }
-    // cout << "getAverageScan() from:" << from << " to:" << to << " scanCount:"
-    // << scanCount << "scans. mzs=" << avgScan->nobs() << endl;
     return avgScan;
 }
 
@@ -1881,6 +1960,7 @@ vector<float> mzSample::getIntensityDistribution(int mslevel)
         if (scan->mslevel != mslevel)
             continue;
 
+        ScanPin pin(scan);
         for (unsigned int i = 0; i < scan->mz.size(); i++) {
             allintensities.push_back(scan->intensity[i]);
         }
@@ -1930,3 +2010,65 @@ mzLink::mzLink(float a, float b, string n) : mz1(a), mz2(b), note(n)
     data1 = data2 = NULL;
     correlation = 0;
 }
+
+///////////////////////////Test Cases//////////////////////////////
+
+TEST_CASE("Testing average scan")
+{
+    mt19937 generator(11);
+    uniform_real_distribution<float> mzDistribution(100.0f, 110.0f);
+    uniform_real_distribution<float> intensityDistribution(1.0f, 1e5f);
+
+    mzSample sample;
+    for (int i = 0; i < 200; ++i) {
+        int mslevel = i % 5 == 0 ? 2 : 1;
+        int polarity = i % 7 == 0 ? -1 : 1;
+        Scan* scan = new Scan(&sample, i, mslevel, i * 0.05f, 0, polarity);
+        for (int j = 0; j < 300; ++j) {
+            scan->mz.push_back(mzDistribution(generator));
+            scan->intensity.push_back(intensityDistribution(generator));
+        }
+        if (i % 9 != 0)
+            sort(scan->mz.begin(), scan->mz.end());
+        sample.addScan(scan);
+    }
+
+    // compare against binning points into ordered maps
+    for (float sd : {100.0f, 1000.0f}) {
+        float rtmin = 1.0f;
+        float rtmax = 7.5f;
+        map<float, double> intensities;
+        map<float, double> weightedMzs;
+        map<float, int> counts;
+        for (auto scan : sample.scans) {
+            if (scan->getPolarity() != 1 || scan->mslevel != 1
+                || scan->rt < rtmin || scan->rt > rtmax)
+                continue;
+            for (size_t i = 0; i < scan->mz.size(); ++i) {
+                float bin = FLOATROUND(scan->mz[i], sd);
+                intensities[bin] += ((double)scan->intensity[i]);
+                weightedMzs[bin] +=
+                    ((double)(scan->intensity[i]) * (scan->mz[i]));
+                counts[bin]++;
+            }
+        }
+
+        Scan* avgScan = sample.getAverageScan(rtmin, rtmax, 1, 1, sd);
+        REQUIRE(avgScan->mz.size() == intensities.size());
+        size_t i = 0;
+        for (const auto& entry : intensities) {
+            float bin = entry.first;
+            float mz = weightedMzs[bin] / entry.second;
+            float intensity = (float)entry.second / counts[bin];
+            REQUIRE(avgScan->mz[i] == doctest::Approx(mz).epsilon(1e-6));
+            REQUIRE(avgScan->intensity[i]
+                    == doctest::Approx(intensity).epsilon(1e-6));
+            ++i;
+        }
+        delete avgScan;
+    }
+
+    Scan* emptyScan = sample.getAverageScan(20.0f, 30.0f, 1, 1, 100.0f);
+    REQUIRE(emptyScan->mz.empty());
+    delete emptyScan;
+}
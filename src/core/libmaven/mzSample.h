@@ -28,6 +28,8 @@ class Scan;
 class Peak;
 class PeakGroup;
 class EIC;
+class EicIndex;
+class TransitionIndex;
 class Compound;
 class Adduct;
 class mzLink;
@@ -297,13 +299,18 @@ class mzSample
     float getAverageFullScanTime();
 
     /**
-    * @brief Map scan numbers to filterline
-    * @details Update map srmScans where key is the filterline and value is int vector.
-    * int vector contains scan numbers
-    * @see mzSample:srmScans
+    * @brief Index the scans of this sample by filterline (SRM ID) and by
+    * SRM/MRM transition
+    * @see TransitionIndex
     */
     void enumerateSRMScans();
 
+    /**
+     * @brief The transition index of this sample's scans, which is built if
+     * it has not been.
+     */
+    const TransitionIndex* transitionIndex();
+
     /**
     * @brief Find correlation between two EICs
     * @param mz1 m/z for first EIC
@@ -370,6 +377,8 @@ class mzSample
 
     /**
     * @brief Get Average Scan
+    * @details Points of matching scans are binned by m/z in parallel, one
+    * scan at a time, and the sorted bins of all scans are merged.
     * @param rtmin Minimum retention time
     * @param rtmax Maximum retention time
     * @param mslevel MS Level
@@ -680,6 +689,62 @@ class mzSample
                           */
     static int getFilter_polarity() { return filter_polarity; }
 
+    /**
+     * @brief Enable or disable caching of loaded samples in a binary format,
+     * that can be re-loaded much faster than the raw files.
+     * @see SampleCache
+     */
+    static void setCache_enabled(bool x) { cache_enabled = x; }
+
+    /**
+     * @brief Set the directory in which sample caches are stored. If empty,
+     * caches are stored next to their sample files.
+     */
+    static void setCache_dir(string x) { cache_dir = x; }
+
+    static bool getCache_enabled() { return cache_enabled; }
+
+    /**
+     * @brief Enable or disable lazy loading of scans. Samples loaded while
+     * enabled keep only the metadata of their scans in memory, and peak
+     * arrays are read from the sample cache on demand (a cache is created if
+     * needed, even when caching is otherwise disabled).
+     * @see ScanStore
+     */
+    static void setLazyScans(bool x) { lazy_scans = x; }
+
+    static bool getLazyScans() { return lazy_scans; }
+
+    /**
+     * @brief Enable or disable building an m/z index of the peaks of every
+     * sample as it is loaded, to speed up EIC extraction.
+     * @see buildEicIndex
+     */
+    static void setEicIndex_enabled(bool x) { eicIndex_enabled = x; }
+
+    static bool getEicIndex_enabled() { return eicIndex_enabled; }
+
+    /**
+     * @brief Index the peaks of all scans by m/z, so that EICs can be
+     * extracted without searching every scan. Must be rebuilt if the peaks
+     * of scans change.
+     * @param binWidth Width of m/z bins of the index, in Da.
+     */
+    void buildEicIndex(float binWidth = 0.01f);
+
+    /**
+     * @brief Release the m/z index of this sample's peaks, if any.
+     */
+    void clearEicIndex() { _eicIndex.reset(); }
+
+    /**
+     * @brief The m/z index of this sample's peaks, or nullptr if it has not
+     * been built.
+     */
+    const EicIndex* eicIndex() const { return _eicIndex.get(); }
+
+    static string getCache_dir() { return cache_dir; }
+
     vector<float> getIntensityDistribution(int mslevel);
 
     deque<Scan *> scans;
@@ -713,8 +778,6 @@ class mzSample
     unsigned long int injectionTime; //Injection Time Stamp
     int injectionOrder; //Injection order
 
-    map<string, vector<int> > srmScans; //SRM to scan mapping
-
     /** tags associated with this sample */
     map<string, string> instrumentInfo;
 
@@ -726,7 +789,15 @@ class mzSample
     vector<double> polynomialAlignmentTransformation; //parameters for polynomial transform
 
   private:
+    friend class SampleCache;
+
     int _id;
+
+    // keeps the sample cache, from which lazy scans are read, mapped
+    shared_ptr<const void> _lazyScanSource;
+
+    shared_ptr<const EicIndex> _eicIndex;
+    shared_ptr<const TransitionIndex> _transitionIndex;
     unsigned int _numMS1Scans;
     unsigned int _numMS2Scans;
 
@@ -760,6 +831,10 @@ class mzSample
     static int filter_intensityQuantile;
     static int filter_mslevel;
     static int filter_polarity;
+    static bool cache_enabled;
+    static bool lazy_scans;
+    static bool eicIndex_enabled;
+    static string cache_dir;
 
     vector<string> filterChromatogram {
         "sample", 
@@ -488,59 +488,109 @@ namespace mzUtils {
 
     pair<float, float> gaussFit(const vector<float>& ycoord)
     {
-        float s = 20;
-        float min_s = 0;
-        float minR = 1e99;
-
-        //find best fit
-        if (ycoord.size()<3){
-            pair<float, float> res = make_pair(numeric_limits<float>::max(),
-                                               numeric_limits<float>::max());
-            return res;
-        }
-        vector<float>yobs = ycoord;
-        int ysize = yobs.size();
-        int midpoint = int(ysize/2);
-        //find maximum point ( assuming it somewhere around midpoint of the yobs);
-        float ymax = max(max(yobs[midpoint], yobs[midpoint-1]),
-                         yobs[midpoint+1]);
-        float ymin = min( yobs[0], yobs[ysize-1]);
-
-        //initialize x vector, values centered around 0,
-        //forxample  -2, -1, 0, 1, 2
-        int xinit = int(ysize / 2) * -1;
-        vector<float> x(ysize, 0);
-        int greaterZeroCount = 0;
+        return gaussFit(ycoord.data(), ycoord.size());
+    }
 
-        for(int i = 0; i < ysize; i++){
-            x[i] = xinit + i;
-            if (yobs[i] > ymin) greaterZeroCount++;
-            yobs[i] = (yobs[i] - ymin) / (ymax - ymin);
-            if(yobs[i] < 0) yobs[i] = 0;
-        }
+    pair<float, float> gaussFit(const float* yobs, int ysize)
+    {
+        if (ysize < 3)
+            return make_pair(FLT_MAX, FLT_MAX);
 
-        bool converged = false;
-        int ittr = 0;
+        // find maximum point (assuming it somewhere around midpoint of yobs)
+        int midpoint = ysize / 2;
+        float ymax = max(max(yobs[midpoint], yobs[midpoint - 1]),
+                         yobs[midpoint + 1]);
+        float ymin = min(yobs[0], yobs[ysize - 1]);
 
-        if (greaterZeroCount <= 3 ){
-            pair<float, float> res = make_pair(FLT_MAX,
-                                               FLT_MAX);
-            return res;
+        int greaterZeroCount = 0;
+        for (int i = 0; i < ysize; i++) {
+            if (yobs[i] > ymin)
+                greaterZeroCount++;
         }
-        while (!converged ) {
-            if ( ittr++ > 20 ) break;
-            float Rsqr = 0;
-            for(int i = 0; i < ysize; i++ ){
-                Rsqr += SQUARE(exp(-0.5*SQUARE(x[i]/s)) - yobs[i]);
+        if (greaterZeroCount <= 3 || !(ymax > ymin))
+            return make_pair(FLT_MAX, FLT_MAX);
+
+        float scale = 1.0f / (ymax - ymin);
+        auto scaled = [yobs, ymin, scale](int i) {
+            float y = (yobs[i] - ymin) * scale;
+            return y < 0.0f ? 0.0f : y;
+        };
+
+        // initial guess from least squares fit of log(y) = -x^2 / (2 s^2),
+        // weighted by y^2 to account for the error of log(y)
+        const float minSigma = 0.18f;
+        const float maxSigma = 20.0f;
+        double sumLog = 0.0;
+        double sumX4 = 0.0;
+        for (int i = 0; i < ysize; i++) {
+            float y = scaled(i);
+            double x2 = SQUARE(static_cast<double>(i - midpoint));
+            if (y <= 0.0f || x2 == 0.0)
+                continue;
+            double weight = SQUARE(static_cast<double>(y));
+            sumLog -= weight * x2 * log(y);
+            sumX4 += weight * x2 * x2;
+        }
+        float s = maxSigma;
+        if (sumLog > 0.0)
+            s = sqrt(sumX4 / (2.0 * sumLog));
+        s = min(max(s, minSigma), maxSigma);
+
+        // sum of squared residuals for a given sigma, with the gradient and
+        // Gauss-Newton approximation of the curvature w.r.t. log(sigma);
+        // on integer offsets k, exp(-k^2 / (2 s^2)) is q^(k^2), which is
+        // updated by multiplication instead of calling exp for every point
+        auto residuals = [&](float sigma, double& grad, double& curv) {
+            double invS2 = 1.0 / SQUARE(static_cast<double>(sigma));
+            double q = exp(-0.5 * invS2);
+            double ratio = q;
+            double g = 1.0;
+            double sum = SQUARE(g - scaled(midpoint));
+            grad = 0.0;
+            curv = 0.0;
+            for (int k = 1; k <= midpoint || midpoint + k < ysize; k++) {
+                g *= ratio;
+                ratio *= q * q;
+                double dg = g * k * k * invS2;
+                for (int i : {midpoint - k, midpoint + k}) {
+                    if (i < 0 || i >= ysize)
+                        continue;
+                    double r = g - scaled(i);
+                    sum += r * r;
+                    grad += dg * r;
+                    curv += dg * dg;
+                }
             }
+            return sum;
+        };
+
+        double grad, curv;
+        double minR = residuals(s, grad, curv);
+        double lambda = 1e-3;
+        for (int ittr = 0; ittr < 20 && curv > 0.0; ittr++) {
+            double step = -grad / (curv * (1.0 + lambda));
+            step = max(-0.5, min(0.5, step));
+            float next = min(max(static_cast<float>(s * exp(step)), minSigma),
+                             maxSigma);
+            if (next == s)
+                break;
 
-            if ( Rsqr < minR || ittr == 0 ) { minR = Rsqr; min_s = s; }
-            else if ( Rsqr > minR ) break;
-            else if ( Rsqr - minR == 0 ) break;
-            s /= 1.25;
+            double nextGrad, nextCurv;
+            double R = residuals(next, nextGrad, nextCurv);
+            if (R < minR) {
+                bool converged = abs(next - s) < 1e-4f * s;
+                s = next;
+                minR = R;
+                grad = nextGrad;
+                curv = nextCurv;
+                lambda /= 10.0;
+                if (converged)
+                    break;
+            } else {
+                lambda *= 10.0;
+            }
         }
-        pair<float, float> res = make_pair(min_s, minR/(ysize*ysize));
-        return res;
+        return make_pair(s, static_cast<float>(minR / SQUARE(ysize)));
     }
 
     inline unsigned long factorial(int n)
@@ -1602,8 +1652,77 @@ TEST_SUITE("Testing mzUtils functions")
         input.push_back(43.998);
 
         pair<float, float> res = mzUtils::gaussFit(input);
-        REQUIRE(doctest::Approx(res.first) == 4.1943);
-        REQUIRE(doctest::Approx(res.second) == 0.0455033);
+        REQUIRE(doctest::Approx(res.first) == 4.1359);
+        REQUIRE(doctest::Approx(res.second) == 0.0454998);
+    }
+
+    TEST_CASE("Testing GaussFit against a search of sigma values")
+    {
+        // previous implementation, which searched sigma on a geometric grid
+        auto gridFit = [](const vector<float>& values) {
+            int ysize = values.size();
+            int midpoint = ysize / 2;
+            float ymax = max(max(values[midpoint], values[midpoint - 1]),
+                             values[midpoint + 1]);
+            float ymin = min(values[0], values[ysize - 1]);
+            vector<float> yobs(ysize);
+            for (int i = 0; i < ysize; i++)
+                yobs[i] = max(0.0f, (values[i] - ymin) / (ymax - ymin));
+
+            float s = 20;
+            float min_s = 0;
+            float minR = FLT_MAX;
+            for (int ittr = 0; ittr <= 20; ittr++) {
+                float Rsqr = 0;
+                for (int i = 0; i < ysize; i++) {
+                    float x = i - midpoint;
+                    Rsqr += SQUARE(exp(-0.5 * SQUARE(x / s)) - yobs[i]);
+                }
+                if (Rsqr >= minR)
+                    break;
+                minR = Rsqr;
+                min_s = s;
+                s /= 1.25;
+            }
+            return make_pair(min_s, minR / (ysize * ysize));
+        };
+
+        mt19937 generator(7);
+        uniform_real_distribution<float> uniform(0.0f, 1.0f);
+        normal_distribution<float> normal(0.0f, 1.0f);
+        int numFits = 0;
+        int numWorse = 0;
+        for (int k = 0; k < 2000; k++) {
+            int moves = 3 + k % 25;
+            float sigma = 0.5f + 12.0f * uniform(generator);
+            float shift = uniform(generator) - 0.5f;
+            float noise = k % 2 == 0 ? 0.01f : 0.05f;
+            vector<float> values(2 * moves + 1);
+            for (size_t i = 0; i < values.size(); i++) {
+                float x = (static_cast<float>(i) - moves - shift) / sigma;
+                values[i] = 1e5f * (0.1f + exp(-0.5f * x * x)
+                                    + noise * normal(generator));
+            }
+
+            pair<float, float> grid = gridFit(values);
+            pair<float, float> res = mzUtils::gaussFit(values);
+            if (res.first == FLT_MAX)
+                continue;
+
+            // the fit may be worse than the grid search only by settling in
+            // another local minimum, and sigma is within the grid's spacing
+            // of the one found by the search
+            numFits++;
+            REQUIRE(res.second <= grid.second * 1.5f);
+            if (res.second > grid.second * 1.0001f)
+                numWorse++;
+            if (grid.first < 20.0f && res.first < 20.0f) {
+                REQUIRE(res.first > grid.first / 1.25f / 1.25f);
+                REQUIRE(res.first < grid.first * 1.25f * 1.25f);
+            }
+        }
+        REQUIRE(numFits > 1900);
+        REQUIRE(numWorse < numFits / 100);
     }
 
     TEST_CASE("Testing decompress string")
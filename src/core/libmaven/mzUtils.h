@@ -319,14 +319,28 @@ namespace mzUtils
     float correlation(const vector<float>& a, const vector<float>& b);
 
     /**
-     * [gaussFit ]
-     * @method gaussFit
-     * @param  yobs     []
-     * @param  sigmal   []
-     * @param  R2       []
+     * @brief Fit a Gaussian curve to a peak.
+     * @see gaussFit(const float*, int)
      */
     pair<float, float> gaussFit(const vector<float>& yobs);
 
+    /**
+     * @brief Fit a Gaussian curve to a peak, centred at the middle of the
+     * observed values.
+     * @details Values are scaled so that the lower of the two end points is
+     * zero and the highest of the three middle points is one, and the width
+     * of a unit-height Gaussian is fit to them by least squares. An initial
+     * width is found in closed form, by fitting a parabola to the logarithm
+     * of the scaled values, and then refined with a few Levenberg–Marquardt
+     * iterations. Nothing is allocated.
+     * @param yobs Observed intensities at consecutive, equally spaced points.
+     * @param size Number of observed values.
+     * @return Pair of the fitted sigma (in number of points, between 0.18 and
+     * 20) and the sum of squared residuals divided by the squared number of
+     * points. Both are FLT_MAX if the values do not look like a peak.
+     */
+    pair<float, float> gaussFit(const float* yobs, int size);
+
     /**
      * @brief factorial Calculates the factorial of the given integer number.
      * @param n Integer number.
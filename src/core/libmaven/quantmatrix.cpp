@@ -0,0 +1,130 @@
+#include "doctest.h"
+#include "mavenparameters.h"
+#include "mzSample.h"
+#include "Peak.h"
+#include "PeakGroup.h"
+#include "quantmatrix.h"
+
+QuantMatrix::QuantMatrix(const vector<PeakGroup*>& groups,
+                         const vector<mzSample*>& samples,
+                         PeakGroup::QType type)
+    : _groups(groups), _samples(samples), _type(type)
+{
+    // for duplicated samples, the last column is used (other columns of the
+    // sample stay zero), as in `PeakGroup::getOrderedIntensityVector`
+    for (size_t i = 0; i < _samples.size(); ++i)
+        _sampleIndexes[_samples[i]] = i;
+
+    _values.assign(_groups.size() * _samples.size(), 0.0f);
+    int numGroups = _groups.size();
+#pragma omp parallel for schedule(dynamic, 256)
+    for (int i = 0; i < numGroups; ++i)
+        updateGroup(i);
+}
+
+int QuantMatrix::sampleIndex(const mzSample* sample) const
+{
+    auto pos = _sampleIndexes.find(sample);
+    return pos == _sampleIndexes.end() ? -1 : pos->second;
+}
+
+vector<float> QuantMatrix::rowVector(size_t row) const
+{
+    const float* values = this->row(row);
+    return vector<float>(values, values + _samples.size());
+}
+
+vector<float> QuantMatrix::columnVector(size_t column) const
+{
+    vector<float> values(_groups.size());
+    for (size_t i = 0; i < _groups.size(); ++i)
+        values[i] = value(i, column);
+    return values;
+}
+
+void QuantMatrix::updateGroup(size_t row)
+{
+    float* values = _values.data() + row * _samples.size();
+    fill(values, values + _samples.size(), 0.0f);
+    for (const Peak& peak : _groups[row]->peaks) {
+        int column = sampleIndex(peak.getSample());
+        if (column < 0)
+            continue;
+        float y = PeakGroup::peakQuantity(peak, _type);
+        if (values[column] < y)
+            values[column] = y;
+    }
+}
+
+///////////////////////////Test Cases//////////////////////////////
+
+TEST_CASE("Testing quantitation matrix")
+{
+    vector<mzSample*> samples;
+    for (int i = 0; i < 4; ++i) {
+        samples.push_back(new mzSample());
+        samples.back()->setNormalizationConstant(1.0f + i);
+    }
+
+    auto parameters = make_shared<MavenParameters>();
+    vector<PeakGroup*> groups;
+    for (int i = 0; i < 3; ++i) {
+        auto group = new PeakGroup(parameters,
+                                   PeakGroup::IntegrationType::Automated);
+        for (int j = 0; j < 4; ++j) {
+            // no peak in the sample on the diagonal, two in the next one
+            if (i == j)
+                continue;
+            Peak peak;
+            peak.setSample(samples[j]);
+            peak.peakAreaTopCorrected = 10.0f * i + j;
+            peak.peakIntensity = 100.0f * i + j;
+            group->addPeak(peak);
+            if (j == (i + 1) % 4) {
+                peak.peakAreaTopCorrected += 0.5f;
+                group->addPeak(peak);
+            }
+        }
+        groups.push_back(group);
+    }
+
+    // the matrix holds a subset of samples, in a different order
+    vector<mzSample*> columns = {samples[3], samples[0], samples[2]};
+    for (auto type : {PeakGroup::AreaTop, PeakGroup::Height}) {
+        QuantMatrix matrix(groups, columns, type);
+        REQUIRE(matrix.numGroups() == 3);
+        REQUIRE(matrix.numSamples() == 3);
+        REQUIRE(matrix.sampleIndex(samples[2]) == 2);
+        REQUIRE(matrix.sampleIndex(samples[1]) == -1);
+        for (size_t i = 0; i < groups.size(); ++i) {
+            vector<float> expected =
+                groups[i]->getOrderedIntensityVector(columns, type);
+            REQUIRE(matrix.rowVector(i) == expected);
+            for (size_t j = 0; j < columns.size(); ++j)
+                REQUIRE(matrix.value(i, j) == expected[j]);
+        }
+    }
+
+    // a sample given twice is quantified in its last column only
+    vector<mzSample*> duplicated = {samples[3], samples[0], samples[3]};
+    QuantMatrix duplicatedMatrix(groups, duplicated, PeakGroup::AreaTop);
+    REQUIRE(duplicatedMatrix.sampleIndex(samples[3]) == 2);
+    for (size_t i = 0; i < groups.size(); ++i) {
+        REQUIRE(duplicatedMatrix.rowVector(i)
+                == groups[i]->getOrderedIntensityVector(duplicated,
+                                                        PeakGroup::AreaTop));
+        REQUIRE(duplicatedMatrix.value(i, 0) == 0.0f);
+    }
+
+    QuantMatrix matrix(groups, columns, PeakGroup::AreaTop);
+    REQUIRE(matrix.value(1, 2) == doctest::Approx((10.5f + 2) * 3));
+    REQUIRE(matrix.columnVector(1)
+            == vector<float>({0.0f, 10.0f, 20.0f}));
+
+    groups[0]->peaks.clear();
+    matrix.updateGroup(0);
+    REQUIRE(matrix.rowVector(0) == vector<float>(3, 0.0f));
+
+    delete_all(groups);
+    delete_all(samples);
+}
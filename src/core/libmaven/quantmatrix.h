@@ -0,0 +1,99 @@
+#ifndef QUANTMATRIX_H
+#define QUANTMATRIX_H
+
+#include <unordered_map>
+
+#include "standardincludes.h"
+#include "PeakGroup.h"
+
+class mzSample;
+
+using namespace std;
+
+/**
+ * @class QuantMatrix
+ * @ingroup libmaven
+ * @brief Dense matrix of a quantity (area, height, etc.) of peak-groups
+ * (rows) across samples (columns).
+ * @details Values are stored contiguously, one row per group, so that a
+ * group's quantities across all samples, or a single group × sample value,
+ * can be read without looking up peaks. Each value is the same as the one
+ * `PeakGroup::getOrderedIntensityVector` gives for that group and sample:
+ * the highest normalized quantity among the group's peaks from the sample,
+ * or zero if it has none. A sample given for more than one column is
+ * quantified in its last column only.
+ *
+ * The matrix is a snapshot of its groups, built from their peaks when it is
+ * constructed. It is not part of detection results: peak detection neither
+ * produces nor updates one, and `PeakGroup::getPeak`/`getSamplePeak` are
+ * still scans over a group's peaks. Its users (heatmap, scatter plot,
+ * clustering, sample comparison and CSV reports) each build one right
+ * before reading it, on the thread that owns the groups, in place of
+ * calling `PeakGroup::getOrderedIntensityVector` once per group. Whoever
+ * keeps a matrix longer is responsible for calling `updateGroup` for every
+ * row whose group has its peaks changed, and must not keep it past the
+ * deletion of any of its groups.
+ */
+class QuantMatrix
+{
+public:
+    /**
+     * @brief Build a matrix of the given groups and samples.
+     * @param groups Groups in row order. Must outlive the matrix.
+     * @param samples Samples in column order.
+     * @param type Quantity to be stored.
+     */
+    QuantMatrix(const vector<PeakGroup*>& groups,
+                const vector<mzSample*>& samples,
+                PeakGroup::QType type);
+
+    size_t numGroups() const { return _groups.size(); }
+
+    size_t numSamples() const { return _samples.size(); }
+
+    PeakGroup::QType type() const { return _type; }
+
+    PeakGroup* group(size_t row) const { return _groups[row]; }
+
+    mzSample* sample(size_t column) const { return _samples[column]; }
+
+    /**
+     * @brief Column of the given sample, or -1 if it is not in the matrix.
+     */
+    int sampleIndex(const mzSample* sample) const;
+
+    float value(size_t row, size_t column) const
+    {
+        return _values[row * _samples.size() + column];
+    }
+
+    /**
+     * @brief Quantities of a group, in sample order (`numSamples` values).
+     */
+    const float* row(size_t row) const
+    {
+        return _values.data() + row * _samples.size();
+    }
+
+    /**
+     * @brief Copy of the quantities of a group, for users that modify or
+     * keep them; `row` avoids the copy.
+     */
+    vector<float> rowVector(size_t row) const;
+
+    vector<float> columnVector(size_t column) const;
+
+    /**
+     * @brief Re-read the quantities of the group at the given row.
+     */
+    void updateGroup(size_t row);
+
+private:
+    vector<PeakGroup*> _groups;
+    vector<mzSample*> _samples;
+    PeakGroup::QType _type;
+    vector<float> _values;
+    unordered_map<const mzSample*, int> _sampleIndexes;
+};
+
+#endif // QUANTMATRIX_H
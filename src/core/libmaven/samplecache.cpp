@@ -0,0 +1,455 @@
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include "doctest.h"
+#include "mzSample.h"
+#include "mzUtils.h"
+#include "samplecache.h"
+#include "Scan.h"
+#include "scanstore.h"
+
+namespace {
+
+const char cacheMagic[8] = {'E', 'M', 'S', 'C', 'A', 'C', 'H', 'E'};
+const uint32_t cacheVersion = 1;
+
+// written in native byte order, used to reject caches from other platforms
+const uint32_t byteOrderMark = 0x01020304;
+
+/**
+ * @brief Writes plain values, strings and float arrays to a stream, keeping
+ * track of the offset so that arrays can be aligned.
+ */
+class CacheWriter
+{
+public:
+    CacheWriter(ofstream& stream) : _stream(stream), _offset(0) {}
+
+    template<typename T>
+    void write(const T& value)
+    {
+        _write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void write(const string& value)
+    {
+        write(static_cast<uint32_t>(value.size()));
+        _write(value.data(), value.size());
+    }
+
+    void write(const vector<float>& values)
+    {
+        static const char padding[sizeof(float)] = {0};
+        size_t misalignment = _offset % sizeof(float);
+        if (misalignment > 0)
+            _write(padding, sizeof(float) - misalignment);
+        _write(reinterpret_cast<const char*>(values.data()),
+               values.size() * sizeof(float));
+    }
+
+    bool good() const { return _stream.good(); }
+
+private:
+    ofstream& _stream;
+    size_t _offset;
+
+    void _write(const char* data, size_t size)
+    {
+        _stream.write(data, size);
+        _offset += size;
+    }
+};
+
+/**
+ * @brief Reads back values written by `CacheWriter` from a memory region,
+ * failing (instead of reading past the end) on truncated or corrupt data.
+ */
+class CacheReader
+{
+public:
+    CacheReader(const char* data, size_t size)
+        : _data(data), _size(size), _offset(0)
+    {
+    }
+
+    template<typename T>
+    bool read(T& value)
+    {
+        if (_size - _offset < sizeof(T))
+            return false;
+        memcpy(&value, _data + _offset, sizeof(T));
+        _offset += sizeof(T);
+        return true;
+    }
+
+    bool read(string& value)
+    {
+        uint32_t length = 0;
+        if (!read(length) || _size - _offset < length)
+            return false;
+        value.assign(_data + _offset, length);
+        _offset += length;
+        return true;
+    }
+
+    bool read(vector<float>& values, uint64_t count)
+    {
+        const char* position = nullptr;
+        if (!skip(position, count))
+            return false;
+        values.resize(count);
+        memcpy(values.data(), position, count * sizeof(float));
+        return true;
+    }
+
+    /**
+     * @brief Skip over an array of floats, storing its (aligned) location.
+     */
+    bool skip(const char*& position, uint64_t count)
+    {
+        size_t misalignment = _offset % sizeof(float);
+        if (misalignment > 0)
+            _offset = min(_size, _offset + sizeof(float) - misalignment);
+        if ((_size - _offset) / sizeof(float) < count)
+            return false;
+        position = _data + _offset;
+        _offset += count * sizeof(float);
+        return true;
+    }
+
+private:
+    const char* _data;
+    size_t _size;
+    size_t _offset;
+};
+
+}
+
+SampleCache::SampleCache(string cacheDir) : _cacheDir(cacheDir)
+{
+}
+
+bool SampleCache::_SourceKey::operator==(const _SourceKey& other) const
+{
+    return path == other.path
+           && size == other.size
+           && modificationTime == other.modificationTime
+           && filterMinIntensity == other.filterMinIntensity
+           && filterCentroidScans == other.filterCentroidScans
+           && filterIntensityQuantile == other.filterIntensityQuantile
+           && filterMsLevel == other.filterMsLevel
+           && filterPolarity == other.filterPolarity;
+}
+
+bool SampleCache::_sourceKey(const string& filename, _SourceKey& key)
+{
+    struct stat fileInfo;
+    if (stat(filename.c_str(), &fileInfo) != 0)
+        return false;
+
+    key.path = filename;
+    key.size = fileInfo.st_size;
+    key.modificationTime = fileInfo.st_mtime;
+    key.filterMinIntensity = mzSample::getFilter_minIntensity();
+    key.filterCentroidScans = mzSample::getFilter_centroidScans();
+    key.filterIntensityQuantile = mzSample::getFilter_intensityQuantile();
+    key.filterMsLevel = mzSample::getFilter_mslevel();
+    key.filterPolarity = mzSample::getFilter_polarity();
+    return true;
+}
+
+string SampleCache::cachePath(const string& filename) const
+{
+    if (_cacheDir.empty())
+        return filename + ".emcache";
+
+    // files with the same name may exist in different directories, so the
+    // hash of the full path is added to the name of the cache
+    size_t slash = filename.find_last_of("/\\");
+    string basename = slash == string::npos ? filename
+                                            : filename.substr(slash + 1);
+    char hash[17];
+    snprintf(hash,
+             sizeof(hash),
+             "%016llx",
+             static_cast<unsigned long long>(std::hash<string>()(filename)));
+
+    string dir = _cacheDir;
+    if (dir.back() != '/' && dir.back() != DIR_SEPARATOR_CHAR)
+        dir += DIR_SEPARATOR_STR;
+    return dir + basename + "." + hash + ".emcache";
+}
+
+bool SampleCache::save(const mzSample* sample, const string& filename) const
+{
+    _SourceKey key;
+    if (sample == nullptr || !_sourceKey(filename, key))
+        return false;
+
+    string path = cachePath(filename);
+    string temporaryPath = path + ".tmp";
+    {
+        ofstream stream(temporaryPath, ios::out | ios::binary | ios::trunc);
+        if (!stream.is_open())
+            return false;
+
+        CacheWriter writer(stream);
+        writer.write(cacheMagic);
+        writer.write(cacheVersion);
+        writer.write(byteOrderMark);
+
+        writer.write(key.path);
+        writer.write(key.size);
+        writer.write(key.modificationTime);
+        writer.write(key.filterMinIntensity);
+        writer.write(key.filterCentroidScans);
+        writer.write(key.filterIntensityQuantile);
+        writer.write(key.filterMsLevel);
+        writer.write(key.filterPolarity);
+
+        writer.write(static_cast<uint64_t>(sample->injectionTime));
+        writer.write(static_cast<uint32_t>(sample->instrumentInfo.size()));
+        for (const auto& info : sample->instrumentInfo) {
+            writer.write(info.first);
+            writer.write(info.second);
+        }
+
+        writer.write(static_cast<uint64_t>(sample->scans.size()));
+        for (Scan* scan : sample->scans) {
+            ScanPin pin(scan);
+            writer.write(static_cast<int32_t>(scan->scannum));
+            writer.write(static_cast<int32_t>(scan->mslevel));
+            writer.write(static_cast<int32_t>(scan->centroided));
+            writer.write(scan->rt);
+            writer.write(scan->originalRt);
+            writer.write(scan->precursorMz);
+            writer.write(scan->precursorIntensity);
+            writer.write(static_cast<int32_t>(scan->precursorCharge));
+            writer.write(static_cast<int32_t>(scan->precursorScanNum));
+            writer.write(scan->isolationWindow);
+            writer.write(scan->productMz);
+            writer.write(scan->collisionEnergy);
+            writer.write(static_cast<int32_t>(scan->polarity));
+            writer.write(scan->scanType);
+            writer.write(scan->filterLine);
+            writer.write(static_cast<uint64_t>(scan->mz.size()));
+            writer.write(static_cast<uint64_t>(scan->intensity.size()));
+            writer.write(scan->mz);
+            writer.write(scan->intensity);
+        }
+
+        if (!writer.good()) {
+            stream.close();
+            remove(temporaryPath.c_str());
+            return false;
+        }
+    }
+
+    // rename does not replace an existing file on every platform
+    remove(path.c_str());
+    if (rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        remove(temporaryPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool SampleCache::load(mzSample* sample,
+                       const string& filename,
+                       bool lazy) const
+{
+    _SourceKey expectedKey;
+    if (sample == nullptr || !_sourceKey(filename, expectedKey))
+        return false;
+
+    string path = cachePath(filename);
+    if (!mzUtils::fileExists(path))
+        return false;
+
+    auto mappedFile = make_shared<boost::iostreams::mapped_file_source>();
+    try {
+        mappedFile->open(path);
+    } catch (const std::exception& e) {
+        return false;
+    }
+    if (!mappedFile->is_open())
+        return false;
+
+    CacheReader reader(mappedFile->data(), mappedFile->size());
+    char magic[sizeof(cacheMagic)];
+    uint32_t version = 0;
+    uint32_t mark = 0;
+    if (!reader.read(magic)
+        || memcmp(magic, cacheMagic, sizeof(cacheMagic)) != 0
+        || !reader.read(version)
+        || version != cacheVersion
+        || !reader.read(mark)
+        || mark != byteOrderMark) {
+        return false;
+    }
+
+    _SourceKey key;
+    if (!reader.read(key.path)
+        || !reader.read(key.size)
+        || !reader.read(key.modificationTime)
+        || !reader.read(key.filterMinIntensity)
+        || !reader.read(key.filterCentroidScans)
+        || !reader.read(key.filterIntensityQuantile)
+        || !reader.read(key.filterMsLevel)
+        || !reader.read(key.filterPolarity)
+        || !(key == expectedKey)) {
+        return false;
+    }
+
+    uint64_t injectionTime = 0;
+    uint32_t numInfo = 0;
+    if (!reader.read(injectionTime) || !reader.read(numInfo))
+        return false;
+    map<string, string> instrumentInfo;
+    for (uint32_t i = 0; i < numInfo; ++i) {
+        string name, value;
+        if (!reader.read(name) || !reader.read(value))
+            return false;
+        instrumentInfo[name] = value;
+    }
+
+    uint64_t numScans = 0;
+    if (!reader.read(numScans))
+        return false;
+
+    deque<Scan*> scans;
+    bool valid = true;
+    for (uint64_t i = 0; i < numScans && valid; ++i) {
+        int32_t scannum, mslevel, centroided, precursorCharge;
+        int32_t precursorScanNum, polarity;
+        float rt, originalRt, precursorMz, precursorIntensity;
+        float isolationWindow, productMz, collisionEnergy;
+        string scanType, filterLine;
+        uint64_t numMz = 0, numIntensities = 0;
+        valid = reader.read(scannum)
+                && reader.read(mslevel)
+                && reader.read(centroided)
+                && reader.read(rt)
+                && reader.read(originalRt)
+                && reader.read(precursorMz)
+                && reader.read(precursorIntensity)
+                && reader.read(precursorCharge)
+                && reader.read(precursorScanNum)
+                && reader.read(isolationWindow)
+                && reader.read(productMz)
+                && reader.read(collisionEnergy)
+                && reader.read(polarity)
+                && reader.read(scanType)
+                && reader.read(filterLine)
+                && reader.read(numMz)
+                && reader.read(numIntensities);
+        if (!valid)
+            break;
+
+        Scan* scan =
+            new Scan(sample, scannum, mslevel, rt, precursorMz, polarity);
+        scans.push_back(scan);
+        scan->centroided = centroided;
+        scan->originalRt = originalRt;
+        scan->precursorIntensity = precursorIntensity;
+        scan->precursorCharge = precursorCharge;
+        scan->precursorScanNum = precursorScanNum;
+        scan->isolationWindow = isolationWindow;
+        scan->productMz = productMz;
+        scan->collisionEnergy = collisionEnergy;
+        scan->scanType = scanType;
+        scan->filterLine = filterLine;
+        if (lazy) {
+            // intensities are stored right after the m/z values
+            const char* mzData = nullptr;
+            const char* intensityData = nullptr;
+            valid = reader.skip(mzData, numMz)
+                    && reader.skip(intensityData, numIntensities);
+            if (valid)
+                scan->setLazyData(mzData, numMz, numIntensities);
+        } else {
+            valid = reader.read(scan->mz, numMz)
+                    && reader.read(scan->intensity, numIntensities);
+        }
+    }
+
+    if (!valid) {
+        mzUtils::delete_all(scans);
+        return false;
+    }
+
+    sample->scans.swap(scans);
+    sample->injectionTime = injectionTime;
+    sample->instrumentInfo = instrumentInfo;
+    sample->_numMS1Scans = 0;
+    sample->_numMS2Scans = 0;
+    for (const Scan* scan : sample->scans) {
+        if (scan->mslevel == 1)
+            ++sample->_numMS1Scans;
+        if (scan->mslevel == 2)
+            ++sample->_numMS2Scans;
+    }
+    if (lazy)
+        sample->_lazyScanSource = mappedFile;
+    return true;
+}
+
+///////////////////////////Test Cases//////////////////////////////
+
+TEST_CASE("Testing sample cache")
+{
+    string samplePath = "sample_cache_test.mzML";
+    ofstream rawFile(samplePath);
+    rawFile << "<mzML></mzML>";
+    rawFile.close();
+
+    mzSample sample;
+    Scan* ms1Scan = new Scan(&sample, 0, 1, 1.5f, 0.0f, 1);
+    ms1Scan->mz = {100.0f, 200.5f, 300.25f};
+    ms1Scan->intensity = {10.0f, 2000.0f, 30.0f};
+    ms1Scan->filterLine = "FTMS + p ESI Full ms";
+    sample.addScan(ms1Scan);
+    Scan* ms2Scan = new Scan(&sample, 1, 2, 1.6f, 200.5f, 1);
+    ms2Scan->mz = {50.0f};
+    ms2Scan->intensity = {5.0f};
+    ms2Scan->collisionEnergy = 35.0f;
+    sample.addScan(ms2Scan);
+    sample.instrumentInfo["msModel"] = "Exactive";
+
+    SampleCache cache;
+    REQUIRE(cache.save(&sample, samplePath));
+
+    mzSample restored;
+    REQUIRE(cache.load(&restored, samplePath));
+    REQUIRE(restored.scans.size() == 2);
+    REQUIRE(restored.ms1ScanCount() == 1);
+    REQUIRE(restored.ms2ScanCount() == 1);
+    REQUIRE(restored.instrumentInfo["msModel"] == "Exactive");
+    for (size_t i = 0; i < sample.scans.size(); ++i) {
+        Scan* original = sample.scans[i];
+        Scan* copy = restored.scans[i];
+        REQUIRE(copy->getSample() == &restored);
+        REQUIRE(copy->scannum == original->scannum);
+        REQUIRE(copy->mslevel == original->mslevel);
+        REQUIRE(copy->rt == original->rt);
+        REQUIRE(copy->precursorMz == original->precursorMz);
+        REQUIRE(copy->collisionEnergy == original->collisionEnergy);
+        REQUIRE(copy->filterLine == original->filterLine);
+        REQUIRE(copy->mz == original->mz);
+        REQUIRE(copy->intensity == original->intensity);
+    }
+
+    // caches are invalidated when scan filters change
+    int polarityFilter = mzSample::getFilter_polarity();
+    mzSample::setFilter_polarity(-1);
+    mzSample filtered;
+    REQUIRE(!cache.load(&filtered, samplePath));
+    REQUIRE(filtered.scans.empty());
+    mzSample::setFilter_polarity(polarityFilter);
+
+    remove(cache.cachePath(samplePath).c_str());
+    remove(samplePath.c_str());
+}
@@ -0,0 +1,93 @@
+#ifndef SAMPLECACHE_H
+#define SAMPLECACHE_H
+
+#include "standardincludes.h"
+
+class mzSample;
+class Scan;
+
+using namespace std;
+
+/**
+ * @class SampleCache
+ * @ingroup libmaven
+ * @brief An on-disk, binary copy of the scans of a sample, that can be loaded
+ * much faster than the raw file it was created from.
+ * @details A cache file holds a header identifying the raw file (its path,
+ * size and modification time) and the scan filters that were in effect when
+ * it was parsed, followed by every scan's metadata and its m/z and intensity
+ * arrays, stored as contiguous, 4-byte aligned blocks of native floats. On
+ * loading, the cache file is memory mapped and scan arrays are filled with a
+ * single block copy each, without any text parsing or base64 decoding. A
+ * cache whose header does not match the raw file or the current filters is
+ * ignored (and overwritten on next save).
+ */
+class SampleCache
+{
+public:
+    /**
+     * @brief Create a cache accessor.
+     * @param cacheDir Directory in which cache files are stored. If empty,
+     * the cache file for a sample is stored next to the sample file itself.
+     */
+    explicit SampleCache(string cacheDir = "");
+
+    /**
+     * @brief Path of the cache file used for the given sample file.
+     */
+    string cachePath(const string& filename) const;
+
+    /**
+     * @brief Restore scans and instrument information of a sample from the
+     * cache of the given file.
+     * @param sample Sample into which scans will be loaded. Any scans it
+     * already has are replaced, but not deleted.
+     * @param filename Path of the raw sample file.
+     * @param lazy If true, peak arrays are not copied. Scans are instead
+     * made lazy, pointing into the cache file that stays mapped for the
+     * lifetime of the sample (see ScanStore).
+     * @return True if a valid cache was found and loaded, false otherwise. If
+     * false, the sample is left untouched.
+     */
+    bool load(mzSample* sample,
+              const string& filename,
+              bool lazy = false) const;
+
+    /**
+     * @brief Write the cache for a sample that was loaded from the given file.
+     * @details The cache is written to a temporary file which is then renamed,
+     * so that concurrent readers never see a partially written cache.
+     * @return True if the cache was written successfully.
+     */
+    bool save(const mzSample* sample, const string& filename) const;
+
+private:
+    string _cacheDir;
+
+    /**
+     * @brief Identification of a raw file and the scan filters applied while
+     * parsing it, against which caches are validated.
+     */
+    struct _SourceKey
+    {
+        string path;
+        unsigned long long size;
+        long long modificationTime;
+        int filterMinIntensity;
+        int filterCentroidScans;
+        int filterIntensityQuantile;
+        int filterMsLevel;
+        int filterPolarity;
+
+        bool operator==(const _SourceKey& other) const;
+    };
+
+    /**
+     * @brief Fill a key for the given file, using the current filters of
+     * `mzSample`.
+     * @return False if the file could not be found.
+     */
+    static bool _sourceKey(const string& filename, _SourceKey& key);
+};
+
+#endif // SAMPLECACHE_H
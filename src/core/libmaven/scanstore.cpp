@@ -0,0 +1,152 @@
+#include <mutex>
+
+#include "doctest.h"
+#include "mzSample.h"
+#include "scanstore.h"
+
+namespace {
+
+mutex storeMutex;
+
+// most recently used scans are at the front
+list<Scan*> residentScans;
+
+size_t residentSize = 0;
+size_t budget = 1024UL * 1024 * 1024;
+
+size_t arrayBytes(const Scan* scan)
+{
+    return (scan->mz.capacity() + scan->intensity.capacity()) * sizeof(float);
+}
+
+}
+
+void ScanStore::setMemoryBudget(size_t bytes)
+{
+    lock_guard<mutex> lock(storeMutex);
+    budget = bytes;
+    _evict();
+}
+
+size_t ScanStore::memoryBudget()
+{
+    lock_guard<mutex> lock(storeMutex);
+    return budget;
+}
+
+size_t ScanStore::residentBytes()
+{
+    lock_guard<mutex> lock(storeMutex);
+    return residentSize;
+}
+
+void ScanStore::pin(Scan* scan)
+{
+    lock_guard<mutex> lock(storeMutex);
+    if (scan->_resident) {
+        residentScans.splice(residentScans.begin(),
+                             residentScans,
+                             scan->_lruPosition);
+    } else {
+        const float* values = reinterpret_cast<const float*>(scan->_lazyData);
+        scan->mz.assign(values, values + scan->_lazyMzCount);
+        values += scan->_lazyMzCount;
+        scan->intensity.assign(values, values + scan->_lazyIntensityCount);
+
+        residentScans.push_front(scan);
+        scan->_lruPosition = residentScans.begin();
+        scan->_resident = true;
+        residentSize += arrayBytes(scan);
+    }
+    ++scan->_pinCount;
+    _evict();
+}
+
+void ScanStore::unpin(Scan* scan)
+{
+    lock_guard<mutex> lock(storeMutex);
+    --scan->_pinCount;
+    _evict();
+}
+
+void ScanStore::forget(Scan* scan)
+{
+    lock_guard<mutex> lock(storeMutex);
+    if (scan->_resident)
+        _release(scan);
+}
+
+void ScanStore::_release(Scan* scan)
+{
+    residentSize -= arrayBytes(scan);
+    residentScans.erase(scan->_lruPosition);
+    vector<float>().swap(scan->mz);
+    vector<float>().swap(scan->intensity);
+    scan->_resident = false;
+}
+
+void ScanStore::_evict()
+{
+    auto it = residentScans.end();
+    while (residentSize > budget && it != residentScans.begin()) {
+        Scan* scan = *(--it);
+        if (scan->_pinCount > 0)
+            continue;
+        it = next(it);
+        _release(scan);
+    }
+}
+
+///////////////////////////Test Cases//////////////////////////////
+
+TEST_CASE("Testing lazy scan materialisation")
+{
+    // four scans, each with 2 × 100 floats laid out as a sample cache would
+    vector<float> data;
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 100; ++j)
+            data.push_back(100.0f * i + j);
+        for (int j = 0; j < 100; ++j)
+            data.push_back(1000.0f * i);
+    }
+
+    mzSample sample;
+    for (int i = 0; i < 4; ++i) {
+        Scan* scan = new Scan(&sample, i, 1, i, 0.0f, 1);
+        scan->setLazyData(
+            reinterpret_cast<const char*>(&data[i * 200]), 100, 100);
+        sample.scans.push_back(scan);
+    }
+
+    size_t originalBudget = ScanStore::memoryBudget();
+    size_t scanBytes = 200 * sizeof(float);
+    ScanStore::setMemoryBudget(2 * scanBytes);
+
+    REQUIRE(sample.scans[0]->isLazy());
+    REQUIRE(sample.scans[0]->nobs() == 0);
+    {
+        ScanPin pin(sample.scans[0]);
+        REQUIRE(sample.scans[0]->nobs() == 100);
+        REQUIRE(sample.scans[0]->mz[10] == 10.0f);
+
+        // the pinned scan is kept even when the budget is exceeded
+        for (int i = 1; i < 4; ++i) {
+            ScanPin otherPin(sample.scans[i]);
+            REQUIRE(sample.scans[i]->mz[99] == 100.0f * i + 99);
+            REQUIRE(sample.scans[i]->intensity[0] == 1000.0f * i);
+        }
+        REQUIRE(sample.scans[0]->nobs() == 100);
+        REQUIRE(ScanStore::residentBytes() <= 2 * scanBytes);
+    }
+
+    // least recently used scans were released first
+    REQUIRE(sample.scans[1]->nobs() == 0);
+    REQUIRE(sample.scans[2]->nobs() == 0);
+    REQUIRE(sample.scans[3]->nobs() == 100);
+
+    ScanStore::setMemoryBudget(0);
+    REQUIRE(ScanStore::residentBytes() == 0);
+    REQUIRE(sample.scans[3]->nobs() == 0);
+
+    ScanStore::setMemoryBudget(originalBudget);
+}
@@ -0,0 +1,88 @@
+#ifndef SCANSTORE_H
+#define SCANSTORE_H
+
+#include "standardincludes.h"
+#include "Scan.h"
+
+using namespace std;
+
+/**
+ * @class ScanStore
+ * @ingroup libmaven
+ * @brief Bounded, least-recently-used store of the peak arrays of lazily
+ * loaded scans, shared by all samples.
+ * @details Samples loaded with lazy scans (see `mzSample::setLazyScans`) keep
+ * only the metadata of every scan (rt, MS level, precursor, etc.) in memory.
+ * The m/z and intensity arrays of such a scan are copied from the memory
+ * mapped sample cache when the scan is pinned, and are released again once
+ * the scan is unpinned and the total size of decoded arrays exceeds the
+ * memory budget. Scans that are in use (pinned) are never released.
+ *
+ * Code reading `Scan::mz` or `Scan::intensity` must hold a `ScanPin` for that
+ * scan, which costs a single check for samples that are loaded eagerly.
+ */
+class ScanStore
+{
+public:
+    /**
+     * @brief Set the maximum number of bytes that decoded peak arrays of
+     * unpinned scans may occupy.
+     */
+    static void setMemoryBudget(size_t bytes);
+
+    static size_t memoryBudget();
+
+    /**
+     * @brief Number of bytes currently occupied by decoded peak arrays of
+     * lazily loaded scans.
+     */
+    static size_t residentBytes();
+
+    /**
+     * @brief Decode the peak arrays of a lazy scan, if they are not already
+     * in memory, and keep them in memory until unpinned.
+     */
+    static void pin(Scan* scan);
+
+    /**
+     * @brief Allow the peak arrays of a lazy scan to be released.
+     */
+    static void unpin(Scan* scan);
+
+    /**
+     * @brief Stop tracking a lazy scan that is about to be destroyed.
+     */
+    static void forget(Scan* scan);
+
+private:
+    static void _release(Scan* scan);
+    static void _evict();
+};
+
+/**
+ * @brief Keeps the peak arrays of a scan in memory for the lifetime of the
+ * object.
+ */
+class ScanPin
+{
+public:
+    explicit ScanPin(Scan* scan) : _scan(scan)
+    {
+        if (_scan != nullptr && _scan->isLazy())
+            ScanStore::pin(_scan);
+    }
+
+    ~ScanPin()
+    {
+        if (_scan != nullptr && _scan->isLazy())
+            ScanStore::unpin(_scan);
+    }
+
+    ScanPin(const ScanPin&) = delete;
+    ScanPin& operator=(const ScanPin&) = delete;
+
+private:
+    Scan* _scan;
+};
+
+#endif // SCANSTORE_H
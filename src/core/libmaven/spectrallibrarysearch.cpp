@@ -0,0 +1,304 @@
+#include "doctest.h"
+#include "Compound.h"
+#include "mzSample.h"
+#include "mzUtils.h"
+#include "Scan.h"
+#include "scanstore.h"
+#include "spectrallibrarysearch.h"
+
+SpectralLibrarySearch::SpectralLibrarySearch(const vector<Compound*>& library,
+                                             const MassCutoff& precursorCutoff,
+                                             float productPpm)
+    : _library(library)
+    , _precursorCutoff(precursorCutoff)
+    , _productPpm(productPpm)
+    , _minFragmentMatches(1)
+    , _scoringAlgo("HyperGeomScore")
+    , _minScore(0.0)
+    , _searchProton(false)
+    , _chunkSize(64)
+    , _stopped(false)
+{
+    _buildIndex();
+}
+
+void SpectralLibrarySearch::setMinFragmentMatches(int minMatches)
+{
+    _minFragmentMatches = max(0, minMatches);
+}
+
+void SpectralLibrarySearch::setScoringAlgorithm(string scoringAlgo)
+{
+    _scoringAlgo = scoringAlgo;
+}
+
+void SpectralLibrarySearch::setMinScore(double minScore)
+{
+    _minScore = minScore;
+}
+
+void SpectralLibrarySearch::setSearchProton(bool searchProton)
+{
+    if (_searchProton == searchProton)
+        return;
+
+    _searchProton = searchProton;
+    _buildIndex();
+}
+
+void SpectralLibrarySearch::setChunkSize(int chunkSize)
+{
+    _chunkSize = max(1, chunkSize);
+}
+
+void SpectralLibrarySearch::setProgressCallback(ProgressCallback callback)
+{
+    _progressCallback = callback;
+}
+
+void SpectralLibrarySearch::_buildIndex()
+{
+    _index.clear();
+    _index.reserve(_library.size());
+    for (auto compound : _library) {
+        if (compound == nullptr
+            || compound->precursorMz() <= 0.0f
+            || compound->fragmentMzValues().empty()) {
+            continue;
+        }
+
+        // building the library spectrum here also makes sure that worker
+        // threads only ever read the cached spectrum while scoring
+        const Fragment& spectrum = compound->librarySpectrum(_searchProton);
+
+        _LibraryEntry entry;
+        entry.precursorMz = compound->precursorMz();
+        entry.compound = compound;
+        entry.numIons = spectrum.nobs();
+        size_t numTopIons = min(entry.numIons, (size_t) _numFilterIons);
+        entry.topIons.assign(begin(spectrum.mzValues),
+                             begin(spectrum.mzValues) + numTopIons);
+        sort(begin(entry.topIons), end(entry.topIons));
+        _index.push_back(entry);
+    }
+
+    sort(begin(_index),
+         end(_index),
+         [](const _LibraryEntry& a, const _LibraryEntry& b) {
+             return a.precursorMz < b.precursorMz;
+         });
+}
+
+bool SpectralLibrarySearch::_passesIonFilter(const _LibraryEntry& entry,
+                                             Scan* scan) const
+{
+    size_t numOtherIons = entry.numIons - entry.topIons.size();
+    if ((size_t) _minFragmentMatches <= numOtherIons)
+        return true;
+
+    int requiredMatches = _minFragmentMatches - numOtherIons;
+    int remainingIons = entry.topIons.size();
+    int matches = 0;
+    for (float ion : entry.topIons) {
+        // slightly wider than the tolerance used during scoring, so that this
+        // filter never rejects a pair that would have matched
+        float tolerance = ion * _productPpm * 1.01f / 1e6f;
+        auto pos = lower_bound(begin(scan->mz), end(scan->mz), ion - tolerance);
+        if (pos != end(scan->mz) && *pos <= ion + tolerance)
+            ++matches;
+        --remainingIons;
+
+        if (matches >= requiredMatches)
+            return true;
+        if (matches + remainingIons < requiredMatches)
+            return false;
+    }
+    return matches >= requiredMatches;
+}
+
+vector<SpectralLibraryHit> SpectralLibrarySearch::searchScan(Scan* scan) const
+{
+    vector<SpectralLibraryHit> hits;
+    if (scan == nullptr
+        || scan->mslevel != 2
+        || scan->precursorMz <= 0.0f) {
+        return hits;
+    }
+
+    ScanPin pin(scan);
+    if (scan->nobs() == 0)
+        return hits;
+
+    float precursorMz = scan->precursorMz;
+    float window = _precursorCutoff.massCutoffValue(precursorMz);
+    auto first = lower_bound(begin(_index),
+                             end(_index),
+                             precursorMz - window,
+                             [](const _LibraryEntry& entry, float mz) {
+                                 return entry.precursorMz < mz;
+                             });
+
+    // experimental fragment is only built if some candidate needs scoring
+    unique_ptr<Fragment> expFrag;
+    for (auto entry = first; entry != end(_index); ++entry) {
+        if (entry->precursorMz > precursorMz + window)
+            break;
+
+        Compound* compound = entry->compound;
+        int polarity = scan->getPolarity();
+        if ((polarity > 0
+             && compound->ionizationMode == Compound::IonizationMode::Negative)
+            || (polarity < 0
+                && compound->ionizationMode
+                       == Compound::IonizationMode::Positive)) {
+            continue;
+        }
+
+        if (!_passesIonFilter(*entry, scan))
+            continue;
+
+        if (!expFrag) {
+            // same settings as used for fragmentation patterns of peak-groups
+            expFrag.reset(new Fragment(scan, 0.01, 1, 1024));
+        }
+
+        const Fragment& libFrag = compound->librarySpectrum(_searchProton);
+        FragmentationMatchScore score = libFrag.scoreMatch(expFrag.get(),
+                                                           _productPpm);
+        score.mergedScore = score.getScoreByName(_scoringAlgo);
+        if (score.numMatches < _minFragmentMatches
+            || score.mergedScore < _minScore) {
+            continue;
+        }
+
+        SpectralLibraryHit hit;
+        hit.compound = compound;
+        hit.scan = scan;
+        hit.score = score;
+        hits.push_back(hit);
+    }
+    return hits;
+}
+
+void SpectralLibrarySearch::search(const vector<mzSample*>& samples,
+                                   HitCallback onHit)
+{
+    _stopped = false;
+
+    vector<Scan*> ms2Scans;
+    for (auto sample : samples) {
+        if (sample == nullptr)
+            continue;
+        for (auto scan : sample->scans) {
+            if (scan->mslevel == 2 && scan->precursorMz > 0.0f)
+                ms2Scans.push_back(scan);
+        }
+    }
+
+    int totalScans = ms2Scans.size();
+    int scansDone = 0;
+#pragma omp parallel for schedule(dynamic, _chunkSize)
+    for (int i = 0; i < totalScans; i++) {
+        if (_stopped)
+            continue;
+
+        vector<SpectralLibraryHit> hits = searchScan(ms2Scans[i]);
+
+#pragma omp critical(spectralLibrarySearch)
+        {
+            for (const auto& hit : hits)
+                onHit(hit);
+
+            ++scansDone;
+            if (_progressCallback
+                && (scansDone % _chunkSize == 0 || scansDone == totalScans)) {
+                _progressCallback(scansDone, totalScans);
+            }
+        }
+    }
+}
+
+vector<SpectralLibraryHit>
+SpectralLibrarySearch::search(const vector<mzSample*>& samples)
+{
+    vector<SpectralLibraryHit> hits;
+    search(samples, [&hits](const SpectralLibraryHit& hit) {
+        hits.push_back(hit);
+    });
+    sort(begin(hits),
+         end(hits),
+         [](const SpectralLibraryHit& a, const SpectralLibraryHit& b) {
+             return a.score.mergedScore > b.score.mergedScore;
+         });
+    return hits;
+}
+
+TEST_CASE("Testing spectral library search")
+{
+    Compound* compound = new Compound("C00064", "glutamine", "C5H10N2O3", 1);
+    compound->setPrecursorMz(147.0764f);
+    compound->setFragmentMzValues({56.0495f, 84.0444f, 101.0709f, 130.0499f});
+    compound->setFragmentIntensities({20.0f, 100.0f, 15.0f, 60.0f});
+    compound->ionizationMode = Compound::IonizationMode::Positive;
+
+    Compound* decoy = new Compound("C00025", "glutamate", "C5H9NO4", 1);
+    decoy->setPrecursorMz(148.0604f);
+    decoy->setFragmentMzValues({56.0495f, 84.0444f, 102.0550f});
+    decoy->setFragmentIntensities({30.0f, 100.0f, 40.0f});
+
+    mzSample* sample = new mzSample();
+    sample->sampleName = "sample";
+    Scan* matching = new Scan(sample, 1, 2, 1.0f, 147.0763f, 1);
+    matching->mz = {56.0496f, 84.0443f, 101.0710f, 130.0500f, 200.0f};
+    matching->intensity = {1500.0f, 9000.0f, 1200.0f, 5000.0f, 100.0f};
+    Scan* unrelated = new Scan(sample, 2, 2, 1.1f, 147.0765f, 1);
+    unrelated->mz = {60.0f, 90.0f, 110.0f};
+    unrelated->intensity = {1000.0f, 2000.0f, 3000.0f};
+    Scan* fullScan = new Scan(sample, 3, 1, 1.2f, 0.0f, 1);
+    fullScan->mz = {147.0764f};
+    fullScan->intensity = {10000.0f};
+    sample->scans.push_back(matching);
+    sample->scans.push_back(unrelated);
+    sample->scans.push_back(fullScan);
+
+    MassCutoff precursorCutoff;
+    precursorCutoff.setMassCutoffAndType(10.0, "ppm");
+    SpectralLibrarySearch librarySearch({compound, decoy}, precursorCutoff, 20);
+    librarySearch.setMinFragmentMatches(3);
+    REQUIRE(librarySearch.librarySize() == 2);
+
+    SUBCASE("Testing single scan search")
+    {
+        auto hits = librarySearch.searchScan(matching);
+        REQUIRE(hits.size() == 1);
+        REQUIRE(hits[0].compound == compound);
+        REQUIRE(hits[0].score.numMatches == 4);
+
+        FragmentationMatchScore expected;
+        Fragment expFrag(matching, 0.01, 1, 1024);
+        expected = compound->scoreCompoundHit(&expFrag, 20);
+        REQUIRE(hits[0].score.hypergeomScore
+                == doctest::Approx(expected.hypergeomScore));
+
+        REQUIRE(librarySearch.searchScan(unrelated).empty());
+        REQUIRE(librarySearch.searchScan(fullScan).empty());
+    }
+
+    SUBCASE("Testing sample search")
+    {
+        unsigned int lastProgress = 0;
+        librarySearch.setProgressCallback([&](unsigned int done,
+                                              unsigned int total) {
+            lastProgress = done;
+            REQUIRE(total == 2);
+        });
+        auto hits = librarySearch.search(vector<mzSample*>({sample}));
+        REQUIRE(hits.size() == 1);
+        REQUIRE(hits[0].scan == matching);
+        REQUIRE(lastProgress == 2);
+    }
+
+    delete sample;
+    delete compound;
+    delete decoy;
+}
@@ -0,0 +1,173 @@
+#ifndef SPECTRALLIBRARYSEARCH_H
+#define SPECTRALLIBRARYSEARCH_H
+
+#include <atomic>
+#include <functional>
+
+#include "Fragment.h"
+#include "masscutofftype.h"
+#include "standardincludes.h"
+
+class Compound;
+class mzSample;
+class Scan;
+
+using namespace std;
+
+/**
+ * @brief A single match between an MS2 scan and a library compound.
+ */
+struct SpectralLibraryHit
+{
+    Compound* compound;
+    Scan* scan;
+    FragmentationMatchScore score;
+};
+
+/**
+ * @class SpectralLibrarySearch
+ * @ingroup libmaven
+ * @brief Search MS2 scans of one or more samples against a spectral library.
+ * @details The library (a collection of compounds having fragment m/z and
+ * intensity values) is indexed once, by precursor m/z, along with a few of
+ * the most intense fragment ions of each compound. For every MS2 scan, only
+ * library compounds that lie within the precursor window and share enough of
+ * their top fragment ions with the scan are fully scored. Scans from all
+ * samples are processed in parallel, in chunks, and hits are streamed to the
+ * caller as soon as a scan has been scored.
+ */
+class SpectralLibrarySearch
+{
+public:
+    typedef std::function<void (const SpectralLibraryHit&)> HitCallback;
+    typedef std::function<void (unsigned int, unsigned int)> ProgressCallback;
+
+    /**
+     * @brief Create a search engine for the given library.
+     * @param library Compounds to be used as queries. Compounds without
+     * fragments or without a precursor m/z are ignored.
+     * @param precursorCutoff Tolerance used to match the precursor m/z of a
+     * scan against library precursors.
+     * @param productPpm PPM tolerance used to match fragment ions.
+     */
+    SpectralLibrarySearch(const vector<Compound*>& library,
+                          const MassCutoff& precursorCutoff,
+                          float productPpm = 20.0f);
+
+    /**
+     * @brief Minimum number of fragment ions that should match for a scan to
+     * be reported as a hit.
+     */
+    void setMinFragmentMatches(int minMatches);
+
+    /**
+     * @brief Name of the score (from
+     * `FragmentationMatchScore::getScoringAlgorithmNames`) used to rank and
+     * filter hits.
+     */
+    void setScoringAlgorithm(string scoringAlgo);
+
+    /**
+     * @brief Hits with a score (as per the set scoring algorithm) lower than
+     * this value will not be reported.
+     */
+    void setMinScore(double minScore);
+
+    /**
+     * @brief Whether fragments that have gained or lost a proton should also
+     * be searched for. Changing this rebuilds the search index.
+     */
+    void setSearchProton(bool searchProton);
+
+    /**
+     * @brief Number of scans processed by a thread at a time.
+     */
+    void setChunkSize(int chunkSize);
+
+    /**
+     * @brief Set a function to be called whenever a batch of scans has been
+     * processed, with the number of scans done and total number of scans.
+     */
+    void setProgressCallback(ProgressCallback callback);
+
+    /**
+     * @brief Number of compounds that made it into the search index.
+     */
+    size_t librarySize() const { return _index.size(); }
+
+    /**
+     * @brief Search all MS2 scans of the given samples.
+     * @details The hit callback is invoked from worker threads, but never
+     * concurrently, so it may append to containers or write to a stream
+     * without any additional locking.
+     * @param samples Samples whose MS2 scans will be searched.
+     * @param onHit Called once for every hit found.
+     */
+    void search(const vector<mzSample*>& samples, HitCallback onHit);
+
+    /**
+     * @brief Convenience overload that collects and returns all hits, sorted
+     * by decreasing score.
+     */
+    vector<SpectralLibraryHit> search(const vector<mzSample*>& samples);
+
+    /**
+     * @brief Find all library hits for a single MS2 scan.
+     * @param scan MS2 scan to be searched.
+     * @return A vector of hits for the given scan.
+     */
+    vector<SpectralLibraryHit> searchScan(Scan* scan) const;
+
+    /**
+     * @brief Request a running search to stop. Scans that have not been
+     * picked up by a thread yet will be skipped.
+     */
+    void stop() { _stopped = true; }
+
+private:
+    struct _LibraryEntry
+    {
+        float precursorMz;
+        Compound* compound;
+
+        // most intense library fragment ions, sorted by m/z
+        vector<float> topIons;
+
+        // total number of fragment ions in the library spectrum
+        size_t numIons;
+    };
+
+    vector<Compound*> _library;
+    vector<_LibraryEntry> _index;
+    MassCutoff _precursorCutoff;
+    float _productPpm;
+    int _minFragmentMatches;
+    string _scoringAlgo;
+    double _minScore;
+    bool _searchProton;
+    int _chunkSize;
+    ProgressCallback _progressCallback;
+    std::atomic<bool> _stopped;
+
+    /**
+     * @brief Number of most intense fragment ions of each library spectrum
+     * used to filter candidates before scoring.
+     */
+    static const int _numFilterIons = 5;
+
+    /**
+     * @brief Index library compounds by precursor m/z.
+     */
+    void _buildIndex();
+
+    /**
+     * @brief Check whether enough of the top ions of a library entry are
+     * present in a scan, for it to be worth scoring.
+     * @details The check is conservative: an entry is only rejected if it
+     * cannot reach the minimum number of fragment matches even when all of
+     * its remaining (non-top) ions match.
+     */
+    bool _passesIonFilter(const _LibraryEntry& entry, Scan* scan) const;
+};
+
+#endif // SPECTRALLIBRARYSEARCH_H
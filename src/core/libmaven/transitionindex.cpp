@@ -0,0 +1,194 @@
+#include <random>
+#include <tuple>
+
+#include "doctest.h"
+#include "mzSample.h"
+#include "Scan.h"
+#include "scanstore.h"
+#include "transitionindex.h"
+
+TransitionIndex::TransitionIndex(const deque<Scan*>& scans)
+{
+    map<tuple<string, float, float, float>, size_t> transitionPositions;
+    map<string, float> representativeIntensities;
+    for (size_t i = 0; i < scans.size(); ++i) {
+        Scan* scan = scans[i];
+        int position = static_cast<int>(i);
+
+        if (scan->mslevel == 2) {
+            auto key = make_tuple(scan->filterLine,
+                                  scan->precursorMz,
+                                  scan->productMz,
+                                  scan->collisionEnergy);
+            auto inserted = transitionPositions.insert(
+                make_pair(key, _transitions.size()));
+            if (inserted.second) {
+                _transitions.push_back({scan->precursorMz,
+                                        scan->productMz,
+                                        scan->collisionEnergy,
+                                        scan->filterLine,
+                                        {}});
+            }
+            _transitions[inserted.first->second].scans.push_back(position);
+        }
+
+        if (scan->filterLine.empty())
+            continue;
+
+        _Srm& srm = _srms[scan->filterLine];
+        srm.scans.push_back(position);
+
+        ScanPin pin(scan);
+        if (scan->totalIntensity() == 0)
+            continue;
+        float& representativeIntensity =
+            representativeIntensities[scan->filterLine];
+        if (srm.representativeScan < 0
+            || scan->intensity[0] > representativeIntensity) {
+            srm.representativeScan = position;
+            representativeIntensity = scan->intensity[0];
+        }
+    }
+
+    stable_sort(_transitions.begin(),
+                _transitions.end(),
+                [](const _Transition& a, const _Transition& b) {
+                    return a.precursorMz < b.precursorMz;
+                });
+}
+
+const vector<int>* TransitionIndex::scansOfSrm(const string& srmId) const
+{
+    auto srm = _srms.find(srmId);
+    if (srm == _srms.end())
+        return nullptr;
+    return &srm->second.scans;
+}
+
+vector<int> TransitionIndex::findScans(float precursorMz,
+                                       float collisionEnergy,
+                                       float productMz,
+                                       float amuQ1,
+                                       float amuQ3,
+                                       const string& filterline) const
+{
+    auto first = _transitions.begin();
+    if (precursorMz != 0.0f) {
+        first = lower_bound(_transitions.begin(),
+                            _transitions.end(),
+                            precursorMz,
+                            [amuQ1](const _Transition& t, float mz) {
+                                return mz - t.precursorMz > amuQ1;
+                            });
+    }
+
+    vector<int> matches;
+    for (auto t = first; t != _transitions.end(); ++t) {
+        if (precursorMz != 0.0f && t->precursorMz - precursorMz > amuQ1)
+            break;
+        if (!filterline.empty() && t->filterLine != filterline)
+            continue;
+        if (precursorMz != 0.0f && abs(t->precursorMz - precursorMz) > amuQ1)
+            continue;
+        if (productMz != 0.0f && abs(t->productMz - productMz) > amuQ3)
+            continue;
+        if (collisionEnergy != 0.0f
+            && t->collisionEnergy != 0.0f
+            && abs(t->collisionEnergy - collisionEnergy) > 0.5) {
+            continue;
+        }
+        matches.insert(matches.end(), t->scans.begin(), t->scans.end());
+    }
+
+    // every scan belongs to a single transition
+    sort(matches.begin(), matches.end());
+    return matches;
+}
+
+///////////////////////////Test Cases//////////////////////////////
+
+TEST_CASE("Testing SRM transition index")
+{
+    mt19937 generator(5);
+    uniform_int_distribution<int> transitionDistribution(0, 59);
+    uniform_real_distribution<float> intensityDistribution(0.0f, 1e4f);
+
+    mzSample sample;
+    for (int i = 0; i < 3000; ++i) {
+        int transition = transitionDistribution(generator);
+        int mslevel = i % 10 == 0 ? 1 : 2;
+        float precursorMz = 100.0f + 7.25f * (transition / 3);
+        Scan* scan = new Scan(&sample, i, mslevel, i * 0.01f, precursorMz, 1);
+        scan->productMz = 50.0f + 0.3f * transition;
+        scan->collisionEnergy = transition % 3 == 0 ? 0.0f : transition % 3;
+        if (transition % 4 != 0)
+            scan->filterLine = "srm " + to_string(transition);
+        if (i % 7 != 0) {
+            scan->mz.push_back(scan->productMz);
+            scan->intensity.push_back(intensityDistribution(generator));
+        }
+        sample.addScan(scan);
+    }
+    TransitionIndex index(sample.scans);
+
+    // compare against a search through all scans
+    for (int k = 0; k < 40; ++k) {
+        int transition = transitionDistribution(generator);
+        float precursorMz = 100.0f + 7.25f * (transition / 3);
+        if (k % 8 == 0)
+            precursorMz = 0.0f;
+        float productMz = k % 5 == 0 ? 0.0f : 50.0f + 0.3f * transition;
+        float collisionEnergy = k % 3;
+        float amuQ1 = k % 2 == 0 ? 0.5f : 7.25f;
+        float amuQ3 = k % 4 == 0 ? 0.1f : 0.6f;
+        string filterline = k % 6 == 0 ? "srm " + to_string(transition) : "";
+
+        vector<int> expected;
+        for (size_t i = 0; i < sample.scans.size(); ++i) {
+            Scan* scan = sample.scans[i];
+            if (!filterline.empty() && scan->filterLine != filterline)
+                continue;
+            if (scan->mslevel != 2)
+                continue;
+            if (precursorMz != 0.0f
+                && abs(scan->precursorMz - precursorMz) > amuQ1)
+                continue;
+            if (productMz != 0.0f && abs(scan->productMz - productMz) > amuQ3)
+                continue;
+            if (collisionEnergy != 0.0f
+                && scan->collisionEnergy != 0.0f
+                && abs(scan->collisionEnergy - collisionEnergy) > 0.5) {
+                continue;
+            }
+            expected.push_back(i);
+        }
+        REQUIRE(index.findScans(precursorMz,
+                                collisionEnergy,
+                                productMz,
+                                amuQ1,
+                                amuQ3,
+                                filterline)
+                == expected);
+    }
+
+    int numSrms = 0;
+    index.forEachSrm([&](const string& srmId, int representative) {
+        ++numSrms;
+        const vector<int>* scans = index.scansOfSrm(srmId);
+        REQUIRE(scans != nullptr);
+
+        int expected = -1;
+        for (int i : *scans) {
+            Scan* scan = sample.scans[i];
+            REQUIRE(scan->filterLine == srmId);
+            if (scan->totalIntensity() == 0)
+                continue;
+            if (expected < 0
+                || scan->intensity[0] > sample.scans[expected]->intensity[0])
+                expected = i;
+        }
+        REQUIRE(representative == expected);
+    });
+    REQUIRE(numSrms == 45);
+    REQUIRE(index.scansOfSrm("srm 4") == nullptr);
+}
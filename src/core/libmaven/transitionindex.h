@@ -0,0 +1,98 @@
+#ifndef TRANSITIONINDEX_H
+#define TRANSITIONINDEX_H
+
+#include "standardincludes.h"
+
+class Scan;
+
+using namespace std;
+
+/**
+ * @class TransitionIndex
+ * @ingroup libmaven
+ * @brief An index of the SRM/MRM transitions of a sample, for finding the
+ * scans of a transition without searching every scan.
+ * @details Scans are grouped in two ways:
+ * - by SRM ID (filterline), for all scans that have one, and
+ * - by transition, i.e., MS2 scans that share a filterline, precursor m/z
+ * (Q1), product m/z (Q3) and collision energy. Transitions are sorted by
+ * precursor m/z, so that the transitions within a Q1 tolerance of some m/z
+ * can be found with a binary search.
+ *
+ * Scans are identified by their position in the container the index was
+ * built from, and scan lists are in increasing order. The index reflects the
+ * scans as they were when it was built.
+ */
+class TransitionIndex
+{
+public:
+    /**
+     * @brief Index the transitions of the given scans.
+     * @param scans Scans of a sample.
+     */
+    TransitionIndex(const deque<Scan*>& scans);
+
+    /**
+     * @brief Positions of the scans that have the given SRM ID, or nullptr
+     * if there are none.
+     */
+    const vector<int>* scansOfSrm(const string& srmId) const;
+
+    /**
+     * @brief Positions of MS2 scans matching a transition, in increasing
+     * order.
+     * @details A scan matches if its precursor and product m/z are within
+     * the given tolerances, and its collision energy within 0.5 of the given
+     * one. A value of zero for precursor m/z, product m/z or collision energy
+     * (of the query, or for collision energy, also of the scan) matches any
+     * value. If a filterline is given, only scans having that filterline
+     * match.
+     */
+    vector<int> findScans(float precursorMz,
+                          float collisionEnergy,
+                          float productMz,
+                          float amuQ1,
+                          float amuQ3,
+                          const string& filterline = "") const;
+
+    /**
+     * @brief Visit every SRM ID with its representative scan, which is the
+     * first non-empty scan having the highest intensity at its first peak.
+     * @param visit Callable as `visit(srmId, scanPosition)`. SRM IDs without
+     * any non-empty scan are not visited.
+     */
+    template<typename Visitor>
+    void forEachSrm(Visitor visit) const
+    {
+        for (const auto& srm : _srms) {
+            if (srm.second.representativeScan >= 0)
+                visit(srm.first, srm.second.representativeScan);
+        }
+    }
+
+    /**
+     * @brief Number of distinct transitions.
+     */
+    size_t numTransitions() const { return _transitions.size(); }
+
+private:
+    struct _Transition
+    {
+        float precursorMz;
+        float productMz;
+        float collisionEnergy;
+        string filterLine;
+        vector<int> scans;
+    };
+
+    struct _Srm
+    {
+        vector<int> scans;
+        int representativeScan = -1;
+    };
+
+    vector<_Transition> _transitions;
+    map<string, _Srm> _srms;
+};
+
+#endif // TRANSITIONINDEX_H
@@ -127,7 +127,7 @@ void AlignmentVizAllGroupsWidget::displayGroup() {
 
     QCPDataRange dataRange;
     int index;
-    PeakGroup grp(make_shared<MavenParameters>(*_mw->mavenParameters),
+    PeakGroup grp(MavenParameters::snapshot(*_mw->mavenParameters),
                   PeakGroup::IntegrationType::Programmatic);
 
     for (unsigned int i =0; i<samples.size(); i++) {
@@ -12,8 +12,15 @@ CompareSamplesDialog::CompareSamplesDialog(QWidget *parent) :
 	setModal(false);
 	_qtype = PeakGroup::AreaTop;
 
-	CompareSamplesLogic* c = new CompareSamplesLogic();
-	compareLogic = *c;
+	// progress is reported while the UI thread computes statistics, so
+	// events are processed for the progress bar to be redrawn
+	compareLogic.boostSignal.connect(
+		[this](const string& message, unsigned int progress, int total) {
+			Q_EMIT(setProgressBar(QString::fromStdString(message),
+			                      progress,
+			                      total));
+			QCoreApplication::processEvents();
+		});
 
 	connect(compareButton, SIGNAL(clicked(bool)), SLOT(compareSamples()));
 	connect(resetButton, SIGNAL(clicked(bool)), SLOT(resetSamples()));
@@ -157,29 +164,17 @@ void CompareSamplesDialog::compareSets(vector<mzSample*> sset1,
 	if (!table)
 		return;
 
-	vector<mzSample*> sampleSet;
-	for (int i = 0; i < sset1.size(); i++)
-		sampleSet.push_back(sset1[i]);
-	for (int i = 0; i < sset2.size(); i++)
-		sampleSet.push_back(sset2[i]);
-
     QList<shared_ptr<PeakGroup>> allgroups = table->getGroups();
 	compareLogic.rand_scores.clear();
 
-	for (int i = 0; i < allgroups.size(); i++) {
-		//replace missing values
-		float _missingValue = missingValue->value();
-
-        shared_ptr<PeakGroup> group = allgroups[i];
-        compareLogic.computeStats(group.get(),
-                                  sampleSet,
-                                  sset1,
-                                  sset2,
-                                  _missingValue);
-
-		//qDebug() << "CompareSamplesDialog: " << i << " " << meanA << " " << meanB;
-		Q_EMIT(setProgressBar("CompareSamples", i + 1, allgroups.size()));
-	}
+	//replace missing values
+	float _missingValue = missingValue->value();
+	compareLogic.setNumPermutations(numPermutations->value());
+	Q_EMIT(setProgressBar("Comparing samples…", 0, allgroups.size()));
+	compareButton->setEnabled(false);
+	compareLogic.computeStats(allgroups, sset1, sset2, _missingValue);
+	compareButton->setEnabled(true);
+	Q_EMIT(setProgressBar("Comparing samples…", allgroups.size(), allgroups.size()));
 
 	float alpha = minPValue->value(); //alpha value //TODO: Alpha value is not being used
 
@@ -198,7 +193,7 @@ void CompareSamplesDialog::compareSets(vector<mzSample*> sset1,
 	/*
 	 TableDockWidget* peaksTable = mainwindow->addPeaksTable("Contrasts");
 	 peaksTable->setWindowTitle("Contrasts: Peaks");
-	 peaksTable->treeWidget->setSortingEnabled(true);
+	 peaksTable->treeView->setSortingEnabled(true);
 	 for(int i=0; i < goodgroups.size(); i++) {
 	 if (goodgroups[i]->changeFoldRatio > _minFoldDiff && goodgroups[i]->changePValue < alpha) { peaksTable->addPeakGroup(goodgroups[i]); }
 	 }
@@ -4,7 +4,9 @@
 #include "Compound.h"
 #include "constants.h"
 #include "database.h"
+#include "databases.h"
 #include "masscutofftype.h"
+#include "massindex.h"
 #include "mgf/mgf.h"
 #include "mzMassCalculator.h"
 #include "mzSample.h"
@@ -40,6 +42,7 @@ void Database::loadAll() {
 
 
 void Database::closeAll() {
+    _massIndex.reset();
     mzUtils::delete_all(adductsDB);
     mzUtils::delete_all(compoundsDB);
     mzUtils::delete_all(fragmentsDB);
@@ -48,6 +51,7 @@ void Database::closeAll() {
 
 void Database::removeDatabase(string dbName)
 {
+    _massIndex.reset();
     auto iter = begin(compoundsDB);
     while (iter < end(compoundsDB)) {
         auto compound = *iter;
@@ -157,6 +161,7 @@ bool Database::addCompound(Compound* newCompound)
                         + newCompound->name()
                         + newCompound->db()] = newCompound;
     compoundsDB.push_back(newCompound);
+    _massIndex.reset();
     if (newCompound->charge() == 0)
         _compoundsWithZeroCharge.push_back(newCompound);
     return true;
@@ -190,24 +195,21 @@ void Database::loadSpecies(string db) {
 }
 
 set<Compound*> Database::findSpeciesByMass(float mz, MassCutoff *massCutoff) {
-	set<Compound*>uniqset;
-
-    Compound x("find", "", "",0);
-    x.setMz(mz-massCutoff->massCutoffValue(mz));
-    deque<Compound*>::iterator itr = lower_bound(
-            compoundsDB.begin(),compoundsDB.end(),
-            &x, Compound::compMass );
-
-    for(;itr != compoundsDB.end(); itr++ ) {
-        Compound* c = *itr;
-        if (c->mz() > mz+1) break;
+    set<Compound*> species;
+    for (auto entry : _compoundMassIndex().find(mz, *massCutoff))
+        species.insert(entry->compound);
+    return species;
+}
 
-        if ( mzUtils::massCutoffDist(c->mz(),mz,massCutoff) < massCutoff->getMassCutoff() ) {
-			if (uniqset.count(c)) continue;
-            uniqset.insert(c);
-        }
+const MassIndex& Database::_compoundMassIndex()
+{
+    if (!_massIndex) {
+        vector<Compound*> compounds(begin(compoundsDB), end(compoundsDB));
+        _massIndex = make_shared<MassIndex>(compounds, [](Compound* c) {
+            return c->mz();
+        });
     }
-    return uniqset;
+    return *_massIndex;
 }
 
 Compound* Database::findSpeciesByIdAndName(string id,
@@ -470,229 +472,19 @@ int Database::loadNISTLibrary(QString filepath,
                                     '\n');
 
     qDebug() << "Loading NIST Libary: " << filepath;
-    QFile data(filepath);
-    if (!data.open(QFile::ReadOnly) ) {
-        qDebug() << "Can't open " << filepath;
-        return 0;
-    }
-
-    QRegExp whiteSpace("\\s+");
-    QRegExp formulaMatch("Formula\\=(C\\d+H\\d+\\S*)");
-    QRegExp retentionTimeMatch("AvgRt\\=(\\S+)");
-    QRegularExpression keyValuePattern("\\\"([^=\\\"]*)=([^\\\"]*)\\\"");
-
-    string dbName = mzUtils::cleanFilename(filepath.toStdString());
-    Compound* currentCompound = nullptr;
-    bool capturePeaks = false;
     int compoundCount = 0;
-    int currentLine = 0;
-
-    QTextStream stream(&data);
-    while (!stream.atEnd()) {
-        QString line = stream.readLine();
-        if (line.startsWith("NAME:", Qt::CaseInsensitive) || stream.atEnd()) {
-            // before reading the next record or ending stream, save the
-            // compound created from last record
-            if (currentCompound and !currentCompound->name().empty()) {
-                if (!currentCompound->formula().empty()) {
-                    auto formula = currentCompound->formula();
-                    auto exactMass = MassCalculator::computeMass(formula, 0);
-                    currentCompound->setMz(exactMass);
-                }
-                if (addCompound(currentCompound))
-                    ++compoundCount;
-            }
-
-            // we need to check this again before creating a new compound,
-            // otherwise it would create one at stream end as well
-            if (line.startsWith("NAME:", Qt::CaseInsensitive)) {
-                // new compound
-                QString name = line.mid(5, line.length()).simplified();
-                currentCompound = new Compound(name.toStdString(),
-                                               name.toStdString(),
-                                               "",
-                                               0);
-                currentCompound->setDb (dbName);
-                capturePeaks = false;
-            }
-        }
-
-        if(currentCompound == nullptr)
-            continue;
-
-        if (line.startsWith("MW:", Qt::CaseInsensitive)) {
-            currentCompound->setMz(line.mid(3, line.length())
-                                        .simplified()
-                                        .toDouble());
-        } else if (line.startsWith("CE:", Qt::CaseInsensitive)
-                   || line.startsWith("COLLISION ENERGY:", Qt::CaseInsensitive)
-                   || line.startsWith("COLLISION_ENERGY:", Qt::CaseInsensitive)) {
-            currentCompound->setCollisionEnergy (line.mid(3, line.length())
-                                                   .simplified()
-                                                   .toDouble());
-        } else if (line.startsWith("ID:", Qt::CaseInsensitive)) {
-            QString id = line.mid(3, line.length()).simplified();
-            if (!id.isEmpty())
-                currentCompound->setId(id.toStdString());
-        } else if (line.startsWith("LOGP:", Qt::CaseInsensitive)) {
-            currentCompound->setLogP (line.mid(5, line.length())
-                                         .simplified()
-                                         .toDouble());
-        } else if (line.startsWith("RT:", Qt::CaseInsensitive)) {
-            currentCompound->setExpectedRt (line.mid(3, line.length())
-                                              .simplified()
-                                              .toDouble());
-        } else if (line.startsWith("SMILE:", Qt::CaseInsensitive)) {
-            QString smileString = line.mid(7, line.length()).simplified();
-            if (!smileString.isEmpty())
-                currentCompound->setSmileString (smileString.toStdString());
-        } else if (line.startsWith("SMILES:", Qt::CaseInsensitive)) {
-            QString smileString = line.mid(8, line.length()).simplified();
-            if (!smileString.isEmpty())
-                currentCompound->setSmileString (smileString.toStdString());
-        } else if (line.startsWith("PRECURSORMZ:", Qt::CaseInsensitive)) {
-            currentCompound->setPrecursorMz ( line.mid(13, line.length())
-                                               .simplified()
-                                               .toDouble());
-        } else if (line.startsWith("EXACTMASS:", Qt::CaseInsensitive)) {
-            currentCompound->setMz( line.mid(10, line.length())
-                                        .simplified()
-                                        .toDouble());
-        } else if (line.startsWith("FORMULA:", Qt::CaseInsensitive)) {
-            QString formula = line.mid(9, line.length()).simplified();
-            formula.replace("\"", "", Qt::CaseInsensitive);
-            if (!formula.isEmpty())
-                currentCompound->setFormula (formula.toStdString());
-        } else if (line.startsWith("MOLECULE FORMULA:", Qt::CaseInsensitive)) {
-            QString formula = line.mid(17, line.length()).simplified();
-            formula.replace("\"", "", Qt::CaseInsensitive);
-            if (!formula.isEmpty())
-                currentCompound->setFormula(formula.toStdString());
-        } else if (line.startsWith("CATEGORY:", Qt::CaseInsensitive)) {
-            auto category = currentCompound->category();
-            category.push_back(line.mid(10, line.length())
-                                                    .simplified()
-                                                    .toStdString());
-            currentCompound->setCategory(category);
-        } else if (line.startsWith("TAG:", Qt::CaseInsensitive)) {
-            if (line.contains("VIRTUAL", Qt::CaseInsensitive))
-                currentCompound->setVirtualFragmentation(true);
-        } else if (line.startsWith("ION MODE:", Qt::CaseInsensitive)
-                   || line.startsWith("ION_MODE:", Qt::CaseInsensitive)
-                   || line.startsWith("IONMODE:", Qt::CaseInsensitive)
-                   || line.startsWith("IONIZATION:", Qt::CaseInsensitive)) {
-            if (line.contains("N", Qt::CaseInsensitive))
-                currentCompound->ionizationMode = Compound::IonizationMode::Negative;
-            if (line.contains("P", Qt::CaseInsensitive))
-                currentCompound->ionizationMode = Compound::IonizationMode::Positive;
-        } else if (line.startsWith("COMMENT:", Qt::CaseInsensitive)
-                   || line.startsWith("COMMENTS:", Qt::CaseInsensitive)) {
-            QString comment = line.mid(8, line.length()).simplified();
-            if (comment.contains(formulaMatch)) {
-                currentCompound->setFormula (formulaMatch.capturedTexts()
-                                                       .at(1)
-                                                       .toStdString());
-            }
-            if (comment.contains(retentionTimeMatch)) {
-                currentCompound->setExpectedRt (retentionTimeMatch.capturedTexts()
-                                                                .at(1)
-                                                                .simplified()
-                                                                .toDouble());
-            }
-
-            // the following pattern logic extracts some useful information
-            // available as comments in the MoNA public library available at:
-            // https://mona.fiehnlab.ucdavis.edu/downloads
-            QString keggId = "";
-            QString hmdbId = "";
-            QString pubchemId = "";
-            QString chebi = "";
-            QString note = "";
-            QRegularExpressionMatchIterator itr =
-                keyValuePattern.globalMatch(comment);
-            while (itr.hasNext()) {
-                QRegularExpressionMatch match = itr.next();
-                QString key = match.captured(1);
-                QString value = match.captured(2);
-
-                // replace SMILE if available and not already set
-                if (key.contains("SMILE")
-                    && currentCompound->smileString().empty()) {
-                    currentCompound->setSmileString(value.toStdString());
-                }
-
-                // replace category if available and not already set
-                if (key.contains("compound class")
-                    && currentCompound->category().empty()) {
-                    string categories = value.toStdString();
-                    currentCompound->setCategory(mzUtils::split(categories,
-                                                                "; "));
-                }
-
-                if (key.contains("kegg", Qt::CaseInsensitive))
-                    keggId = value;
-                if (key.contains("hmdb", Qt::CaseInsensitive))
-                    hmdbId = value;
-                if (key.contains("pubchem", Qt::CaseInsensitive))
-                    pubchemId = value;
-                if (key.contains("chebi", Qt::CaseInsensitive))
-                    chebi = value;
-
-                note += QString("\"%1: %2\" ").arg(key, value);
-            }
-
-            if (!keggId.isEmpty()) {
-                // KEGG gets precendence over HMDB
-                currentCompound->setId(keggId.toStdString());
-            } else if (!hmdbId.isEmpty()) {
-                // HMDB gets precendence over PubChem
-                currentCompound->setId(hmdbId.toStdString());
-            } else if (!pubchemId.isEmpty()) {
-                // PubChem gets precendence over ChEBI
-                currentCompound->setId(pubchemId.toStdString());
-            } else if (!chebi.isEmpty()) {
-                currentCompound->setId(chebi.toStdString());
-            }
-
-            // comments are added as a note for the compound
-            if (note.isEmpty()) {
-                currentCompound->setNote(comment.toStdString());
-            } else {
-                currentCompound->setNote(note.simplified().toStdString());
-            }
-        } else if (line.startsWith("NUM PEAKS:", Qt::CaseInsensitive)
-                   || line.startsWith("NUMPEAKS:", Qt::CaseInsensitive)) {
-            capturePeaks = true;
-        } else if (capturePeaks) {
-            QStringList mzIntensityPair = line.split(whiteSpace);
-            if (mzIntensityPair.size() >= 2) {
-                double mz = mzIntensityPair.at(0).toDouble();
-                double in = mzIntensityPair.at(1).toDouble();
-                if (mz >= 0.0 && in >= 0.0) {
-                    auto mzValues = currentCompound->fragmentMzValues();
-                    mzValues.push_back(mz);
-                    currentCompound->setFragmentMzValues(mzValues);
-                    auto intensities = currentCompound->fragmentIntensities();
-                    intensities.push_back(in);
-                    currentCompound->setFragmentIntensities(intensities);
-
-                    int fragIdx = currentCompound->fragmentMzValues().size() - 1;
-                    if (mzIntensityPair.size() >= 3) {
-                        auto ionTypes = currentCompound->fragmentIonTypes();
-                        ionTypes[fragIdx] =
-                            mzIntensityPair.at(2).toStdString();
-                        currentCompound->setFragmentIonTypes(ionTypes);
-                    }
-                }
-            }
-        }
-        ++currentLine;
+    auto onCompound = [&](Compound* compound) {
+        if (addCompound(compound))
+            ++compoundCount;
+    };
+    auto onLine = [&](int currentLine) {
         if (signal) {
             (*signal)("Loading spectral library: " + filename.toStdString(),
                       currentLine,
                       lineCount);
         }
-    }
+    };
+    Databases::readNISTLibrary(filepath.toStdString(), onCompound, onLine);
 
     return compoundCount;
 }
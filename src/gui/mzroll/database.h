@@ -9,6 +9,7 @@
 class Adduct;
 class Compound;
 class MassCutoff;
+class MassIndex;
 class Pathway;
 class Peak;
 class Reaction;
@@ -139,6 +140,18 @@ class Database {
        private:
 	QSqlDatabase ligandDB;
 	bool _connected;
+
+    /**
+     * @brief Index of compound m/z values used for mass lookups. Built on
+     * first use and discarded whenever compounds are added or removed.
+     */
+    shared_ptr<MassIndex> _massIndex;
+
+    /**
+     * @brief Obtain the mass index for currently loaded compounds, building
+     * it if required.
+     */
+    const MassIndex& _compoundMassIndex();
 };
 
 extern Database DB;
@@ -1,3 +1,5 @@
+#include <qtconcurrentrun.h>
+
 #include "eicwidget.h"
 #include "Compound.h"
 #include "EIC.h"
@@ -25,7 +27,7 @@
 #include "spectrawidget.h"
 #include "treedockwidget.h"
 
-EicWidget::EicWidget(QWidget *p) {
+EicWidget::EicWidget(QWidget *p) : _eicCache(_maxCachedEICs) {
 
 	eicParameters = new EICLogic();
 	parent = p;
@@ -78,10 +80,30 @@ EicWidget::EicWidget(QWidget *p) {
     _ignoreMouseReleaseEvent = false;
     _selectionLine = nullptr;
 
+    _pullRequest = 0;
+    _pullPending = false;
+    _pulledRequest = 0;
+    _pulledCount = 0;
+    _pullFinished = false;
+    _prefetchRequest = 0;
+    _prefetchFinished = false;
+    _deferPull = false;
+    connect(this,
+            &EicWidget::eicsPulled,
+            this,
+            &EicWidget::_showPulledEICs,
+            Qt::QueuedConnection);
+    connect(this,
+            &EicWidget::eicsPrefetched,
+            this,
+            &EicWidget::_cachePrefetchedEICs,
+            Qt::QueuedConnection);
+
     setStyleSheet("QWidget { border: none; }");
 }
 
 EicWidget::~EicWidget() {
+    stopPulling();
 	cleanup();
 	scene()->clear();
 }
@@ -199,7 +221,7 @@ void EicWidget::mouseDoubleClickEvent(QMouseEvent* event) {
 void EicWidget::integrateRegion(float rtMin, float rtMax)
 {
     MavenParameters* mp = getMainWindow()->mavenParameters;
-    auto parameters = make_shared<MavenParameters>(*mp);
+    auto parameters = MavenParameters::snapshot(*mp);
     auto integratedGroup =
         make_shared<PeakGroup>(parameters, PeakGroup::IntegrationType::Manual);
     integratedGroup->minQuality = parameters->minQuality;
@@ -325,8 +347,7 @@ void EicWidget::toggleAreaIntegration(bool toggleOn)
 void EicWidget::cleanup() {
 	//qDebug <<" EicWidget::cleanup()";
         //remove groups
-        mzUtils::delete_all(eicParameters->eics);
-	eicParameters->peakgroups.clear();
+        eicParameters->clearEICs();
         if (_showTicLine == false && eicParameters->tics.size() > 0) {
             mzUtils::delete_all(eicParameters->tics);
 	}
@@ -340,28 +361,178 @@ void EicWidget::computeEICs() {
 	if (samples.size() == 0)
 		return;
 
+    mzSlice slice = eicParameters->_slice;
     mzSlice bounds = visibleSamplesBounds();
+    slice.rtmin = bounds.rtmin;
+    slice.rtmax = bounds.rtmax;
+
+    auto key = _eicKey(samples,
+                       eicParameters->_slice,
+                       eicParameters->selectedGroup());
+    auto set = EICLogic::pullEICSet(slice,
+                                    samples,
+                                    key.parameters.get(),
+                                    getMainWindow()->getClassifier(),
+                                    _groupPeaks);
+    _eicCache.insert(key, set);
+    eicParameters->setEICSet(set);
+	eicParameters->associateNameWithPeakGroups();
+
+}
 
+EICCache::Key EicWidget::_eicKey(const vector<mzSample*>& samples,
+                                 const mzSlice& slice,
+                                 shared_ptr<PeakGroup> group)
+{
     auto mp = getMainWindow()->mavenParameters;
-    if (eicParameters->selectedGroup() != nullptr
-        && !eicParameters->selectedGroup()->tableName().empty()) {
-        mp = eicParameters->selectedGroup()->parameters().get();
+    if (group != nullptr && !group->tableName().empty())
+        mp = group->parameters().get();
+
+    EICCache::Key key;
+    key.mzmin = slice.mzmin;
+    key.mzmax = slice.mzmax;
+    key.srmId = slice.srmId;
+    key.compound = slice.compound;
+    key.adduct = slice.adduct;
+    key.samples = samples;
+    key.parameters = MavenParameters::snapshot(*mp);
+    key.groupPeaks = _groupPeaks;
+    return key;
+}
+
+void EicWidget::_pullEICs(function<void()> onPulled)
+{
+    cleanup();
+    eicParameters->setDisplayedGroup(nullptr);
+
+    // a pull still running is for an older request, and is abandoned
+    ++_pullRequest;
+    _pullPending = false;
+    _onPulled = nullptr;
+
+    vector<mzSample*> samples = getMainWindow()->getVisibleSamples();
+    if (samples.size() == 0) {
+        onPulled();
+        return;
     }
-    eicParameters->getEIC(bounds, samples, mp);
 
-    // score peak quality
+    _pullKey = _eicKey(samples,
+                       eicParameters->_slice,
+                       eicParameters->selectedGroup());
+    auto set = _eicCache.find(_pullKey);
+    if (set != nullptr) {
+        eicParameters->setEICSet(set);
+        eicParameters->associateNameWithPeakGroups();
+        onPulled();
+        return;
+    }
+
+    _pullSlice = eicParameters->_slice;
+    mzSlice bounds = visibleSamplesBounds();
+    _pullSlice.rtmin = bounds.rtmin;
+    _pullSlice.rtmax = bounds.rtmax;
+    _onPulled = onPulled;
+    _pullPending = true;
+
+    // otherwise started once the running pull has stopped
+    _startNextPull();
+}
+
+void EicWidget::_startPull()
+{
+    _pullPending = false;
+    _pullFinished = false;
+    _partialReplotTimer.start();
+
+    int request = _pullRequest;
+    mzSlice slice = _pullSlice;
+    EICCache::Key key = _pullKey;
     ClassifierNeuralNet* clsf = getMainWindow()->getClassifier();
-    if (clsf != NULL) {
-        clsf->scoreEICs(eicParameters->eics);
-	}
+    auto task = [this, request, slice, key, clsf] {
+        auto pulled = [this, request](shared_ptr<EICSet> set, size_t count) {
+            if (request != _pullRequest)
+                return false;
+
+            QMutexLocker lock(&_pulledMutex);
+            _pulledRequest = request;
+            _pulledSet = set;
+            _pulledCount = count;
+            lock.unlock();
+            emit eicsPulled();
+            return true;
+        };
+        auto set = EICLogic::pullEICSet(slice,
+                                        key.samples,
+                                        key.parameters.get(),
+                                        clsf,
+                                        key.groupPeaks,
+                                        pulled);
+
+        QMutexLocker lock(&_pulledMutex);
+        _pulledRequest = request;
+        _pulledSet = set;
+        _pulledCount = set != nullptr ? set->eics.size() : 0;
+        _pullFinished = true;
+        lock.unlock();
+        emit eicsPulled();
+    };
+    _pullFuture = QtConcurrent::run(task);
+}
+
+void EicWidget::_showPulledEICs()
+{
+    QMutexLocker lock(&_pulledMutex);
+    int request = _pulledRequest;
+    shared_ptr<EICSet> set = _pulledSet;
+    size_t count = _pulledCount;
+    bool finished = _pullFinished;
+    if (finished) {
+        _pulledSet = nullptr;
+        _pullFinished = false;
+    }
+    lock.unlock();
+
+    if (finished) {
+        // the task emits just before returning
+        _pullFuture.waitForFinished();
+        if (request == _pullRequest && set != nullptr) {
+            _eicCache.insert(_pullKey, set);
+            eicParameters->setEICSet(set);
+            eicParameters->associateNameWithPeakGroups();
+            auto onPulled = _onPulled;
+            _onPulled = nullptr;
+            if (onPulled)
+                onPulled();
+        }
+        _startNextPull();
+        return;
+    }
 
-	bool isIsotope = false;
-    PeakFiltering peakFiltering(mp, isIsotope);
-	peakFiltering.filter(eicParameters->eics);
+    // replot EICs pulled so far, a few times a second at most
+    if (request != _pullRequest
+        || set == nullptr
+        || count == eicParameters->eics.size()
+        || _partialReplotTimer.elapsed() < 200) {
+        return;
+    }
+    eicParameters->setEICSet(set, count);
+    replot(eicParameters->selectedGroup());
+    _partialReplotTimer.start();
+}
 
-	if(_groupPeaks) groupPeaks(); //TODO: Sahil, added while merging eicwidget
-	eicParameters->associateNameWithPeakGroups();
+void EicWidget::stopPulling()
+{
+    ++_pullRequest;
+    _pullPending = false;
+    _onPulled = nullptr;
+    ++_prefetchRequest;
+    _prefetches.clear();
+    _pullFuture.waitForFinished();
+    _prefetchFuture.waitForFinished();
 
+    // EICs prefetched but not cached yet may be from unloaded samples
+    QMutexLocker lock(&_pulledMutex);
+    _prefetched.clear();
 }
 
 mzSlice EicWidget::visibleSamplesBounds() {
@@ -557,12 +728,16 @@ void EicWidget::addEICLines(bool showSpline,
 
         EicLine* lineEic = new EicLine(0, scene());
         EicLine* lineSpline = new EicLine(0, scene());
+        lineEic->setDecimated(true);
+        lineSpline->setDecimated(true);
 
         EicLine* lineEicLeft = nullptr;
         EicLine* lineEicRight = nullptr;
         if (overlayingIntegratedArea) {
             lineEicLeft = new EicLine(0, scene());
             lineEicRight = new EicLine(0, scene());
+            lineEicLeft->setDecimated(true);
+            lineEicRight->setDecimated(true);
         }
 
         // sample stacking
@@ -838,6 +1013,7 @@ void EicWidget::addTicLine() {
 			continue;
 		EicLine* line = new EicLine(0, scene());
 		line->setEIC(tic);
+		line->setDecimated(true);
 
 		_maxY = tic->maxIntensity;
 		_minY = 0;
@@ -939,6 +1115,7 @@ EicLine* EicWidget::addBaseLine(EIC* eic, double zValue)
         return nullptr;
     EicLine* line = new EicLine(0, scene());
     line->setEIC(eic);
+    line->setDecimated(true);
 
     float baselineSum = 0;
     for (int j = 0; j < eic->size(); j++) {
@@ -1144,6 +1321,9 @@ void EicWidget::setTitle() {
 
 void EicWidget::recompute() {
 	//qDebug <<" EicWidget::recompute()";
+    // recomputing means that samples or settings may have changed
+    stopPulling();
+    _eicCache.clear();
 	cleanup(); //more clean up
 	computeEICs();	//retrive eics
     eicParameters->setDisplayedGroup(nullptr);
@@ -1539,9 +1719,10 @@ void EicWidget::setSrmId(string srmId) {
 	//qDebug << "EicWidget::setSrmId" <<  srmId.c_str();
 	eicParameters->_slice.compound = NULL;
 	eicParameters->_slice.srmId = srmId;
-	recompute();
-	resetZoom();
-	replot();
+    _pullEICs([this] {
+        resetZoom();
+        replot();
+    });
 }
 
 void EicWidget::setCompound(Compound* c)
@@ -1593,27 +1774,28 @@ void EicWidget::setCompound(Compound* c)
 	slice.compound = c;
         if (!c->srmId().empty())
                 slice.srmId = c->srmId();
+    _deferPull = true;
     setMzSlice(slice);
+    _deferPull = false;
     emit compoundSet(c);
 
-	//clock_gettime(CLOCK_REALTIME, &tE);
-	//qDebug() << "Time taken" << (tE.tv_sec-tS.tv_sec)*1000 + (tE.tv_nsec - tS.tv_nsec)/1e6;
+    _pullEICs([this, c] {
+        replot(nullptr);
 
-	for (int i = 0; i < eicParameters->peakgroups.size(); i++)
-		eicParameters->peakgroups[i].setCompound(c);
+        for (int i = 0; i < eicParameters->peakgroups.size(); i++)
+            eicParameters->peakgroups[i].setCompound(c);
         if (c->expectedRt() > 0) {
-                setFocusLine(c->expectedRt());
-                selectGroupNearRt(c->expectedRt());
-	}
-	else {
-		//remove previous focusline
-		if (_focusLine && _focusLine->scene())
-			scene()->removeItem(_focusLine);
-		getMainWindow()->mavenParameters->setPeakGroup(NULL);
-		resetZoom();
-	}
-	//clock_gettime(CLOCK_REALTIME, &tE);
-	// qDebug() << "Time taken" << (tE.tv_sec-tS.tv_sec)*1000 + (tE.tv_nsec - tS.tv_nsec)/1e6;
+            setFocusLine(c->expectedRt());
+            selectGroupNearRt(c->expectedRt());
+        } else {
+            //remove previous focusline
+            if (_focusLine && _focusLine->scene())
+                scene()->removeItem(_focusLine);
+            getMainWindow()->mavenParameters->setPeakGroup(NULL);
+            resetZoom();
+        }
+        emit compoundGroupSelected(c, getSelectedGroup());
+    });
 }
 
 void EicWidget::setMzSlice(const mzSlice& slice)
@@ -1644,8 +1826,10 @@ void EicWidget::setMzSlice(const mzSlice& slice)
 		eicParameters->_slice = slice;
 	}
 
-    recompute();
-    replot(NULL);
+    if (_deferPull)
+        return;
+
+    _pullEICs([this] { replot(nullptr); });
 }
 
 void EicWidget::setPeakGroup(shared_ptr<PeakGroup> group)
@@ -1653,21 +1837,7 @@ void EicWidget::setPeakGroup(shared_ptr<PeakGroup> group)
     if (group == nullptr)
         return;
 
-    int charge = group->parameters()->getCharge(group->getCompound());
-	if (group->getExpectedMz(charge) != -1) {
-		eicParameters->_slice.mz = group->getExpectedMz(charge);
-	} else {
-		eicParameters->_slice.mz = group->meanMz;
-	}
-
-	eicParameters->_slice.compound = group->getCompound();
-    eicParameters->_slice.srmId = group->srmId;
-
-    if (!group->srmId.empty()) {
-        setSrmId(group->srmId);
-    } else if (group->hasSlice() && !group->sliceIsZero()) {
-        setMzSlice(group->getSlice());
-    }
+    eicParameters->_slice = _sliceOf(group);
 
     auto parentGroup = group->parent == nullptr ? group.get() : group->parent;
     if (_autoZoom && parentGroup->peakCount() > 0) {
@@ -1679,27 +1849,175 @@ void EicWidget::setPeakGroup(shared_ptr<PeakGroup> group)
     }
 
     //make sure that plot region is within visible samPle bounds;
-    mzSlice bounds = eicParameters->visibleEICBounds();
+    mzSlice bounds = visibleSamplesBounds();
 	if (eicParameters->_slice.rtmin < bounds.rtmin)
 		eicParameters->_slice.rtmin = bounds.rtmin;
 	if (eicParameters->_slice.rtmax > bounds.rtmax)
         eicParameters->_slice.rtmax = bounds.rtmax;
 
-    setMassCutoff(getMainWindow()->getUserMassCutoff());
     eicParameters->setSelectedGroup(group);
-    recompute();
 
-    if (group->hasCompoundLink())
-		for (int i = 0; i < eicParameters->peakgroups.size(); i++)
-			eicParameters->peakgroups[i].setCompound(group->getCompound());
-	if (eicParameters->_slice.srmId.length())
-		for (int i = 0; i < eicParameters->peakgroups.size(); i++)
-			eicParameters->peakgroups[i].srmId = eicParameters->_slice.srmId;
+    _pullEICs([this, group] {
+        if (group->hasCompoundLink())
+            for (int i = 0; i < eicParameters->peakgroups.size(); i++)
+                eicParameters->peakgroups[i].setCompound(group->getCompound());
+        if (eicParameters->_slice.srmId.length())
+            for (int i = 0; i < eicParameters->peakgroups.size(); i++)
+                eicParameters->peakgroups[i].srmId = eicParameters->_slice.srmId;
+
+        emit groupSet(group);
+        replot(group);
+        _clearEicPoints();
+        addPeakPositions(group);
+    });
+}
+
+/**
+ * @brief Use the precursor and product m/z of a compound's transition as the
+ * m/z bounds of its slice, as `setMzSlice` does.
+ */
+static void useTransitionBounds(mzSlice& slice)
+{
+    Compound* c = slice.compound;
+    if (c && c->precursorMz() != 0 && c->productMz() != 0) {
+        slice.mzmin = c->precursorMz();
+        slice.mzmax = c->productMz();
+        slice.mz = c->precursorMz();
+    }
+}
+
+mzSlice EicWidget::_sliceOf(shared_ptr<PeakGroup> group)
+{
+    mzSlice slice = eicParameters->_slice;
+    int charge = group->parameters()->getCharge(group->getCompound());
+    if (group->getExpectedMz(charge) != -1) {
+        slice.mz = group->getExpectedMz(charge);
+    } else {
+        slice.mz = group->meanMz;
+    }
+    slice.compound = group->getCompound();
+    slice.srmId = group->srmId;
+
+    if (!group->srmId.empty()) {
+        slice.compound = nullptr;
+    } else if (group->hasSlice() && !group->sliceIsZero()) {
+        slice = group->getSlice();
+        useTransitionBounds(slice);
+    }
+
+    if (!_ignoreTolerance) {
+        MassCutoff* massCutoff = getMainWindow()->getUserMassCutoff();
+        if (slice.mz <= 0)
+            slice.mz = slice.mzmin + (slice.mzmax - slice.mzmin) / 2.0;
+        slice.mzmin = slice.mz - massCutoff->massCutoffValue(slice.mz);
+        slice.mzmax = slice.mz + massCutoff->massCutoffValue(slice.mz);
+        useTransitionBounds(slice);
+    }
+    return slice;
+}
+
+void EicWidget::prefetch(QList<shared_ptr<PeakGroup>> groups)
+{
+    // groups given earlier are no longer the ones likely to be shown next
+    ++_prefetchRequest;
+    _prefetches.clear();
+
+    vector<mzSample*> samples = getMainWindow()->getVisibleSamples();
+    if (samples.size() == 0)
+        return;
+
+    mzSlice bounds = visibleSamplesBounds();
+    for (auto group : groups) {
+        if (group == nullptr)
+            continue;
+
+        // leave room in the cache for the EICs being shown
+        if ((_prefetches.size() + 1) * samples.size() > _maxCachedEICs / 2)
+            break;
+
+        _Prefetch prefetch;
+        prefetch.slice = _sliceOf(group);
+        prefetch.key = _eicKey(samples, prefetch.slice, group);
+        if (_eicCache.find(prefetch.key) != nullptr)
+            continue;
+
+        prefetch.slice.rtmin = bounds.rtmin;
+        prefetch.slice.rtmax = bounds.rtmax;
+        _prefetches.push_back(prefetch);
+    }
+    _startNextPull();
+}
+
+void EicWidget::_startPrefetch()
+{
+    if (_prefetches.empty())
+        return;
+
+    _prefetchFinished = false;
+    int request = _prefetchRequest;
+    int pullRequest = _pullRequest;
+    vector<_Prefetch> prefetches;
+    prefetches.swap(_prefetches);
+    ClassifierNeuralNet* clsf = getMainWindow()->getClassifier();
+    auto task = [this, request, pullRequest, prefetches, clsf] {
+        // yield to newer prefetches, and to EICs pulled for the widget
+        auto current = [this, request, pullRequest](shared_ptr<EICSet>,
+                                                    size_t) {
+            return request == _prefetchRequest && pullRequest == _pullRequest;
+        };
+        for (const auto& prefetch : prefetches) {
+            auto set = EICLogic::pullEICSet(prefetch.slice,
+                                            prefetch.key.samples,
+                                            prefetch.key.parameters.get(),
+                                            clsf,
+                                            prefetch.key.groupPeaks,
+                                            current);
+            if (set == nullptr)
+                break;
+
+            QMutexLocker lock(&_pulledMutex);
+            _prefetched.push_back(make_pair(prefetch.key, set));
+            lock.unlock();
+            emit eicsPrefetched();
+        }
+
+        QMutexLocker lock(&_pulledMutex);
+        _prefetchFinished = true;
+        lock.unlock();
+        emit eicsPrefetched();
+    };
+    _prefetchFuture = QtConcurrent::run(task);
+}
+
+void EicWidget::_cachePrefetchedEICs()
+{
+    QMutexLocker lock(&_pulledMutex);
+    vector<pair<EICCache::Key, shared_ptr<EICSet>>> prefetched;
+    prefetched.swap(_prefetched);
+    bool finished = _prefetchFinished;
+    _prefetchFinished = false;
+    lock.unlock();
+
+    for (const auto& entry : prefetched)
+        _eicCache.insert(entry.first, entry.second);
+
+    if (finished) {
+        // the task emits just before returning
+        _prefetchFuture.waitForFinished();
+        _startNextPull();
+    }
+}
+
+void EicWidget::_startNextPull()
+{
+    if (_pullFuture.isRunning() || _prefetchFuture.isRunning())
+        return;
 
-    emit groupSet(group);
-    replot(group);
-    _clearEicPoints();
-	addPeakPositions(group);
+    if (_pullPending) {
+        _startPull();
+    } else {
+        _startPrefetch();
+    }
 }
 
 void EicWidget::setSensitiveToTolerance(bool sensitive)
@@ -1740,16 +2058,6 @@ void EicWidget::setMzSlice(float mz1, float mz2) {
 	setMzSlice(x);
 }
 
-void EicWidget::groupPeaks() {
-    auto mp = getMainWindow()->mavenParameters;
-    if (eicParameters->selectedGroup() != nullptr
-        && !eicParameters->selectedGroup()->tableName().empty()) {
-        mp = eicParameters->selectedGroup()->parameters().get();
-    }
-
-    eicParameters->groupPeaks(&(eicParameters->_slice), mp);
-}
-
 void EicWidget::print(QPaintDevice* printer) {
 	//qDebug <<"EicWidget::print(QPaintDevice* printer) ";
 	QPainter painter(printer);
@@ -2241,7 +2549,7 @@ void EicWidget::renderPdf(shared_ptr<PeakGroup> group, QPainter* painter)
                           samples,
                           group->parameters().get());
     PeakFiltering peakFiltering(group->parameters().get(), false);
-    peakFiltering.filter(eicParameters->eics);
+    peakFiltering.filter(eicparameters->eics);
 
     bounds = eicparameters->visibleEICBounds();
     if (eicparameters->_slice.rtmin < bounds.rtmin)
@@ -1,9 +1,16 @@
 #ifndef PLOT_WIDGET_H
 #define PLOT_WIDGET_H
 
+#include <atomic>
+#include <functional>
+
 #include <qnamespace.h>
+#include <QElapsedTimer>
+#include <QFuture>
+#include <QMutex>
 
 #include "stable.h"
+#include "eiclogic.h"
 
 class EIC;
 class EICLogic;
@@ -51,6 +58,15 @@ public Q_SLOTS:
 	 * @param selected compound object
 	 **/
 	void setCompound(Compound* c);
+
+    /**
+     * @brief Pull EICs of the given groups in the background, into the cache
+     * of recent slices, so that they are shown at once when selected.
+     * @details Groups should be given in the order they are likely to be
+     * selected. Prefetching yields to EICs pulled for the widget itself, and
+     * groups given earlier that have not been prefetched yet are dropped.
+     */
+    void prefetch(QList<shared_ptr<PeakGroup>> groups);
     void setSelectedGroup(shared_ptr<PeakGroup> group);
     shared_ptr<PeakGroup> getSelectedGroup();
     void addEICLines(bool showSpline,
@@ -150,6 +166,12 @@ public Q_SLOTS:
 	void freezeView(bool freeze);
     void unSetPeakTableGroup(shared_ptr<PeakGroup>);
 
+    /**
+     * @brief Abandon any EICs being pulled in the background, waiting for the
+     * pull to stop. Must be called before samples are unloaded.
+     */
+    void stopPulling();
+
     /**
      * @brief Set whether the EIC widget should respond to requests for
      * readjustments to its slice as the global mass tolerance changes.
@@ -189,6 +211,26 @@ Q_SIGNALS:
     void groupSet(shared_ptr<PeakGroup>);
     void compoundSet(Compound*);
 
+    /**
+     * @brief Emitted once the EICs of a compound set with `setCompound` have
+     * been pulled, with the group selected near its expected RT (if any).
+     */
+    void compoundGroupSelected(Compound*, shared_ptr<PeakGroup>);
+
+    /**
+     * @brief Emitted from the background as EICs are pulled.
+     */
+    void eicsPulled();
+
+    /**
+     * @brief Emitted from the background as EICs are prefetched.
+     */
+    void eicsPrefetched();
+
+private Q_SLOTS:
+    void _showPulledEICs();
+    void _cachePrefetchedEICs();
+
 private:
 	EICLogic* eicParameters;
 	float _focusLineRt;					// 0
@@ -247,8 +289,47 @@ private:
 	QWidget *parent;
 	QGraphicsLineItem* _focusLine;
 
+    // EICs of the slices selected last are kept, up to this many in all
+    static const size_t _maxCachedEICs = 4000;
+
+    // EICs of interactive selections are pulled in the background; starting
+    // another pull abandons the previous one, and only the latest request is
+    // pulled once the running pull stops
+    EICCache _eicCache;
+    QFuture<void> _pullFuture;
+    std::atomic<int> _pullRequest;
+    bool _pullPending;
+    EICCache::Key _pullKey;
+    mzSlice _pullSlice;
+    function<void()> _onPulled;
+    QElapsedTimer _partialReplotTimer;
+
+    // progress of the running pull, written from the background
+    QMutex _pulledMutex;
+    int _pulledRequest;
+    shared_ptr<EICSet> _pulledSet;
+    size_t _pulledCount;
+    bool _pullFinished;
+
+    // groups likely to be shown next are prefetched while nothing else is
+    // being pulled
+    struct _Prefetch
+    {
+        EICCache::Key key;
+        mzSlice slice;
+    };
+    QFuture<void> _prefetchFuture;
+    std::atomic<int> _prefetchRequest;
+    vector<_Prefetch> _prefetches;
+
+    // prefetched sets not cached yet, guarded by _pulledMutex
+    vector<pair<EICCache::Key, shared_ptr<EICSet>>> _prefetched;
+    bool _prefetchFinished;
+
+    // slices set while this is true are pulled by the caller, once done
+    bool _deferPull;
+
 	void showPeak(float freq, float amplitude);
-	void groupPeaks();
 	void computeEICs();
 	void cleanup();		//deallocate eics, fragments, peaks, peakgroups
 	void clearPlot();	//removes non permenent graphics objects
@@ -269,6 +350,36 @@ private:
     void _clearEicLines();
     void _clearEicPoints();
     void _clearBarPlot();
+
+    /**
+     * @brief Key of the EICs of a slice in the given samples, pulled with
+     * the parameters of the given group if it belongs to a table.
+     */
+    EICCache::Key _eicKey(const vector<mzSample*>& samples,
+                          const mzSlice& slice,
+                          shared_ptr<PeakGroup> group);
+
+    /**
+     * @brief Slice shown for a group by `setPeakGroup`, before its RT range
+     * is zoomed to the group.
+     */
+    mzSlice _sliceOf(shared_ptr<PeakGroup> group);
+
+    /**
+     * @brief Pull the EICs of the current slice (from the cache, if they
+     * were pulled recently, or else in the background), then call
+     * `onPulled`. EICs are replotted as they are pulled in the meantime.
+     */
+    void _pullEICs(function<void()> onPulled);
+
+    void _startPull();
+    void _startPrefetch();
+
+    /**
+     * @brief Start a pending pull, or else any prefetches, unless a pull or
+     * prefetch is already running.
+     */
+    void _startNextPull();
 };
 
 #endif
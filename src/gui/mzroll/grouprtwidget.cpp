@@ -28,7 +28,7 @@ void GroupRtWidget::plotGraph(PeakGroup*  group) {
     if (group == nullptr)
         return;
     currentDisplayedGroup = new PeakGroup(
-        make_shared<MavenParameters>(*_mw->mavenParameters),
+        MavenParameters::snapshot(*_mw->mavenParameters),
         PeakGroup::IntegrationType::Programmatic);
     currentDisplayedGroup->copyObj(*group);
     intialSetup();
@@ -187,7 +187,7 @@ float GroupRtWidget::calculateRsquare(PeakGroup newGroup,PeakGroup oldGroup) {
 
 PeakGroup GroupRtWidget::getNewGroup(PeakGroup group) {
 
-    PeakGroup newGroup(make_shared<MavenParameters>(*_mw->mavenParameters),
+    PeakGroup newGroup(MavenParameters::snapshot(*_mw->mavenParameters),
                        PeakGroup::IntegrationType::Programmatic);
 
     bool groupFound = false;
@@ -1,14 +1,159 @@
 #include <QGraphicsScene>
+#include <qtconcurrentrun.h>
 
 #include "Compound.h"
 #include "globals.h"
 #include "heatmap.h"
 #include "mainwindow.h"
 #include "mzSample.h"
+#include "quantmatrix.h"
 #include "Scan.h"
 #include "statistics.h"
 #include "tabledockwidget.h"
 
+HeatMapTiles::HeatMapTiles(float cellWidth, float cellHeight)
+    : QGraphicsItem(nullptr), _cellWidth(cellWidth), _cellHeight(cellHeight)
+{
+    setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);
+}
+
+void HeatMapTiles::setValues(const MatrixXf& values)
+{
+    prepareGeometryChange();
+    _values = values;
+
+    // drop tiles outside the new bounds
+    int tileRows = (_values.rows() + _tileSize - 1) / _tileSize;
+    int tileColumns = (_values.cols() + _tileSize - 1) / _tileSize;
+    for (auto it = _tiles.begin(); it != _tiles.end();) {
+        if (it.key().first >= tileRows || it.key().second >= tileColumns) {
+            it = _tiles.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void HeatMapTiles::setColorFunction(function<QColor(float)> colorOf)
+{
+    _colorOf = colorOf;
+    invalidate();
+}
+
+void HeatMapTiles::invalidate()
+{
+    _tiles.clear();
+    update();
+}
+
+void HeatMapTiles::invalidateRows(int firstRow, int lastRow)
+{
+    for (auto it = _tiles.begin(); it != _tiles.end();) {
+        int tileFirstRow = it.key().first * _tileSize;
+        int tileLastRow = tileFirstRow + _tileSize - 1;
+        if (tileFirstRow <= lastRow && tileLastRow >= firstRow) {
+            it = _tiles.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    update();
+}
+
+int HeatMapTiles::rowAt(const QPointF& point) const
+{
+    int row = static_cast<int>(floor(point.y() / _cellHeight));
+    return row >= 0 && row < _values.rows() ? row : -1;
+}
+
+int HeatMapTiles::columnAt(const QPointF& point) const
+{
+    int column = static_cast<int>(floor(point.x() / _cellWidth));
+    return column >= 0 && column < _values.cols() ? column : -1;
+}
+
+QRectF HeatMapTiles::boundingRect() const
+{
+    return QRectF(0,
+                  0,
+                  _values.cols() * _cellWidth,
+                  _values.rows() * _cellHeight);
+}
+
+void HeatMapTiles::paint(QPainter* painter,
+                         const QStyleOptionGraphicsItem* option,
+                         QWidget*)
+{
+    if (_values.size() == 0 || !_colorOf)
+        return;
+
+    QRectF exposed = option->exposedRect.intersected(boundingRect());
+    if (exposed.isEmpty())
+        return;
+
+    int firstRow = max(0, static_cast<int>(exposed.top() / _cellHeight));
+    int lastRow = min(static_cast<int>(_values.rows()) - 1,
+                      static_cast<int>(exposed.bottom() / _cellHeight));
+    int firstColumn = max(0, static_cast<int>(exposed.left() / _cellWidth));
+    int lastColumn = min(static_cast<int>(_values.cols()) - 1,
+                         static_cast<int>(exposed.right() / _cellWidth));
+
+    for (int tileRow = firstRow / _tileSize;
+         tileRow <= lastRow / _tileSize;
+         tileRow++) {
+        for (int tileColumn = firstColumn / _tileSize;
+             tileColumn <= lastColumn / _tileSize;
+             tileColumn++) {
+            auto key = qMakePair(tileRow, tileColumn);
+            auto tile = _tiles.find(key);
+            if (tile == _tiles.end())
+                tile = _tiles.insert(key, _renderTile(tileRow, tileColumn));
+
+            QRectF target(tileColumn * _tileSize * _cellWidth,
+                          tileRow * _tileSize * _cellHeight,
+                          tile->width() * _cellWidth,
+                          tile->height() * _cellHeight);
+            painter->drawImage(target, *tile);
+        }
+    }
+
+    // cell borders, once cells are large enough to show them
+    qreal levelOfDetail =
+        option->levelOfDetailFromTransform(painter->worldTransform());
+    if (levelOfDetail * min(_cellWidth, _cellHeight) < 6)
+        return;
+
+    painter->setPen(QPen(Qt::black, 0));
+    qreal top = firstRow * _cellHeight;
+    qreal bottom = (lastRow + 1) * _cellHeight;
+    qreal left = firstColumn * _cellWidth;
+    qreal right = (lastColumn + 1) * _cellWidth;
+    for (int row = firstRow; row <= lastRow + 1; row++)
+        painter->drawLine(QLineF(left, row * _cellHeight, right, row * _cellHeight));
+    for (int column = firstColumn; column <= lastColumn + 1; column++) {
+        painter->drawLine(
+            QLineF(column * _cellWidth, top, column * _cellWidth, bottom));
+    }
+}
+
+QImage HeatMapTiles::_renderTile(int tileRow, int tileColumn) const
+{
+    int firstRow = tileRow * _tileSize;
+    int firstColumn = tileColumn * _tileSize;
+    int rows = min(_tileSize, static_cast<int>(_values.rows()) - firstRow);
+    int columns = min(_tileSize,
+                      static_cast<int>(_values.cols()) - firstColumn);
+
+    // one pixel per cell
+    QImage image(columns, rows, QImage::Format_RGB32);
+    for (int i = 0; i < rows; i++) {
+        QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(i));
+        for (int j = 0; j < columns; j++)
+            line[j] = _colorOf(_values(firstRow + i, firstColumn + j)).rgb();
+    }
+    return image;
+}
+
 HeatMap::HeatMap(MainWindow* mw) { 
     this->mainwindow = mw;
     _table=NULL;
@@ -17,14 +162,32 @@ HeatMap::HeatMap(MainWindow* mw) {
     _rowSpacer=150;
     _boxW = 30;
     _boxH = 30;
+    _heatMax = 0;
+    _heatMin = 0;
+    _replotPending = false;
+    _computing = false;
 
     setScene(new QGraphicsScene(this));
     scene()->setItemIndexMethod(QGraphicsScene::BspTreeIndex);
     setObjectName("Heatmap");
+
+    _tiles = new HeatMapTiles(_boxW, _boxH);
+    _tiles->setColorFunction([this](float cellValue) {
+        return getColor(cellValue, _heatMin, _heatMax);
+    });
+    _tiles->setPos(_rowSpacer, _sampleSpacer);
+
+    connect(this,
+            &HeatMap::foldChangesComputed,
+            this,
+            &HeatMap::_showFoldChanges,
+            Qt::QueuedConnection);
 }
 
 
 HeatMap::~HeatMap() {
+  _computeFuture.waitForFinished();
+  if (_tiles->scene() == nullptr) delete _tiles;
   if (scene()!=NULL) delete(scene());
 }
 
@@ -45,37 +208,33 @@ void HeatMap::wheelEvent(QWheelEvent *event) {
 }
 
 void HeatMap::updateColors() {
-
-    cerr << "HeatMap::updateColors()" << endl;
-    Q_FOREACH (QGraphicsItem *item, scene()->items()) {
-        if (QGraphicsRectItem *rect = qgraphicsitem_cast<QGraphicsRectItem *>(item)) {
-           float cellValue = rect->data(1).toDouble();
-           QColor color = getColor(cellValue,_heatMin,_heatMax);
-           if(cellValue) ((QGraphicsRectItem*) rect)->setBrush(color);
-        }
+    // cells are colored again as their tiles are rendered again
+    _tiles->invalidate();
+    for (auto box : _legendBoxes) {
+        float cellValue = box->data(1).toFloat();
+        box->setBrush(getColor(cellValue, _heatMin, _heatMax));
     }
-
-    cerr << "HeatMap::updateColors() .. done" << endl;
 }
 
 
 void HeatMap::drawMap() { 
 
+	if (_table == NULL) {
+        if (_tiles->scene() != nullptr) scene()->removeItem(_tiles);
         scene()->clear();
-	if (_table == NULL) return;
+        _legendBoxes.clear();
+        return;
+    }
 
+    // the map is drawn again once the running computation has been shown
+    if (_computing) {
+        _replotPending = true;
+        return;
+    }
 
     QList<shared_ptr<PeakGroup>> allgroups = _table->getGroups();
-        int Nrows= allgroups.size();
 	vector<mzSample*> vsamples = mainwindow->getVisibleSamples();
    	sort(vsamples.begin(), vsamples.end(), mzSample::compSampleOrder);
-	int Ncols= vsamples.size();
-	if ( Nrows == 0 || Ncols == 0) return;
-
-	heatmap.resize(Nrows,Ncols);
-    heatmap.setZero();
-    _heatMax=0;
-    _heatMin=0;
 
     sort(allgroups.begin(),
          allgroups.end(),
@@ -83,23 +242,105 @@ void HeatMap::drawMap() {
              return a->meanRt < b->meanRt;
          });
 
-    for (int i=0; i < Nrows; i++ ) {
-        auto group = allgroups[i];
-        StatisticsVector<float> yvalues = group->getOrderedIntensityVector(vsamples,PeakGroup::AreaTop);
-
-        float center = median(yvalues);
-        if ( center == 0 ) center = yvalues.mean();
-        if ( center == 0 ) center = yvalues[0];
-        if ( center == 0 ) center = 1;
-        if ( center )
-           for(int j=0; j< yvalues.size(); j++ ) {
-            float ratio = yvalues[j]/center;
-            if (ratio !=0 ) ratio = log2(ratio);   //fold change on log2 scale
-            heatmap(i,j)=ratio;
-            if (ratio > _heatMax)  _heatMax=ratio;
-            if (ratio < _heatMin)  _heatMin=ratio;
+    // peaks are read here, since groups may be edited or deleted while fold
+    // changes are computed; the task is only given their quantities
+    int Nrows = allgroups.size();
+    int Ncols = vsamples.size();
+    vector<PeakGroup*> groups;
+    for (auto group : allgroups)
+        groups.push_back(group.get());
+    QuantMatrix quantMatrix(groups, vsamples, PeakGroup::AreaTop);
+    vector<vector<float>> quantities(Nrows);
+    for (int i = 0; i < Nrows; i++)
+        quantities[i] = quantMatrix.rowVector(i);
+
+    // groups are kept, so that rows can still be clicked once shown
+    _computedGroups = allgroups;
+    _computedSamples = vsamples;
+
+    auto task = [this, Nrows, Ncols, quantities] {
+        _computedHeatmap.resize(Nrows, Ncols);
+        _computedHeatmap.setZero();
+        _computedHeatMax = 0;
+        _computedHeatMin = 0;
+
+        for (int i=0; i < Nrows && Ncols > 0; i++ ) {
+            StatisticsVector<float> yvalues = quantities[i];
+
+            float center = median(yvalues);
+            if ( center == 0 ) center = yvalues.mean();
+            if ( center == 0 ) center = yvalues[0];
+            if ( center == 0 ) center = 1;
+            if ( center )
+               for(int j=0; j< yvalues.size(); j++ ) {
+                float ratio = yvalues[j]/center;
+                if (ratio !=0 ) ratio = log2(ratio);   //fold change on log2 scale
+                _computedHeatmap(i,j)=ratio;
+                if (ratio > _computedHeatMax)  _computedHeatMax=ratio;
+                if (ratio < _computedHeatMin)  _computedHeatMin=ratio;
+            }
+        }
+        emit foldChangesComputed();
+    };
+    _computing = true;
+    _computeFuture = QtConcurrent::run(task);
+}
+
+void HeatMap::_showFoldChanges()
+{
+    // the task emits just before returning, and must not be seen as running
+    // by a replot started from here
+    _computeFuture.waitForFinished();
+    _computing = false;
+
+    if (_replotPending) {
+        _replotPending = false;
+        drawMap();
+        return;
+    }
+
+    // only tiles of rows that have changed are rendered again, unless the
+    // range of colors has changed as well
+    bool sameColumns = _computedSamples == _samples
+                       && _computedHeatMin == _heatMin
+                       && _computedHeatMax == _heatMax;
+    int firstChangedRow = -1;
+    int lastChangedRow = -1;
+    int numRows = max(_groups.size(), _computedGroups.size());
+    for (int i = 0; i < numRows && sameColumns; i++) {
+        if (i < _groups.size()
+            && i < _computedGroups.size()
+            && _groups[i] == _computedGroups[i]
+            && heatmap.row(i) == _computedHeatmap.row(i)) {
+            continue;
         }
-	}
+        if (firstChangedRow < 0)
+            firstChangedRow = i;
+        lastChangedRow = i;
+    }
+
+    _groups = _computedGroups;
+    _samples = _computedSamples;
+    heatmap = _computedHeatmap;
+    _heatMin = _computedHeatMin;
+    _heatMax = _computedHeatMax;
+    _computedGroups.clear();
+
+    _tiles->setValues(heatmap);
+    if (!sameColumns) {
+        _tiles->invalidate();
+    } else if (firstChangedRow >= 0) {
+        _tiles->invalidateRows(firstChangedRow, lastChangedRow);
+    }
+
+    // labels and legend are created again, while the cells keep their tiles
+    if (_tiles->scene() != nullptr) scene()->removeItem(_tiles);
+    scene()->clear();
+    _legendBoxes.clear();
+
+    int Nrows = heatmap.rows();
+    int Ncols = heatmap.cols();
+	if ( Nrows == 0 || Ncols == 0) return;
 
 	//heatmap.print();
         float range  =  _heatMax-_heatMin;
@@ -110,22 +351,9 @@ void HeatMap::drawMap() {
 
 	//draw heatmap
         scene()->setSceneRect(0,0,sceneWidth,sceneHeight);
-        for (int i=0; i < heatmap.rows(); i++ ) {
-            auto group = allgroups[i];
-            for (int j=0; j < heatmap.cols(); j++ ) {
-                float cellValue = heatmap(i,j);
-                QColor color = getColor(cellValue,_heatMin,_heatMax);
-                int xpos = _rowSpacer+j*_boxW;
-                int ypos = _sampleSpacer+i*_boxH;
-
-                QBrush brush(color);
-                QPen pen(Qt::black);
-                QGraphicsRectItem* item = scene()->addRect(QRectF(xpos,ypos,_boxW,_boxH),pen,brush);
-                item->setData(0, QVariant::fromValue(group));
-                item->setData(1, QVariant::fromValue(cellValue));
-                item->setFlag(QGraphicsItem::ItemIsSelectable);
-            }
-
+        scene()->addItem(_tiles);
+        for (int i=0; i < Nrows; i++ ) {
+            auto group = _groups[i];
             Compound* c  = group->getCompound();
             if ( c != NULL) {
                 QGraphicsTextItem* item = scene()->addText(QString(c->name().c_str()));
@@ -139,8 +367,8 @@ void HeatMap::drawMap() {
         }
 
 	//draw labels
-	 for(int i=0; i < vsamples.size(); i++ ) {
-		 QGraphicsTextItem* item = scene()->addText(QString(vsamples[i]->sampleName.c_str()));
+	 for(int i=0; i < _samples.size(); i++ ) {
+		 QGraphicsTextItem* item = scene()->addText(QString(_samples[i]->sampleName.c_str()));
 		 int textWidth = item->boundingRect().width();
 		 float ratio = _sampleSpacer/(float) textWidth;
 	  	 if ( ratio < 1 ) item->setScale(ratio);
@@ -162,6 +390,7 @@ void HeatMap::drawMap() {
                  text->setPos(xpos,ypos);
                  item->setPos(xpos,ypos);
                  item->setData(1, QVariant::fromValue(cellValue));
+                 _legendBoxes.append(item);
 	}
 
      scene()->update();
@@ -191,7 +420,12 @@ void HeatMap::mousePressEvent(QMouseEvent *event) {
     if (event->button() == Qt::LeftButton) {
         QGraphicsItem* item = itemAt(event->pos());
         cerr << "Item=" << item << endl;
-        if ( item != NULL )  {
+        if (item == _tiles) {
+            QPointF point = _tiles->mapFromScene(mapToScene(event->pos()));
+            int row = _tiles->rowAt(point);
+            if (row >= 0 && row < _groups.size() && mainwindow != nullptr)
+                mainwindow->setPeakGroup(_groups[row]);
+        } else if ( item != NULL )  {
 			QVariant v = item->data(0);
             shared_ptr<PeakGroup> group = v.value<shared_ptr<PeakGroup>>();
             if (group != nullptr && mainwindow != nullptr)
@@ -1,10 +1,69 @@
 #ifndef HEATMAPWIDGET_H
 #define HEATMAPWIDGET_H
 
+#include <functional>
+
+#include <QFuture>
+
 #include "stable.h"
 
 class MainWindow;
+class PeakGroup;
 class TableDockWidget;
+class mzSample;
+
+/**
+ * @brief Cells of a heatmap, drawn from cached images of square tiles.
+ * @details Each tile is rendered once into an image with one pixel per cell,
+ * which is scaled to the size of the cells when painted. Only the tiles that
+ * intersect the exposed area are painted (and rendered, if not cached), so
+ * the cost of drawing does not grow with the size of the map. Cell borders
+ * are drawn only when cells are large enough on screen to show them.
+ */
+class HeatMapTiles : public QGraphicsItem
+{
+public:
+    HeatMapTiles(float cellWidth, float cellHeight);
+
+    /**
+     * @brief Set the values of cells, keeping cached tiles.
+     * @details Tiles of rows that have changed should be invalidated with
+     * `invalidateRows`, or all tiles with `invalidate`.
+     */
+    void setValues(const MatrixXf& values);
+
+    /**
+     * @brief Set the function giving the color of a cell from its value.
+     * Invalidates all tiles.
+     */
+    void setColorFunction(function<QColor(float)> colorOf);
+
+    void invalidate();
+
+    void invalidateRows(int firstRow, int lastRow);
+
+    int rowAt(const QPointF& point) const;
+
+    int columnAt(const QPointF& point) const;
+
+    QRectF boundingRect() const;
+
+protected:
+    void paint(QPainter* painter,
+               const QStyleOptionGraphicsItem* option,
+               QWidget* widget);
+
+private:
+    static const int _tileSize = 64;
+
+    float _cellWidth;
+    float _cellHeight;
+    MatrixXf _values;
+    function<QColor(float)> _colorOf;
+    QHash<QPair<int, int>, QImage> _tiles;
+
+    QImage _renderTile(int tileRow, int tileColumn) const;
+};
 
 class HeatMap : public QGraphicsView
 {
@@ -19,6 +78,12 @@ public Q_SLOTS:
     void replot();
     void updateColors();
 
+Q_SIGNALS:
+    void foldChangesComputed();
+
+private Q_SLOTS:
+    void _showFoldChanges();
+
 private:
     QColor getColor(float cellValue, float minValue, float maxValue);
     MainWindow* mainwindow;
@@ -33,6 +98,25 @@ private:
     float _boxW;
     float _boxH;
 
+    // groups and samples of the rows and columns of the map
+    QList<shared_ptr<PeakGroup>> _groups;
+    vector<mzSample*> _samples;
+
+    // fold changes are computed in the background, into the members below,
+    // and shown once finished
+    QFuture<void> _computeFuture;
+    bool _computing;
+    bool _replotPending;
+    QList<shared_ptr<PeakGroup>> _computedGroups;
+    vector<mzSample*> _computedSamples;
+    MatrixXf _computedHeatmap;
+    float _computedHeatMax;
+    float _computedHeatMin;
+
+    HeatMapTiles* _tiles;
+
+    // boxes of the color legend, holding their values as data
+    QList<QGraphicsRectItem*> _legendBoxes;
 
 protected:
     void drawMap();
@@ -44,4 +128,3 @@ protected:
 };
 
 #endif
-
@@ -11,9 +11,62 @@ EicLine::EicLine(QGraphicsItem* parent, QGraphicsScene *scene):QGraphicsItem(par
     _closePath=true;
     //Unintialised Value - Kiran
     _eic=NULL;
+    _decimated = false;
+    _columnStart = -1;
     if(scene) scene->addItem(this);
 }
 
+void EicLine::addPoint(QPointF p)
+{
+    if (!_decimated) {
+        _line << p;
+        return;
+    }
+
+    int column = static_cast<int>(floor(p.x()));
+    if (_columnStart < 0 || column != _column) {
+        _columnStart = _line.size();
+        _column = column;
+        _columnSize = 1;
+        _columnFirst = _columnMin = _columnMax = _columnLast = p;
+        _columnMinOrder = _columnMaxOrder = 0;
+        _line << p;
+        return;
+    }
+
+    // scene y grows downwards, so the highest point has the lowest y
+    int order = _columnSize++;
+    _columnLast = p;
+    if (p.y() > _columnMin.y()) {
+        _columnMin = p;
+        _columnMinOrder = order;
+    }
+    if (p.y() < _columnMax.y()) {
+        _columnMax = p;
+        _columnMaxOrder = order;
+    }
+
+    // rewrite the points of the column, skipping the lowest and highest
+    // points if they are the first or last one
+    auto isInner = [order](int pointOrder) {
+        return pointOrder > 0 && pointOrder < order;
+    };
+    _line.resize(_columnStart);
+    _line << _columnFirst;
+    if (_columnMinOrder < _columnMaxOrder) {
+        if (isInner(_columnMinOrder))
+            _line << _columnMin;
+        if (isInner(_columnMaxOrder))
+            _line << _columnMax;
+    } else {
+        if (isInner(_columnMaxOrder))
+            _line << _columnMax;
+        if (isInner(_columnMinOrder))
+            _line << _columnMin;
+    }
+    _line << _columnLast;
+}
+
 void EicLine::removeFromScene()
 {
     prepareGeometryChange();
@@ -100,6 +153,7 @@ void EicLine::fixEnds() {
     _line.append(a);        //drop to baseline
     _line.append(b);        //move along baseline to origin
     _line.append(first);    //close path
+    _columnStart = -1;
 
     //qDebug() << last << a << b << first;
     _endsFixed=true;
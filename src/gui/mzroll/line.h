@@ -10,8 +10,20 @@ class EicLine : public QGraphicsItem
 {
 public:
     EicLine(QGraphicsItem* parent, QGraphicsScene *scene);
-    void addPoint(float x, float y)  { _line << QPointF(x,y); }
-    void addPoint(QPointF p)  { _line << p; }
+    void addPoint(float x, float y)  { addPoint(QPointF(x,y)); }
+    void addPoint(QPointF p);
+
+    /**
+     * @brief Set whether points added to the line are decimated.
+     * @details When decimated, consecutive points that fall within the same
+     * pixel column (unit of x) are reduced to at most four: the first, the
+     * lowest, the highest and the last of them, in the order they were
+     * added. This bounds the number of points drawn by the width of the
+     * scene, however long the trace, without changing how it looks. Lines
+     * are re-created from their data on zooming, so zooming in brings back
+     * the points that were merged. Must be set before any point is added.
+     */
+    void setDecimated(bool value) { _decimated = value; }
     void setColor(const QColor &c)  { _color = c; }
     void setPen(QPen &p)  { _pen = p; }
     void setBrush(QBrush &b)  { _brush = b; }
@@ -26,7 +38,7 @@ public:
     void removeFromScene();
     void setClipPath(QPainterPath& path) { _clipPath = path; }
     QPolygonF line() const { return _line; }
-    void setLine(const QPolygonF& line) { _line = line; }
+    void setLine(const QPolygonF& line) { _line = line; _columnStart = -1; }
 
 protected:
     QRectF boundingRect() const;
@@ -47,6 +59,20 @@ private:
     bool _closePath;
     bool _fillPath;
     QPainterPath _clipPath;
+
+    bool _decimated;
+
+    // position in `_line` of the points of the last pixel column, and the
+    // points of the column that are kept, by the order in which they came
+    int _columnStart;
+    int _column;
+    int _columnSize;
+    QPointF _columnFirst;
+    QPointF _columnMin;
+    QPointF _columnMax;
+    QPointF _columnLast;
+    int _columnMinOrder;
+    int _columnMaxOrder;
 };
 
 #endif
@@ -619,6 +619,10 @@ using namespace mzUtils;
 
     connect(spectralHitsDockWidget,SIGNAL(updateProgressBar(QString,int,int)), SLOT(setProgressBar(QString, int,int)));
     connect(eicWidget,SIGNAL(scanChanged(Scan*)),spectraWidget,SLOT(setScan(Scan*)));
+    connect(eicWidget,
+            &EicWidget::compoundGroupSelected,
+            this,
+            &MainWindow::setCompoundGroupFocus);
 
 	qRegisterMetaType<QList<PeakGroup> >("QList<PeakGroup>");
 	connect(this, SIGNAL(undoAlignment(QList<PeakGroup> )), this, SLOT(plotAlignmentVizAllGroupGraph(QList<PeakGroup>)));
@@ -1463,23 +1467,10 @@ void MainWindow::setCompoundFocus(Compound*c) {
 		massCalcWidget->setMass(mz);
 	}
 
-	if (eicWidget->isVisible() && samples.size() > 0) {
+	// widgets showing the group selected for the compound are updated once
+	// its EICs have been pulled, by `setCompoundGroupFocus`
+	if (eicWidget->isVisible() && samples.size() > 0)
         eicWidget->setCompound(c);
-        shared_ptr<PeakGroup> selectedGroup = eicWidget->getSelectedGroup();
-		if (isotopeWidget && isotopeWidget->isVisible()) {
-			isotopeWidget->setCompound(c);
-			isotopeWidget->setPeakGroupAndMore(selectedGroup);
-        } else if (isotopeWidget
-                   && isotopePlot
-                   && isotopePlot->isVisible()
-                   && selectedGroup
-                   && selectedGroup->getCompound() != NULL) {
-            isotopeWidget->updateIsotopicBarplot(selectedGroup);
-        }
-
-		if (fragSpectraWidget->isVisible())
-			fragSpectraWidget->overlayPeakGroup(selectedGroup);
-    }
 
     if (fragPanel->isVisible())
         showFragmentationScans(mz);
@@ -1497,6 +1488,24 @@ void MainWindow::setCompoundFocus(Compound*c) {
 		setUrl(c);
 }
 
+void MainWindow::setCompoundGroupFocus(Compound* c,
+                                       shared_ptr<PeakGroup> selectedGroup)
+{
+    if (isotopeWidget && isotopeWidget->isVisible()) {
+        isotopeWidget->setCompound(c);
+        isotopeWidget->setPeakGroupAndMore(selectedGroup);
+    } else if (isotopeWidget
+               && isotopePlot
+               && isotopePlot->isVisible()
+               && selectedGroup
+               && selectedGroup->getCompound() != NULL) {
+        isotopeWidget->updateIsotopicBarplot(selectedGroup);
+    }
+
+    if (fragSpectraWidget->isVisible())
+        fragSpectraWidget->overlayPeakGroup(selectedGroup);
+}
+
 /*
 @author: Sahil
 */
@@ -3513,6 +3522,15 @@ void MainWindow::showSRMList() {
      }
 }
 
+void MainWindow::prefetchPeakGroups(QList<shared_ptr<PeakGroup>> groups)
+{
+    if (eicWidget && eicWidget->isVisible())
+        eicWidget->prefetch(groups);
+
+    if (fragSpectraWidget && fragSpectraDockWidget->isVisible())
+        fragSpectraWidget->prefetch(groups);
+}
+
 void MainWindow::setPeakGroup(shared_ptr<PeakGroup> group) {
     qDebug() << "setPeakgroup(group)" << endl;
 	if (group == NULL)
@@ -343,6 +343,12 @@ public Q_SLOTS:
 	void spectaFocused(Peak* _peak);
 	bool checkCompoundExistance(Compound* c);
 	void setCompoundFocus(Compound* c);
+
+    /**
+     * @brief Show the group selected in the EIC widget for a compound in
+     * widgets following it (isotopes and fragmentation spectra).
+     */
+    void setCompoundGroupFocus(Compound* c, shared_ptr<PeakGroup> selectedGroup);
 	void setPathwayFocus(Pathway* p);
 	void showFragmentationScans(float pmz);
 	QString groupTextExport(PeakGroup* group);
@@ -361,6 +367,12 @@ public Q_SLOTS:
 	void exportPDF();
     void exportSVG();
     void setPeakGroup(shared_ptr<PeakGroup> group);
+
+    /**
+     * @brief Prepare the plots of groups likely to be shown next (e.g.,
+     * neighbouring rows of a table) in the background, nearest first.
+     */
+    void prefetchPeakGroups(QList<shared_ptr<PeakGroup>> groups);
 	void showDockWidgets();
 	void hideDockWidgets();
 	//void terminateTheads();
@@ -1310,7 +1310,7 @@ void mzFileIO::readSamplesXML(QXmlStreamReader& xml,
 PeakGroup* mzFileIO::readGroupXML(QXmlStreamReader& xml, PeakGroup* parent)
 {
     PeakGroup* group = new PeakGroup(
-        make_shared<MavenParameters>(*_mainwindow->mavenParameters),
+        MavenParameters::snapshot(*_mainwindow->mavenParameters),
         PeakGroup::IntegrationType::Programmatic);
 
     group->groupId = xml.attributes().value("groupId").toString().toInt();
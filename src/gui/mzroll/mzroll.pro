@@ -202,6 +202,7 @@ HEADERS += stable.h \
            pollyelmaveninterface.h \
            comparesamplesdialog.h \
            tabledockwidget.h  \
+           peaktablemodel.h \
            treedockwidget.h  \
            heatmap.h  \
            treemap.h  \
@@ -278,6 +279,7 @@ SOURCES += mainwindow.cpp  \
            eicwidget.cpp \
            plot_axes.cpp \
            tabledockwidget.cpp \
+           peaktablemodel.cpp \
            peakdetectiondialog.cpp \
            pollyelmaveninterface.cpp \
            comparesamplesdialog.cpp \
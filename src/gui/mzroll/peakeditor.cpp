@@ -317,16 +317,21 @@ void PeakEditor::_applyEdits()
 {
     _setBusyState();
 
-    MavenParameters* mp = _group->parameters().get();
+    // group parameters may be shared with other groups, therefore changes
+    // are made to a copy which then replaces the group's parameters
+    MavenParameters editedParameters(*_group->parameters());
     if (ui->baselineTabWidget->currentIndex() == 0) {
-        mp->aslsBaselineMode = false;
-        mp->baseline_dropTopX = ui->dropTopSpinBox->value();
-        mp->baseline_smoothingWindow = ui->smoothingSpinBox->value();
+        editedParameters.aslsBaselineMode = false;
+        editedParameters.baseline_dropTopX = ui->dropTopSpinBox->value();
+        editedParameters.baseline_smoothingWindow =
+            ui->smoothingSpinBox->value();
     } else {
-        mp->aslsBaselineMode = true;
-        mp->aslsSmoothness = ui->smoothnessSlider->value();
-        mp->aslsAsymmetry = ui->asymmetrySlider->value();
+        editedParameters.aslsBaselineMode = true;
+        editedParameters.aslsSmoothness = ui->smoothnessSlider->value();
+        editedParameters.aslsAsymmetry = ui->asymmetrySlider->value();
     }
+    editedParameters.linkIsotopeRtRange = ui->syncRtCheckBox->isChecked();
+    _group->setParameters(MavenParameters::snapshot(editedParameters));
 
     // lambda: edits peak regions and recalculates a group's statistics
     auto editGroup = [this](PeakGroup* group, vector<EIC*>& eics) {
@@ -357,8 +362,6 @@ void PeakEditor::_applyEdits()
 
     // if checked, edit regions for all related isotopologues
     if (ui->syncRtCheckBox->isChecked()) {
-        mp->linkIsotopeRtRange = true;
-
         PeakGroup* parentGroup = nullptr;
         if (_group->childCount() > 0) {
             parentGroup = _group.get();
@@ -379,7 +382,6 @@ void PeakEditor::_applyEdits()
             editGroup(child.get(), eics);
         }
     } else {
-        mp->linkIsotopeRtRange = false;
         auto eics = _gallery->eics();
         editGroup(_group.get(), eics);
     }
@@ -0,0 +1,646 @@
+#include <map>
+
+#include "globals.h"
+#include "mavenparameters.h"
+#include "mzSample.h"
+#include "peaktablemodel.h"
+
+PeakTableModel::PeakTableModel(QObject* parent)
+    : QAbstractItemModel(parent)
+    , _quantType(PeakGroup::AreaTop)
+    , _minQuality(0.0f)
+    , _sortColumn(-1)
+    , _sortOrder(Qt::AscendingOrder)
+    , _goodIcon(":/images/good.png")
+    , _badIcon(":/images/bad.png")
+{
+    _collator.setNumericMode(true);
+}
+
+PeakTableModel::~PeakTableModel()
+{
+}
+
+void PeakTableModel::setColumns(const QStringList& names,
+                                const vector<mzSample*>& samples)
+{
+    beginResetModel();
+    _columnNames = names;
+    _samples = samples;
+    _clearValues(&_root);
+    endResetModel();
+}
+
+void PeakTableModel::setQuantType(PeakGroup::QType type)
+{
+    if (type == _quantType)
+        return;
+
+    _quantType = type;
+    updateAll();
+}
+
+void PeakTableModel::setMinQuality(float minQuality)
+{
+    _minQuality = minQuality;
+}
+
+void PeakTableModel::setGroups(const QList<shared_ptr<PeakGroup>>& groups)
+{
+    beginResetModel();
+    _root.children.clear();
+    _root.rows.clear();
+    _nodes.clear();
+    _filter = nullptr;
+
+    map<int, _Node*> clusters;
+    for (auto group : groups) {
+        if (group == nullptr)
+            continue;
+
+        int clusterId = group->clusterId;
+        if (clusterId && group->meanMz > 0 && group->peakCount() > 0) {
+            _Node*& cluster = clusters[clusterId];
+            if (cluster == nullptr) {
+                cluster = new _Node;
+                cluster->clusterId = clusterId;
+                cluster->parent = &_root;
+                _root.children.push_back(unique_ptr<_Node>(cluster));
+            }
+            _addNode(group, cluster);
+        } else {
+            _addNode(group, &_root);
+        }
+    }
+
+    _filterRows(&_root);
+    _sortRows(&_root);
+    endResetModel();
+}
+
+void PeakTableModel::appendGroup(shared_ptr<PeakGroup> group)
+{
+    _Node* node = _addNode(group, &_root);
+    if (node == nullptr)
+        return;
+
+    _filterRows(node);
+    _sortRows(node);
+    if (_filter && !_filter(group.get()))
+        return;
+
+    int row = _root.rows.size();
+    beginInsertRows(QModelIndex(), row, row);
+    node->row = row;
+    _root.rows.push_back(node);
+    endInsertRows();
+}
+
+void PeakTableModel::removeGroup(const PeakGroup* group)
+{
+    auto found = _nodes.find(group);
+    if (found == _nodes.end())
+        return;
+
+    _Node* node = found->second;
+    _Node* parent = node->parent;
+    QModelIndex parentIndex = _index(parent);
+    bool shown = node->row >= 0 && (parent == &_root || parentIndex.isValid());
+    if (shown)
+        beginRemoveRows(parentIndex, node->row, node->row);
+
+    if (node->row >= 0) {
+        parent->rows.erase(parent->rows.begin() + node->row);
+        for (size_t i = node->row; i < parent->rows.size(); ++i)
+            parent->rows[i]->row = i;
+    }
+    _forgetNode(node);
+    parent->children.erase(find_if(parent->children.begin(),
+                                   parent->children.end(),
+                                   [node](const unique_ptr<_Node>& child) {
+                                       return child.get() == node;
+                                   }));
+
+    if (shown)
+        endRemoveRows();
+}
+
+void PeakTableModel::updateGroup(const PeakGroup* group, bool withChildren)
+{
+    auto found = _nodes.find(group);
+    if (found == _nodes.end())
+        return;
+
+    _Node* node = found->second;
+    node->hasValues = false;
+    QModelIndex index = _index(node);
+
+    if (withChildren) {
+        // rows of children are created again if the children have changed
+        vector<PeakGroup*> children;
+        for (auto child : node->group->children) {
+            if (child != nullptr && child->meanMz > 0)
+                children.push_back(child.get());
+        }
+        bool sameChildren = children.size() == node->children.size();
+        for (size_t i = 0; sameChildren && i < children.size(); ++i)
+            sameChildren = node->children[i]->group.get() == children[i];
+
+        if (sameChildren) {
+            _clearValues(node);
+            if (index.isValid() && !node->rows.empty()) {
+                emit dataChanged(this->index(0, 0, index),
+                                 this->index(node->rows.size() - 1,
+                                             columnCount() - 1,
+                                             index));
+            }
+        } else {
+            bool removing = index.isValid() && !node->rows.empty();
+            if (removing)
+                beginRemoveRows(index, 0, node->rows.size() - 1);
+            for (auto& child : node->children)
+                _forgetNode(child.get());
+            node->children.clear();
+            node->rows.clear();
+            if (removing)
+                endRemoveRows();
+
+            for (auto child : node->group->children)
+                _addNode(child, node);
+            bool inserting = index.isValid() && !node->children.empty();
+            if (inserting)
+                beginInsertRows(index, 0, node->children.size() - 1);
+            _filterRows(node);
+            _sortRows(node);
+            if (inserting)
+                endInsertRows();
+        }
+    }
+
+    if (index.isValid())
+        emit dataChanged(index, index.sibling(index.row(), columnCount() - 1));
+}
+
+void PeakTableModel::updateAll()
+{
+    _clearValues(&_root);
+    if (_root.rows.empty() || _columnNames.empty())
+        return;
+
+    emit dataChanged(index(0, 0),
+                     index(_root.rows.size() - 1, columnCount() - 1));
+}
+
+void PeakTableModel::setFilter(function<bool(PeakGroup*)> accepts)
+{
+    beginResetModel();
+    _filter = accepts;
+    _filterRows(&_root);
+    _sortRows(&_root);
+    endResetModel();
+}
+
+shared_ptr<PeakGroup> PeakTableModel::group(const QModelIndex& index) const
+{
+    if (!index.isValid())
+        return nullptr;
+    return _node(index)->group;
+}
+
+QModelIndex PeakTableModel::indexOf(const PeakGroup* group) const
+{
+    auto found = _nodes.find(group);
+    if (found == _nodes.end())
+        return QModelIndex();
+    return _index(found->second);
+}
+
+QModelIndex PeakTableModel::index(int row,
+                                  int column,
+                                  const QModelIndex& parent) const
+{
+    if (!hasIndex(row, column, parent))
+        return QModelIndex();
+
+    const _Node* parentNode = parent.isValid() ? _node(parent) : &_root;
+    return createIndex(row, column, parentNode->rows[row]);
+}
+
+QModelIndex PeakTableModel::parent(const QModelIndex& index) const
+{
+    if (!index.isValid())
+        return QModelIndex();
+
+    _Node* parentNode = _node(index)->parent;
+    if (parentNode == nullptr || parentNode == &_root)
+        return QModelIndex();
+    return createIndex(parentNode->row, 0, parentNode);
+}
+
+int PeakTableModel::rowCount(const QModelIndex& parent) const
+{
+    if (parent.column() > 0)
+        return 0;
+
+    const _Node* node = parent.isValid() ? _node(parent) : &_root;
+    return node->rows.size();
+}
+
+int PeakTableModel::columnCount(const QModelIndex&) const
+{
+    return _columnNames.size();
+}
+
+QVariant PeakTableModel::data(const QModelIndex& index, int role) const
+{
+    if (!index.isValid())
+        return QVariant();
+
+    _Node* node = _node(index);
+    int column = index.column();
+    switch (role) {
+    case Qt::DisplayRole:
+        return _text(node, column);
+    case Qt::DecorationRole:
+        if (column == 0 && node->group != nullptr) {
+            if (node->group->label == 'g')
+                return _goodIcon;
+            if (node->group->label == 'b')
+                return _badIcon;
+        }
+        return QVariant();
+    case Qt::BackgroundRole:
+        return _background(node, column);
+    case Qt::UserRole:
+        return QVariant::fromValue(node->group);
+    default:
+        return QVariant();
+    }
+}
+
+QVariant PeakTableModel::headerData(int section,
+                                    Qt::Orientation orientation,
+                                    int role) const
+{
+    if (orientation == Qt::Horizontal
+        && role == Qt::DisplayRole
+        && section >= 0
+        && section < _columnNames.size()) {
+        return _columnNames[section];
+    }
+    return QAbstractItemModel::headerData(section, orientation, role);
+}
+
+bool PeakTableModel::setHeaderData(int section,
+                                   Qt::Orientation orientation,
+                                   const QVariant& value,
+                                   int role)
+{
+    if (orientation != Qt::Horizontal
+        || (role != Qt::EditRole && role != Qt::DisplayRole)
+        || section < 0
+        || section >= _columnNames.size()) {
+        return false;
+    }
+
+    _columnNames[section] = value.toString();
+    emit headerDataChanged(orientation, section, section);
+    return true;
+}
+
+Qt::ItemFlags PeakTableModel::flags(const QModelIndex& index) const
+{
+    if (!index.isValid())
+        return Qt::NoItemFlags;
+    return Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsDragEnabled;
+}
+
+void PeakTableModel::sort(int column, Qt::SortOrder order)
+{
+    emit layoutAboutToBeChanged();
+
+    // persistent indexes (selection, current row, etc.) follow their rows
+    QModelIndexList oldIndexes = persistentIndexList();
+    vector<pair<_Node*, int>> persistentNodes;
+    for (const auto& index : oldIndexes)
+        persistentNodes.push_back(make_pair(_node(index), index.column()));
+
+    _sortColumn = column;
+    _sortOrder = order;
+    if (_sortColumn < 0)
+        _filterRows(&_root);
+    _sortRows(&_root);
+
+    QModelIndexList newIndexes;
+    for (const auto& persistentNode : persistentNodes) {
+        QModelIndex index = _index(persistentNode.first);
+        newIndexes.append(index.isValid()
+                              ? index.sibling(index.row(),
+                                              persistentNode.second)
+                              : QModelIndex());
+    }
+    changePersistentIndexList(oldIndexes, newIndexes);
+
+    emit layoutChanged();
+}
+
+PeakTableModel::_Node* PeakTableModel::_node(const QModelIndex& index) const
+{
+    return static_cast<_Node*>(index.internalPointer());
+}
+
+QModelIndex PeakTableModel::_index(_Node* node) const
+{
+    if (node == nullptr || node == &_root)
+        return QModelIndex();
+
+    // rows under hidden rows are not shown either
+    for (_Node* ancestor = node; ancestor != &_root; ancestor = ancestor->parent) {
+        if (ancestor->row < 0)
+            return QModelIndex();
+    }
+    return createIndex(node->row, 0, node);
+}
+
+PeakTableModel::_Node* PeakTableModel::_addNode(shared_ptr<PeakGroup> group,
+                                                _Node* parent)
+{
+    // groups without any m/z are not shown
+    if (group == nullptr || group->meanMz <= 0)
+        return nullptr;
+
+    _Node* node = new _Node;
+    node->group = group;
+    node->parent = parent;
+    parent->children.push_back(unique_ptr<_Node>(node));
+    _nodes[group.get()] = node;
+
+    for (auto child : group->children)
+        _addNode(child, node);
+    return node;
+}
+
+void PeakTableModel::_forgetNode(_Node* node)
+{
+    if (node->group != nullptr)
+        _nodes.erase(node->group.get());
+    for (auto& child : node->children)
+        _forgetNode(child.get());
+}
+
+void PeakTableModel::_clearValues(_Node* node)
+{
+    node->hasValues = false;
+    node->values.clear();
+    for (auto& child : node->children)
+        _clearValues(child.get());
+}
+
+void PeakTableModel::_filterRows(_Node* node)
+{
+    // only top-level groups, with or without a cluster, are filtered
+    bool filtered = node == &_root || node->group == nullptr;
+
+    node->rows.clear();
+    for (auto& child : node->children) {
+        _filterRows(child.get());
+        child->row = -1;
+
+        bool visible = true;
+        if (child->group == nullptr) {
+            visible = !child->rows.empty();
+        } else if (filtered && _filter) {
+            visible = _filter(child->group.get());
+        }
+        if (visible)
+            node->rows.push_back(child.get());
+    }
+}
+
+void PeakTableModel::_sortRows(_Node* node)
+{
+    if (_sortColumn >= 0 && node->rows.size() > 1) {
+        vector<pair<QVariant, _Node*>> keyedRows;
+        keyedRows.reserve(node->rows.size());
+        for (_Node* row : node->rows)
+            keyedRows.push_back(make_pair(_sortKey(row, _sortColumn), row));
+
+        bool ascending = _sortOrder == Qt::AscendingOrder;
+        stable_sort(keyedRows.begin(),
+                    keyedRows.end(),
+                    [this, ascending](const pair<QVariant, _Node*>& a,
+                                      const pair<QVariant, _Node*>& b) {
+                        return ascending ? _lessThan(a.first, b.first)
+                                         : _lessThan(b.first, a.first);
+                    });
+        for (size_t i = 0; i < keyedRows.size(); ++i)
+            node->rows[i] = keyedRows[i].second;
+    }
+
+    for (size_t i = 0; i < node->rows.size(); ++i) {
+        node->rows[i]->row = i;
+        _sortRows(node->rows[i]);
+    }
+}
+
+const vector<float>& PeakTableModel::_values(_Node* node) const
+{
+    if (!node->hasValues) {
+        vector<mzSample*> samples = _samples;
+        node->values = node->group->getOrderedIntensityVector(samples,
+                                                              _quantType);
+        node->maxValue = node->values.empty()
+                             ? 0.0f
+                             : *max_element(node->values.begin(),
+                                            node->values.end());
+        node->hasValues = true;
+    }
+    return node->values;
+}
+
+QVariant PeakTableModel::_sortKey(_Node* node, int column) const
+{
+    PeakGroup* group = node->group.get();
+    if (group == nullptr) {
+        if (column == 0)
+            return QString("Cluster ") + QString::number(node->clusterId);
+        if (column == 5 && !node->children.empty())
+            return static_cast<double>(node->children.front()->group->meanRt);
+        return QVariant();
+    }
+
+    if (!_samples.empty() && column >= numCommonColumns) {
+        const vector<float>& values = _values(node);
+        size_t i = column - numCommonColumns;
+        if (i < values.size())
+            return static_cast<double>(values[i]);
+        return QVariant();
+    }
+
+    switch (column) {
+    case 0:
+        return static_cast<double>(group->groupId);
+    case 1:
+        return QString::fromStdString(group->getName());
+    case 2:
+        return static_cast<double>(group->meanMz);
+    case 3: {
+        int charge = group->parameters()->getCharge(group->getCompound());
+        double mz = group->getExpectedMz(charge);
+        if (mz == -1)
+            return QVariant();
+        return mz;
+    }
+    case 4:
+        return static_cast<double>(group->meanRt);
+    case 5: {
+        float expectedRtDiff = group->expectedRtDiff();
+        if (expectedRtDiff == -1.0f)
+            return QVariant();
+        return static_cast<double>(expectedRtDiff);
+    }
+    case 6:
+        return static_cast<double>(group->sampleCount
+                                   + group->blankSampleCount);
+    case 7:
+        return static_cast<double>(group->goodPeakCount);
+    case 8:
+        return static_cast<double>(group->maxNoNoiseObs);
+    case 9:
+        switch (_quantType) {
+        case PeakGroup::AreaTop:
+            return static_cast<double>(group->maxAreaTopIntensity);
+        case PeakGroup::Area:
+            return static_cast<double>(group->maxAreaIntensity);
+        case PeakGroup::Height:
+            return static_cast<double>(group->maxHeightIntensity);
+        case PeakGroup::AreaNotCorrected:
+            return static_cast<double>(group->maxAreaNotCorrectedIntensity);
+        case PeakGroup::AreaTopNotCorrected:
+            return static_cast<double>(
+                group->maxAreaTopNotCorrectedIntensity);
+        default:
+            return static_cast<double>(group->currentIntensity);
+        }
+    case 10:
+        return static_cast<double>(group->maxSignalBaselineRatio);
+    case 11:
+        return static_cast<double>(group->maxQuality);
+    case 12:
+        return static_cast<double>(group->fragMatchScore.mergedScore);
+    case 13:
+        return static_cast<double>(group->ms2EventCount);
+    case 14:
+        return static_cast<double>(group->groupRank);
+    case 15:
+        return static_cast<double>(group->changeFoldRatio);
+    case 16:
+        return static_cast<double>(group->changePValue);
+    default:
+        return QVariant();
+    }
+}
+
+bool PeakTableModel::_lessThan(const QVariant& a, const QVariant& b) const
+{
+    // numbers come before text, and text before missing values
+    auto rank = [](const QVariant& key) {
+        if (!key.isValid())
+            return 2;
+        return key.type() == QVariant::String ? 1 : 0;
+    };
+
+    int rankA = rank(a);
+    int rankB = rank(b);
+    if (rankA != rankB)
+        return rankA < rankB;
+    if (rankA == 0)
+        return a.toDouble() < b.toDouble();
+    if (rankA == 1)
+        return _collator.compare(a.toString(), b.toString()) < 0;
+    return false;
+}
+
+QString PeakTableModel::_text(_Node* node, int column) const
+{
+    QVariant key = _sortKey(node, column);
+    if (!key.isValid()) {
+        if (node->group != nullptr && (column == 3 || column == 5))
+            return "NA";
+        return QString();
+    }
+    if (key.type() == QVariant::String)
+        return key.toString();
+
+    double value = key.toDouble();
+    if (node->group == nullptr)
+        return QString::number(value, 'f', 2);
+    if (!_samples.empty() && column >= numCommonColumns)
+        return QString::number(value);
+
+    switch (column) {
+    case 2:
+    case 3:
+        return QString::number(value, 'f', 4);
+    case 4:
+    case 5:
+    case 11:
+    case 12:
+        return QString::number(value, 'f', 2);
+    case 9:
+        return QString::number(value, 'g', 3);
+    case 10:
+        return QString::number(value, 'f', 0);
+    case 14:
+        return QString::number(value, 'e', 6);
+    case 15:
+        return QString::number(value, 'f', 3);
+    case 16:
+        return QString::number(value, 'f', 6);
+    default:
+        return QString::number(static_cast<qlonglong>(value));
+    }
+}
+
+QVariant PeakTableModel::_background(_Node* node, int column) const
+{
+    PeakGroup* group = node->group.get();
+    if (group == nullptr)
+        return QVariant();
+
+    // highlight groups marked against the quality of their peaks
+    if (column == 0) {
+        int good = 0;
+        int bad = 0;
+        int total = group->peakCount();
+        for (int i = 0; i < total; i++)
+            group->peaks[i].quality > _minQuality ? good++ : bad++;
+
+        if (good > 0 && group->label == 'b') {
+            float incorrectFraction = ((float)good) / total;
+            return QBrush(QColor::fromRgbF(0.8, 0, 0, incorrectFraction));
+        } else if (bad > 0 && group->label == 'g') {
+            float incorrectFraction = ((float)bad) / total;
+            return QBrush(QColor::fromRgbF(0.8, 0, 0, incorrectFraction));
+        }
+        return QBrush(QColor::fromRgbF(1.0, 1.0, 1.0, 1.0));
+    }
+
+    // shade quantities of samples by their difference from the highest one
+    if (!_samples.empty() && column >= numCommonColumns) {
+        const vector<float>& values = _values(node);
+        size_t i = column - numCommonColumns;
+        if (i >= values.size())
+            return QVariant();
+
+        float prob = values[i];
+        if (node->maxValue != 0)
+            prob = abs((node->maxValue - values[i]) / node->maxValue);
+        prob = min(max(prob, 0.0f), 1.0f);
+
+        QColor color = Qt::white;
+        color.setHsvF(0.0, prob, 1, 1);
+        return QBrush(color);
+    }
+    return QVariant();
+}
@@ -0,0 +1,178 @@
+#ifndef PEAKTABLEMODEL_H
+#define PEAKTABLEMODEL_H
+
+#include <functional>
+#include <unordered_map>
+
+#include <QAbstractItemModel>
+#include <QCollator>
+#include <QIcon>
+
+#include "stable.h"
+#include "PeakGroup.h"
+
+class mzSample;
+
+/**
+ * @brief Item model of the peak-groups in a peak table.
+ * @details Groups are held as a tree of rows: top-level groups (under a
+ * "Cluster" row, if they have been clustered) and their children. Cells are
+ * formatted only when a view asks for them, from the groups themselves, so
+ * that adding many groups does not cost more than storing pointers to them.
+ *
+ * Each row keeps the order of its visible children as a permutation of its
+ * children. Sorting reorders these permutations and filtering rebuilds them,
+ * without creating or deleting any rows.
+ *
+ * The first `numCommonColumns` columns are the same for all tables. Later
+ * columns show either properties of groups (group view), or the quantity of
+ * each sample (peak view), if samples have been set along with the columns.
+ */
+class PeakTableModel : public QAbstractItemModel
+{
+    Q_OBJECT
+
+public:
+    static const int numCommonColumns = 5;
+
+    PeakTableModel(QObject* parent = nullptr);
+    ~PeakTableModel();
+
+    /**
+     * @brief Set the names of columns.
+     * @param names Column names.
+     * @param samples Samples of the quantity columns, in column order. If
+     * empty, columns after the common ones show group properties instead.
+     */
+    void setColumns(const QStringList& names,
+                    const vector<mzSample*>& samples = {});
+
+    /**
+     * @brief Set the quantity shown for the max intensity and sample columns.
+     */
+    void setQuantType(PeakGroup::QType type);
+
+    /**
+     * @brief Set the peak quality above which peaks are considered good, for
+     * highlighting groups marked in disagreement with their peaks.
+     */
+    void setMinQuality(float minQuality);
+
+    /**
+     * @brief Replace all rows with the given groups, in the current sort
+     * order. Groups with a non-zero cluster ID are shown under a row for
+     * their cluster. Removes any filter.
+     */
+    void setGroups(const QList<shared_ptr<PeakGroup>>& groups);
+
+    /**
+     * @brief Add a row for a top-level group, after all other rows.
+     * @details Meant for adding groups one at a time, while they are being
+     * found. Rows added this way are sorted along with the rest on the next
+     * call to `sort` or `setGroups`.
+     */
+    void appendGroup(shared_ptr<PeakGroup> group);
+
+    /**
+     * @brief Remove the row of a group, along with its children.
+     */
+    void removeGroup(const PeakGroup* group);
+
+    /**
+     * @brief Refresh the row of a group, e.g., after its peaks or label have
+     * changed.
+     * @param withChildren If true, rows of children are refreshed as well,
+     * and added or removed to match the current children of the group.
+     */
+    void updateGroup(const PeakGroup* group, bool withChildren = true);
+
+    /**
+     * @brief Refresh all rows.
+     */
+    void updateAll();
+
+    /**
+     * @brief Show only groups accepted by the given filter, and cluster rows
+     * having any such group. Children of groups are not filtered. An empty
+     * function removes the filter.
+     */
+    void setFilter(function<bool(PeakGroup*)> accepts);
+
+    /**
+     * @brief Group shown at the given index, or nullptr for cluster rows.
+     */
+    shared_ptr<PeakGroup> group(const QModelIndex& index) const;
+
+    /**
+     * @brief Index (of the first column) of the row showing the given group,
+     * or an invalid index if the group is not shown.
+     */
+    QModelIndex indexOf(const PeakGroup* group) const;
+
+    QModelIndex index(int row,
+                      int column,
+                      const QModelIndex& parent = QModelIndex()) const;
+    QModelIndex parent(const QModelIndex& index) const;
+    int rowCount(const QModelIndex& parent = QModelIndex()) const;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const;
+    QVariant headerData(int section,
+                        Qt::Orientation orientation,
+                        int role = Qt::DisplayRole) const;
+    bool setHeaderData(int section,
+                       Qt::Orientation orientation,
+                       const QVariant& value,
+                       int role = Qt::EditRole);
+    Qt::ItemFlags flags(const QModelIndex& index) const;
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder);
+
+private:
+    struct _Node
+    {
+        shared_ptr<PeakGroup> group;
+        int clusterId = 0;
+        _Node* parent = nullptr;
+        vector<unique_ptr<_Node>> children;
+
+        // visible children, in display order
+        vector<_Node*> rows;
+
+        // position in the rows of the parent, or -1 if hidden
+        int row = -1;
+
+        // quantities of samples, computed when first needed
+        bool hasValues = false;
+        vector<float> values;
+        float maxValue = 0.0f;
+    };
+
+    _Node _root;
+    unordered_map<const PeakGroup*, _Node*> _nodes;
+
+    QStringList _columnNames;
+    vector<mzSample*> _samples;
+    PeakGroup::QType _quantType;
+    float _minQuality;
+    function<bool(PeakGroup*)> _filter;
+    int _sortColumn;
+    Qt::SortOrder _sortOrder;
+
+    QCollator _collator;
+    QIcon _goodIcon;
+    QIcon _badIcon;
+
+    _Node* _node(const QModelIndex& index) const;
+    QModelIndex _index(_Node* node) const;
+    _Node* _addNode(shared_ptr<PeakGroup> group, _Node* parent);
+    void _forgetNode(_Node* node);
+    void _clearValues(_Node* node);
+    void _filterRows(_Node* node);
+    void _sortRows(_Node* node);
+    const vector<float>& _values(_Node* node) const;
+    QVariant _sortKey(_Node* node, int column) const;
+    bool _lessThan(const QVariant& a, const QVariant& b) const;
+    QString _text(_Node* node, int column) const;
+    QVariant _background(_Node* node, int column) const;
+};
+
+#endif // PEAKTABLEMODEL_H
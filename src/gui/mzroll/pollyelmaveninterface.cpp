@@ -1048,7 +1048,7 @@ QStringList PollyElmavenInterfaceDialog::_prepareFilesToUpload(QDir qdir,
         peakTable->excludeBadPeakSet();
     }
 
-    peakTable->treeWidget->selectAll();
+    peakTable->treeView->selectAll();
     peakTable->prepareDataForPolly(_writeableTempDir,
                                    "Groups Summary Matrix Format "
                                    "Comma Delimited (*.csv)",
@@ -1162,7 +1162,7 @@ PollyElmavenInterfaceDialog::_prepareSessionFiles(QString datetimestamp)
                                + tableName
                                + "_groups"
                                + ".csv";
-    peakTable->treeWidget->selectAll();
+    peakTable->treeView->selectAll();
     peakTable->prepareDataForPolly(_writeableTempDir,
                                    "Groups Summary Matrix Format "
                                    "Comma Delimited (*.csv)",
@@ -1178,7 +1178,7 @@ PollyElmavenInterfaceDialog::_prepareSessionFiles(QString datetimestamp)
                               + tableName
                               + "_peaks"
                               + ".csv";
-    peakTable->treeWidget->selectAll();
+    peakTable->treeView->selectAll();
     peakTable->prepareDataForPolly(_writeableTempDir,
                                    "Peaks Detailed Format "
                                    "Comma Delimited (*.csv)",
@@ -947,6 +947,13 @@ void ProjectDockWidget::keyPressEvent(QKeyEvent *e ) {
 void ProjectDockWidget::unloadSample(mzSample* sample) {
     if ( sample == NULL) return;
 
+    // EICs and spectra must not be computed from the sample while its scans
+    // are deleted
+    if (_mainwindow->getEicWidget())
+        _mainwindow->getEicWidget()->stopPulling();
+    if (_mainwindow->fragSpectraWidget)
+        _mainwindow->fragSpectraWidget->stopPrefetching();
+
     //mark sample as unselected
     sample->isSelected=false;
     delete_all(sample->scans);
@@ -7,6 +7,7 @@
 #include "mzUtils.h"
 #include "pls.h"
 #include "pls.h"
+#include "quantmatrix.h"
 #include "Scan.h"
 #include "scatterplot.h"
 #include "tabledockwidget.h"
@@ -303,16 +304,18 @@ void ScatterPlot::drawPLS(vector<PeakGroup*>groups) {
         Mat2D X; X = Mat2D::Zero(groups.size(),vsamples.size());
         Mat2D Y; Y=  Mat2D::Zero(groups.size(),setNumericIds.size());
 
+        QuantMatrix quantMatrix(groups, vsamples, qtype);
 		for(int i=0; i < groups.size(); i++ ) {
-        	 vector<float>values=groups[i]->getOrderedIntensityVector(vsamples,qtype);
+        	 const float* values=quantMatrix.row(i);
+             int numValues=quantMatrix.numSamples();
              float sum=0;
-             for(int j=0; j < values.size(); j++ ) {  sum += values[j]; }
+             for(int j=0; j < numValues; j++ ) {  sum += values[j]; }
              if(sum==0) continue;
-             float meanValue=sum/values.size();
+             float meanValue=sum/numValues;
 
-             for(int j=0; j < values.size(); j++ ) {  X(i,j)=(values[j]/sum)-(meanValue/sum);}
+             for(int j=0; j < numValues; j++ ) {  X(i,j)=(values[j]/sum)-(meanValue/sum);}
 
-             for(int j=0; j < values.size(); j++ ) {
+             for(int j=0; j < numValues; j++ ) {
                     mzSample* sample = vsamples[j];
 					QList<QString>setnames = sampleSetnameMap.values(sample);
 					Q_FOREACH(QString setname, setnames ) { 
@@ -636,7 +639,7 @@ void ScatterPlot::showSimilar(PeakGroup* group) {
 	if (!_table) return;
 
     QList<shared_ptr<PeakGroup>> allgroups = _table->getGroups();
-    if (!group->clusterId) _table->clusterGroups();
+    if (!group->clusterId) _table->clusterGroups(false);
 
     QSet<PeakGroup*>similar;
 
@@ -1001,7 +1001,7 @@ void SpectralHitsDockWidget::integrateMS1() {
         //qDebug() << "here.. .here.. here " << eics.size();
 
         vector<PeakGroup> peakgroups =
-            EIC::groupPeaks(eics, nullptr, make_shared<MavenParameters>(*mp));
+            EIC::groupPeaks(eics, nullptr, MavenParameters::snapshot(*mp));
 
        PeakGroup* nearestGrp = NULL;
        for(int i=0; i < peakgroups.size();i++ ) {
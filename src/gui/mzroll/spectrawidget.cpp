@@ -1,3 +1,5 @@
+#include <qtconcurrentrun.h>
+
 #include "datastructures/adduct.h"
 #include "line.h"
 #include "Compound.h"
@@ -16,7 +18,7 @@
 #include "spectrawidget.h"
 
 SpectraWidget::SpectraWidget(MainWindow* mw, bool isFragSpectra)
-    : _currentGroup(make_shared<MavenParameters>(*mw->mavenParameters),
+    : _currentGroup(MavenParameters::snapshot(*mw->mavenParameters),
                     PeakGroup::IntegrationType::Programmatic)
 {
     this->mainwindow = mw;
@@ -37,6 +39,30 @@ SpectraWidget::SpectraWidget(MainWindow* mw, bool isFragSpectra)
     _profileMode = false;
     _nearestCoord = QPointF(0,0);
     _focusCoord = QPointF(0,0);
+
+    _consensusRequest = 0;
+    _consensusFinished = false;
+    connect(this,
+            &SpectraWidget::consensusPrefetched,
+            this,
+            &SpectraWidget::_cachePrefetchedConsensus,
+            Qt::QueuedConnection);
+}
+
+SpectraWidget::~SpectraWidget()
+{
+    stopPrefetching();
+}
+
+void SpectraWidget::stopPrefetching()
+{
+    ++_consensusRequest;
+    _pendingConsensus.clear();
+    _consensusFuture.waitForFinished();
+    _consensusCache.clear();
+
+    QMutexLocker lock(&_consensusMutex);
+    _prefetchedConsensus.clear();
 }
 
 void SpectraWidget::initPlot()
@@ -278,13 +304,24 @@ void SpectraWidget::overlayPeptideFragmentation(QString peptideSeq,MassCutoff *p
 void SpectraWidget::overlayPeakGroup(shared_ptr<PeakGroup> group)
 {
     _currentGroup =
-        PeakGroup(make_shared<MavenParameters>(*mainwindow->mavenParameters),
+        PeakGroup(MavenParameters::snapshot(*mainwindow->mavenParameters),
                   PeakGroup::IntegrationType::Programmatic);
     if (!group) return;
     
     _overlayMode = OverlayMode::Consensus;
     float productPpmTolr = mainwindow->mavenParameters->fragmentTolerance;
-    Scan* avgScan = group->getAverageFragmentationScan(productPpmTolr);
+
+    // the group is left with its fragmentation pattern, as if computed here
+    Scan* avgScan = nullptr;
+    auto consensus = _findConsensus(group, productPpmTolr);
+    if (consensus != nullptr) {
+        group->fragmentationPattern = consensus->pattern;
+        group->ms2EventCount = consensus->ms2EventCount;
+        avgScan = new Scan(NULL, 0, 2, 0, 0, 0);
+        avgScan->deepcopy(consensus->scan.get());
+    } else {
+        avgScan = group->getAverageFragmentationScan(productPpmTolr);
+    }
     setScan(avgScan);
     if (group->getCompound()) {
         _currentGroup.copyObj(*group);
@@ -294,6 +331,122 @@ void SpectraWidget::overlayPeakGroup(shared_ptr<PeakGroup> group)
     delete(avgScan);
 }
 
+const SpectraWidget::_Consensus*
+SpectraWidget::_findConsensus(shared_ptr<PeakGroup> group, float tolerance)
+{
+    for (auto entry = _consensusCache.begin();
+         entry != _consensusCache.end();
+         ++entry) {
+        if (entry->group != group || entry->tolerance != tolerance)
+            continue;
+
+        // the group has been changed since
+        if (entry->meanRt != group->meanRt
+            || entry->peakCount != group->peaks.size()) {
+            _consensusCache.erase(entry);
+            return nullptr;
+        }
+        _consensusCache.splice(_consensusCache.begin(), _consensusCache, entry);
+        return &_consensusCache.front();
+    }
+    return nullptr;
+}
+
+void SpectraWidget::prefetch(QList<shared_ptr<PeakGroup>> groups)
+{
+    // groups given earlier are no longer the ones likely to be shown next
+    ++_consensusRequest;
+    _pendingConsensus.clear();
+
+    float tolerance = mainwindow->mavenParameters->fragmentTolerance;
+    for (auto group : groups) {
+        if (group == nullptr || !group->hasCompoundLink())
+            continue;
+        if (_findConsensus(group, tolerance) != nullptr)
+            continue;
+        if (_pendingConsensus.size()
+            >= static_cast<int>(_maxCachedConsensus / 2)) {
+            break;
+        }
+        _pendingConsensus.append(group);
+    }
+
+    // otherwise started once the running computation has stopped
+    if (!_consensusFuture.isRunning())
+        _startConsensusPrefetch();
+}
+
+void SpectraWidget::_startConsensusPrefetch()
+{
+    if (_pendingConsensus.isEmpty())
+        return;
+
+    _consensusFinished = false;
+    int request = _consensusRequest;
+    float tolerance = mainwindow->mavenParameters->fragmentTolerance;
+
+    // patterns are computed for copies, since computing them changes groups
+    vector<pair<shared_ptr<PeakGroup>, shared_ptr<PeakGroup>>> groups;
+    for (auto group : _pendingConsensus)
+        groups.push_back(make_pair(group, make_shared<PeakGroup>(*group)));
+    _pendingConsensus.clear();
+
+    auto task = [this, request, tolerance, groups]() {
+        for (auto& entry : groups) {
+            if (request != _consensusRequest)
+                break;
+
+            PeakGroup& copy = *entry.second;
+            _Consensus consensus;
+            consensus.group = entry.first;
+            consensus.tolerance = tolerance;
+            consensus.meanRt = copy.meanRt;
+            consensus.peakCount = copy.peaks.size();
+            consensus.scan.reset(copy.getAverageFragmentationScan(tolerance));
+            consensus.pattern = copy.fragmentationPattern;
+            consensus.ms2EventCount = copy.ms2EventCount;
+
+            QMutexLocker lock(&_consensusMutex);
+            _prefetchedConsensus.push_back(consensus);
+        }
+
+        QMutexLocker lock(&_consensusMutex);
+        _consensusFinished = true;
+        lock.unlock();
+        emit consensusPrefetched();
+    };
+    _consensusFuture = QtConcurrent::run(task);
+}
+
+void SpectraWidget::_cachePrefetchedConsensus()
+{
+    QMutexLocker lock(&_consensusMutex);
+    vector<_Consensus> prefetched;
+    prefetched.swap(_prefetchedConsensus);
+    bool finished = _consensusFinished;
+    _consensusFinished = false;
+    lock.unlock();
+
+    for (auto& consensus : prefetched) {
+        auto entry = find_if(_consensusCache.begin(),
+                             _consensusCache.end(),
+                             [&consensus](const _Consensus& entry) {
+                                 return entry.group == consensus.group;
+                             });
+        if (entry != _consensusCache.end())
+            _consensusCache.erase(entry);
+        _consensusCache.push_front(consensus);
+    }
+    while (_consensusCache.size() > _maxCachedConsensus)
+        _consensusCache.pop_back();
+
+    if (finished) {
+        // the task emits just before returning
+        _consensusFuture.waitForFinished();
+        _startConsensusPrefetch();
+    }
+}
+
 void SpectraWidget::overlayCompoundFragmentation(Compound* c)
 {
     clearOverlay();
@@ -1,6 +1,11 @@
 #ifndef SPECTRAWIDGET_H
 #define SPECTRAWIDGET_H
 
+#include <atomic>
+
+#include <QFuture>
+#include <QMutex>
+
 #include "stable.h"
 #include "spectralhit.h"
 #include "mzSample.h"
@@ -25,6 +30,7 @@ public:
     };
 
     SpectraWidget(MainWindow* mw, bool isFragSpectra = false);
+    ~SpectraWidget();
     static vector<mzLink> findLinks(float centerMz, Scan* scan, MassCutoff *massCutoff, int ionizationMode);
 
         public Q_SLOTS:
@@ -45,6 +51,22 @@ public:
                     void spectraToClipboard();
                     void spectraToClipboardTop();
                     void overlayPeakGroup(shared_ptr<PeakGroup> group);
+
+                    /**
+                     * @brief Compute the consensus fragmentation spectra of
+                     * the given groups in the background, so that
+                     * `overlayPeakGroup` shows them at once.
+                     * @details Groups given earlier that have not been
+                     * computed yet are dropped.
+                     */
+                    void prefetch(QList<shared_ptr<PeakGroup>> groups);
+
+                    /**
+                     * @brief Stop computing consensus spectra and forget the
+                     * ones computed so far, e.g., before scans of a sample
+                     * are deleted.
+                     */
+                    void stopPrefetching();
                     void overlayPeptideFragmentation(QString proteinSeq,MassCutoff *productMassCutoff); //TODO: Sahil, Added while merging point
                     void overlayCompoundFragmentation(Compound* c);
 
@@ -80,9 +102,43 @@ public:
                     void drawAnnotations(); //TODO: Sahil, Added while merging spectrawidget
                     void clearScans();
 
+        Q_SIGNALS:
+                    void consensusPrefetched();
 
+        private Q_SLOTS:
+                    void _cachePrefetchedConsensus();
 
         private:
+                    // consensus spectrum of a group, as it was when computed
+                    struct _Consensus
+                    {
+                        shared_ptr<PeakGroup> group;
+                        float tolerance;
+                        float meanRt;
+                        size_t peakCount;
+                        Fragment pattern;
+                        int ms2EventCount;
+                        shared_ptr<Scan> scan;
+                    };
+
+                    // consensus spectra computed ahead of time, most
+                    // recently used first
+                    static const size_t _maxCachedConsensus = 16;
+                    list<_Consensus> _consensusCache;
+
+                    QFuture<void> _consensusFuture;
+                    std::atomic<int> _consensusRequest;
+                    QList<shared_ptr<PeakGroup>> _pendingConsensus;
+
+                    // spectra computed in the background, not cached yet
+                    QMutex _consensusMutex;
+                    vector<_Consensus> _prefetchedConsensus;
+                    bool _consensusFinished;
+
+                    void _startConsensusPrefetch();
+                    const _Consensus* _findConsensus(shared_ptr<PeakGroup> group,
+                                                     float tolerance);
+
                     EICLogic* eicparameters;
                     MainWindow* mainwindow;
                     Scan* _currentScan;
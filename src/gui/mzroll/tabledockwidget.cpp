@@ -13,6 +13,7 @@
 #include "EIC.h"
 #include "eicwidget.h"
 #include "globals.h"
+#include "groupClustering.h"
 #include "groupClassifier.h"
 #include "grouprtwidget.h"
 #include "groupsettingslog.h"
@@ -27,8 +28,8 @@
 #include "mzSample.h"
 #include "mzUtils.h"
 #include "notificator.h"
-#include "numeric_treewidgetitem.h"
 #include "peakeditor.h"
+#include "peaktablemodel.h"
 #include "PeakGroup.h"
 #include "peaktabledeletiondialog.h"
 #include "saveJson.h"
@@ -74,33 +75,33 @@ TableDockWidget::TableDockWidget(MainWindow *mw) {
   viewType = groupView;
   maxPeaks = 0; //Maximum Number of Peaks in a Group
 
-  treeWidget = new QTreeWidget(this);
-  treeWidget->setSortingEnabled(false);
-  treeWidget->setDragDropMode(QAbstractItemView::DragOnly);
-  treeWidget->setSelectionMode(QAbstractItemView::ExtendedSelection);
-  treeWidget->setAcceptDrops(false);
-  treeWidget->setObjectName("PeakGroupTable");
-  treeWidget->setFocusPolicy(Qt::NoFocus);
-  treeWidget->setSelectionBehavior(QAbstractItemView::SelectRows);
+  _model = new PeakTableModel(this);
+  treeView = new QTreeView(this);
+  treeView->setModel(_model);
+  treeView->setSortingEnabled(false);
+  treeView->setUniformRowHeights(true);
+  treeView->setDragDropMode(QAbstractItemView::DragOnly);
+  treeView->setSelectionMode(QAbstractItemView::ExtendedSelection);
+  treeView->setAcceptDrops(false);
+  treeView->setObjectName("PeakGroupTable");
+  treeView->setFocusPolicy(Qt::NoFocus);
+  treeView->setSelectionBehavior(QAbstractItemView::SelectRows);
   this->setFocusPolicy(Qt::ClickFocus);
   tableSelectionFlagUp = false;
   tableSelectionFlagDown = false;
   this->setAcceptDrops(true);
 
-  setWidget(treeWidget);
+  setWidget(treeView);
   setupPeakTable();
 
-  connect(treeWidget,
-          &QTreeWidget::itemClicked,
+  connect(treeView,
+          &QTreeView::clicked,
           this,
           &TableDockWidget::showSelectedGroup);
-  connect(treeWidget,
-          &QTreeWidget::itemSelectionChanged,
+  connect(treeView->selectionModel(),
+          &QItemSelectionModel::selectionChanged,
           this,
           &TableDockWidget::showSelectedGroup);
-  connect(treeWidget,
-          SIGNAL(itemExpanded(QTreeWidgetItem *)), this,
-          SLOT(sortChildrenAscending(QTreeWidgetItem *)));
 
   clusterDialog = new ClusterDialog(this);
   connect(clusterDialog->clusterButton,
@@ -116,6 +117,7 @@ TableDockWidget::TableDockWidget(MainWindow *mw) {
           SLOT(setProgressBar(QString, int, int, bool)));
   connect(this, SIGNAL(UploadPeakBatch()), this, SLOT(UploadPeakBatchToCloud()));
   connect(this, SIGNAL(renderedPdf()), this, SLOT(pdfReadyNotification()));
+  connect(this, SIGNAL(clusteringFinished()), this, SLOT(_applyClusters()));
 
   setupFiltersDialog();
 
@@ -123,10 +125,11 @@ TableDockWidget::TableDockWidget(MainWindow *mw) {
 }
 
 TableDockWidget::~TableDockWidget() {
+  _clusteringFuture.waitForFinished();
   if (clusterDialog != NULL)
     delete clusterDialog;
 
-  delete treeWidget;
+  delete treeView;
   QDir qDirS3(writableTempS3Dir);
   if(qDirS3.exists()){
     qDirS3.removeRecursively();
@@ -134,14 +137,10 @@ TableDockWidget::~TableDockWidget() {
 
 }
 
-void TableDockWidget::sortChildrenAscending(QTreeWidgetItem *item) {
-  item->sortChildren(1, Qt::AscendingOrder);
-}
-
 void TableDockWidget::showClusterDialog() { clusterDialog->show(); }
 
 void TableDockWidget::sortBy(int col) {
-  treeWidget->sortByColumn(col, Qt::AscendingOrder);
+  treeView->sortByColumn(col, Qt::AscendingOrder);
 }
 
 void TableDockWidget::updateTableAfterAlignment()
@@ -153,7 +152,6 @@ void TableDockWidget::updateTableAfterAlignment()
 }
 
 void TableDockWidget::setIntensityColName() {
-  QTreeWidgetItem *header = treeWidget->headerItem();
   QString temp;
   PeakGroup::QType qtype = _mainwindow->getUserQuantType();
   switch (qtype) {
@@ -177,7 +175,7 @@ void TableDockWidget::setIntensityColName() {
     break;
   }
   _mainwindow->currentIntensityName = temp;
-  header->setText(9, temp);
+  _model->setHeaderData(9, Qt::Horizontal, temp);
 }
 
 void TableDockWidget::setupPeakTable() {
@@ -204,8 +202,11 @@ void TableDockWidget::setupPeakTable() {
     colNames << "MS2 Score";
     colNames << "#MS2 Events";
     colNames << "Rank";
-  } else if (viewType == peakView) {
-    vector<mzSample *> vsamples = _mainwindow->getVisibleSamples();
+  }
+
+  vector<mzSample *> vsamples;
+  if (viewType == peakView) {
+    vsamples = _mainwindow->getVisibleSamples();
     sort(vsamples.begin(), vsamples.end(), mzSample::compSampleOrder);
     for (unsigned int i = 0; i < vsamples.size(); i++) {
       // Add peak view columns to the table
@@ -213,277 +214,57 @@ void TableDockWidget::setupPeakTable() {
     }
   }
 
-  treeWidget->setColumnCount(colNames.size());
-  treeWidget->setHeaderLabels(colNames);
-  treeWidget->header()->setSectionResizeMode(QHeaderView::ResizeToContents);
-  treeWidget->header()->adjustSize();
-  treeWidget->setSortingEnabled(true);
+  _model->setColumns(colNames, vsamples);
+  treeView->header()->setSectionResizeMode(QHeaderView::ResizeToContents);
+  treeView->header()->adjustSize();
+  treeView->setSortingEnabled(true);
 }
 
 void TableDockWidget::updateTable() {
-  QTreeWidgetItemIterator it(treeWidget);
-  while (*it) {
-    updateItem(*it);
-    ++it;
-  }
+  _model->setQuantType(_mainwindow->getUserQuantType());
+  _model->setMinQuality(_mainwindow->mavenParameters->minQuality);
+  for (auto group : _topLevelGroups)
+    _classifyGroup(group.get());
+  _model->updateAll();
   updateStatus();
 }
 
-void TableDockWidget::updateItem(QTreeWidgetItem *item, bool updateChildren) {
-  QVariant v = item->data(0, Qt::UserRole);
-  shared_ptr<PeakGroup> group = v.value<shared_ptr<PeakGroup>>();
+void TableDockWidget::updateGroup(PeakGroup *group, bool updateChildren) {
   if (group == nullptr)
     return;
 
-  heatmapBackground(item);
+  _classifyGroup(group, updateChildren);
+  _model->updateGroup(group, updateChildren);
+}
 
+void TableDockWidget::_classifyGroup(PeakGroup *group, bool withChildren) {
   //Find maximum number of peaks
   if (maxPeaks < group->peakCount()) maxPeaks = group->peakCount();
 
   //score group quality
   groupClassifier* groupClsf = _mainwindow->getGroupClassifier();
   if (group->peakCount() > 0 && groupClsf != NULL) {
-      groupClsf->classify(group.get());
+      groupClsf->classify(group);
   }
 
   //get probability good/bad from svm
   svmPredictor* groupPred = _mainwindow->getSVMPredictor();
   if (group->peakCount() > 0 && groupPred != NULL) {
-      groupPred->predict(group.get());
-  }
-
-  // Updating the peakid
-  item->setText(0, QString::number(group->groupId));
-  item->setText(1, QString(group->getName().c_str()));
-  item->setText(2, QString::number(group->meanMz, 'f', 4));
-
-  int charge = group->parameters()->getCharge(group->getCompound());
-  if (group->getExpectedMz(charge) != -1) {
-    float mz = group->getExpectedMz(charge);
-    item->setText(3, QString::number(mz, 'f', 4));
-  } else {
-    item->setText(3, "NA");
-  }
-
-  item->setText(4, QString::number(group->meanRt, 'f', 2));
-
-  if (viewType == groupView) {
-    auto expectedRtDiff = group->expectedRtDiff();
-    if (expectedRtDiff == -1.0f) {
-      item->setText(5, "NA");
-    } else {
-      item->setText(5, QString::number(expectedRtDiff, 'f', 2));
-    }
-    item->setText(6, QString::number(group->sampleCount
-                                     + group->blankSampleCount));
-    item->setText(7, QString::number(group->goodPeakCount));
-    item->setText(8, QString::number(group->maxNoNoiseObs));
-    item->setText(9, QString::number(extractMaxIntensity(group.get()), 'g', 3));
-    item->setText(10, QString::number(group->maxSignalBaselineRatio, 'f', 0));
-    item->setText(11, QString::number(group->maxQuality, 'f', 2));
-    item->setText(12, QString::number(group->fragMatchScore.mergedScore, 'f', 2));
-    item->setText(13, QString::number(group->ms2EventCount));
-    item->setText(14, QString::number(group->groupRank, 'e', 6));
-
-    if (fabs(group->changeFoldRatio) >= 0) {
-      item->setText(15, QString::number(group->changeFoldRatio, 'f', 3));
-      item->setText(16, QString::number(group->changePValue, 'f', 6));
-    }
-  }
-
-  int good = 0;
-  int bad = 0;
-  int total = group->peakCount();
-  for (int i = 0; i < group->peakCount(); i++) {
-    group->peaks[i].quality > _mainwindow->mavenParameters->minQuality ? good++
-                                                                       : bad++;
-  }
-
-  QBrush brush = Qt::NoBrush;
-  if (good > 0 && group->label == 'b') {
-    float incorrectFraction = ((float)good) / total;
-    brush = QBrush(QColor::fromRgbF(0.8, 0, 0, incorrectFraction));
-  } else if (bad > 0 && group->label == 'g') {
-    float incorrectFraction = ((float)bad) / total;
-    brush = QBrush(QColor::fromRgbF(0.8, 0, 0, incorrectFraction));
-  } else {
-    brush = QBrush(QColor::fromRgbF(1.0, 1.0, 1.0, 1.0));
-  }
-  item->setBackground(0, brush);
-
-  if (group->label == 'g') {
-    item->setIcon(0, QIcon(":/images/good.png"));
-  } else if (group->label == 'b') {
-    item->setIcon(0, QIcon(":/images/bad.png"));
-  } else {
-    item->setIcon(0, QIcon());
+      groupPred->predict(group);
   }
 
-  if (filtersDialog->isVisible()) {
-    float minG = sliders["GoodPeakCount"]->minBoundValue();
-    float maxG = sliders["GoodPeakCount"]->maxBoundValue();
-
-    if (group->goodPeakCount < minG || group->goodPeakCount > maxG) {
-      item->setHidden(true);
-    } else {
-      item->setHidden(false);
-    }
-  }
-
-  if (updateChildren) {
-    for (int i = 0; i < item->childCount(); ++i)
-      updateItem(item->child(i));
+  if (withChildren) {
+    for (auto child : group->children)
+      _classifyGroup(child.get());
   }
 }
 
 void TableDockWidget::updateCompoundWidget() {
   _mainwindow->ligandWidget->resetColor();
-  QTreeWidgetItemIterator itr(treeWidget);
-  while (*itr) {
-    QTreeWidgetItem *item = (*itr);
-    if (item) {
-      QVariant v = item->data(0, Qt::UserRole);
-      shared_ptr<PeakGroup> group = v.value<shared_ptr<PeakGroup>>();
-      if (group == nullptr)
-        continue;
-      _mainwindow->ligandWidget->markAsDone(group->getCompound());
-    }
-    ++itr;
-  }
-}
-
-void TableDockWidget::heatmapBackground(QTreeWidgetItem *item) {
-  if (viewType != peakView)
-    return;
-
-  int firstColumn = 4;
-  StatisticsVector<float> values;
-  float sum = 0;
-  for (unsigned int i = firstColumn; i < item->columnCount(); i++) {
-    values.push_back(item->text(i).toFloat());
-  }
-
-  if (values.size()) {
-    // normalize
-    float mean = values.mean();
-    float sd = values.stddev();
-
-    float max = values.maximum();
-    float min = values.minimum();
-    float range = max - min;
-
-    for (int i = 0; i < values.size(); i++) {
-      if (max != 0)
-        values[i] = abs((max - values[i]) / max); // Z-score
-    }
-
-    QColor color = Qt::white;
-
-    float colorramp = 0.5;
-
-    for (int i = 0; i < values.size(); i++) {
-      float value = values[i];
-      float prob = value;
-      if (prob < 0)
-        prob = 0;
-      color.setHsvF(0.0, prob, 1, 1);
-
-      item->setBackgroundColor(firstColumn + i, color);
-    }
-  }
-}
-
-void TableDockWidget::addRow(shared_ptr<PeakGroup> group,
-                             QTreeWidgetItem *root) {
-
-  if (group == nullptr)
-    return;
-  if (group->meanMz <= 0) {
-    return;
-  }
-
-  NumericTreeWidgetItem *item = new NumericTreeWidgetItem(root, 0);
-  item->setFlags(Qt::ItemIsSelectable | Qt::ItemIsEnabled |
-                 Qt::ItemIsDragEnabled);
-  item->setData(0, Qt::UserRole, QVariant::fromValue(group));
-
-  item->setText(0, QString::number(group->groupId));
-  item->setText(1, QString(group->getName().c_str()));
-  item->setText(2, QString::number(group->meanMz, 'f', 4));
-
-  int charge = group->parameters()->getCharge(group->getCompound());
-  if (group->getExpectedMz(charge) != -1) {
-    float mz = group->getExpectedMz(charge);
-
-    item->setText(3, QString::number(mz, 'f', 4));
-  } else {
-    item->setText(3, "NA");
-  }
-
-  item->setText(4, QString::number(group->meanRt, 'f', 2));
-
-  if (group->label == 'g')
-    item->setIcon(0, QIcon(":/images/good.png"));
-  if (group->label == 'b')
-    item->setIcon(0, QIcon(":/images/bad.png"));
-
-  if (viewType == groupView) {
-    auto expectedRtDiff = group->expectedRtDiff();
-    if (expectedRtDiff == -1.0f) {
-      item->setText(5, "NA");
-    } else {
-      item->setText(5, QString::number(expectedRtDiff, 'f', 2));
-    }
-    item->setText(6, QString::number(group->sampleCount
-                                     + group->blankSampleCount));
-    item->setText(7, QString::number(group->goodPeakCount));
-    item->setText(8, QString::number(group->maxNoNoiseObs));
-    item->setText(9, QString::number(extractMaxIntensity(group.get()), 'g', 3));
-    item->setText(10, QString::number(group->maxSignalBaselineRatio, 'f', 0));
-    item->setText(11, QString::number(group->maxQuality, 'f', 2));
-    item->setText(12, QString::number(group->fragMatchScore.mergedScore, 'f', 2));
-    item->setText(13, QString::number(group->ms2EventCount));
-    item->setText(14, QString::number(group->groupRank, 'e', 6));
-
-    if (group->changeFoldRatio != 0) {
-
-      item->setText(15, QString::number(group->changeFoldRatio, 'f', 2));
-      item->setText(16, QString::number(group->changePValue, 'e', 4));
-    }
-
-    //Find maximum number of peaks
-    if (maxPeaks < group->peakCount())
-        maxPeaks = group->peakCount();
-
-    //TODO: Move this to peak detector or peakgroup
-    groupClassifier* groupClsf = _mainwindow->getGroupClassifier();
-    if (group->peakCount() > 0 && groupClsf != NULL) {
-        groupClsf->classify(group.get());
-    }
-
-    //Get prediction labels from svm
-    svmPredictor* groupPred = _mainwindow->getSVMPredictor();
-    if (group->peakCount() > 0 && groupPred != NULL) {
-        groupPred->predict(group.get());
-    }
-  } else if (viewType == peakView) {
-    vector<mzSample *> vsamples = _mainwindow->getVisibleSamples();
-    sort(vsamples.begin(), vsamples.end(), mzSample::compSampleOrder);
-    vector<float> yvalues = group->getOrderedIntensityVector(
-        vsamples, _mainwindow->getUserQuantType());
-    for (unsigned int i = 0; i < yvalues.size(); i++) {
-
-      item->setText(5 + i, QString::number(yvalues[i]));
-    }
-    heatmapBackground(item);
-  }
-  if (root == NULL)
-    treeWidget->addTopLevelItem(item);
-  updateItem(item);
-
-  if (group->childCount() > 0) {
+  for (auto group : _topLevelGroups) {
+    _mainwindow->ligandWidget->markAsDone(group->getCompound());
     for (auto child : group->children)
-      addRow(child, item);
+      _mainwindow->ligandWidget->markAsDone(child->getCompound());
   }
 }
 
@@ -503,16 +284,13 @@ shared_ptr<PeakGroup> TableDockWidget::addPeakGroup(PeakGroup *group)
       _labeledGroups++;
     if (sharedGroup->getCompound())
       _targetedGroups++;
-    if (_topLevelGroups.size() > 0) {
-      shared_ptr<PeakGroup> g = _topLevelGroups.back();
-      g->setTableName(this->titlePeakTable->text().toStdString());
-      for (int i = 0; i < _topLevelGroups.size(); ++i) {
-        auto group = _topLevelGroups[i];
-        group->groupId = i + 1;
-        group->setGroupIdForChildren();
-      }
-      return g;
-    }
+    sharedGroup->setTableName(this->titlePeakTable->text().toStdString());
+
+    // groups are numbered in the order they were added
+    sharedGroup->groupId = _topLevelGroups.size();
+    sharedGroup->setGroupIdForChildren();
+    _model->appendGroup(sharedGroup);
+    return sharedGroup;
   }
 
   return NULL;
@@ -525,20 +303,19 @@ QList<shared_ptr<PeakGroup>> TableDockWidget::getGroups()
 
 void TableDockWidget::deleteAll()
 {
-  if (treeWidget->currentItem()) {
+  if (treeView->currentIndex().isValid()) {
       _mainwindow->getEicWidget()->unSetPeakTableGroup(
-          treeWidget->currentItem()->data(0, Qt::UserRole)
-              .value<shared_ptr<PeakGroup>>());
+          _model->group(treeView->currentIndex()));
   }
 
-  disconnect(treeWidget,
-             &QTreeWidget::itemSelectionChanged,
+  disconnect(treeView->selectionModel(),
+             &QItemSelectionModel::selectionChanged,
              this,
              &TableDockWidget::showSelectedGroup);
-  treeWidget->clear();
   _topLevelGroups.clear();
-  connect(treeWidget,
-          &QTreeWidget::itemSelectionChanged,
+  _model->setGroups(_topLevelGroups);
+  connect(treeView->selectionModel(),
+          &QItemSelectionModel::selectionChanged,
           this,
           &TableDockWidget::showSelectedGroup);
 
@@ -554,87 +331,50 @@ void TableDockWidget::deleteAll()
 }
 
 void TableDockWidget::showAllGroups() {
-  treeWidget->clear();
-
   setFocus();
   if (topLevelGroupCount() == 0) {
+    _model->setGroups(_topLevelGroups);
     if (viewType == groupView)
       setIntensityColName();
     setVisible(false);
     return;
   }
 
-  treeWidget->setSortingEnabled(false);
+  treeView->setSortingEnabled(false);
 
   setupPeakTable();
   if (viewType == groupView)
     setIntensityColName();
 
-  QMap<int, QTreeWidgetItem *> parents;
-  for (auto group : _topLevelGroups) {
-    int clusterId = group->clusterId;
-    if (clusterId && group->meanMz > 0 && group->peakCount() > 0) {
-      if (!parents.contains(clusterId)) {
-        parents[clusterId] = new QTreeWidgetItem(treeWidget);
-        parents[clusterId]->setText(0, QString("Cluster ") +
-                                           QString::number(clusterId));
-        parents[clusterId]->setText(
-            5, QString::number(group->meanRt, 'f', 2));
-        parents[clusterId]->setExpanded(true);
-      }
-      QTreeWidgetItem *parent = parents[clusterId];
-      addRow(group, parent);
-    } else {
-      addRow(group, NULL);
-    }
+  _model->setQuantType(_mainwindow->getUserQuantType());
+  _model->setMinQuality(_mainwindow->mavenParameters->minQuality);
+  for (auto group : _topLevelGroups)
+    _classifyGroup(group.get());
+  _model->setGroups(_topLevelGroups);
+
+  // clusters are shown expanded
+  for (int row = 0; row < _model->rowCount(); ++row) {
+    QModelIndex index = _model->index(row, 0);
+    if (_model->group(index) == nullptr)
+      treeView->expand(index);
   }
 
-  QScrollBar *vScroll = treeWidget->verticalScrollBar();
+  QScrollBar *vScroll = treeView->verticalScrollBar();
   if (vScroll) {
     vScroll->setSliderPosition(vScroll->maximum());
   }
-  treeWidget->setSortingEnabled(true);
+  treeView->setSortingEnabled(true);
   updateStatus();
   updateCompoundWidget();
   //@Kailash: Check and validate all groups automatically
-  QTreeWidgetItemIterator itr(treeWidget);
-  while(*itr) {
-      QTreeWidgetItem* item = (*itr);
-      QVariant v = item->data(0,Qt::UserRole);
-      shared_ptr<PeakGroup> grp = v.value<shared_ptr<PeakGroup>>();
-      validateGroup(grp.get(), item);
-      itr++;
+  for (auto group : _topLevelGroups) {
+      validateGroup(group.get());
+      for (auto child : group->children)
+          validateGroup(child.get());
   }
 
-  treeWidget->header()->setSectionResizeMode(1,QHeaderView::Interactive);
-  treeWidget->setColumnWidth(1, 250);
-}
-
-float TableDockWidget::extractMaxIntensity(PeakGroup *group) {
-  float temp;
-  PeakGroup::QType qtype = _mainwindow->getUserQuantType();
-  switch (qtype) {
-  case PeakGroup::AreaTop:
-    temp = group->maxAreaTopIntensity;
-    break;
-  case PeakGroup::Area:
-    temp = group->maxAreaIntensity;
-    break;
-  case PeakGroup::Height:
-    temp = group->maxHeightIntensity;
-    break;
-  case PeakGroup::AreaNotCorrected:
-    temp = group->maxAreaNotCorrectedIntensity;
-    break;
-  case PeakGroup::AreaTopNotCorrected:
-    temp = group->maxAreaTopNotCorrectedIntensity;
-    break;
-  default:
-    temp = group->currentIntensity;
-    break;
-  }
-  group->currentIntensity = temp;
-  return temp;
+  treeView->header()->setSectionResizeMode(1,QHeaderView::Interactive);
+  treeView->setColumnWidth(1, 250);
 }
 
 void TableDockWidget::exportGroupsToSpreadsheet() {
@@ -743,10 +483,12 @@ void TableDockWidget::exportGroupsToSpreadsheet() {
   QList<shared_ptr<PeakGroup>> selectedGroups = getSelectedGroups();
   csvreports.setSelectionFlag(static_cast<int>(peakTableSelection));
 
+  vector<PeakGroup*> groupsToWrite;
   for (auto group : _topLevelGroups) {
     if (selectedGroups.contains(group))
-      csvreports.addGroup(group.get());
+      groupsToWrite.push_back(group.get());
   }
+  csvreports.addGroups(groupsToWrite);
  
   if (csvreports.getErrorReport() != "") {
     QMessageBox msgBox(_mainwindow);
@@ -839,13 +581,15 @@ void TableDockWidget::prepareDataForPolly(QString writableTempDir,
     QList<shared_ptr<PeakGroup>> selectedGroups = getSelectedGroups();
     csvreports.setSelectionFlag(static_cast<int>(peakTableSelection));
 
+    vector<PeakGroup*> groupsToWrite;
     for (auto group : _topLevelGroups) {
         // we do not set untargeted groups to Polly yet, remove this when we
         // can.
         if (selectedGroups.contains(group) && group->hasCompoundLink()) {
-            csvreports.addGroup(group.get());
+            groupsToWrite.push_back(group.get());
         }
     }
+    csvreports.addGroups(groupsToWrite);
 
     if (csvreports.getErrorReport() != "") {
         QMessageBox msgBox(_mainwindow);
@@ -1020,44 +764,67 @@ bool TableDockWidget::selectPeakGroup(shared_ptr<PeakGroup> group)
   if (group == nullptr)
     return false;
 
-  QTreeWidgetItemIterator it(treeWidget);
-  while (*it) {
-    QTreeWidgetItem *item = (*it);
-    QVariant v = item->data(0, Qt::UserRole);
-    shared_ptr<PeakGroup> currentGroup = v.value<shared_ptr<PeakGroup>>();
-    if (currentGroup == group) {
-        treeWidget->setCurrentItem(item);
-      return true;
-    }
-  }
-  return false;
+  QModelIndex index = _model->indexOf(group.get());
+  if (!index.isValid())
+    return false;
+
+  treeView->setCurrentIndex(index);
+  return true;
 }
 
 void TableDockWidget::showSelectedGroup() {
 
-  QTreeWidgetItem *item = treeWidget->currentItem();
-  if (!item)
+  QModelIndex index = treeView->currentIndex();
+  if (!index.isValid())
     return;
 
-  QVariant v = item->data(0, Qt::UserRole);
-  shared_ptr<PeakGroup> group = v.value<shared_ptr<PeakGroup>>();
+  shared_ptr<PeakGroup> group = _model->group(index);
   _mainwindow->groupRtWidget->plotGraph(group.get());
 
   if (group != nullptr && _mainwindow != nullptr) {
     _mainwindow->setPeakGroup(group);
+
+    // rows are often stepped through one at a time
+    _mainwindow->prefetchPeakGroups(_neighbourGroups(index, 3));
   }
 }
 
+QList<shared_ptr<PeakGroup>> TableDockWidget::_neighbourGroups(QModelIndex index,
+                                                               int count)
+{
+  QList<shared_ptr<PeakGroup>> below;
+  for (QModelIndex i = treeView->indexBelow(index);
+       i.isValid() && below.size() < count;
+       i = treeView->indexBelow(i)) {
+    if (auto group = _model->group(i))
+      below.append(group);
+  }
+
+  QList<shared_ptr<PeakGroup>> above;
+  for (QModelIndex i = treeView->indexAbove(index);
+       i.isValid() && above.size() < count;
+       i = treeView->indexAbove(i)) {
+    if (auto group = _model->group(i))
+      above.append(group);
+  }
+
+  QList<shared_ptr<PeakGroup>> neighbours;
+  for (int i = 0; i < count; ++i) {
+    if (i < below.size())
+      neighbours.append(below[i]);
+    if (i < above.size())
+      neighbours.append(above[i]);
+  }
+  return neighbours;
+}
+
 QList<shared_ptr<PeakGroup>> TableDockWidget::getSelectedGroups()
 {
   QList<shared_ptr<PeakGroup>> selectedGroups;
-  Q_FOREACH (QTreeWidgetItem *item, treeWidget->selectedItems()) {
-    if (item) {
-      QVariant v = item->data(0, Qt::UserRole);
-      shared_ptr<PeakGroup> group = v.value<shared_ptr<PeakGroup>>();
-      if (group != nullptr) {
-        selectedGroups.append(group);
-      }
+  Q_FOREACH (QModelIndex index, treeView->selectionModel()->selectedRows()) {
+    shared_ptr<PeakGroup> group = _model->group(index);
+    if (group != nullptr) {
+      selectedGroups.append(group);
     }
   }
   return selectedGroups;
@@ -1070,39 +837,28 @@ void TableDockWidget::showNotification()
 
 shared_ptr<PeakGroup> TableDockWidget::getSelectedGroup()
 {
-  QTreeWidgetItem *item = treeWidget->currentItem();
-  if (!item)
-    return NULL;
-  QVariant v = item->data(0, Qt::UserRole);
-  shared_ptr<PeakGroup> group = v.value<shared_ptr<PeakGroup>>();
-  if (group != nullptr) {
-    return group;
-  } else
-    return shared_ptr<PeakGroup>(nullptr);
+  return _model->group(treeView->currentIndex());
 }
 
 void TableDockWidget::setGroupLabel(char label)
 {
-  Q_FOREACH (QTreeWidgetItem *item, treeWidget->selectedItems()) {
-    if (item) {
-      QVariant v = item->data(0, Qt::UserRole);
-      shared_ptr<PeakGroup> group = v.value<shared_ptr<PeakGroup>>();
-      if (group != nullptr) {
-        if (group->label != 'g' && group->label != 'b') {
-          numberOfGroupsMarked+=1;
-          subsetPeakGroups.push_back(*(group.get()));
-        }
-        group->setLabel(label);
-        if (numberOfGroupsMarked ==10){
-          numberOfGroupsMarked = 0;
-          Q_EMIT(UploadPeakBatch());
-          subsetPeakGroups.clear();
-          uploadCount+=1;
-        }
+  Q_FOREACH (QModelIndex index, treeView->selectionModel()->selectedRows()) {
+    shared_ptr<PeakGroup> group = _model->group(index);
+    if (group != nullptr) {
+      if (group->label != 'g' && group->label != 'b') {
+        numberOfGroupsMarked+=1;
+        subsetPeakGroups.push_back(*(group.get()));
       }
-      updateItem(item);
-      if (item->parent() != nullptr)
-        updateItem(item->parent(), false);
+      group->setLabel(label);
+      if (numberOfGroupsMarked ==10){
+        numberOfGroupsMarked = 0;
+        Q_EMIT(UploadPeakBatch());
+        subsetPeakGroups.clear();
+        uploadCount+=1;
+      }
+      updateGroup(group.get());
+      if (group->parent != nullptr)
+        updateGroup(group->parent, false);
     }
   }
   updateStatus();
@@ -1122,33 +878,15 @@ void TableDockWidget::deleteGroup(PeakGroup *groupX) {
   if (pos == -1)
     return;
 
-  QTreeWidgetItemIterator it(treeWidget);
-  while (*it) {
-    QTreeWidgetItem *item = (*it);
-    if (item->isHidden()) {
-      ++it;
-      continue;
-    }
-    QVariant v = item->data(0, Qt::UserRole);
-    shared_ptr<PeakGroup> group = v.value<shared_ptr<PeakGroup>>();
-    if (group != nullptr and group.get() == groupX) {
-      item->setHidden(true);
-
-      if (!group->children.empty())
-        _labeledGroups--;
-      if (group->hasCompoundLink())
-        _targetedGroups--;
-
-      // Deleting
-      int posTree = treeWidget->indexOfTopLevelItem(item);
-      if (posTree != -1)
-        treeWidget->takeTopLevelItem(posTree);
-
-      _topLevelGroups.erase(_topLevelGroups.begin() + pos);
-      break;
-    }
-    ++it;
-  }
+  shared_ptr<PeakGroup> group = _topLevelGroups[pos];
+  if (!group->children.empty())
+    _labeledGroups--;
+  if (group->hasCompoundLink())
+    _targetedGroups--;
+
+  // Deleting
+  _model->removeGroup(groupX);
+  _topLevelGroups.erase(_topLevelGroups.begin() + pos);
 
   for (int i = 0; i < _topLevelGroups.size(); ++i) {
     auto group = _topLevelGroups[i];
@@ -1162,87 +900,48 @@ void TableDockWidget::deleteGroup(PeakGroup *groupX) {
 void TableDockWidget::deleteSelectedItems()
 {
     // temporarily disconnect selection trigger
-    disconnect(treeWidget,
-               SIGNAL(itemSelectionChanged()),
+    disconnect(treeView->selectionModel(),
+               &QItemSelectionModel::selectionChanged,
                this,
-               SLOT(showSelectedGroup()));
-
-    // extract selected items such that all parent items occur first
-    QList<QTreeWidgetItem*> selectedItems;
-    QTreeWidgetItem* nextItem = nullptr;
-    for (auto item : treeWidget->selectedItems()) {
-        if (item->parent() == nullptr) {
-            selectedItems.prepend(item);
-            nextItem = treeWidget->itemBelow(item);
-            while(nextItem && nextItem->parent() != nullptr) {
-                nextItem = treeWidget->itemBelow(nextItem);
+               &TableDockWidget::showSelectedGroup);
+
+    // extract selected groups such that all top-level groups occur first
+    QList<shared_ptr<PeakGroup>> selectedGroups;
+    QModelIndex nextIndex;
+    for (auto index : treeView->selectionModel()->selectedRows()) {
+        shared_ptr<PeakGroup> group = _model->group(index);
+        if (!index.parent().isValid()) {
+            if (group != nullptr)
+                selectedGroups.prepend(group);
+            nextIndex = treeView->indexBelow(index);
+            while (nextIndex.isValid() && nextIndex.parent().isValid()) {
+                nextIndex = treeView->indexBelow(nextIndex);
             }
         } else {
-            selectedItems.append(item);
-            nextItem = treeWidget->itemBelow(item);
+            if (group != nullptr)
+                selectedGroups.append(group);
+            nextIndex = treeView->indexBelow(index);
         }
     }
-    if (selectedItems.isEmpty())
-        return;
 
-    set<QTreeWidgetItem*> itemsToDelete;
+    set<PeakGroup*> parentsToDelete;
     set<shared_ptr<PeakGroup>> groupsToDelete;
-
-    for (auto item : selectedItems)
+    for (auto group : selectedGroups)
     {
-        if (item == nullptr)
-            continue;
-
-        auto v = item->data(0, Qt::UserRole);
-        auto group = v.value<shared_ptr<PeakGroup>>();
-        if (group == nullptr)
-            continue;
-
         auto parentGroup = group->parent;
         if (parentGroup == nullptr){
             if (!group->children.empty())
                 _labeledGroups--;
             if (group->hasCompoundLink())
                 _targetedGroups--;
-            itemsToDelete.insert(item);
+            parentsToDelete.insert(group.get());
             groupsToDelete.insert(group);
         } else if (parentGroup && parentGroup->childCount() > 0) {
-            auto parentItem = item->parent();
-            if (parentItem == nullptr)
-                continue;
-            if (itemsToDelete.count(parentItem) > 0
-                || itemsToDelete.count(item) > 0) {
-                continue;
-            }
-
-            if (!parentGroup->deleteChild(group.get()))
+            // children go along with their parent, if it is deleted
+            if (parentsToDelete.count(parentGroup) > 0)
                 continue;
 
-            itemsToDelete.insert(item);
-
-            // once a child is deleted, the pointers storing the
-            // location of memory blocks of child `PeakGroup`
-            // objects, may no longer be valid, therefore we
-            // update them.
-            for (int i = 0; i < parentItem->childCount(); ++i) {
-                QTreeWidgetItem* child = parentItem->child(i);
-                if (!child)
-                    continue;
-
-                auto name = child->text(1).toStdString();
-                auto childGroupIter =
-                    find_if(begin(parentGroup->children),
-                            end(parentGroup->children),
-                            [&](shared_ptr<PeakGroup> g) {
-                                return g->getName() == name;
-                            });
-                if (childGroupIter != end(parentGroup->children)) {
-                    auto& childGroup = *childGroupIter;
-                    child->setData(0,
-                                   Qt::UserRole,
-                                   QVariant::fromValue(childGroup));
-                }
-            }
+            parentGroup->deleteChild(group.get());
         }
     }
 
@@ -1255,34 +954,18 @@ void TableDockWidget::deleteSelectedItems()
                               end(_topLevelGroups));
     }
 
-    // reconnect selection trigger
-    connect(treeWidget,
-            SIGNAL(itemSelectionChanged()),
-            this,
-            SLOT(showSelectedGroup()));
+    shared_ptr<PeakGroup> nextGroup = _model->group(nextIndex);
+    if (!selectedGroups.isEmpty())
+        showAllGroups();
 
-    if(nextItem){
-        treeWidget->setCurrentItem(nextItem);
-    }
-
-    /* Disconnecting selection trigger as while deleting item from
-     * tree widget selection changes and might give some null pointer
-     * for setting group which causes segment fault */
-    disconnect(treeWidget,
-               SIGNAL(itemSelectionChanged()),
-               this,
-               SLOT(showSelectedGroup()));
-    Q_FOREACH (QTreeWidgetItem* item, itemsToDelete) {
-        if(item)
-            delete(item);
-    }
-    connect(treeWidget,
-            SIGNAL(itemSelectionChanged()),
+    // reconnect selection trigger
+    connect(treeView->selectionModel(),
+            &QItemSelectionModel::selectionChanged,
             this,
-            SLOT(showSelectedGroup()));
+            &TableDockWidget::showSelectedGroup);
 
-    auto groupSelected = getSelectedGroup();
-    showAllGroups();
+    if (selectedGroups.isEmpty())
+        return;
 
     if (_topLevelGroups.empty()) {
         _mainwindow->getEicWidget()->replot(nullptr);
@@ -1291,19 +974,7 @@ void TableDockWidget::deleteSelectedItems()
         return;
     }
 
-    QTreeWidgetItemIterator it(treeWidget);
-    while (*it) {
-        QTreeWidgetItem *item = (*it);
-        QVariant v = item->data(0, Qt::UserRole);
-        shared_ptr<PeakGroup> currentGroup = v.value<shared_ptr<PeakGroup>>();
-        if (currentGroup == groupSelected) {
-            treeWidget->setCurrentItem(item);
-            break;
-        }
-        it++;
-    }
-
-    return;
+    selectPeakGroup(nextGroup);
 }
 
 void TableDockWidget::setClipboard() {
@@ -1354,114 +1025,114 @@ void TableDockWidget::markGroupIgnored() {
 }
 
 void TableDockWidget::showLastGroup() {
-  QTreeWidgetItem *item = treeWidget->currentItem();
-  if (item != NULL) {
-    treeWidget->setCurrentItem(treeWidget->itemAbove(item));
+  QModelIndex index = treeView->currentIndex();
+  if (index.isValid()) {
+    treeView->setCurrentIndex(treeView->indexAbove(index));
   }
 }
 
 void TableDockWidget::showNextGroup() {
 
-  QTreeWidgetItem *item = treeWidget->currentItem();
-  if (item == NULL)
+  QModelIndex index = treeView->currentIndex();
+  if (!index.isValid())
     return;
 
   // get next item
-  QTreeWidgetItem *nextitem = treeWidget->itemBelow(item);
-  if (nextitem != NULL)
-    treeWidget->setCurrentItem(nextitem);
+  QModelIndex nextIndex = treeView->indexBelow(index);
+  if (nextIndex.isValid())
+    treeView->setCurrentIndex(nextIndex);
 }
 
 void TableDockWidget::keyPressEvent(QKeyEvent *e) {
 
-  QTreeWidgetItem *item = treeWidget->currentItem();
+  QModelIndex index = treeView->currentIndex();
   if (e->key() == Qt::Key_Delete) {
-    QList<QTreeWidgetItem *> items = treeWidget->selectedItems();
-    if (items.size() > 0) {
-      cerr << items.size() << endl;
+    QModelIndexList rows = treeView->selectionModel()->selectedRows();
+    if (rows.size() > 0) {
+      cerr << rows.size() << endl;
       deleteSelectedItems();
     }
   } else if (e->key() == Qt::Key_G) {
 
-    if (item) {
+    if (index.isValid()) {
       markGroupGood();
     }
   } else if (e->key() == Qt::Key_B) {
 
-    if (item) {
+    if (index.isValid()) {
       markGroupBad();
     }
   } else if (e->key() == Qt::Key_U) {
-    if (item) {
+    if (index.isValid()) {
       unmarkGroup();
     }
   } else if (e->key() == Qt::Key_Left) {
 
-    if (treeWidget->currentItem()) {
-      if (treeWidget->currentItem()->parent()) {
-        treeWidget->collapseItem(treeWidget->currentItem()->parent());
-        treeWidget->setCurrentItem(treeWidget->currentItem()->parent());
+    if (index.isValid()) {
+      if (index.parent().isValid()) {
+        treeView->collapse(index.parent());
+        treeView->setCurrentIndex(index.parent());
       } else {
-        treeWidget->collapseItem(treeWidget->currentItem());
+        treeView->collapse(index);
       }
     }
   } else if (e->key() == Qt::Key_Right) {
 
-    if (treeWidget->currentItem()) {
-      if (!treeWidget->currentItem()->isExpanded()) {
-        treeWidget->expandItem(treeWidget->currentItem());
+    if (index.isValid()) {
+      if (!treeView->isExpanded(index)) {
+        treeView->expand(index);
       }
     }
   } else if (e->key() == Qt::Key_O) {
-    if (treeWidget->currentItem()) {
-      if (treeWidget->currentItem()->isExpanded()) {
-        if (treeWidget->currentItem()->parent()) {
-          treeWidget->collapseItem(treeWidget->currentItem()->parent());
-          treeWidget->setCurrentItem(treeWidget->currentItem()->parent());
+    if (index.isValid()) {
+      if (treeView->isExpanded(index)) {
+        if (index.parent().isValid()) {
+          treeView->collapse(index.parent());
+          treeView->setCurrentIndex(index.parent());
         } else {
-          treeWidget->collapseItem(treeWidget->currentItem());
+          treeView->collapse(index);
         }
       } else {
-        treeWidget->expandItem(treeWidget->currentItem());
+        treeView->expand(index);
       }
     }
   } else if (e->key() == Qt::Key_Down && e->modifiers() == Qt::ShiftModifier) {
-    if (treeWidget->itemBelow(item)) {
+    if (treeView->indexBelow(index).isValid()) {
       if (tableSelectionFlagDown) {
-        treeWidget->selectionModel()->setCurrentIndex(
-            treeWidget->currentIndex(),
+        treeView->selectionModel()->setCurrentIndex(
+            treeView->currentIndex(),
             QItemSelectionModel::Toggle | QItemSelectionModel::Rows);
         tableSelectionFlagDown = false;
       } else {
-        treeWidget->selectionModel()->setCurrentIndex(
-            treeWidget->indexBelow(treeWidget->currentIndex()),
+        treeView->selectionModel()->setCurrentIndex(
+            treeView->indexBelow(treeView->currentIndex()),
             QItemSelectionModel::Toggle | QItemSelectionModel::Rows);
       }
       tableSelectionFlagUp = true;
     }
   } else if (e->key() == Qt::Key_Up && e->modifiers() == Qt::ShiftModifier) {
-    if (treeWidget->itemAbove(item)) {
+    if (treeView->indexAbove(index).isValid()) {
       if (tableSelectionFlagUp) {
-        treeWidget->selectionModel()->setCurrentIndex(
-            treeWidget->currentIndex(),
+        treeView->selectionModel()->setCurrentIndex(
+            treeView->currentIndex(),
             QItemSelectionModel::Toggle | QItemSelectionModel::Rows);
         tableSelectionFlagUp = false;
       } else {
-        treeWidget->selectionModel()->setCurrentIndex(
-            treeWidget->indexAbove(treeWidget->currentIndex()),
+        treeView->selectionModel()->setCurrentIndex(
+            treeView->indexAbove(treeView->currentIndex()),
             QItemSelectionModel::Toggle | QItemSelectionModel::Rows);
       }
       tableSelectionFlagDown = true;
     }
   } else if (e->key() == Qt::Key_Down) {
 
-    if (treeWidget->itemBelow(item)) {
-      treeWidget->setCurrentItem(treeWidget->itemBelow(item));
+    if (treeView->indexBelow(index).isValid()) {
+      treeView->setCurrentIndex(treeView->indexBelow(index));
     }
   } else if (e->key() == Qt::Key_Up) {
 
-    if (treeWidget->itemAbove(item)) {
-      treeWidget->setCurrentItem(treeWidget->itemAbove(item));
+    if (treeView->indexAbove(index).isValid()) {
+      treeView->setCurrentIndex(treeView->indexAbove(index));
     }
   } else if (e->key() == Qt::Key_E) {
       editSelectedPeakGroup();
@@ -1597,7 +1268,7 @@ void TableDockWidget::showHeatMap() {
 
 void TableDockWidget::editSelectedPeakGroup()
 {
-  if (treeWidget->selectedItems().size() != 1)
+  if (treeView->selectionModel()->selectedRows().size() != 1)
       return;
 
   shared_ptr<PeakGroup> group = getSelectedGroup();
@@ -1608,33 +1279,27 @@ void TableDockWidget::editSelectedPeakGroup()
   editor->setPeakGroup(group);
   editor->exec();
 
-  auto currentItem = treeWidget->currentItem();
-  if (currentItem->parent() != nullptr) {
-    updateItem(currentItem->parent(), true);
+  shared_ptr<PeakGroup> parentGroup =
+      _model->group(treeView->currentIndex().parent());
+  if (parentGroup != nullptr) {
+    updateGroup(parentGroup.get(), true);
   } else {
-    updateItem(currentItem, true);
+    updateGroup(group.get(), true);
   }
 
   auto groupToSave = group;
   if (group->isIsotope() && group->parent != nullptr) {
-      QTreeWidgetItemIterator it(treeWidget);
-      while (*it) {
-          QTreeWidgetItem* item = (*it);
-          QVariant v = item->data(0, Qt::UserRole);
-          shared_ptr<PeakGroup> currentGroup = v.value<shared_ptr<PeakGroup>>();
-          if (currentGroup.get() == group->parent) {
-              groupToSave = currentGroup;
-              break;
-          }
-          it++;
-      }
+      shared_ptr<PeakGroup> currentGroup =
+          _model->group(_model->indexOf(group->parent));
+      if (currentGroup != nullptr)
+          groupToSave = currentGroup;
   }
   _mainwindow->autoSaveSignal({groupToSave});
 }
 
 void TableDockWidget::showIntegrationSettings()
 {
-  if (treeWidget->selectedItems().size() != 1)
+  if (treeView->selectionModel()->selectedRows().size() != 1)
       return;
 
   shared_ptr<PeakGroup> group = getSelectedGroup();
@@ -1643,7 +1308,7 @@ void TableDockWidget::showIntegrationSettings()
 }
 
 void TableDockWidget::contextMenuEvent(QContextMenuEvent *event) {
-  if (treeWidget->topLevelItemCount() < 1)
+  if (_model->rowCount() < 1)
       return;
 
   QMenu menu;
@@ -1668,11 +1333,12 @@ void TableDockWidget::contextMenuEvent(QContextMenuEvent *event) {
   QAction *z4 = menu.addAction("Delete All Groups");
   connect(z4, SIGNAL(triggered()), SLOT(deleteAll()));
 
-  if (treeWidget->selectedItems().empty()) {
+  QModelIndexList selectedRows = treeView->selectionModel()->selectedRows();
+  if (selectedRows.empty()) {
     // disable actions not relevant when nothing is selected
     z0->setEnabled(false);
   }
-  if (treeWidget->selectedItems().size() != 1) {
+  if (selectedRows.size() != 1) {
     // disable actions not relevant to individual peak-groups
     z1->setEnabled(false);
     z2->setEnabled(false);
@@ -1752,98 +1418,70 @@ void TableDockWidget::clearClusters()
   showAllGroups();
 }
 
-void TableDockWidget::clusterGroups()
+void TableDockWidget::clusterGroups(bool inBackground)
 {
+  // a blocking call has to wait for the clusters of a running task instead
+  if (_clusteringFuture.isRunning()) {
+    if (!inBackground)
+      _applyClusters();
+    return;
+  }
+
   sort(_topLevelGroups.begin(),
        _topLevelGroups.end(),
        [](shared_ptr<PeakGroup> a, shared_ptr<PeakGroup> b) {
            return a->meanRt < b->meanRt;
        });
   qDebug() << "Clustering…";
-  int clusterId = 0;
-
-  double maxRtDiff = clusterDialog->maxRtDiff_2->value();
-  double minSampleCorrelation = clusterDialog->minSampleCorr->value();
-  double minRtCorrelation = clusterDialog->minRt->value();
-  MassCutoff *massCutoff = _mainwindow->getUserMassCutoff();
-
-  vector<mzSample *> samples = _mainwindow->getSamples();
 
-  // clear cluster information
-  for (auto group : _topLevelGroups)
-    group->clusterId = 0;
-
-  map<int, shared_ptr<PeakGroup>> parentGroups;
-  for (int i = 0; i < _topLevelGroups.size(); ++i) {
-    auto group1 = _topLevelGroups[i];
-    if (group1->clusterId == 0) {
-      // create new cluster
-      group1->clusterId = ++clusterId;
-      parentGroups[clusterId] = group1;
-    }
-
-    // cluster parent
-    shared_ptr<PeakGroup> parent = parentGroups[clusterId];
-
-    mzSample *largestSample = NULL;
-    double maxIntensity = 0;
-
-    for (int i = 0; i < group1->peakCount(); i++) {
-      mzSample *sample = group1->peaks[i].getSample();
-      if (group1->peaks[i].peakIntensity > maxIntensity)
-        largestSample = sample;
-    }
-
-    if (largestSample == NULL)
-      continue;
-    vector<float> peakIntensityA =
-        group1->getOrderedIntensityVector(samples, PeakGroup::AreaTop);
-
-    for (auto group2 : _topLevelGroups) {
-      if (group2->clusterId > 0)
-        continue;
-
-      // retention time distance
-        float rtdist = abs(parent->meanRt - group2->meanRt);
-      if (rtdist > maxRtDiff * 2)
-        continue;
-
-      // retention time overlap
-      float rtoverlap = mzUtils::checkOverlap(group1->minRt, group1->maxRt,
-                                              group2->minRt, group2->maxRt);
-      if (rtoverlap < 0.1)
-        continue;
-
-      // peak intensity correlation
-      vector<float> peakIntensityB =
-          group2->getOrderedIntensityVector(samples, PeakGroup::AreaTop);
-      float cor = correlation(peakIntensityA, peakIntensityB);
-      if (cor < minSampleCorrelation)
-        continue;
-
-      // peak shape correlation
-      float cor2 = largestSample->correlation(group1->meanMz,
-                                              group2->meanMz,
-                                              massCutoff,
-                                              group1->minRt,
-                                              group1->maxRt,
-                                              _mainwindow->mavenParameters->eicType,
-                                              _mainwindow->mavenParameters->filterline);
-      if (cor2 < minRtCorrelation)
-        continue;
-
-      // passed all the filters, group1 and group2 into a single metagroup
-      group2->clusterId = group1->clusterId;
-    }
-    if (i % 10 == 0)
-      _mainwindow->setProgressBar("Clustering…",
-                                  i + 1,
-                                  _topLevelGroups.size());
+  auto clustering = make_shared<GroupClustering>(
+      _mainwindow->getSamples(),
+      _mainwindow->getUserMassCutoff(),
+      _mainwindow->mavenParameters->eicType,
+      _mainwindow->mavenParameters->filterline);
+  clustering->setMaxRtDifference(clusterDialog->maxRtDiff_2->value());
+  clustering->setMinSampleCorrelation(clusterDialog->minSampleCorr->value());
+  clustering->setMinRtCorrelation(clusterDialog->minRt->value());
+  clustering->boostSignal.connect(
+      [this](const string& message, unsigned int progress, int total) {
+          emit updateProgressBar(QString::fromStdString(message),
+                                 progress,
+                                 total);
+      });
+
+  // groups are held until their clusters are assigned, so that they outlive
+  // any deletion from the table while clustering is still in progress; the
+  // task only computes IDs, which are assigned on this thread
+  _clusteredGroups = _topLevelGroups;
+  _computedClusterIds.clear();
+  QList<shared_ptr<PeakGroup>> groups = _clusteredGroups;
+  auto task = [this, clustering, groups] {
+      vector<PeakGroup*> groupsToCluster;
+      for (auto group : groups)
+          groupsToCluster.push_back(group.get());
+      _computedClusterIds = clustering->clusterIds(groupsToCluster);
+      emit clusteringFinished();
+  };
+
+  if (inBackground) {
+    _clusteringFuture = QtConcurrent::run(task);
+  } else {
+    task();
   }
+}
 
-  _mainwindow->setProgressBar("Clustering done!",
-                              _topLevelGroups.size(),
-                              _topLevelGroups.size());
+void TableDockWidget::_applyClusters()
+{
+  // the task emits just before returning, and its IDs are only read once it
+  // has finished
+  _clusteringFuture.waitForFinished();
+  if (_clusteredGroups.isEmpty())
+    return;
+
+  for (int i = 0; i < _clusteredGroups.size(); ++i)
+    _clusteredGroups[i]->clusterId = _computedClusterIds[i];
+  _clusteredGroups.clear();
+  _computedClusterIds.clear();
   showAllGroups();
 }
 
@@ -1888,34 +1526,19 @@ void TableDockWidget::showFiltersDialog() {
     slider->recalculatePlotBounds();
 }
 
-void TableDockWidget::filterPeakTable() { updateTable(); }
+void TableDockWidget::filterPeakTable() {
+  if (filtersDialog->isVisible()) {
+    float minG = sliders["GoodPeakCount"]->minBoundValue();
+    float maxG = sliders["GoodPeakCount"]->maxBoundValue();
+    _model->setFilter([minG, maxG](PeakGroup *group) {
+      return group->goodPeakCount >= minG && group->goodPeakCount <= maxG;
+    });
+  }
+  updateTable();
+}
 
 void TableDockWidget::showFocusedGroups() {
-  int N = treeWidget->topLevelItemCount();
-  for (int i = 0; i < N; i++) {
-    QTreeWidgetItem *item = treeWidget->topLevelItem(i);
-    QVariant v = item->data(0, Qt::UserRole);
-    shared_ptr<PeakGroup> group = v.value<shared_ptr<PeakGroup>>();
-    if (group != nullptr && group->isFocused)
-      item->setHidden(false);
-    else
-      item->setHidden(true);
-
-    if (item->text(0).startsWith("Cluster")) {
-      bool showParentFlag = false;
-      for (int j = 0; j < item->childCount(); j++) {
-        QVariant v = (item->child(j))->data(0, Qt::UserRole);
-        shared_ptr<PeakGroup> group = v.value<shared_ptr<PeakGroup>>();
-        if (group != nullptr && group->isFocused) {
-          item->setHidden(false);
-          showParentFlag = true;
-        } else
-          item->setHidden(true);
-      }
-      if (showParentFlag)
-        item->setHidden(false);
-    }
-  }
+  _model->setFilter([](PeakGroup *group) { return group->isFocused; });
 }
 
 void TableDockWidget::clearFocusedGroups() {
@@ -2066,7 +1689,7 @@ QWidget *TableToolBarWidgetAction::createWidget(QWidget *parent) {
     connect(exportSelected, SIGNAL(triggered()), td, SLOT(showNotification()));
 
     connect(exportAll, SIGNAL(triggered()), td, SLOT(wholePeakSet()));
-    connect(exportAll, SIGNAL(triggered()), td->treeWidget, SLOT(selectAll()));
+    connect(exportAll, SIGNAL(triggered()), td->treeView, SLOT(selectAll()));
     connect(exportAll,
             SIGNAL(triggered()),
             td,
@@ -2074,7 +1697,7 @@ QWidget *TableToolBarWidgetAction::createWidget(QWidget *parent) {
     connect(exportAll, SIGNAL(triggered()), td, SLOT(showNotification()));
 
     connect(exportGood, SIGNAL(triggered()), td, SLOT(goodPeakSet()));
-    connect(exportGood, SIGNAL(triggered()), td->treeWidget, SLOT(selectAll()));
+    connect(exportGood, SIGNAL(triggered()), td->treeView, SLOT(selectAll()));
     connect(exportGood,
             SIGNAL(triggered()),
             td,
@@ -2082,7 +1705,7 @@ QWidget *TableToolBarWidgetAction::createWidget(QWidget *parent) {
     connect(exportGood, SIGNAL(triggered()), td, SLOT(showNotification()));
 
     connect(excludeBad, SIGNAL(triggered()), td, SLOT(excludeBadPeakSet()));
-    connect(excludeBad, SIGNAL(triggered()), td->treeWidget, SLOT(selectAll()));
+    connect(excludeBad, SIGNAL(triggered()), td->treeView, SLOT(selectAll()));
     connect(excludeBad,
             SIGNAL(triggered()),
             td,
@@ -2090,7 +1713,7 @@ QWidget *TableToolBarWidgetAction::createWidget(QWidget *parent) {
     connect(excludeBad, SIGNAL(triggered()), td, SLOT(showNotification()));
 
     connect(exportBad, SIGNAL(triggered()), td, SLOT(badPeakSet()));
-    connect(exportBad, SIGNAL(triggered()), td->treeWidget, SLOT(selectAll()));
+    connect(exportBad, SIGNAL(triggered()), td->treeView, SLOT(selectAll()));
     connect(exportBad,
             SIGNAL(triggered()),
             td,
@@ -2314,10 +1937,8 @@ void PeakTableDockWidget::deleteAll()
 
 void PeakTableDockWidget::cleanUp()
 {
-  if (treeWidget->currentItem()) {
-    emit unSetFromEicWidget(
-          treeWidget->currentItem()->data(0, Qt::UserRole)
-              .value<shared_ptr<PeakGroup>>());
+  if (treeView->currentIndex().isValid()) {
+    emit unSetFromEicWidget(_model->group(treeView->currentIndex()));
   }
   _mainwindow->ligandWidget->resetColor();
 }
@@ -2590,53 +2211,34 @@ void BookmarkTableDockWidget::deleteGroup(PeakGroup *groupX) {
   if (pos == -1)
     return;
 
-  QTreeWidgetItemIterator it(treeWidget);
-  while (*it) {
-    QTreeWidgetItem *item = (*it);
-    if (item->isHidden()) {
-      ++it;
-      continue;
-    }
-    QVariant v = item->data(0, Qt::UserRole);
-    shared_ptr<PeakGroup> group = v.value<shared_ptr<PeakGroup>>();
-    if (group != nullptr and group.get() == groupX) {
-        item->setHidden(true);
-
-    if (!group->children.empty())
-      _labeledGroups--;
-    if (group->getCompound())
-      _targetedGroups--;
+  shared_ptr<PeakGroup> group = _topLevelGroups[pos];
+  if (!group->children.empty())
+    _labeledGroups--;
+  if (group->getCompound())
+    _targetedGroups--;
 
-      	// Deleting
-        int posTree = treeWidget->indexOfTopLevelItem(item);
-        if (posTree != -1)
-    		treeWidget->takeTopLevelItem(posTree);
+  // Deleting
+  _model->removeGroup(groupX);
 
-        /**
-         * delete name of compound associated with this group stored in
-         * <sameMzRtGroups> with given mz and rt
-        */
-        int intMz = group->meanMz * 1e5;
-        int intRt = group->meanRt * 1e5;
-        QPair<int, int> sameMzRtGroupIndexHash(intMz, intRt);
-        QString compoundName = QString::fromStdString(groupX->getName());
-        if (sameMzRtGroups[sameMzRtGroupIndexHash].contains(compoundName)) {
-        	for (int i = 0; i < sameMzRtGroups[sameMzRtGroupIndexHash].size();
-            	 ++i)
-			{
-            	if (sameMzRtGroups[sameMzRtGroupIndexHash][i] == compoundName) {
-            	sameMzRtGroups[sameMzRtGroupIndexHash].removeAt(i);
-            	break;
-          	}
-        }
+  /**
+   * delete name of compound associated with this group stored in
+   * <sameMzRtGroups> with given mz and rt
+   */
+  int intMz = group->meanMz * 1e5;
+  int intRt = group->meanRt * 1e5;
+  QPair<int, int> sameMzRtGroupIndexHash(intMz, intRt);
+  QString compoundName = QString::fromStdString(groupX->getName());
+  if (sameMzRtGroups[sameMzRtGroupIndexHash].contains(compoundName)) {
+    for (int i = 0; i < sameMzRtGroups[sameMzRtGroupIndexHash].size(); ++i) {
+      if (sameMzRtGroups[sameMzRtGroupIndexHash][i] == compoundName) {
+        sameMzRtGroups[sameMzRtGroupIndexHash].removeAt(i);
+        break;
       }
-
-      _topLevelGroups.erase(_topLevelGroups.begin() + pos);
-      break;
     }
-    ++it;
   }
 
+  _topLevelGroups.erase(_topLevelGroups.begin() + pos);
+
   for (int i = 0; i < _topLevelGroups.size(); ++i) {
     auto group = _topLevelGroups[i];
     group->groupId = i + 1;
@@ -2760,8 +2362,11 @@ void ScatterplotTableDockWidget::setupPeakTable() {
     // add scatterplot table columns
     colNames << "Ratio Change";
     colNames << "P-value";
-  } else if (viewType == peakView) {
-    vector<mzSample *> vsamples = _mainwindow->getVisibleSamples();
+  }
+
+  vector<mzSample *> vsamples;
+  if (viewType == peakView) {
+    vsamples = _mainwindow->getVisibleSamples();
     sort(vsamples.begin(), vsamples.end(), mzSample::compSampleOrder);
     for (unsigned int i = 0; i < vsamples.size(); i++) {
       // Add peak view columns to the table
@@ -2769,15 +2374,14 @@ void ScatterplotTableDockWidget::setupPeakTable() {
     }
   }
 
-  treeWidget->setColumnCount(colNames.size());
-  treeWidget->setHeaderLabels(colNames);
-  treeWidget->header()->setSectionResizeMode(QHeaderView::ResizeToContents);
-  treeWidget->header()->adjustSize();
-  treeWidget->setSortingEnabled(true);
+  _model->setColumns(colNames, vsamples);
+  treeView->header()->setSectionResizeMode(QHeaderView::ResizeToContents);
+  treeView->header()->adjustSize();
+  treeView->setSortingEnabled(true);
 }
 
 //@Kailash: Put decision sequence/tree for automatic validation here
-void TableDockWidget::validateGroup(PeakGroup* grp, QTreeWidgetItem* item)
+void TableDockWidget::validateGroup(PeakGroup* grp)
 {
     int mark=0;
     bool decisionConflict=false;
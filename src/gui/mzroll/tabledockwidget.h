@@ -1,6 +1,7 @@
 #ifndef TABLEDOCKWIDGET_H
 #define TABLEDOCKWIDGET_H
 
+#include <QFuture>
 #include <QWidgetAction>
 
 #include "pollyintegration.h"
@@ -9,13 +10,13 @@
 class MainWindow;
 class ClusterDialog;
 class PeakTableDeletionDialog;
-class NumericTreeWidgetItem;
 class ListView;
 class JSONReports;
 class PeakGroup;
 class EIC;
 class QHistogramSlider;
 class PeakDetector;
+class PeakTableModel;
 
 using namespace std;
 
@@ -25,7 +26,7 @@ class TableDockWidget : public QDockWidget {
 public:
   QWidget *dockWidgetContents;
   QHBoxLayout *horizontalLayout;
-  QTreeWidget *treeWidget;
+  QTreeView *treeView;
   QLabel *titlePeakTable;
   JSONReports *jsonReports;
   int numberOfGroupsMarked = 0;
@@ -84,15 +85,6 @@ public:
    */
   void setIntensityColName();
 
-  /**
-   * @brief Obtain the maximum intensity for a group according to
-   * the quantity type currently selected by the user.
-   * 
-   * @param group Pointer to the PeakGroup.
-   * @return Floating precision value of maximum intensity
-   */
-  float extractMaxIntensity(PeakGroup *group);
-
   /**
    * @brief Get the number of targeted groups in this peak table.
    * @return Targeted group count as integer.
@@ -155,7 +147,6 @@ public:
 public Q_SLOTS:
   void updateCompoundWidget();
   shared_ptr<PeakGroup> addPeakGroup(PeakGroup *group);
-  void sortChildrenAscending(QTreeWidgetItem *item);
   virtual void setupPeakTable();
   shared_ptr<PeakGroup> getSelectedGroup();
   QList<shared_ptr<PeakGroup>> getSelectedGroups();
@@ -217,11 +208,17 @@ public Q_SLOTS:
   void pdfReadyNotification();
 
   void updateTable();
-  void updateItem(QTreeWidgetItem *item, bool updateChildren = true);
+
+  /**
+   * @brief Score a group again and refresh its row in the table.
+   * @param group Pointer to a group in this table.
+   * @param updateChildren If true, children of the group are updated too.
+   */
+  void updateGroup(PeakGroup *group, bool updateChildren = true);
   void updateStatus();
 
   //Group validation functions
-  void validateGroup(PeakGroup* grp, QTreeWidgetItem* item);
+  void validateGroup(PeakGroup* grp);
 
   virtual void markGroupBad();
   virtual void markGroupGood();
@@ -239,7 +236,14 @@ public Q_SLOTS:
 
   void sortBy(int);
   void deleteAll();
-  void clusterGroups();
+  /**
+   * @brief Cluster top-level groups of this table by RT, intensity and peak
+   * shape similarity, using parameters set in the cluster dialog.
+   * @param inBackground If true, clustering happens on a separate thread
+   * and the table is refreshed once it finishes. Otherwise this call blocks
+   * until all groups have been assigned a cluster.
+   */
+  void clusterGroups(bool inBackground = true);
   void showFiltersDialog();
   void filterPeakTable();
 
@@ -282,6 +286,7 @@ public Q_SLOTS:
 
 protected:
   MainWindow *_mainwindow;
+  PeakTableModel *_model;
   tableViewType viewType;
   QList<shared_ptr<PeakGroup>> _topLevelGroups;
   int _labeledGroups;
@@ -301,20 +306,44 @@ Q_SIGNALS:
   void updateProgressBar(QString, int, int, bool = false);
   void UploadPeakBatch();
   void renderedPdf();
+  void clusteringFinished();
 
 protected Q_SLOTS:
   void keyPressEvent(QKeyEvent *e);
   void contextMenuEvent(QContextMenuEvent *event);
 
+private Q_SLOTS:
+  /**
+   * @brief Assign the cluster IDs computed by the last clustering task to
+   * its groups and refresh the table. Waits for the task, if still running.
+   */
+  void _applyClusters();
+
 private:
   QPalette pal;
-  void addRow(shared_ptr<PeakGroup> group, QTreeWidgetItem *root);
-  void heatmapBackground(QTreeWidgetItem *item);
+
+  /**
+   * @brief Update the maximum peak count of the table and score a group with
+   * the group classifier and SVM predictor, if available.
+   */
+  void _classifyGroup(PeakGroup *group, bool withChildren = true);
+
+  /**
+   * @brief Groups of the rows around the given index, at most `count` on
+   * either side, alternating below and above, nearest first.
+   */
+  QList<shared_ptr<PeakGroup>> _neighbourGroups(QModelIndex index, int count);
 
   // TODO: investigate and remove this dialog if not being used
   void setupFiltersDialog();
 
   ClusterDialog *clusterDialog;
+
+  // clusters are computed in the background, into the members below, and
+  // assigned to the groups on the UI thread once finished
+  QFuture<void> _clusteringFuture;
+  QList<shared_ptr<PeakGroup>> _clusteredGroups;
+  vector<int> _computedClusterIds;
   QDialog *filtersDialog;
   QMap<QString, QHistogramSlider *> sliders;
   peakTableSelectionType peakTableSelection;
@@ -1106,10 +1106,10 @@ ProjectDatabase::loadGroups(const vector<mzSample*>& loaded,
         if (settings.count(databaseId)) {
             auto mp = fromMaptoParameters(settings.at(databaseId),
                                           globalParams);
-            group = new PeakGroup(make_shared<MavenParameters>(mp),
+            group = new PeakGroup(MavenParameters::snapshot(mp),
                                   integrationType);
         } else {
-            group = new PeakGroup(make_shared<MavenParameters>(*globalParams),
+            group = new PeakGroup(MavenParameters::snapshot(*globalParams),
                                   integrationType);
         }
 